@@ -31,6 +31,9 @@
 
 #define DEFAULT_POLICY_KEY "DefaultPolicy"
 #define AUTH_MODE_KEY "AuthMode"
+#define RATE_LIMIT_KEY "RateLimit"
+#define RATE_LIMIT_BURST_KEY "RateLimitBurst"
+#define CHANGES_LATENCY_KEY "ChangesLatency"
 
 const char *
 bolt_get_store_path (void)
@@ -163,3 +166,93 @@ bolt_config_set_auth_mode (GKeyFile   *cfg,
 
   g_key_file_set_string (cfg, DAEMON_GROUP, AUTH_MODE_KEY, authmode);
 }
+
+BoltTri
+bolt_config_load_rate_limit (GKeyFile *cfg,
+                             guint    *rate,
+                             guint    *burst,
+                             GError  **error)
+{
+  g_autoptr(GError) err = NULL;
+  guint64 r, b;
+
+  if (cfg == NULL)
+    return TRI_NO;
+
+  g_return_val_if_fail (error == NULL || *error == NULL, TRI_NO);
+
+  r = g_key_file_get_uint64 (cfg, DAEMON_GROUP, RATE_LIMIT_KEY, &err);
+  if (err != NULL)
+    {
+      int res = bolt_err_notfound (err) ? TRI_NO : TRI_ERROR;
+
+      if (res == TRI_ERROR)
+        bolt_error_propagate (error, &err);
+
+      return res;
+    }
+
+  b = g_key_file_get_uint64 (cfg, DAEMON_GROUP, RATE_LIMIT_BURST_KEY, &err);
+  if (err != NULL && !bolt_err_notfound (err))
+    {
+      bolt_error_propagate (error, &err);
+      return TRI_ERROR;
+    }
+  else if (err != NULL)
+    {
+      b = r;
+    }
+
+  if (r > G_MAXUINT || b > G_MAXUINT)
+    {
+      g_set_error (error, BOLT_ERROR, BOLT_ERROR_CFG,
+                   "invalid rate limit: %" G_GUINT64_FORMAT
+                   " (burst %" G_GUINT64_FORMAT ")", r, b);
+      return TRI_ERROR;
+    }
+
+  if (rate)
+    *rate = (guint) r;
+
+  if (burst)
+    *burst = (guint) b;
+
+  return TRI_YES;
+}
+
+BoltTri
+bolt_config_load_changes_latency (GKeyFile *cfg,
+                                  guint    *msec,
+                                  GError  **error)
+{
+  g_autoptr(GError) err = NULL;
+  guint64 l;
+
+  if (cfg == NULL)
+    return TRI_NO;
+
+  g_return_val_if_fail (error == NULL || *error == NULL, TRI_NO);
+
+  l = g_key_file_get_uint64 (cfg, DAEMON_GROUP, CHANGES_LATENCY_KEY, &err);
+  if (err != NULL)
+    {
+      int res = bolt_err_notfound (err) ? TRI_NO : TRI_ERROR;
+
+      if (res == TRI_ERROR)
+        bolt_error_propagate (error, &err);
+
+      return res;
+    }
+
+  if (l > G_MAXUINT)
+    {
+      g_set_error (error, BOLT_ERROR, BOLT_ERROR_CFG,
+                   "invalid changes latency: %" G_GUINT64_FORMAT, l);
+      return TRI_ERROR;
+    }
+
+  if (msec)
+    *msec = (guint) l;
+
+  return TRI_YES;
+}
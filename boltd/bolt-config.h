@@ -54,4 +54,13 @@ BoltTri   bolt_config_load_auth_mode (GKeyFile     *cfg,
 void      bolt_config_set_auth_mode (GKeyFile   *cfg,
                                      const char *authmode);
 
+BoltTri   bolt_config_load_rate_limit (GKeyFile *cfg,
+                                       guint    *rate,
+                                       guint    *burst,
+                                       GError  **error);
+
+BoltTri   bolt_config_load_changes_latency (GKeyFile *cfg,
+                                            guint    *msec,
+                                            GError  **error);
+
 G_END_DECLS
@@ -0,0 +1,865 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-database.h"
+
+#include "bolt-error.h"
+#include "bolt-fs.h"
+#include "bolt-io.h"
+#include "bolt-log.h"
+#include "bolt-macros.h"
+#include "bolt-str.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* On-disk format
+ *
+ * The database is a single file that consists of a fixed size
+ * header followed by the payload. All integers in the header
+ * are stored in little endian byte order. The payload is a
+ * serialized (little endian) GVariant of type 'a(sa{sv})',
+ * i.e. an array of (uid, record) tuples, sorted by the uid,
+ * which makes it possible to do a binary search directly on
+ * the memory mapped file. The checksum is the SHA-256 digest
+ * of the payload.
+ *
+ * Updates are crash-safe: the new database is written to a
+ * temporary file, which is then synced and atomically renamed
+ * over the old one. Before that, the old one is hard linked
+ * to '<name>.prev', so that the previous generation is kept
+ * around to recover from, should the current one get damaged,
+ * at the cost of one directory entry.
+ */
+
+#define DB_MAGIC "BOLTDB\0\0"
+#define DB_VERSION 1
+#define DB_TYPE G_VARIANT_TYPE ("a(sa{sv})")
+#define DB_DIGEST_LEN 32
+
+typedef struct DbHeader
+{
+  guint8  magic[8];
+  guint32 version;
+  guint32 flags;   /* reserved, 0 */
+  guint64 count;
+  guint64 size;    /* payload size */
+  guint8  checksum[DB_DIGEST_LEN];
+} DbHeader;
+
+G_STATIC_ASSERT (sizeof (DbHeader) == 64);
+
+/* ************************************  */
+/* BoltDatabase */
+
+static void     bolt_database_initable_iface_init (GInitableIface *iface);
+
+static gboolean bolt_database_initialize (GInitable    *initable,
+                                          GCancellable *cancellable,
+                                          GError      **error);
+
+struct _BoltDatabase
+{
+  GObject  object;
+
+  GFile   *root;
+  char    *name;
+  char    *path;
+
+  gboolean fresh;
+
+  /* sorted array of (uid, record); the lock guards
+   * replacing it, for readers of the committed data */
+  GMutex       lock;
+  GMappedFile *map;
+  GVariant    *data;
+
+  /* uncommitted changes: uid -> record or NULL (deleted) */
+  GHashTable *pending;
+  guint       batch;
+};
+
+
+enum {
+  PROP_DATABASE_0,
+
+  PROP_ROOT,
+  PROP_NAME,
+
+  PROP_FRESH,
+
+  PROP_DATABASE_LAST
+};
+
+static GParamSpec *database_props[PROP_DATABASE_LAST] = { NULL, };
+
+G_DEFINE_TYPE_WITH_CODE (BoltDatabase,
+                         bolt_database,
+                         G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE,
+                                                bolt_database_initable_iface_init));
+
+static void
+bolt_database_finalize (GObject *object)
+{
+  BoltDatabase *db = BOLT_DATABASE (object);
+
+  if (db->batch > 0)
+    bolt_warn (LOG_TOPIC ("database"),
+               "discarding uncommitted changes");
+
+  g_clear_object (&db->root);
+  g_clear_pointer (&db->name, g_free);
+  g_clear_pointer (&db->path, g_free);
+
+  g_clear_pointer (&db->data, g_variant_unref);
+  g_clear_pointer (&db->map, g_mapped_file_unref);
+  g_clear_pointer (&db->pending, g_hash_table_unref);
+  g_mutex_clear (&db->lock);
+
+  G_OBJECT_CLASS (bolt_database_parent_class)->finalize (object);
+}
+
+static void
+bolt_database_init (BoltDatabase *db)
+{
+  db->pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                       g_free, (GDestroyNotify) g_variant_unref);
+  g_mutex_init (&db->lock);
+}
+
+static void
+bolt_database_get_property (GObject    *object,
+                            guint       prop_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
+{
+  BoltDatabase *db = BOLT_DATABASE (object);
+
+  switch (prop_id)
+    {
+    case PROP_ROOT:
+      g_value_set_object (value, db->root);
+      break;
+
+    case PROP_NAME:
+      g_value_set_string (value, db->name);
+      break;
+
+    case PROP_FRESH:
+      g_value_set_boolean (value, db->fresh);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bolt_database_set_property (GObject      *object,
+                            guint         prop_id,
+                            const GValue *value,
+                            GParamSpec   *pspec)
+{
+  BoltDatabase *db = BOLT_DATABASE (object);
+
+  switch (prop_id)
+    {
+    case PROP_ROOT:
+      db->root = g_value_dup_object (value);
+      break;
+
+    case PROP_NAME:
+      db->name = g_value_dup_string (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bolt_database_class_init (BoltDatabaseClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = bolt_database_finalize;
+
+  gobject_class->get_property = bolt_database_get_property;
+  gobject_class->set_property = bolt_database_set_property;
+
+  database_props[PROP_ROOT] =
+    g_param_spec_object ("root",
+                         NULL, NULL,
+                         G_TYPE_FILE,
+                         G_PARAM_READWRITE      |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_NAME);
+
+  database_props[PROP_NAME] =
+    g_param_spec_string ("name", NULL, NULL,
+                         NULL,
+                         G_PARAM_READWRITE      |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_NAME);
+
+  database_props[PROP_FRESH] =
+    g_param_spec_boolean ("fresh", NULL, NULL,
+                          FALSE,
+                          G_PARAM_READABLE |
+                          G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (gobject_class,
+                                     PROP_DATABASE_LAST,
+                                     database_props);
+}
+
+static void
+bolt_database_initable_iface_init (GInitableIface *iface)
+{
+  iface->init = bolt_database_initialize;
+}
+
+/* internal methods */
+static void
+database_compute_digest (gconstpointer data,
+                         gsize         size,
+                         guint8       *digest)
+{
+  g_autoptr(GChecksum) cs = NULL;
+  gsize len = DB_DIGEST_LEN;
+
+  cs = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (cs, data, size);
+  g_checksum_get_digest (cs, digest, &len);
+}
+
+static gboolean
+database_load (BoltDatabase *db,
+               GError      **error)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GMappedFile) mf = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GBytes) payload = NULL;
+  g_autofree char *sizestr = NULL;
+  guint8 digest[DB_DIGEST_LEN];
+  const DbHeader *hdr;
+  const char *data;
+  GVariant *var;
+  guint32 version;
+  guint64 psize;
+  gsize size;
+
+  mf = g_mapped_file_new (db->path, FALSE, &err);
+
+  if (mf == NULL && bolt_err_notfound (err))
+    {
+      db->fresh = TRUE;
+      db->data = g_variant_ref_sink (g_variant_new_array (G_VARIANT_TYPE ("(sa{sv})"),
+                                                          NULL, 0));
+      return TRUE;
+    }
+  else if (mf == NULL)
+    {
+      return bolt_error_propagate (error, &err);
+    }
+
+  data = g_mapped_file_get_contents (mf);
+  size = g_mapped_file_get_length (mf);
+
+  if (size < sizeof (DbHeader))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "database too small: %" G_GSIZE_FORMAT " bytes", size);
+      return FALSE;
+    }
+
+  hdr = (const DbHeader *) data;
+
+  if (memcmp (hdr->magic, DB_MAGIC, sizeof (hdr->magic)) != 0)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                           "database header is invalid");
+      return FALSE;
+    }
+
+  version = GUINT32_FROM_LE (hdr->version);
+  if (version != DB_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "unsupported database version: %u", version);
+      return FALSE;
+    }
+
+  psize = GUINT64_FROM_LE (hdr->size);
+  if (psize != size - sizeof (DbHeader))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "database size mismatch: %" G_GUINT64_FORMAT
+                   " vs %" G_GSIZE_FORMAT, psize, size - sizeof (DbHeader));
+      return FALSE;
+    }
+
+  database_compute_digest (data + sizeof (DbHeader), psize, digest);
+
+  if (memcmp (digest, hdr->checksum, DB_DIGEST_LEN) != 0)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                           "database checksum mismatch");
+      return FALSE;
+    }
+
+  /* the payload starts at an offset of 64 bytes into the
+   * mapping, which satisfies GVariant's alignment needs */
+  bytes = g_mapped_file_get_bytes (mf);
+  payload = g_bytes_new_from_bytes (bytes, sizeof (DbHeader), psize);
+  var = g_variant_new_from_bytes (DB_TYPE, payload, FALSE);
+
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+  {
+    g_autoptr(GVariant) le = g_variant_ref_sink (var);
+    var = g_variant_byteswap (le);
+  }
+#endif
+
+  db->data = g_variant_ref_sink (var);
+  db->map = g_steal_pointer (&mf);
+
+  sizestr = g_format_size (size);
+  bolt_info (LOG_TOPIC ("database"), "loaded '%s': %" G_GSIZE_FORMAT
+             " records, %s", db->name, g_variant_n_children (db->data),
+             sizestr);
+
+  return TRUE;
+}
+
+static gboolean
+bolt_database_initialize (GInitable    *initable,
+                          GCancellable *cancellable,
+                          GError      **error)
+{
+  g_autoptr(GFile) file = NULL;
+  BoltDatabase *db;
+
+  db = BOLT_DATABASE (initable);
+
+  if (bolt_strzero (db->name) || db->root == NULL)
+    {
+      bolt_bug ("invalid arguments");
+      g_set_error (error, BOLT_ERROR, BOLT_ERROR_FAILED,
+                   "root and/or name NULL for database");
+      return FALSE;
+    }
+
+  file = g_file_get_child (db->root, db->name);
+  db->path = g_file_get_path (file);
+
+  return database_load (db, error);
+}
+
+static gboolean
+database_find (GVariant   *data,
+               const char *uid,
+               gsize      *pos)
+{
+  gsize lo = 0;
+  gsize hi;
+
+  hi = g_variant_n_children (data);
+
+  while (lo < hi)
+    {
+      g_autoptr(GVariant) entry = NULL;
+      gsize mid = lo + (hi - lo) / 2;
+      const char *key;
+      int r;
+
+      entry = g_variant_get_child_value (data, mid);
+      g_variant_get_child (entry, 0, "&s", &key);
+
+      r = strcmp (uid, key);
+
+      if (r == 0)
+        {
+          *pos = mid;
+          return TRUE;
+        }
+      else if (r < 0)
+        {
+          hi = mid;
+        }
+      else
+        {
+          lo = mid + 1;
+        }
+    }
+
+  *pos = lo;
+  return FALSE;
+}
+
+static int
+database_strcmp (gconstpointer a,
+                 gconstpointer b)
+{
+  const char * const *sa = a;
+  const char * const *sb = b;
+
+  return strcmp (*sa, *sb);
+}
+
+/* merge the existing (sorted) data with the pending changes */
+static GVariant *
+database_merge (GVariant   *data,
+                GHashTable *pending)
+{
+  g_autofree gpointer *keys = NULL;
+  GVariantBuilder b;
+  guint len;
+  gsize n;
+  gsize i = 0;
+  guint k = 0;
+
+  keys = g_hash_table_get_keys_as_array (pending, &len);
+  qsort (keys, len, sizeof (gpointer), database_strcmp);
+
+  g_variant_builder_init (&b, DB_TYPE);
+
+  n = g_variant_n_children (data);
+
+  while (i < n || k < len)
+    {
+      g_autoptr(GVariant) entry = NULL;
+      const char *have = NULL;
+      const char *uid = NULL;
+      GVariant *record;
+      int r;
+
+      if (i < n)
+        {
+          entry = g_variant_get_child_value (data, i);
+          g_variant_get_child (entry, 0, "&s", &have);
+        }
+
+      if (k < len)
+        uid = keys[k];
+
+      if (have == NULL)
+        r = 1;
+      else if (uid == NULL)
+        r = -1;
+      else
+        r = strcmp (have, uid);
+
+      if (r < 0)
+        {
+          g_variant_builder_add_value (&b, entry);
+          i++;
+          continue;
+        }
+
+      /* uid has pending changes: insert, replace or delete */
+      record = g_hash_table_lookup (pending, uid);
+
+      if (record != NULL)
+        g_variant_builder_add (&b, "(s@a{sv})", uid, record);
+
+      if (r == 0)
+        i++;
+
+      k++;
+    }
+
+  return g_variant_ref_sink (g_variant_builder_end (&b));
+}
+
+static gboolean
+database_keep_previous (BoltDatabase *db,
+                        GError      **error)
+{
+  g_autoptr(GError) err = NULL;
+  g_autofree char *prev = NULL;
+
+  prev = g_strconcat (db->path, BOLT_DATABASE_PREVIOUS, NULL);
+
+  if (!bolt_unlink (prev, &err) && !bolt_err_notfound (err))
+    return bolt_error_propagate (error, &err);
+
+  g_clear_error (&err);
+
+  /* nothing to keep for a fresh database */
+  if (!bolt_link (db->path, prev, &err) && !bolt_err_notfound (err))
+    return bolt_error_propagate (error, &err);
+
+  return TRUE;
+}
+
+static gboolean
+database_write (BoltDatabase *db,
+                GVariant     *data,
+                GError      **error)
+{
+  g_autoptr(GVariant) le = NULL;
+  g_autofree char *tmp = NULL;
+  bolt_autoclose int fd = -1;
+  DbHeader hdr;
+  gconstpointer payload;
+  gboolean ok;
+  gsize size;
+
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+  le = g_variant_byteswap (data);
+#else
+  le = g_variant_ref (data);
+#endif
+
+  size = g_variant_get_size (le);
+  payload = g_variant_get_data (le);
+
+  memset (&hdr, 0, sizeof (hdr));
+  memcpy (hdr.magic, DB_MAGIC, sizeof (hdr.magic));
+  hdr.version = GUINT32_TO_LE (DB_VERSION);
+  hdr.count = GUINT64_TO_LE ((guint64) g_variant_n_children (le));
+  hdr.size = GUINT64_TO_LE ((guint64) size);
+  database_compute_digest (payload, size, hdr.checksum);
+
+  tmp = g_strdup_printf ("%s.tmp", db->path);
+
+  fd = bolt_open (tmp,
+                  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0600,
+                  error);
+
+  if (fd < 0)
+    return FALSE;
+
+  ok = bolt_write_all (fd, &hdr, sizeof (hdr), error);
+
+  if (ok)
+    ok = bolt_write_all (fd, payload, size, error);
+
+  if (ok)
+    ok = bolt_fdatasync (fd, error);
+
+  if (ok)
+    ok = database_keep_previous (db, error);
+
+  if (ok)
+    ok = bolt_rename (tmp, db->path, error);
+
+  if (!ok)
+    {
+      (void) unlink (tmp);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+database_flush (BoltDatabase *db,
+                GError      **error)
+{
+  g_autoptr(GVariant) data = NULL;
+  gboolean ok;
+
+  /* a fresh database is always written, so it exists on disk */
+  if (g_hash_table_size (db->pending) == 0 && !db->fresh)
+    return TRUE;
+
+  data = database_merge (db->data, db->pending);
+
+  /* pending changes are kept, and retried with the
+   * next flush, if they could not be written */
+  ok = database_write (db, data, error);
+
+  if (!ok)
+    return FALSE;
+
+  g_hash_table_remove_all (db->pending);
+
+  g_mutex_lock (&db->lock);
+  g_clear_pointer (&db->data, g_variant_unref);
+  g_clear_pointer (&db->map, g_mapped_file_unref);
+
+  db->data = g_steal_pointer (&data);
+  g_mutex_unlock (&db->lock);
+
+  db->fresh = FALSE;
+
+  bolt_debug (LOG_TOPIC ("database"), "wrote %" G_GSIZE_FORMAT " records",
+              g_variant_n_children (db->data));
+
+  return TRUE;
+}
+
+/* the data is immutable, a reference to it can be
+ * used without the lock, even if it is replaced */
+static GVariant *
+database_get_committed (BoltDatabase *db)
+{
+  GVariant *data;
+
+  g_mutex_lock (&db->lock);
+  data = g_variant_ref (db->data);
+  g_mutex_unlock (&db->lock);
+
+  return data;
+}
+
+/* 'pending' may be NULL, for the committed data only */
+static GStrv
+database_list (GVariant   *data,
+               GHashTable *pending)
+{
+  GHashTableIter iter;
+  GPtrArray *ids;
+  gpointer key, val;
+  gsize n;
+
+  n = g_variant_n_children (data);
+  ids = g_ptr_array_new_full (n + 1, g_free);
+
+  for (gsize i = 0; i < n; i++)
+    {
+      g_autoptr(GVariant) entry = NULL;
+      const char *uid;
+
+      entry = g_variant_get_child_value (data, i);
+      g_variant_get_child (entry, 0, "&s", &uid);
+
+      /* deleted, or re-added below */
+      if (pending != NULL && g_hash_table_contains (pending, uid))
+        continue;
+
+      g_ptr_array_add (ids, g_strdup (uid));
+    }
+
+  if (pending == NULL)
+    return bolt_strv_from_ptr_array (&ids);
+
+  g_hash_table_iter_init (&iter, pending);
+  while (g_hash_table_iter_next (&iter, &key, &val))
+    if (val != NULL)
+      g_ptr_array_add (ids, g_strdup (key));
+
+  return bolt_strv_from_ptr_array (&ids);
+}
+
+static GVariant *
+database_lookup (GVariant   *data,
+                 GHashTable *pending,
+                 const char *uid)
+{
+  g_autoptr(GVariant) entry = NULL;
+  GVariant *record;
+  gboolean found;
+  gsize pos;
+
+  found = pending != NULL &&
+          g_hash_table_lookup_extended (pending, uid,
+                                        NULL, (gpointer *) &record);
+  if (found)
+    return record ? g_variant_ref (record) : NULL;
+
+  found = database_find (data, uid, &pos);
+  if (!found)
+    return NULL;
+
+  entry = g_variant_get_child_value (data, pos);
+
+  return g_variant_get_child_value (entry, 1);
+}
+
+/* public methods */
+
+BoltDatabase *
+bolt_database_new (GFile      *root,
+                   const char *name,
+                   GError    **error)
+{
+  return g_initable_new (BOLT_TYPE_DATABASE,
+                         NULL, error,
+                         "root", root,
+                         "name", name,
+                         NULL);
+}
+
+gboolean
+bolt_database_is_fresh (BoltDatabase *db)
+{
+  g_return_val_if_fail (BOLT_IS_DATABASE (db), FALSE);
+
+  return db->fresh;
+}
+
+guint
+bolt_database_count (BoltDatabase *db)
+{
+  g_auto(GStrv) uids = NULL;
+
+  g_return_val_if_fail (BOLT_IS_DATABASE (db), 0);
+
+  if (g_hash_table_size (db->pending) == 0)
+    return g_variant_n_children (db->data);
+
+  uids = bolt_database_list_uids (db);
+
+  return g_strv_length (uids);
+}
+
+GStrv
+bolt_database_list_uids (BoltDatabase *db)
+{
+  g_return_val_if_fail (BOLT_IS_DATABASE (db), NULL);
+
+  return database_list (db->data, db->pending);
+}
+
+GVariant *
+bolt_database_lookup (BoltDatabase *db,
+                      const char   *uid)
+{
+  g_return_val_if_fail (BOLT_IS_DATABASE (db), NULL);
+  g_return_val_if_fail (uid != NULL, NULL);
+
+  return database_lookup (db->data, db->pending, uid);
+}
+
+GStrv
+bolt_database_list_committed (BoltDatabase *db)
+{
+  g_autoptr(GVariant) data = NULL;
+
+  g_return_val_if_fail (BOLT_IS_DATABASE (db), NULL);
+
+  data = database_get_committed (db);
+
+  return database_list (data, NULL);
+}
+
+GVariant *
+bolt_database_lookup_committed (BoltDatabase *db,
+                                const char   *uid)
+{
+  g_autoptr(GVariant) data = NULL;
+
+  g_return_val_if_fail (BOLT_IS_DATABASE (db), NULL);
+  g_return_val_if_fail (uid != NULL, NULL);
+
+  data = database_get_committed (db);
+
+  return database_lookup (data, NULL, uid);
+}
+
+gboolean
+bolt_database_put (BoltDatabase *db,
+                   const char   *uid,
+                   GVariant     *record,
+                   GError      **error)
+{
+  g_return_val_if_fail (BOLT_IS_DATABASE (db), FALSE);
+  g_return_val_if_fail (uid != NULL, FALSE);
+  g_return_val_if_fail (record != NULL, FALSE);
+  g_return_val_if_fail (g_variant_is_of_type (record, G_VARIANT_TYPE_VARDICT), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  g_hash_table_insert (db->pending,
+                       g_strdup (uid),
+                       g_variant_ref_sink (record));
+
+  if (db->batch > 0)
+    return TRUE;
+
+  return database_flush (db, error);
+}
+
+gboolean
+bolt_database_del (BoltDatabase *db,
+                   const char   *uid,
+                   GError      **error)
+{
+  g_autoptr(GVariant) record = NULL;
+
+  g_return_val_if_fail (BOLT_IS_DATABASE (db), FALSE);
+  g_return_val_if_fail (uid != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  record = bolt_database_lookup (db, uid);
+
+  if (record == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                   "no entry for '%s' in database", uid);
+      return FALSE;
+    }
+
+  g_hash_table_insert (db->pending, g_strdup (uid), NULL);
+
+  if (db->batch > 0)
+    return TRUE;
+
+  return database_flush (db, error);
+}
+
+void
+bolt_database_begin (BoltDatabase *db)
+{
+  g_return_if_fail (BOLT_IS_DATABASE (db));
+
+  db->batch++;
+}
+
+gboolean
+bolt_database_commit (BoltDatabase *db,
+                      GError      **error)
+{
+  g_return_val_if_fail (BOLT_IS_DATABASE (db), FALSE);
+  g_return_val_if_fail (db->batch > 0, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  db->batch--;
+
+  /* nested transaction, the outer one will commit */
+  if (db->batch > 0)
+    return TRUE;
+
+  return database_flush (db, error);
+}
+
+void
+bolt_database_rollback (BoltDatabase *db)
+{
+  g_return_if_fail (BOLT_IS_DATABASE (db));
+  g_return_if_fail (db->batch > 0);
+
+  db->batch--;
+
+  /* nested transaction, only the outer one
+   * can discard the changes */
+  if (db->batch > 0)
+    return;
+
+  g_hash_table_remove_all (db->pending);
+}
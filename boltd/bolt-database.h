@@ -0,0 +1,71 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* BoltDatabase - single file, memory mapped record database */
+#define BOLT_TYPE_DATABASE bolt_database_get_type ()
+
+/* suffix of the previous generation of the database file */
+#define BOLT_DATABASE_PREVIOUS ".prev"
+
+G_DECLARE_FINAL_TYPE (BoltDatabase, bolt_database, BOLT, DATABASE, GObject);
+
+BoltDatabase *    bolt_database_new (GFile      *root,
+                                     const char *name,
+                                     GError    **error);
+
+gboolean          bolt_database_is_fresh (BoltDatabase *db);
+
+guint             bolt_database_count (BoltDatabase *db);
+
+GStrv             bolt_database_list_uids (BoltDatabase *db);
+
+GVariant *        bolt_database_lookup (BoltDatabase *db,
+                                        const char   *uid);
+
+/* only the committed records, safe to call from any
+ * thread, while another one is writing */
+GStrv             bolt_database_list_committed (BoltDatabase *db);
+
+GVariant *        bolt_database_lookup_committed (BoltDatabase *db,
+                                                  const char   *uid);
+
+gboolean          bolt_database_put (BoltDatabase *db,
+                                     const char   *uid,
+                                     GVariant     *record,
+                                     GError      **error);
+
+gboolean          bolt_database_del (BoltDatabase *db,
+                                     const char   *uid,
+                                     GError      **error);
+
+void              bolt_database_begin (BoltDatabase *db);
+
+gboolean          bolt_database_commit (BoltDatabase *db,
+                                        GError      **error);
+
+void              bolt_database_rollback (BoltDatabase *db);
+
+G_END_DECLS
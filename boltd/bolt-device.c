@@ -50,10 +50,10 @@ static gboolean handle_set_label (BoltExported *obj,
                                   GError      **error);
 
 /* dbus method calls */
-static GVariant *  handle_authorize (BoltExported          *object,
+static void        handle_authorize (BoltExported          *object,
                                      GVariant              *params,
                                      GDBusMethodInvocation *invocation,
-                                     GError               **error);
+                                     GTask                 *task);
 
 
 struct _BoltDevice
@@ -524,9 +524,9 @@ bolt_device_class_init (BoltDeviceClass *klass)
                                        props[PROP_LABEL],
                                        handle_set_label);
 
-  bolt_exported_class_export_method (exported_class,
-                                     "Authorize",
-                                     handle_authorize);
+  bolt_exported_class_export_async_method (exported_class,
+                                           "Authorize",
+                                           handle_authorize);
 
 }
 
@@ -716,6 +716,8 @@ authorize_adjust_error (BoltDevice *dev,
     g_prefix_error (error, "%s", "kernel error: ");
 }
 
+typedef struct _AuthLane AuthLane;
+
 typedef struct
 {
   BoltAuth *auth;
@@ -724,6 +726,10 @@ typedef struct
   GAsyncReadyCallback callback;
   gpointer            user_data;
 
+  /* executor bookkeeping */
+  AuthLane *lane;
+  guint     depth;
+
 } AuthData;
 
 static void
@@ -810,6 +816,125 @@ authorize_in_thread (GTask        *task,
     g_task_return_boolean (task, TRUE);
 }
 
+/* authorization executor: writes to the sysfs of one domain are
+ * serialized, parents before children (shallowest syspath first),
+ * while different domains are authorized in parallel */
+#define AUTH_MAX_THREADS 4
+
+struct _AuthLane
+{
+  gpointer domain;   /* key only, never dereferenced */
+  GQueue   waiting;  /* GTask, sorted by depth */
+  gboolean busy;
+};
+
+static struct
+{
+  GThreadPool *pool;
+  GHashTable  *lanes;    /* domain -> AuthLane */
+  guint        queued;
+  guint        inflight;
+} authq = {NULL, NULL, 0, 0};
+
+static void
+authq_run (gpointer data,
+           gpointer user_data)
+{
+  g_autoptr(GTask) task = data;
+
+  authorize_in_thread (task,
+                       g_task_get_source_object (task),
+                       g_task_get_task_data (task),
+                       g_task_get_cancellable (task));
+}
+
+static gint
+auth_task_cmp (gconstpointer a,
+               gconstpointer b,
+               gpointer      user_data)
+{
+  AuthData *x = g_task_get_task_data ((GTask *) a);
+  AuthData *y = g_task_get_task_data ((GTask *) b);
+
+  /* ties keep their order: g_queue_insert_sorted inserts
+   * after all elements that compare equal */
+  return (x->depth > y->depth) - (x->depth < y->depth);
+}
+
+static void
+authq_kick (AuthLane *lane)
+{
+  GError *error = NULL;
+  GTask *task;
+
+  if (lane->busy || g_queue_is_empty (&lane->waiting))
+    return;
+
+  if (authq.pool == NULL)
+    {
+      authq.pool = g_thread_pool_new (authq_run, NULL,
+                                      AUTH_MAX_THREADS,
+                                      FALSE,
+                                      &error);
+      /* can only fail for exclusive pools */
+      g_assert_no_error (error);
+    }
+
+  task = g_queue_pop_head (&lane->waiting);
+
+  lane->busy = TRUE;
+  authq.queued--;
+  authq.inflight++;
+
+  bolt_debug (LOG_TOPIC ("authorize"), "dispatching: %u queued, %u in flight",
+              authq.queued, authq.inflight);
+
+  /* reference is transferred to authq_run */
+  g_thread_pool_push (authq.pool, task, NULL);
+}
+
+static void
+authq_push (BoltDevice *dev,
+            GTask      *task)
+{
+  AuthData *auth_data = g_task_get_task_data (task);
+  AuthLane *lane;
+
+  if (authq.lanes == NULL)
+    authq.lanes = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
+  lane = g_hash_table_lookup (authq.lanes, dev->domain);
+
+  if (lane == NULL)
+    {
+      lane = g_new0 (AuthLane, 1);
+      lane->domain = dev->domain;
+      g_queue_init (&lane->waiting);
+      g_hash_table_insert (authq.lanes, lane->domain, lane);
+    }
+
+  auth_data->lane = lane;
+  auth_data->depth = bolt_str_count_char (dev->syspath, '/');
+
+  g_queue_insert_sorted (&lane->waiting, g_object_ref (task),
+                         auth_task_cmp, NULL);
+  authq.queued++;
+
+  authq_kick (lane);
+}
+
+static void
+authq_done (AuthLane *lane)
+{
+  lane->busy = FALSE;
+  authq.inflight--;
+
+  authq_kick (lane);
+
+  if (!lane->busy)
+    g_hash_table_remove (authq.lanes, lane->domain);
+}
+
 static void
 authorize_thread_done (GObject      *object,
                        GAsyncResult *res,
@@ -830,6 +955,9 @@ authorize_thread_done (GObject      *object,
   auth_data = g_task_get_task_data (task);
   auth = auth_data->auth;
 
+  /* the next device of the domain can go ahead */
+  authq_done (auth_data->lane);
+
   ok = g_task_propagate_boolean (task, &error);
 
   if (!ok)
@@ -894,7 +1022,7 @@ authorize_prepare (BoltDevice         *dev,
     }
 
   task = g_task_new (dev, NULL, authorize_thread_done, NULL);
-  auth_data = g_slice_new (AuthData);
+  auth_data = g_slice_new0 (AuthData);
   auth_data->callback = callback;
   auth_data->user_data = user_data;
   auth_data->auth = g_object_ref (auth);
@@ -918,13 +1046,54 @@ authorize_device_idle (gpointer user_data)
   g_return_val_if_fail (G_IS_TASK (user_data), G_SOURCE_REMOVE);
   task = (GTask *) user_data;
 
-  g_task_run_in_thread (task, authorize_in_thread);
+  authq_push (g_task_get_source_object (task), task);
 
   return G_SOURCE_REMOVE;
 }
 
 /* dbus property setter */
 
+typedef struct
+{
+  BoltDevice *dev;
+  char       *label; /* the one that was set */
+  char       *old;   /* to revert to, on error */
+} LabelData;
+
+static void
+label_data_free (LabelData *data)
+{
+  g_clear_object (&data->dev);
+  g_free (data->label);
+  g_free (data->old);
+  g_slice_free (LabelData, data);
+}
+
+static void
+handle_set_label_done (GObject      *store,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  LabelData *data = user_data;
+  BoltDevice *dev = data->dev;
+  gboolean ok;
+
+  ok = bolt_store_put_device_finish (BOLT_STORE (store), res, &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_DEV (dev), "failed to store device");
+
+  /* only revert if the label was not changed again meanwhile */
+  if (!ok && bolt_streq (dev->label, data->label))
+    {
+      bolt_swap (dev->label, data->old);
+      g_object_notify_by_pspec (G_OBJECT (dev), props[PROP_LABEL]);
+    }
+
+  label_data_free (data);
+}
+
 static gboolean
 handle_set_label (BoltExported *obj,
                   const char   *name,
@@ -932,10 +1101,9 @@ handle_set_label (BoltExported *obj,
                   GError      **error)
 {
   g_autofree char *nick = NULL;
-  g_autofree char *old = NULL;
   BoltDevice *dev = BOLT_DEVICE (obj);
   const char *str = g_value_get_string (value);
-  gboolean ok;
+  LabelData *data;
 
   nick = bolt_strdup_validate (str);
 
@@ -959,61 +1127,78 @@ handle_set_label (BoltExported *obj,
       return FALSE;
     }
 
-  old = dev->label;
-  dev->label = g_steal_pointer (&nick);
-
-  ok = bolt_store_put_device (dev->store, dev, dev->policy, NULL, error);
+  data = g_slice_new0 (LabelData);
+  data->dev = g_object_ref (dev);
+  data->label = g_strdup (nick);
+  data->old = g_steal_pointer (&dev->label);
 
-  if (!ok)
-    {
-      bolt_warn_err (*error, LOG_DEV (dev), "failed to store device");
+  dev->label = g_steal_pointer (&nick);
 
-      nick = dev->label;
-      dev->label = g_steal_pointer (&old);
-    }
+  /* written on the I/O thread, so the bus is not blocked by
+   * other writes; if that fails, the label is reverted */
+  bolt_store_put_device_async (dev->store, dev, dev->policy, NULL, NULL,
+                               handle_set_label_done, data);
 
-  return ok;
+  return TRUE;
 }
 
 /* dbus methods */
 
+static void
+handle_authorize_key_stored (GObject      *store,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  g_autoptr(GError) err = NULL;
+  BoltDevice *dev;
+  gboolean ok;
+
+  dev = g_task_get_source_object (task);
+  ok = bolt_store_put_key_finish (BOLT_STORE (store), res, &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_DEV (dev), "failed to store key");
+  else
+    g_object_set (dev, "key", BOLT_KEY_NEW, NULL);
+
+  g_task_return_pointer (task, NULL, NULL);
+}
+
 static void
 handle_authorize_done (GObject      *device,
                        GAsyncResult *res,
                        gpointer      user_data)
 {
+  g_autoptr(GTask) task = user_data;
   BoltDevice *dev = BOLT_DEVICE (device);
-  GDBusMethodInvocation *inv;
   BoltKeyState ks;
   GError *error = NULL;
   BoltAuth *auth;
   gboolean ok;
 
-  inv  = user_data;
   auth = BOLT_AUTH (res);
 
   ok = bolt_auth_check (auth, &error);
   if (!ok)
     {
-      g_dbus_method_invocation_take_error (inv, error);
+      g_task_return_error (task, error);
       return;
     }
 
   ks = bolt_auth_get_keystate (auth);
-  if (ks == BOLT_KEY_NEW)
+  if (ks == BOLT_KEY_NEW && dev->store != NULL)
     {
-      g_autoptr(GError) err  = NULL;
       BoltKey *key = bolt_auth_get_key (auth);
 
-      ok = bolt_store_put_key (dev->store, dev->uid, key, &err);
-
-      if (!ok)
-        bolt_warn_err (err, "failed to store key");
-      else
-        g_object_set (dev, "key", ks, NULL);
+      /* task is completed from handle_authorize_key_stored */
+      bolt_store_put_key_async (dev->store, dev->uid, key, NULL,
+                                handle_authorize_key_stored,
+                                g_steal_pointer (&task));
+      return;
     }
 
-  g_dbus_method_invocation_return_value (inv, g_variant_new ("()"));
+  g_task_return_pointer (task, NULL, NULL);
 }
 
 static gboolean
@@ -1035,14 +1220,15 @@ device_should_upgrade_key (BoltDevice *dev)
   return upgrade;
 }
 
-static GVariant *
+static void
 handle_authorize (BoltExported          *object,
                   GVariant              *params,
                   GDBusMethodInvocation *inv,
-                  GError               **error)
+                  GTask                 *task)
 {
   g_autoptr(BoltAuth) auth = NULL;
   g_autoptr(BoltKey) key = NULL;
+  GError *error = NULL;
   BoltDevice *dev = BOLT_DEVICE (object);
   BoltSecurity level;
 
@@ -1052,17 +1238,17 @@ handle_authorize (BoltExported          *object,
    */
   if (!bolt_status_is_pending (dev->status))
     {
-      g_set_error (error, BOLT_ERROR, BOLT_ERROR_BADSTATE,
-                   "wrong device state: %s",
-                   bolt_status_to_string (dev->status));
-      return NULL;
+      g_task_return_new_error (task, BOLT_ERROR, BOLT_ERROR_BADSTATE,
+                               "wrong device state: %s",
+                               bolt_status_to_string (dev->status));
+      return;
     }
   else if (dev->domain == NULL)
     {
       bolt_bug (LOG_DEV (dev), "device connected but no domain");
-      g_set_error_literal (error, BOLT_ERROR, BOLT_ERROR_BADSTATE,
-                           "device has no domain associated");
-      return NULL;
+      g_task_return_new_error (task, BOLT_ERROR, BOLT_ERROR_BADSTATE,
+                               "%s", "device has no domain associated");
+      return;
     }
 
   level = bolt_domain_get_security (dev->domain);
@@ -1070,9 +1256,9 @@ handle_authorize (BoltExported          *object,
   if (level == BOLT_SECURITY_SECURE)
     {
       if (dev->key)
-        key = bolt_store_get_key (dev->store, dev->uid, error);
+        key = bolt_store_get_key (dev->store, dev->uid, &error);
       else if (device_should_upgrade_key (dev))
-        key = bolt_key_new (error);
+        key = bolt_key_new (&error);
       else
         level = BOLT_SECURITY_USER;
     }
@@ -1081,12 +1267,13 @@ handle_authorize (BoltExported          *object,
    * key could not be generated (should practically never happen).
    * In both cases 'error' will be set. */
   if (level == BOLT_SECURITY_SECURE && key == NULL)
-    return NULL;
+    {
+      g_task_return_error (task, error);
+      return;
+    }
 
   auth = bolt_auth_new (dev, level, key);
-  bolt_device_authorize (dev, auth, handle_authorize_done, inv);
-
-  return NULL;
+  bolt_device_authorize (dev, auth, handle_authorize_done, g_object_ref (task));
 }
 
 /* public methods */
@@ -1200,7 +1387,7 @@ bolt_device_authorize (BoltDevice         *dev,
   if (task == NULL)
     return;
 
-  g_task_run_in_thread (task, authorize_in_thread);
+  authq_push (dev, task);
 }
 
 void
@@ -1222,6 +1409,17 @@ bolt_device_authorize_idle (BoltDevice         *dev,
   g_idle_add (authorize_device_idle, task);
 }
 
+void
+bolt_device_get_auth_queue (guint *queued,
+                            guint *inflight)
+{
+  if (queued)
+    *queued = authq.queued;
+
+  if (inflight)
+    *inflight = authq.inflight;
+}
+
 BoltStatus
 bolt_device_connected (BoltDevice         *dev,
                        BoltDomain         *domain,
@@ -1381,6 +1579,22 @@ bolt_device_get_name (BoltDevice *dev)
   return dev->name;
 }
 
+const char *
+bolt_device_get_parent (BoltDevice *dev)
+{
+  g_return_val_if_fail (BOLT_IS_DEVICE (dev), NULL);
+
+  return dev->parent;
+}
+
+BoltDomain *
+bolt_device_get_domain (BoltDevice *dev)
+{
+  g_return_val_if_fail (BOLT_IS_DEVICE (dev), NULL);
+
+  return dev->domain;
+}
+
 const char *
 bolt_device_get_object_path (BoltDevice *device)
 {
@@ -66,10 +66,18 @@ void              bolt_device_authorize_idle (BoltDevice         *dev,
                                               GAsyncReadyCallback callback,
                                               gpointer            user_data);
 
+/* authorizations waiting for their domain, and currently running */
+void              bolt_device_get_auth_queue (guint *queued,
+                                              guint *inflight);
+
 BoltKeyState      bolt_device_get_keystate (BoltDevice *dev);
 
 const char *      bolt_device_get_name (BoltDevice *dev);
 
+const char *      bolt_device_get_parent (BoltDevice *dev);
+
+BoltDomain *      bolt_device_get_domain (BoltDevice *dev);
+
 const char *      bolt_device_get_object_path (BoltDevice *device);
 
 BoltPolicy        bolt_device_get_policy (BoltDevice *dev);
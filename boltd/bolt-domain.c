@@ -367,6 +367,22 @@ bolt_domain_bootacl_can_update (BoltDomain *domain,
   return TRUE;
 }
 
+static void
+bootacl_stored (GObject      *store,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr(BoltDomain) domain = user_data;
+  g_autoptr(GError) err = NULL;
+  gboolean ok;
+
+  ok = bolt_store_put_domain_finish (BOLT_STORE (store), res, &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_TOPIC ("bootacl"), LOG_DOM (domain),
+                   "could not update domain");
+}
+
 static void
 bolt_domain_bootacl_update (BoltDomain *domain,
                             GStrv      *acl,
@@ -394,16 +410,9 @@ bolt_domain_bootacl_update (BoltDomain *domain,
   g_object_notify_by_pspec (G_OBJECT (domain), props[PROP_BOOTACL]);
 
   if (domain->store)
-    {
-      g_autoptr(GError) err = NULL;
-      gboolean ok;
-
-      ok = bolt_store_put_domain (domain->store, domain, &err);
-
-      if (!ok)
-        bolt_warn_err (err, LOG_TOPIC ("bootacl"), LOG_DOM (domain),
-                       "could not update domain");
-    }
+    bolt_store_put_domain_async (domain->store, domain, NULL,
+                                 bootacl_stored,
+                                 g_object_ref (domain));
 
   signal = signals[SIGNAL_BOOTACL_CHANGED];
   pending = g_signal_has_handler_pending (domain, signal, 0, FALSE);
@@ -464,17 +473,13 @@ bolt_domain_bootacl_sync (BoltDomain *domain,
   bolt_info (LOG_TOPIC ("bootacl"), LOG_DOM (domain), "synchronizing journal");
 
   acl = g_strdupv (*sysacl);
-  diff = bolt_journal_list (log, &err);
 
-  if (diff == NULL)
-    {
-      bolt_warn_err (err, LOG_TOPIC ("bootacl"), LOG_DOM (domain),
-                     "could not list bootacl changes");
-      return;
-    }
+  /* only the last op for every uuid, in the order
+   * they were written, so no need to replay it all */
+  diff = bolt_journal_list_latest (log);
 
   bolt_debug (LOG_TOPIC ("bootacl"), LOG_DOM (domain),
-              "journal contains %u entries", diff->len);
+              "journal contains %u uuids", diff->len);
 
   for (guint i = 0; i < diff->len; i++)
     {
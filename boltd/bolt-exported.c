@@ -30,6 +30,8 @@
 
 #include "bolt-exported.h"
 
+#define OBJECT_MANAGER_INTERFACE "org.freedesktop.DBus.ObjectManager"
+
 typedef struct _BoltExportedMethod BoltExportedMethod;
 typedef struct _BoltExportedProp   BoltExportedProp;
 
@@ -54,6 +56,15 @@ static gboolean   handle_authorize_property_default (BoltExported          *expo
 
 static void       bolt_exported_method_free (gpointer data);
 
+static void       object_manager_add (BoltExported *exported);
+
+static void       object_manager_remove (BoltExported *exported);
+
+static void       object_manager_get_managed_objects (BoltExported          *root,
+                                                      GDBusMethodInvocation *invocation);
+
+static void       changes_queue_flush_now (void);
+
 static void       bolt_exported_prop_free (gpointer data);
 
 
@@ -61,6 +72,9 @@ struct _BoltExportedMethod
 {
   char                     *name;
   BoltExportedMethodHandler handler;
+
+  /* if set, 'handler' is unused */
+  BoltExportedAsyncMethodHandler async_handler;
 };
 
 struct _BoltExportedProp
@@ -97,12 +111,60 @@ typedef struct _BoltExportedPrivate
   /* if exported */
   guint registration;
 
+  /* serialized property values, invalidated via notify */
+  GHashTable *props_cache;    /* BoltExportedProp -> GVariant */
+  GVariant   *props_all;      /* a{sv}, for GetAll */
+
   /* property changes */
-  GPtrArray *props_changed;
-  guint      props_changed_id;
+  GPtrArray *props_changed;   /* BoltExportedProp, dirty set */
+  guint      props_changed_id; /* position in the dirty queue, 0 if not */
 
 } BoltExportedPrivate;
 
+/* all objects with pending property changes, see
+ * bolt_exported_dispatch_properties_changed */
+static struct
+{
+  GPtrArray        *dirty;    /* BoltExported (strong refs) */
+  guint             flush_id;
+  guint             latency;  /* msec, 0: flush when idle */
+  BoltExportedStats stats;
+} changes_queue = {NULL, 0, 0, {0, }};
+
+/* per-client rate limiting of incoming calls, see limiter_admit */
+#define LIMITER_BACKLOG 32                     /* waiting calls per client */
+#define LIMITER_PRUNE_USEC (60 * G_USEC_PER_SEC)
+
+typedef struct _Client
+{
+  char  *name;
+  double tokens;
+  gint64 tlast;    /* last refill, monotonic usec */
+  GQueue waiting;  /* QueuedCall, in arrival order */
+} Client;
+
+typedef struct _QueuedCall
+{
+  BoltExported          *exported;
+  GDBusMethodInvocation *inv;
+} QueuedCall;
+
+static struct
+{
+  GHashTable *clients;    /* unique name -> Client */
+  GQueue      ready;      /* Clients with waiting calls, round robin */
+  guint       rate;       /* calls per second, 0: unlimited */
+  guint       burst;
+  guint       tick_id;
+  gint64      tprune;
+  guint64     throttled;
+  guint64     rejected;
+} limiter = {NULL, G_QUEUE_INIT, 0, 0, 0, 0, 0, 0};
+
+/* all currently exported objects (weak), so that an object
+ * manager can pick up the ones exported before it */
+static GHashTable *exported_objects = NULL;
+
 static gpointer bolt_exported_parent_class = NULL;
 static gint BoltExported_private_offset = 0;
 
@@ -181,9 +243,15 @@ bolt_exported_finalize (GObject *object)
   if (bolt_exported_is_exported (exported))
     bolt_exported_unexport (exported);
 
+  /* the queue holds a reference, i.e. we cannot be in it */
+  g_warn_if_fail (priv->props_changed_id == 0);
+
   g_clear_pointer (&priv->object_path, g_free);
   g_ptr_array_free (priv->props_changed, TRUE);
 
+  g_hash_table_destroy (priv->props_cache);
+  g_clear_pointer (&priv->props_all, g_variant_unref);
+
   G_OBJECT_CLASS (bolt_exported_parent_class)->finalize (object);
 }
 
@@ -223,6 +291,8 @@ bolt_exported_init (GTypeInstance *instance, gpointer g_class)
   BoltExportedPrivate *priv = GET_PRIV (exported);
 
   priv->props_changed = g_ptr_array_new ();
+  priv->props_cache = g_hash_table_new_full (NULL, NULL, NULL,
+                                             (GDestroyNotify) g_variant_unref);
 }
 
 static void
@@ -390,10 +460,17 @@ bolt_exported_get_prop (BoltExported     *exported,
 {
   g_autoptr(GError) err = NULL;
   g_auto(GValue) res = G_VALUE_INIT;
+  BoltExportedPrivate *priv;
   const char *name;
   const GParamSpec *spec;
   GVariant *ret;
 
+  priv = GET_PRIV (exported);
+  ret = g_hash_table_lookup (priv->props_cache, prop);
+
+  if (ret != NULL)
+    return g_variant_ref (ret);
+
   name = prop->name_obj;
   spec = prop->spec;
 
@@ -406,6 +483,9 @@ bolt_exported_get_prop (BoltExported     *exported,
     bolt_bug ("failed to serialize value for prop %s: %s",
               prop->spec->name, err->message);
 
+  else
+    g_hash_table_insert (priv->props_cache, prop, g_variant_ref (ret));
+
   return ret;
 }
 
@@ -489,6 +569,154 @@ dispach_property_setter (BoltExported          *exported,
   return g_variant_new ("()");
 }
 
+/* callers with asynchronous method calls in flight, the
+ * cancellable is shared by all of them and cancelled as
+ * soon as the caller vanishes from the bus */
+typedef struct _Caller
+{
+  char         *name;
+  GCancellable *cancel;
+  guint         watch;
+  guint         calls;
+} Caller;
+
+static GHashTable *callers = NULL; /* unique name -> Caller */
+
+static void
+caller_vanished (GDBusConnection *connection,
+                 const char      *name,
+                 gpointer         user_data)
+{
+  Caller *caller = user_data;
+
+  bolt_debug (LOG_TOPIC ("dbus"), "caller '%s' vanished, "
+              "cancelling %u call(s)", name, caller->calls);
+
+  g_cancellable_cancel (caller->cancel);
+}
+
+static Caller *
+caller_ref (GDBusMethodInvocation *inv)
+{
+  GDBusConnection *dbus;
+  const char *sender;
+  Caller *caller;
+
+  dbus = g_dbus_method_invocation_get_connection (inv);
+  sender = g_dbus_method_invocation_get_sender (inv);
+
+  /* peer-to-peer connections have no sender */
+  if (sender == NULL)
+    sender = "";
+
+  if (callers == NULL)
+    callers = g_hash_table_new (g_str_hash, g_str_equal);
+
+  caller = g_hash_table_lookup (callers, sender);
+
+  if (caller == NULL)
+    {
+      caller = g_slice_new0 (Caller);
+      caller->name = g_strdup (sender);
+      caller->cancel = g_cancellable_new ();
+
+      if (*sender != '\0')
+        caller->watch = g_bus_watch_name_on_connection (dbus,
+                                                        sender,
+                                                        G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                        NULL,
+                                                        caller_vanished,
+                                                        caller,
+                                                        NULL);
+
+      g_hash_table_insert (callers, caller->name, caller);
+    }
+
+  caller->calls++;
+
+  return caller;
+}
+
+static void
+caller_unref (Caller *caller)
+{
+  if (--caller->calls > 0)
+    return;
+
+  g_hash_table_remove (callers, caller->name);
+
+  if (caller->watch > 0)
+    g_bus_unwatch_name (caller->watch);
+
+  g_clear_object (&caller->cancel);
+  g_free (caller->name);
+  g_slice_free (Caller, caller);
+}
+
+typedef struct _AsyncCall
+{
+  GDBusMethodInvocation *inv;
+  Caller                *caller;
+} AsyncCall;
+
+static void
+dispatch_async_done (GObject      *source_object,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GVariant) ret = NULL;
+  AsyncCall *call = user_data;
+  GDBusMethodInvocation *inv = call->inv;
+
+  ret = g_task_propagate_pointer (G_TASK (res), &err);
+
+  /* changes caused by the call are visible before the reply */
+  changes_queue_flush_now ();
+
+  if (err != NULL)
+    {
+      if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        bolt_debug (LOG_TOPIC ("dbus"), "call to '%s' cancelled",
+                    g_dbus_method_invocation_get_method_name (inv));
+
+      g_dbus_method_invocation_return_gerror (inv, err);
+    }
+  else
+    {
+      if (ret != NULL && g_variant_is_floating (ret))
+        g_variant_ref_sink (ret);
+
+      /* NULL means an empty reply, i.e. "()" */
+      g_dbus_method_invocation_return_value (inv, ret);
+    }
+
+  caller_unref (call->caller);
+  g_slice_free (AsyncCall, call);
+}
+
+static void
+dispatch_async_method_call (BoltExported          *exported,
+                            GDBusMethodInvocation *inv,
+                            BoltExportedMethod    *method)
+{
+  g_autoptr(GTask) task = NULL;
+  GVariant *params;
+  AsyncCall *call;
+
+  params = g_dbus_method_invocation_get_parameters (inv);
+
+  call = g_slice_new0 (AsyncCall);
+  call->inv = inv;
+  call->caller = caller_ref (inv);
+
+  task = g_task_new (exported, call->caller->cancel,
+                     dispatch_async_done, call);
+  g_task_set_source_tag (task, dispatch_async_method_call);
+
+  method->async_handler (exported, params, inv, task);
+}
+
 static GVariant *
 dispatch_method_call (BoltExported          *exported,
                       GDBusMethodInvocation *inv,
@@ -498,6 +726,13 @@ dispatch_method_call (BoltExported          *exported,
   GVariant *params = g_dbus_method_invocation_get_parameters (inv);
   GVariant *res;
 
+  if (method->async_handler != NULL)
+    {
+      /* reply is sent from dispatch_async_done */
+      dispatch_async_method_call (exported, inv, method);
+      return NULL;
+    }
+
   res = method->handler (exported, params, inv, error);
 
   return res;
@@ -537,6 +772,9 @@ query_authorization_done (GObject      *source_object,
   else
     ret = dispatch_method_call (exported, inv, data->method, &err);
 
+  /* changes caused by the call are visible before the reply */
+  changes_queue_flush_now ();
+
   if (ret == NULL && err != NULL)
     g_dbus_method_invocation_return_gerror (inv, err);
   else if (ret != NULL)
@@ -619,30 +857,79 @@ handle_authorize_property_default (BoltExported          *exported,
 
 /* DBus virtual table */
 
+/* Get and GetAll are answered from the property cache and
+ * need no authorization, Set is dispatched like a method */
 static void
-handle_dbus_method_call (GDBusConnection       *connection,
-                         const char            *sender,
-                         const char            *object_path,
-                         const char            *interface_name,
-                         const char            *method_name,
-                         GVariant              *parameters,
-                         GDBusMethodInvocation *invocation,
-                         gpointer               user_data)
+handle_dbus_get_property (BoltExported          *exported,
+                          GDBusMethodInvocation *inv)
+{
+  g_autoptr(GVariant) var = NULL;
+  g_autoptr(GError) err = NULL;
+  const GDBusPropertyInfo *pi;
+  BoltExportedProp *prop = NULL;
+
+  pi = g_dbus_method_invocation_get_property_info (inv);
+
+  if (pi != NULL)
+    prop = bolt_exported_lookup_property (exported, pi->name, &err);
+  else
+    g_set_error (&err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                 "property information missing");
+
+  if (prop == NULL)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("dbus"), "get_property");
+      g_dbus_method_invocation_return_gerror (inv, err);
+      return;
+    }
+
+  var = bolt_exported_get_prop (exported, prop);
+  g_dbus_method_invocation_return_value (inv, g_variant_new ("(v)", var));
+}
+
+static void
+handle_dbus_get_all (BoltExported          *exported,
+                     GDBusMethodInvocation *inv)
+{
+  g_autoptr(GVariant) props = NULL;
+
+  props = bolt_exported_get_properties (exported);
+  g_dbus_method_invocation_return_value (inv, g_variant_new ("(@a{sv})", props));
+}
+
+static void
+dispatch_call (BoltExported          *exported,
+               GDBusMethodInvocation *invocation)
 {
   g_autoptr(GTask) task = NULL;
   g_autoptr(GError) err = NULL;
-  BoltExported *exported;
+  const char *interface_name;
+  const char *method_name;
   gboolean is_property;
   DispatchData *data;
 
-  exported = BOLT_EXPORTED (user_data);
-
-  bolt_debug (LOG_TOPIC ("dbus"), "method call: %s.%s at %s from %s",
-              interface_name, method_name, object_path, sender);
+  interface_name = g_dbus_method_invocation_get_interface_name (invocation);
+  method_name = g_dbus_method_invocation_get_method_name (invocation);
 
-  /* we also handle property setting here */
+  /* we also handle properties here */
   is_property = bolt_streq (interface_name, "org.freedesktop.DBus.Properties");
 
+  if (is_property && bolt_streq (method_name, "Get"))
+    {
+      handle_dbus_get_property (exported, invocation);
+      return;
+    }
+  else if (is_property && bolt_streq (method_name, "GetAll"))
+    {
+      handle_dbus_get_all (exported, invocation);
+      return;
+    }
+  else if (bolt_streq (interface_name, OBJECT_MANAGER_INTERFACE))
+    {
+      object_manager_get_managed_objects (exported, invocation);
+      return;
+    }
+
   data = g_slice_new0 (DispatchData);
   data->inv = invocation;
   data->is_property = is_property;
@@ -686,161 +973,692 @@ handle_dbus_method_call (GDBusConnection       *connection,
 
   task = g_task_new (exported, NULL, query_authorization_done, data);
 
-  g_task_set_source_tag (task, handle_dbus_method_call);
+  g_task_set_source_tag (task, dispatch_call);
   g_task_set_task_data (task, data, NULL);
 
   g_task_run_in_thread (task, query_authorization);
 }
 
-static GVariant *
-handle_dbus_get_property (GDBusConnection *connection,
-                          const char      *sender,
-                          const char      *object_path,
-                          const char      *interface_name,
-                          const char      *property_name,
-                          GError         **error,
-                          gpointer         user_data)
+/* rate limiting: every client has a token bucket that is refilled
+ * with 'rate' tokens per second, up to 'burst'. Calls for which no
+ * token is available are queued per client and the queues are then
+ * drained round robin, one call per client and tick, so a single
+ * busy client cannot starve the others. */
+static void
+client_free (gpointer data)
 {
-  g_autoptr(GError) err = NULL;
-  BoltExported *exported;
-  BoltExportedProp *prop;
-  GVariant *ret;
+  Client *client = data;
+
+  g_free (client->name);
+  g_slice_free (Client, client);
+}
 
-  exported = BOLT_EXPORTED (user_data);
+static void
+client_refill (Client *client,
+               gint64  now)
+{
+  double dt = (now - client->tlast) / (double) G_USEC_PER_SEC;
 
-  bolt_debug (LOG_TOPIC ("dbus"), "get property: %s.%s at %s from %s",
-              interface_name, property_name, object_path, sender);
+  client->tokens = MIN (client->tokens + dt * limiter.rate,
+                        (double) limiter.burst);
+  client->tlast = now;
+}
 
-  prop = bolt_exported_lookup_property (exported, property_name, &err);
-  if (prop == NULL)
-    {
-      bolt_warn_err (err, LOG_TOPIC ("dbus"), "get_property");
-      bolt_error_propagate (error, &err);
-      return NULL;
-    }
+static gboolean
+client_is_idle (gpointer key,
+                gpointer value,
+                gpointer user_data)
+{
+  Client *client = value;
+  gint64 now = *(gint64 *) user_data;
 
-  ret = bolt_exported_get_prop (exported, prop);
+  client_refill (client, now);
 
-  return ret;
+  return g_queue_is_empty (&client->waiting) &&
+         client->tokens >= (double) limiter.burst;
 }
 
 static void
-bolt_exported_dispatch_properties_changed (GObject     *object,
-                                           guint        n_pspecs,
-                                           GParamSpec **pspecs)
+client_dispatch_one (Client *client)
 {
-  g_autoptr(GVariant) changes = NULL;
-  g_autoptr(GError) err = NULL;
-  g_auto(GVariantBuilder) changed;
-  g_auto(GVariantBuilder) invalidated;
-  const char *iface_name;
-  BoltExported *exported;
-  BoltExportedPrivate *priv;
-  gboolean ok;
-  guint count = 0;
+  QueuedCall *call = g_queue_pop_head (&client->waiting);
 
-  exported = BOLT_EXPORTED (object);
-  priv = GET_PRIV (exported);
+  dispatch_call (call->exported, call->inv);
 
-  g_variant_builder_init (&changed, G_VARIANT_TYPE ("a{sv}"));
-  g_variant_builder_init (&invalidated, G_VARIANT_TYPE ("as"));
+  g_object_unref (call->exported);
+  g_slice_free (QueuedCall, call);
+}
 
-  /* no bus, no changed signal */
-  if (priv->dbus == NULL || priv->object_path == NULL)
-    goto out;
+static gboolean
+limiter_tick (gpointer user_data)
+{
+  gint64 now = g_get_monotonic_time ();
+  guint n = g_queue_get_length (&limiter.ready);
 
-  for (guint i = 0; i < n_pspecs; i++)
+  for (guint i = 0; i < n; i++)
     {
-      g_autoptr(GVariant) var = NULL;
-      GParamSpec *pspec = pspecs[i];
-      BoltExportedProp *prop;
-      const char *nick;
+      Client *client = g_queue_pop_head (&limiter.ready);
 
-      nick = g_param_spec_get_nick (pspec);
-      prop =  bolt_exported_lookup_property (exported, nick, NULL);
+      client_refill (client, now);
 
-      if (prop == NULL)
+      if (client->tokens >= 1.0)
         {
-          bolt_debug (LOG_TOPIC ("dbus"), "prop %s change ignored", nick);
-          continue;
+          client->tokens -= 1.0;
+          client_dispatch_one (client);
         }
 
-      bolt_debug (LOG_TOPIC ("dbus"), "prop %s changed", nick);
-
-      var = bolt_exported_get_prop (exported, prop);
-      g_variant_builder_add (&changed, "{sv}", prop->name_bus, var);
-      count++;
+      if (!g_queue_is_empty (&client->waiting))
+        g_queue_push_tail (&limiter.ready, client);
     }
 
-  if (count == 0)
-    goto out;
-
-  iface_name = bolt_exported_get_iface_name (exported);
-  changes = g_variant_ref_sink (g_variant_new ("(sa{sv}as)",
-                                               iface_name,
-                                               &changed,
-                                               &invalidated));
+  if (!g_queue_is_empty (&limiter.ready))
+    return G_SOURCE_CONTINUE;
 
-  ok = g_dbus_connection_emit_signal (priv->dbus,
-                                      NULL,
-                                      priv->object_path,
-                                      "org.freedesktop.DBus.Properties",
-                                      "PropertiesChanged",
-                                      changes,
-                                      &err);
+  limiter.tick_id = 0;
+  return G_SOURCE_REMOVE;
+}
 
-  if (!ok)
-    bolt_warn_err (err, LOG_TOPIC ("dbus"),
-                   "error emitting property changes");
+static void
+limiter_drain (void)
+{
+  Client *client;
 
-  bolt_debug (LOG_TOPIC ("dbus"), "emitted property %u changes", count);
+  while ((client = g_queue_pop_head (&limiter.ready)) != NULL)
+    while (!g_queue_is_empty (&client->waiting))
+      client_dispatch_one (client);
 
-out:
-  CHAIN_UP (dispatch_properties_changed) (object, n_pspecs, pspecs);
+  if (limiter.tick_id > 0)
+    {
+      g_source_remove (limiter.tick_id);
+      limiter.tick_id = 0;
+    }
 }
 
-static GDBusInterfaceVTable dbus_vtable = {
-  handle_dbus_method_call,
-  handle_dbus_get_property,
-  NULL, /* set_property (handled by method call) */
-};
-
-/* public methods: class */
-
-void
-bolt_exported_class_set_interface_name (BoltExportedClass *klass,
-                                        const char        *name)
+/* returns TRUE if the call can be dispatched right away, otherwise
+ * it was either queued or rejected */
+static gboolean
+limiter_admit (BoltExported          *exported,
+               GDBusMethodInvocation *inv)
 {
-  g_return_if_fail (BOLT_IS_EXPORTED_CLASS (klass));
-  g_return_if_fail (klass->priv != NULL);
-  g_return_if_fail (klass->priv->iface_name == NULL);
+  const char *sender;
+  QueuedCall *call;
+  Client *client;
+  gint64 now;
 
-  klass->priv->iface_name = g_strdup (name);
-}
+  sender = g_dbus_method_invocation_get_sender (inv);
 
-void
-bolt_exported_class_set_interface_info (BoltExportedClass *klass,
-                                        const char        *iface_name,
-                                        const char        *resource_name)
-{
-  g_autoptr(GError) err = NULL;
-  GDBusInterfaceInfo *info = NULL;
+  /* peer-to-peer connections have no sender */
+  if (limiter.rate == 0 || sender == NULL)
+    return TRUE;
 
-  g_return_if_fail (BOLT_IS_EXPORTED_CLASS (klass));
-  g_return_if_fail (klass->priv != NULL);
-  g_return_if_fail (klass->priv->iface_info == NULL);
-  g_return_if_fail (iface_name != NULL);
-  g_return_if_fail (resource_name != NULL);
+  if (limiter.clients == NULL)
+    limiter.clients = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             NULL, client_free);
 
-  bolt_exported_class_set_interface_name (klass, iface_name);
+  now = g_get_monotonic_time ();
 
-  info = bolt_dbus_interface_info_lookup (resource_name,
-                                          iface_name,
-                                          &err);
+  /* forget clients that are back to a full bucket */
+  if (now - limiter.tprune > LIMITER_PRUNE_USEC)
+    {
+      g_hash_table_foreach_remove (limiter.clients, client_is_idle, &now);
+      limiter.tprune = now;
+    }
 
-  if (info == NULL)
-    bolt_error (LOG_TOPIC ("dbus"), LOG_ERR (err),
-                "could not set interface info");
+  client = g_hash_table_lookup (limiter.clients, sender);
+
+  if (client == NULL)
+    {
+      client = g_slice_new0 (Client);
+      client->name = g_strdup (sender);
+      client->tokens = limiter.burst;
+      client->tlast = now;
+      g_queue_init (&client->waiting);
+
+      g_hash_table_insert (limiter.clients, client->name, client);
+    }
+  else
+    {
+      client_refill (client, now);
+    }
+
+  /* calls of a client are never reordered */
+  if (g_queue_is_empty (&client->waiting) && client->tokens >= 1.0)
+    {
+      client->tokens -= 1.0;
+      return TRUE;
+    }
+
+  if (g_queue_get_length (&client->waiting) >= LIMITER_BACKLOG)
+    {
+      limiter.rejected++;
+      bolt_debug (LOG_TOPIC ("dbus"), "rejecting call from %s: "
+                  "too many calls waiting", sender);
+      g_dbus_method_invocation_return_error (inv, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_LIMITS_EXCEEDED,
+                                             "too many requests from %s",
+                                             sender);
+      return FALSE;
+    }
+
+  limiter.throttled++;
+
+  call = g_slice_new0 (QueuedCall);
+  call->exported = g_object_ref (exported);
+  call->inv = inv;
+
+  if (g_queue_is_empty (&client->waiting))
+    g_queue_push_tail (&limiter.ready, client);
+
+  g_queue_push_tail (&client->waiting, call);
+
+  if (limiter.tick_id == 0)
+    limiter.tick_id = g_timeout_add (MAX (1000 / limiter.rate, 1),
+                                     limiter_tick,
+                                     NULL);
+
+  return FALSE;
+}
+
+static void
+handle_dbus_method_call (GDBusConnection       *connection,
+                         const char            *sender,
+                         const char            *object_path,
+                         const char            *interface_name,
+                         const char            *method_name,
+                         GVariant              *parameters,
+                         GDBusMethodInvocation *invocation,
+                         gpointer               user_data)
+{
+  BoltExported *exported = BOLT_EXPORTED (user_data);
+
+  bolt_debug (LOG_TOPIC ("dbus"), "method call: %s.%s at %s from %s",
+              interface_name, method_name, object_path, sender);
+
+  if (!limiter_admit (exported, invocation))
+    return;
+
+  dispatch_call (exported, invocation);
+}
+
+
+static void
+bolt_exported_emit_changes (BoltExported *exported)
+{
+  g_autoptr(GVariant) changes = NULL;
+  g_autoptr(GError) err = NULL;
+  g_auto(GVariantBuilder) changed;
+  g_auto(GVariantBuilder) invalidated;
+  const char *iface_name;
+  BoltExportedPrivate *priv;
+  gboolean ok;
+  guint count;
+
+  priv = GET_PRIV (exported);
+  count = priv->props_changed->len;
+
+  g_variant_builder_init (&changed, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_init (&invalidated, G_VARIANT_TYPE ("as"));
+
+  /* no bus, no changed signal */
+  if (count == 0 || priv->dbus == NULL || priv->object_path == NULL)
+    {
+      g_ptr_array_set_size (priv->props_changed, 0);
+      return;
+    }
+
+  for (guint i = 0; i < count; i++)
+    {
+      g_autoptr(GVariant) var = NULL;
+      BoltExportedProp *prop = g_ptr_array_index (priv->props_changed, i);
+
+      var = bolt_exported_get_prop (exported, prop);
+      g_variant_builder_add (&changed, "{sv}", prop->name_bus, var);
+    }
+
+  g_ptr_array_set_size (priv->props_changed, 0);
+
+  iface_name = bolt_exported_get_iface_name (exported);
+  changes = g_variant_ref_sink (g_variant_new ("(sa{sv}as)",
+                                               iface_name,
+                                               &changed,
+                                               &invalidated));
+
+  ok = g_dbus_connection_emit_signal (priv->dbus,
+                                      NULL,
+                                      priv->object_path,
+                                      "org.freedesktop.DBus.Properties",
+                                      "PropertiesChanged",
+                                      changes,
+                                      &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_TOPIC ("dbus"),
+                   "error emitting property changes");
+
+  changes_queue.stats.signals++;
+  bolt_debug (LOG_TOPIC ("dbus"), "emitted property %u changes", count);
+}
+
+static gboolean
+changes_queue_flush (gpointer user_data)
+{
+  g_autoptr(GPtrArray) dirty = NULL;
+
+  changes_queue.flush_id = 0;
+
+  if (changes_queue.dirty == NULL)
+    return G_SOURCE_REMOVE;
+
+  /* emitting can, via the property getters, lead to new
+   * changes; those will end up in a new queue */
+  dirty = g_steal_pointer (&changes_queue.dirty);
+
+  for (guint i = 0; i < dirty->len; i++)
+    {
+      BoltExported *exported = g_ptr_array_index (dirty, i);
+      BoltExportedPrivate *priv = GET_PRIV (exported);
+
+      /* already flushed individually */
+      if (priv->props_changed_id == 0)
+        continue;
+
+      priv->props_changed_id = 0;
+      bolt_exported_emit_changes (exported);
+    }
+
+  bolt_debug (LOG_TOPIC ("dbus"), "flushed %u objects "
+              "[changes: %" G_GUINT64_FORMAT ", signals: %" G_GUINT64_FORMAT
+              ", saved: %" G_GUINT64_FORMAT "]",
+              dirty->len, changes_queue.stats.changes,
+              changes_queue.stats.signals, changes_queue.stats.saved);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+changes_queue_flush_now (void)
+{
+  if (changes_queue.flush_id == 0)
+    return;
+
+  g_source_remove (changes_queue.flush_id);
+  changes_queue_flush (NULL);
+}
+
+static void
+changes_queue_add (BoltExported *exported)
+{
+  BoltExportedPrivate *priv = GET_PRIV (exported);
+
+  if (priv->props_changed_id != 0)
+    return;
+
+  if (changes_queue.dirty == NULL)
+    changes_queue.dirty = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_ptr_array_add (changes_queue.dirty, g_object_ref (exported));
+  priv->props_changed_id = changes_queue.dirty->len;
+
+  if (changes_queue.flush_id != 0)
+    return;
+
+  if (changes_queue.latency == 0)
+    changes_queue.flush_id = g_idle_add (changes_queue_flush, NULL);
+  else
+    changes_queue.flush_id = g_timeout_add (changes_queue.latency,
+                                            changes_queue_flush,
+                                            NULL);
+}
+
+/* Property changes are not emitted right away, but collected
+ * in a per object dirty set, which is flushed for all objects
+ * at once when the main loop is idle (or after the configured
+ * latency, see bolt_exported_set_changes_latency). Thus all
+ * changes of one object in that window result in just one
+ * PropertiesChanged signal carrying the latest values. */
+static void
+bolt_exported_dispatch_properties_changed (GObject     *object,
+                                           guint        n_pspecs,
+                                           GParamSpec **pspecs)
+{
+  BoltExported *exported;
+  BoltExportedPrivate *priv;
+  guint count = 0;
+
+  exported = BOLT_EXPORTED (object);
+  priv = GET_PRIV (exported);
+
+  for (guint i = 0; i < n_pspecs; i++)
+    {
+      GParamSpec *pspec = pspecs[i];
+      BoltExportedProp *prop;
+      const char *nick;
+      gboolean known = FALSE;
+
+      nick = g_param_spec_get_nick (pspec);
+      prop =  bolt_exported_lookup_property (exported, nick, NULL);
+
+      if (prop == NULL)
+        {
+          bolt_debug (LOG_TOPIC ("dbus"), "prop %s change ignored", nick);
+          continue;
+        }
+
+      g_hash_table_remove (priv->props_cache, prop);
+      g_clear_pointer (&priv->props_all, g_variant_unref);
+
+      /* no bus, no changed signal */
+      if (priv->dbus == NULL || priv->object_path == NULL)
+        continue;
+
+      bolt_debug (LOG_TOPIC ("dbus"), "prop %s changed", nick);
+      changes_queue.stats.changes++;
+      count++;
+
+      for (guint k = 0; !known && k < priv->props_changed->len; k++)
+        known = g_ptr_array_index (priv->props_changed, k) == prop;
+
+      if (!known)
+        g_ptr_array_add (priv->props_changed, prop);
+    }
+
+  if (count == 0)
+    goto out;
+
+  /* merged into an already pending signal */
+  if (priv->props_changed_id != 0)
+    changes_queue.stats.saved++;
+
+  changes_queue_add (exported);
+
+out:
+  CHAIN_UP (dispatch_properties_changed) (object, n_pspecs, pspecs);
+}
+
+static GDBusInterfaceVTable dbus_vtable = {
+  handle_dbus_method_call,
+  NULL, /* get_property (handled by method call) */
+  NULL, /* set_property (handled by method call) */
+};
+
+/* object manager */
+static const char *object_manager_xml =
+  "<node>"
+  "  <interface name='" OBJECT_MANAGER_INTERFACE "'>"
+  "    <method name='GetManagedObjects'>"
+  "      <arg type='a{oa{sa{sv}}}' name='objects' direction='out'/>"
+  "    </method>"
+  "    <signal name='InterfacesAdded'>"
+  "      <arg type='o' name='object_path'/>"
+  "      <arg type='a{sa{sv}}' name='interfaces_and_properties'/>"
+  "    </signal>"
+  "    <signal name='InterfacesRemoved'>"
+  "      <arg type='o' name='object_path'/>"
+  "      <arg type='as' name='interfaces'/>"
+  "    </signal>"
+  "  </interface>"
+  "</node>";
+
+/* One object manager per connection, attached to it via qdata.
+ * All objects exported below its path are tracked. */
+typedef struct _ObjectManager
+{
+  GDBusConnection *dbus;
+  BoltExported    *root;
+  char            *prefix;  /* object path of root + '/' */
+  guint            registration;
+
+  GHashTable      *objects; /* object path -> BoltExported */
+} ObjectManager;
+
+static GQuark
+object_manager_quark (void)
+{
+  return g_quark_from_static_string ("bolt-object-manager");
+}
+
+static void
+object_manager_free (gpointer data)
+{
+  ObjectManager *om = data;
+
+  g_hash_table_unref (om->objects);
+  g_free (om->prefix);
+  g_slice_free (ObjectManager, om);
+}
+
+static ObjectManager *
+object_manager_for (BoltExported *exported)
+{
+  BoltExportedPrivate *priv = GET_PRIV (exported);
+  ObjectManager *om;
+
+  if (priv->dbus == NULL || priv->object_path == NULL)
+    return NULL;
+
+  om = g_object_get_qdata (G_OBJECT (priv->dbus), object_manager_quark ());
+
+  if (om == NULL || !g_str_has_prefix (priv->object_path, om->prefix))
+    return NULL;
+
+  return om;
+}
+
+static GVariant *
+object_manager_interfaces (BoltExported *exported)
+{
+  g_autoptr(GVariant) props = NULL;
+  GVariantBuilder builder;
+  const char *iface_name;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+
+  iface_name = bolt_exported_get_iface_name (exported);
+  props = bolt_exported_get_properties (exported);
+  g_variant_builder_add (&builder, "{s@a{sv}}", iface_name, props);
+
+  return g_variant_builder_end (&builder);
+}
+
+static void
+object_manager_emit (ObjectManager *om,
+                     const char    *name,
+                     GVariant      *params)
+{
+  g_autoptr(GError) err = NULL;
+  gboolean ok;
+
+  ok = g_dbus_connection_emit_signal (om->dbus,
+                                      NULL,
+                                      bolt_exported_get_object_path (om->root),
+                                      OBJECT_MANAGER_INTERFACE,
+                                      name,
+                                      params,
+                                      &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_TOPIC ("dbus"), "error emitting %s", name);
+}
+
+static void
+object_manager_add (BoltExported *exported)
+{
+  BoltExportedPrivate *priv = GET_PRIV (exported);
+  ObjectManager *om;
+  GVariant *ifaces;
+
+  om = object_manager_for (exported);
+
+  if (om == NULL)
+    return;
+
+  if (g_hash_table_contains (om->objects, priv->object_path))
+    {
+      bolt_warn (LOG_TOPIC ("dbus"), "object manager: %s already managed",
+                 priv->object_path);
+      return;
+    }
+
+  g_hash_table_insert (om->objects, priv->object_path, exported);
+
+  ifaces = object_manager_interfaces (exported);
+  object_manager_emit (om, "InterfacesAdded",
+                       g_variant_new ("(o@a{sa{sv}})",
+                                      priv->object_path,
+                                      ifaces));
+}
+
+static void
+object_manager_remove (BoltExported *exported)
+{
+  BoltExportedPrivate *priv = GET_PRIV (exported);
+  const char *ifaces[2] = {NULL, NULL};
+  ObjectManager *om;
+
+  om = g_object_get_qdata (G_OBJECT (priv->dbus), object_manager_quark ());
+
+  /* the root itself goes away, and with it the manager */
+  if (om != NULL && om->root == exported)
+    {
+      g_dbus_connection_unregister_object (priv->dbus, om->registration);
+      g_object_set_qdata (G_OBJECT (priv->dbus), object_manager_quark (), NULL);
+      return;
+    }
+
+  om = object_manager_for (exported);
+
+  if (om == NULL)
+    return;
+
+  if (g_hash_table_lookup (om->objects, priv->object_path) != exported)
+    return;
+
+  g_hash_table_remove (om->objects, priv->object_path);
+
+  ifaces[0] = bolt_exported_get_iface_name (exported);
+  object_manager_emit (om, "InterfacesRemoved",
+                       g_variant_new ("(o^as)",
+                                      priv->object_path,
+                                      ifaces));
+}
+
+/* called via dispatch_call, i.e. after the call was admitted
+ * by the rate limiter, which might have queued it for a while,
+ * so the manager is looked up again */
+static void
+object_manager_get_managed_objects (BoltExported          *root,
+                                    GDBusMethodInvocation *invocation)
+{
+  GDBusConnection *dbus;
+  ObjectManager *om;
+  BoltExportedClass *klass;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  dbus = g_dbus_method_invocation_get_connection (invocation);
+  om = g_object_get_qdata (G_OBJECT (dbus), object_manager_quark ());
+
+  if (om == NULL || om->root != root)
+    {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_UNKNOWN_OBJECT,
+                                             "object manager is gone");
+      return;
+    }
+
+  /* objects created lazily get exported now */
+  klass = BOLT_EXPORTED_GET_CLASS (om->root);
+  if (klass->prepare_managed_objects)
+    klass->prepare_managed_objects (om->root);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oa{sa{sv}}}"));
+
+  g_hash_table_iter_init (&iter, om->objects);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      GVariant *ifaces = object_manager_interfaces (value);
+      g_variant_builder_add (&builder, "{o@a{sa{sv}}}", key, ifaces);
+    }
+
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(a{oa{sa{sv}}})",
+                                                        &builder));
+}
+
+static void
+handle_object_manager_call (GDBusConnection       *connection,
+                            const char            *sender,
+                            const char            *object_path,
+                            const char            *interface_name,
+                            const char            *method_name,
+                            GVariant              *parameters,
+                            GDBusMethodInvocation *invocation,
+                            gpointer               user_data)
+{
+  ObjectManager *om = user_data;
+
+  bolt_debug (LOG_TOPIC ("dbus"), "method call: %s.%s at %s from %s",
+              interface_name, method_name, object_path, sender);
+
+  if (!bolt_streq (method_name, "GetManagedObjects"))
+    {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_UNKNOWN_METHOD,
+                                             "no such method: %s",
+                                             method_name);
+      return;
+    }
+
+  /* same admission as all other calls */
+  if (!limiter_admit (om->root, invocation))
+    return;
+
+  dispatch_call (om->root, invocation);
+}
+
+static GDBusInterfaceVTable object_manager_vtable = {
+  handle_object_manager_call,
+  NULL,
+  NULL,
+};
+
+/* public methods: class */
+
+void
+bolt_exported_class_set_interface_name (BoltExportedClass *klass,
+                                        const char        *name)
+{
+  g_return_if_fail (BOLT_IS_EXPORTED_CLASS (klass));
+  g_return_if_fail (klass->priv != NULL);
+  g_return_if_fail (klass->priv->iface_name == NULL);
+
+  klass->priv->iface_name = g_strdup (name);
+}
+
+void
+bolt_exported_class_set_interface_info (BoltExportedClass *klass,
+                                        const char        *iface_name,
+                                        const char        *resource_name)
+{
+  g_autoptr(GError) err = NULL;
+  GDBusInterfaceInfo *info = NULL;
+
+  g_return_if_fail (BOLT_IS_EXPORTED_CLASS (klass));
+  g_return_if_fail (klass->priv != NULL);
+  g_return_if_fail (klass->priv->iface_info == NULL);
+  g_return_if_fail (iface_name != NULL);
+  g_return_if_fail (resource_name != NULL);
+
+  bolt_exported_class_set_interface_name (klass, iface_name);
+
+  info = bolt_dbus_interface_info_lookup (resource_name,
+                                          iface_name,
+                                          &err);
+
+  if (info == NULL)
+    bolt_error (LOG_TOPIC ("dbus"), LOG_ERR (err),
+                "could not set interface info");
 
   klass->priv->iface_info = info; /* transfer ownership */
 }
@@ -974,6 +1792,25 @@ bolt_exported_class_export_method (BoltExportedClass        *klass,
   g_hash_table_insert (klass->priv->methods, method->name, method);
 }
 
+void
+bolt_exported_class_export_async_method (BoltExportedClass             *klass,
+                                         const char                    *name,
+                                         BoltExportedAsyncMethodHandler handler)
+{
+  BoltExportedMethod *method;
+
+  g_return_if_fail (BOLT_IS_EXPORTED_CLASS (klass));
+  g_return_if_fail (name != NULL);
+  g_return_if_fail (handler != NULL);
+
+  method = g_new0 (BoltExportedMethod, 1);
+
+  method->name = g_strdup (name);
+  method->async_handler = handler;
+
+  g_hash_table_insert (klass->priv->methods, method->name, method);
+}
+
 
 /* public methods: instance */
 gboolean
@@ -1037,6 +1874,12 @@ bolt_exported_export (BoltExported    *exported,
   g_object_notify_by_pspec (G_OBJECT (exported), props[PROP_OBJECT_PATH]);
   g_object_notify_by_pspec (G_OBJECT (exported), props[PROP_EXPORTED]);
 
+  if (exported_objects == NULL)
+    exported_objects = g_hash_table_new (NULL, NULL);
+
+  g_hash_table_add (exported_objects, exported);
+  object_manager_add (exported);
+
   return TRUE;
 }
 
@@ -1054,6 +1897,14 @@ bolt_exported_unexport (BoltExported *exported)
   if (priv->dbus == NULL || priv->registration == 0)
     return FALSE;
 
+  /* send out the last changes while we still can */
+  bolt_exported_flush (exported);
+
+  object_manager_remove (exported);
+
+  if (exported_objects != NULL)
+    g_hash_table_remove (exported_objects, exported);
+
   ok = g_dbus_connection_unregister_object (priv->dbus, priv->registration);
 
   if (ok)
@@ -1106,6 +1957,175 @@ bolt_exported_get_object_path (BoltExported *exported)
   return priv->object_path;
 }
 
+void
+bolt_exported_flush (BoltExported *exported)
+{
+  BoltExportedPrivate *priv;
+
+  g_return_if_fail (BOLT_IS_EXPORTED (exported));
+
+  priv = GET_PRIV (exported);
+
+  if (priv->props_changed_id == 0)
+    return;
+
+  /* the queue still holds a reference, it will
+   * be dropped during the next flush of the queue */
+  priv->props_changed_id = 0;
+  bolt_exported_emit_changes (exported);
+}
+
+void
+bolt_exported_set_changes_latency (guint msec)
+{
+  changes_queue.latency = msec;
+}
+
+void
+bolt_exported_get_stats (BoltExportedStats *stats)
+{
+  g_return_if_fail (stats != NULL);
+
+  *stats = changes_queue.stats;
+  stats->throttled = limiter.throttled;
+  stats->rejected = limiter.rejected;
+}
+
+void
+bolt_exported_set_rate_limit (guint rate,
+                              guint burst)
+{
+  limiter.rate = rate;
+  limiter.burst = MAX (burst, MAX (rate, 1));
+
+  /* waiting calls are not held back any longer */
+  if (rate == 0)
+    limiter_drain ();
+}
+
+gboolean
+bolt_exported_export_object_manager (BoltExported *root,
+                                     GError      **error)
+{
+  g_autoptr(GDBusInterfaceInfo) info = NULL;
+  BoltExportedPrivate *priv;
+  ObjectManager *om;
+  GObject *bus;
+  guint id;
+
+  g_return_val_if_fail (BOLT_IS_EXPORTED (root), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  priv = GET_PRIV (root);
+
+  if (priv->dbus == NULL || priv->object_path == NULL)
+    {
+      g_set_error_literal (error, BOLT_ERROR, BOLT_ERROR_FAILED,
+                           "object manager root is not exported");
+      return FALSE;
+    }
+
+  bus = G_OBJECT (priv->dbus);
+  if (g_object_get_qdata (bus, object_manager_quark ()) != NULL)
+    {
+      g_set_error_literal (error, BOLT_ERROR, BOLT_ERROR_FAILED,
+                           "object manager already exported");
+      return FALSE;
+    }
+
+  info = bolt_dbus_interface_info_find (object_manager_xml,
+                                        OBJECT_MANAGER_INTERFACE,
+                                        error);
+  if (info == NULL)
+    return FALSE;
+
+  om = g_slice_new0 (ObjectManager);
+  om->dbus = priv->dbus;
+  om->root = root;
+  om->prefix = g_strconcat (priv->object_path,
+                            g_str_equal (priv->object_path, "/") ? "" : "/",
+                            NULL);
+  om->objects = g_hash_table_new (g_str_hash, g_str_equal);
+
+  id = g_dbus_connection_register_object (priv->dbus,
+                                          priv->object_path,
+                                          info,
+                                          &object_manager_vtable,
+                                          om,
+                                          NULL,
+                                          error);
+
+  if (id == 0)
+    {
+      object_manager_free (om);
+      return FALSE;
+    }
+
+  om->registration = id;
+  g_object_set_qdata_full (bus, object_manager_quark (),
+                           om, object_manager_free);
+
+  /* objects that were already exported below the root */
+  if (exported_objects != NULL)
+    {
+      GHashTableIter iter;
+      gpointer key;
+
+      g_hash_table_iter_init (&iter, exported_objects);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          BoltExported *obj = key;
+
+          if (object_manager_for (obj) == om)
+            g_hash_table_insert (om->objects, GET_PRIV (obj)->object_path, obj);
+        }
+    }
+
+  bolt_debug (LOG_TOPIC ("dbus"), "object manager at %s",
+              priv->object_path);
+
+  return TRUE;
+}
+
+GVariant *
+bolt_exported_get_properties (BoltExported *exported)
+{
+  BoltExportedPrivate *priv;
+  BoltExportedClass *klass;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_return_val_if_fail (BOLT_IS_EXPORTED (exported), NULL);
+
+  priv = GET_PRIV (exported);
+
+  if (priv->props_all != NULL)
+    return g_variant_ref (priv->props_all);
+
+  klass = BOLT_EXPORTED_GET_CLASS (exported);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+
+  g_hash_table_iter_init (&iter, klass->priv->properties);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      g_autoptr(GVariant) var = NULL;
+      BoltExportedProp *prop = value;
+
+      var = bolt_exported_get_prop (exported, prop);
+
+      if (var == NULL)
+        continue;
+
+      g_variant_builder_add (&builder, "{sv}", prop->name_bus, var);
+    }
+
+  priv->props_all = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  return g_variant_ref (priv->props_all);
+}
+
 gboolean
 bolt_exported_emit_signal (BoltExported *exported,
                            const char   *name,
@@ -50,8 +50,14 @@ struct _BoltExportedClass
                                   GDBusMethodInvocation *invocation,
                                   GError               **error);
 
+  /* virtuals */
+
+  /* called on the object manager root before GetManagedObjects
+   * is answered, to export objects that are created lazily */
+  void     (*prepare_managed_objects) (BoltExported *root);
+
   /* for the future */
-  gpointer padding[10];
+  gpointer padding[9];
 };
 
 typedef GVariant *  (* BoltExportedMethodHandler) (BoltExported          *obj,
@@ -59,6 +65,16 @@ typedef GVariant *  (* BoltExportedMethodHandler) (BoltExported          *obj,
                                                    GDBusMethodInvocation *inv,
                                                    GError               **error);
 
+/* The handler must eventually complete @task, which it does not own,
+ * either via g_task_return_error or g_task_return_pointer with the
+ * reply GVariant (floating or full, NULL for an empty reply) and
+ * g_variant_unref as destroy notify. The cancellable of @task is
+ * cancelled when the caller disconnects from the bus. */
+typedef void (* BoltExportedAsyncMethodHandler) (BoltExported          *obj,
+                                                 GVariant              *params,
+                                                 GDBusMethodInvocation *inv,
+                                                 GTask                 *task);
+
 typedef gboolean (* BoltExportedSetter) (BoltExported *obj,
                                          const char   *name,
                                          const GValue *value,
@@ -91,6 +107,10 @@ void     bolt_exported_class_export_method (BoltExportedClass        *klass,
                                             const char               *name,
                                             BoltExportedMethodHandler handler);
 
+void     bolt_exported_class_export_async_method (BoltExportedClass             *klass,
+                                                  const char                    *name,
+                                                  BoltExportedAsyncMethodHandler handler);
+
 /* instance methods */
 gboolean           bolt_exported_export (BoltExported    *exported,
                                          GDBusConnection *connection,
@@ -105,6 +125,12 @@ GDBusConnection *  bolt_exported_get_connection (BoltExported *exported);
 
 const char *       bolt_exported_get_object_path (BoltExported *exported);
 
+/* all exported properties (a{sv}), cached until one changes */
+GVariant *         bolt_exported_get_properties (BoltExported *exported);
+
+gboolean           bolt_exported_export_object_manager (BoltExported *root,
+                                                        GError      **error);
+
 gboolean           bolt_exported_emit_signal (BoltExported *exported,
                                               const char   *name,
                                               GVariant     *parameters,
@@ -112,4 +138,22 @@ gboolean           bolt_exported_emit_signal (BoltExported *exported,
 
 void               bolt_exported_flush (BoltExported *exported);
 
+/* statistics */
+typedef struct BoltExportedStats
+{
+  guint64 changes;   /* changed exported properties */
+  guint64 signals;   /* PropertiesChanged signals emitted */
+  guint64 saved;     /* signals saved by merging changes */
+  guint64 throttled; /* calls delayed by the rate limit */
+  guint64 rejected;  /* calls rejected by the rate limit */
+} BoltExportedStats;
+
+void               bolt_exported_set_changes_latency (guint msec);
+
+/* per-client calls per second, 0 disables the limit */
+void               bolt_exported_set_rate_limit (guint rate,
+                                                 guint burst);
+
+void               bolt_exported_get_stats (BoltExportedStats *stats);
+
 G_END_DECLS
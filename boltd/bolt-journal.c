@@ -31,8 +31,127 @@
 
 #include <gio/gunixinputstream.h>
 
-#include <errno.h>
 #include <stdio.h>
+#include <string.h>
+
+/* On-disk format
+ *
+ * A small header followed by an array of fixed size records,
+ * one for each entry, in the order they were written. The id
+ * is stored as 16 byte binary uuid if it is a uuid in its
+ * canonical (lower case) form, otherwise, if it is short
+ * enough, as zero padded string. The timestamp is stored as
+ * little endian 64 bit integer and every record is protected
+ * by a CRC-32 so that torn or corrupted records are skipped.
+ *
+ * All but the last record of a diff are flagged as batch
+ * records; a diff that was not completely written, e.g. due
+ * to a crash, is dropped when the journal is opened.
+ *
+ * From time to time the journal is compacted, i.e. it is
+ * rewritten with only the last entry for every id. Such a
+ * snapshot starts with a checkpoint record that contains
+ * the number of entries in it; all the entries that follow
+ * the snapshot are the tail of the journal.
+ *
+ * If a maximum size or age is set, the journal is split into
+ * segments: once the active segment, i.e. '<name>', exceeds
+ * either limit it is sealed by renaming it to '<name>.<n>',
+ * with increasing n, and a new active segment is started.
+ * Entries are replayed from the sealed segments, oldest one
+ * first, followed by the active one. Compaction checkpoints
+ * the effects of all segments into the active segment, after
+ * which the sealed segments are deleted.
+ *
+ * The old, line based text format is still supported; such a
+ * journal is converted to the binary format the first time it
+ * is written to, unless it contains, or is about to be given,
+ * ids that can not be represented, in which case it stays a
+ * text journal. For the same reason a new journal is started
+ * as text journal if its first ids can not be represented.
+ * Ids that can not be represented are only rejected, with
+ * G_IO_ERROR_INVALID_ARGUMENT, by journals that are already
+ * in the binary format.
+ */
+
+#define JR_MAGIC "BOLTJRNL"
+#define JR_VERSION 1
+#define JR_ID_LEN 16
+#define JR_ID_STRLEN 36 /* canonical uuid */
+
+/* compact if the tail is more than twice the snapshot */
+#define JOURNAL_COMPACT_RATIO 2
+#define JOURNAL_COMPACT_MIN   64
+
+/* compact once there are more sealed segments */
+#define JOURNAL_SEGMENTS_MAX 4
+
+typedef struct JournalHeader
+{
+  guint8  magic[8];
+  guint32 version;
+  guint32 recsize;
+} JournalHeader;
+
+G_STATIC_ASSERT (sizeof (JournalHeader) == 16);
+
+typedef enum JournalRecordFlags {
+  JR_FLAG_UUID       = 1 << 0,
+  JR_FLAG_BATCH      = 1 << 1, /* more records of the diff follow */
+  JR_FLAG_CHECKPOINT = 1 << 2,
+} JournalRecordFlags;
+
+typedef struct JournalRecord
+{
+  guint8  id[JR_ID_LEN];
+  guint64 ts;
+  guint8  op;
+  guint8  flags;
+  guint16 reserved;
+  guint32 crc;  /* of all the preceding bytes */
+} JournalRecord;
+
+G_STATIC_ASSERT (sizeof (JournalRecord) == 32);
+
+#define JR_CRC_LEN G_STRUCT_OFFSET (JournalRecord, crc)
+
+typedef enum JournalFormat {
+  JOURNAL_EMPTY,
+  JOURNAL_TEXT,
+  JOURNAL_BINARY,
+} JournalFormat;
+
+typedef struct JournalIndexEntry
+{
+  BoltJournalOp op;
+  guint64       ts;
+  guint64       seq;  /* order of the entries */
+} JournalIndexEntry;
+
+typedef struct JournalSpan
+{
+  const JournalRecord *recs;
+  gsize                n;
+} JournalSpan;
+
+struct _BoltJournalIter
+{
+  BoltJournal *journal;
+  gboolean     reverse;
+
+  gsize        n;
+  gsize        pos;
+
+  /* binary journals are read from mappings,
+   * one for every segment, oldest first */
+  GPtrArray *maps;
+  GArray    *spans;
+
+  /* text journals are read in completely */
+  GPtrArray *items;
+
+  char id[JR_ID_STRLEN + 1];
+};
 
 /* ************************************  */
 /* BoltJournal */
@@ -42,6 +161,23 @@ static void     bolt_journal_initable_iface_init (GInitableIface *iface);
 static gboolean bolt_journal_initialize (GInitable    *initable,
                                          GCancellable *cancellable,
                                          GError      **error);
+
+static gboolean journal_detect_format (int            fd,
+                                       off_t          size,
+                                       JournalFormat *format,
+                                       GError       **error);
+
+static gboolean journal_recover (BoltJournal *journal,
+                                 int          fd,
+                                 off_t        size,
+                                 GError     **error);
+
+static gboolean journal_index_build (BoltJournal *journal,
+                                     GError     **error);
+
+static gboolean journal_segments_scan (BoltJournal *journal,
+                                       GError     **error);
+
 struct _BoltJournal
 {
   GObject  object;
@@ -52,7 +188,27 @@ struct _BoltJournal
 
   gboolean fresh;
 
-  int      fd;
+  int           fd;
+  JournalFormat format;
+
+  /* group commit */
+  int        commit_window;  /* msec, -1 for none */
+  guint      commit_id;
+  GPtrArray *commit_queue;   /* GTask */
+
+  /* compaction, in records */
+  guint snap_len;
+  guint tail_len;
+
+  /* id -> JournalIndexEntry, the last op for every id */
+  GHashTable *index;
+  guint64     seq;
+
+  /* rotation */
+  guint64  max_size;      /* bytes, 0 for no limit */
+  guint64  max_age;       /* seconds, 0 for no limit */
+  GArray  *segments;      /* guint, sealed segments, oldest first */
+  guint64  active_since;  /* first entry in the active segment */
 
   /* serials */
   gint64  sl_time;
@@ -67,6 +223,9 @@ enum {
   PROP_NAME,
 
   PROP_FRESH,
+  PROP_COMMIT_WINDOW,
+  PROP_MAX_SIZE,
+  PROP_MAX_AGE,
 
   PROP_JOURNAL_LAST
 };
@@ -84,12 +243,22 @@ bolt_journal_finalize (GObject *object)
 {
   BoltJournal *journal = BOLT_JOURNAL (object);
 
+  /* the queued tasks keep us alive, so only
+   * entries written via bolt_journal_put are left */
+  if (journal->commit_id > 0)
+    {
+      g_source_remove (journal->commit_id);
+      (void) bolt_fdatasync (journal->fd, NULL);
+    }
+
   if (journal->fd > -1)
     bolt_close (journal->fd, NULL);
 
   g_clear_object (&journal->root);
   g_clear_pointer (&journal->name, g_free);
   g_clear_object (&journal->path);
+  g_clear_pointer (&journal->index, g_hash_table_unref);
+  g_clear_pointer (&journal->segments, g_array_unref);
 
   G_OBJECT_CLASS (bolt_journal_parent_class)->finalize (object);
 }
@@ -98,6 +267,10 @@ static void
 bolt_journal_init (BoltJournal *journal)
 {
   journal->fd = -1;
+  journal->commit_window = -1;
+  journal->index = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, g_free);
+  journal->segments = g_array_new (FALSE, FALSE, sizeof (guint));
 }
 
 static void
@@ -122,6 +295,18 @@ bolt_journal_get_property (GObject    *object,
       g_value_set_boolean (value, journal->fresh);
       break;
 
+    case PROP_COMMIT_WINDOW:
+      g_value_set_int (value, journal->commit_window);
+      break;
+
+    case PROP_MAX_SIZE:
+      g_value_set_uint64 (value, journal->max_size);
+      break;
+
+    case PROP_MAX_AGE:
+      g_value_set_uint64 (value, journal->max_age);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -145,6 +330,18 @@ bolt_journal_set_property (GObject      *object,
       journal->name = g_value_dup_string (value);
       break;
 
+    case PROP_COMMIT_WINDOW:
+      journal->commit_window = g_value_get_int (value);
+      break;
+
+    case PROP_MAX_SIZE:
+      journal->max_size = g_value_get_uint64 (value);
+      break;
+
+    case PROP_MAX_AGE:
+      journal->max_age = g_value_get_uint64 (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -181,6 +378,24 @@ bolt_journal_class_init (BoltJournalClass *klass)
                           G_PARAM_READABLE |
                           G_PARAM_STATIC_STRINGS);
 
+  journal_props[PROP_COMMIT_WINDOW] =
+    g_param_spec_int ("commit-window", NULL, NULL,
+                      -1, G_MAXINT, -1,
+                      G_PARAM_READWRITE |
+                      G_PARAM_STATIC_STRINGS);
+
+  journal_props[PROP_MAX_SIZE] =
+    g_param_spec_uint64 ("max-size", NULL, NULL,
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS);
+
+  journal_props[PROP_MAX_AGE] =
+    g_param_spec_uint64 ("max-age", NULL, NULL,
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_READWRITE |
+                         G_PARAM_STATIC_STRINGS);
+
   g_object_class_install_properties (gobject_class,
                                      PROP_JOURNAL_LAST,
                                      journal_props);
@@ -243,263 +458,1657 @@ bolt_journal_initialize (GInitable    *initable,
   bolt_info (LOG_TOPIC ("journal"), "opened for '%.13s'; size: %s",
              journal->name, size);
 
-  journal->fresh = st.st_size == 0;
+  ok = journal_detect_format (fd, st.st_size, &journal->format, error);
+  if (!ok)
+    return FALSE;
+
+  if (journal->format == JOURNAL_BINARY)
+    {
+      ok = journal_recover (journal, fd, st.st_size, error);
+      if (!ok)
+        return FALSE;
+
+      journal->fresh = journal->snap_len + journal->tail_len == 0;
+    }
+  else
+    {
+      journal->fresh = st.st_size == 0;
+    }
+
+  ok = journal_segments_scan (journal, error);
+  if (!ok)
+    return FALSE;
+
+  if (journal->segments->len > 0)
+    journal->fresh = FALSE;
+
   journal->fd = bolt_steal (&fd, -1);
 
-  bolt_debug (LOG_TOPIC ("journal"), "fresh: %s, fd: %d",
-              bolt_yesno (journal->fresh), journal->fd);
+  ok = journal_index_build (journal, error);
+  if (!ok)
+    return FALSE;
+
+  bolt_debug (LOG_TOPIC ("journal"), "fresh: %s, fd: %d, binary: %s, ids: %u",
+              bolt_yesno (journal->fresh), journal->fd,
+              bolt_yesno (journal->format == JOURNAL_BINARY),
+              g_hash_table_size (journal->index));
 
   return TRUE;
 }
 
 /* internal methods */
-static gboolean
-bolt_journal_write_entry (int           fd,
-                          const char   *id,
-                          BoltJournalOp op,
-                          GError      **error)
-{
-  g_autoptr(GError) err = NULL;
-  g_autofree char *data = NULL;
-  const char *opstr;
-  gboolean ok;
-  guint64 now;
-  size_t l;
-
-  g_return_val_if_fail (fd > -1, FALSE);
 
-  now = (guint64) g_get_real_time ();
-  opstr = bolt_journal_op_to_string (op);
+static void
+journal_index_update (BoltJournal  *journal,
+                      const char   *id,
+                      BoltJournalOp op,
+                      guint64       ts)
+{
+  JournalIndexEntry *entry;
 
-  data = g_strdup_printf ("%s %s %016"G_GINT64_MODIFIER "X\n",
-                          id, opstr, now);
+  entry = g_hash_table_lookup (journal->index, id);
 
-  l = strlen (data);
-  ok = bolt_write_all (fd, data, l, &err);
-  if (!ok)
+  if (entry == NULL)
     {
-      g_propagate_prefixed_error (error, g_steal_pointer (&err),
-                                  "could not add journal entry: ");
-      return FALSE;
+      entry = g_new (JournalIndexEntry, 1);
+      g_hash_table_insert (journal->index, g_strdup (id), entry);
     }
 
-  bolt_debug (LOG_TOPIC ("journal"), "wrote '%.*s' to %d",
-              l - 1, data, fd);
+  entry->op = op;
+  entry->ts = ts;
+  entry->seq = journal->seq++;
+}
+
+static gboolean
+journal_index_build (BoltJournal *journal,
+                     GError     **error)
+{
+  g_autoptr(BoltJournalIter) iter = NULL;
+  const char *id;
+  BoltJournalOp op;
+  guint64 ts;
+
+  g_hash_table_remove_all (journal->index);
+  journal->seq = 0;
+
+  iter = bolt_journal_iter_new (journal, BOLT_JOURNAL_ITER_FORWARD, error);
+
+  if (iter == NULL)
+    return FALSE;
+
+  while (bolt_journal_iter_next (iter, &id, &op, &ts))
+    journal_index_update (journal, id, op, ts);
 
   return TRUE;
 }
 
-/* public methods */
-
-BoltJournal *
-bolt_journal_new (GFile      *root,
-                  const char *name,
-                  GError    **error)
+static int
+journal_index_entry_cmp (gconstpointer a,
+                         gconstpointer b,
+                         gpointer      user_data)
 {
-  return g_initable_new (BOLT_TYPE_JOURNAL,
-                         NULL, error,
-                         "root", root,
-                         "name", name,
-                         NULL);
+  GHashTable *index = user_data;
+  const JournalIndexEntry *x = g_hash_table_lookup (index, *(const char **) a);
+  const JournalIndexEntry *y = g_hash_table_lookup (index, *(const char **) b);
+
+  return x->seq < y->seq ? -1 : (x->seq > y->seq ? 1 : 0);
 }
 
-gboolean
-bolt_journal_is_fresh (BoltJournal *journal)
+/* all ids, in the order of their last entry */
+static const char **
+journal_index_list (BoltJournal *journal,
+                    guint       *n)
 {
-  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), FALSE);
+  const char **ids;
 
-  return journal->fresh;
+  ids = (const char **) g_hash_table_get_keys_as_array (journal->index, n);
+  g_qsort_with_data (ids, *n, sizeof (char *),
+                     journal_index_entry_cmp,
+                     journal->index);
+
+  return ids;
 }
 
-gboolean
-bolt_journal_put (BoltJournal  *journal,
-                  const char   *id,
-                  BoltJournalOp op,
-                  GError      **error)
+/* CRC-32 (IEEE 802.3), as used by zlib */
+static guint32
+journal_crc32 (const guint8 *data,
+               gsize         len)
 {
-  gboolean ok;
-  int r;
+  static guint32 table[256];
+  static gsize init = 0;
+  guint32 crc = 0xFFFFFFFF;
 
-  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), FALSE);
-  g_return_val_if_fail (id != NULL, FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  if (g_once_init_enter (&init))
+    {
+      for (guint32 i = 0; i < 256; i++)
+        {
+          guint32 c = i;
 
-  ok = bolt_journal_write_entry (journal->fd, id, op, error);
+          for (guint k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
 
-  if (!ok)
-    return FALSE;
+          table[i] = c;
+        }
 
-  r = fdatasync (journal->fd);
-  if (r == -1)
-    {
-      bolt_warn (LOG_TOPIC ("journal"),
-                 "could not flush (fdatasync) journal: %s",
-                 g_strerror (errno));
+      g_once_init_leave (&init, 1);
     }
 
-  journal->fresh = FALSE;
+  for (gsize i = 0; i < len; i++)
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
 
-  return TRUE;
+  return crc ^ 0xFFFFFFFF;
 }
 
-gboolean
-bolt_journal_put_diff (BoltJournal *journal,
-                       GHashTable  *diff,
-                       GError     **error)
+static gboolean
+journal_encode_uuid (const char *id,
+                     guint8     *out)
 {
-  g_autoptr(GError) err = NULL;
-  g_autofree char *path = NULL;
-  g_autofree char *base = NULL;
-  bolt_autoclose int fd = -1;
-  struct stat st;
-  GHashTableIter iter;
-  gpointer key, val;
-  gboolean ok = TRUE;
+  guint k = 0;
 
-  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), FALSE);
-  g_return_val_if_fail (diff != NULL, FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  /* only the canonical form, so it can be restored exactly */
+  if (strlen (id) != 36)
+    return FALSE;
 
-  base = g_file_get_path (journal->path);
-  path = g_strdup_printf ("%s.lock", base);
+  for (guint i = 0; i < 36; )
+    {
+      int hi, lo;
 
-  fd = bolt_open (path,
-                  O_RDWR |  O_CREAT | O_CLOEXEC | O_TRUNC,
-                  0666,
-                  error);
+      if (i == 8 || i == 13 || i == 18 || i == 23)
+        {
+          if (id[i] != '-')
+            return FALSE;
 
-  if (fd < 0)
-    return FALSE;
+          i++;
+          continue;
+        }
 
-  memset (&st, 0, sizeof (st));
-  ok = bolt_fstat (journal->fd, &st, &err);
-  if (!ok)
-    {
-      g_propagate_prefixed_error (error, g_steal_pointer (&err),
-                                  "could not query journal: ");
-      return FALSE;
+      if (g_ascii_isupper (id[i]) || g_ascii_isupper (id[i + 1]))
+        return FALSE;
+
+      hi = g_ascii_xdigit_value (id[i]);
+      lo = g_ascii_xdigit_value (id[i + 1]);
+
+      if (hi < 0 || lo < 0)
+        return FALSE;
+
+      out[k++] = (guint8) (hi << 4 | lo);
+      i += 2;
     }
 
-  ok = bolt_lseek (journal->fd, 0, SEEK_SET, NULL, error);
+  return TRUE;
+}
 
-  if (ok)
-    ok = bolt_copy_bytes (journal->fd, fd, st.st_size, error);
+static gboolean
+journal_id_supported (const char *id)
+{
+  guint8 buf[JR_ID_LEN];
+  gsize len = strlen (id);
+
+  if (len > 0 && len <= JR_ID_LEN)
+    return TRUE;
+
+  return journal_encode_uuid (id, buf);
+}
+
+static gboolean
+journal_diff_supported (GHashTable *diff)
+{
+  GHashTableIter iter;
+  gpointer key;
 
   g_hash_table_iter_init (&iter, diff);
-  while (ok && g_hash_table_iter_next (&iter, &key, &val))
-    {
-      const char *uid = key;
-      const int opcode = GPOINTER_TO_INT (val);
-      BoltJournalOp op;
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    if (!journal_id_supported (key))
+      return FALSE;
 
-      switch (opcode)
-        {
-        case '+':
-          op = BOLT_JOURNAL_ADDED;
-          break;
+  return TRUE;
+}
 
-        case '-':
-          op = BOLT_JOURNAL_REMOVED;
-          break;
+static gboolean
+journal_record_encode (JournalRecord *rec,
+                       const char    *id,
+                       BoltJournalOp  op,
+                       guint64        ts,
+                       guint8         flags,
+                       GError       **error)
+{
+  gsize len = strlen (id);
 
-        default:
-          g_set_error (error, BOLT_ERROR, BOLT_ERROR_FAILED,
-                       "unsupported op-code in diff: %c", opcode);
-          return FALSE;
-        }
+  memset (rec, 0, sizeof (JournalRecord));
+  rec->flags = flags;
 
-      ok = bolt_journal_write_entry (fd, uid, op, error);
+  if (journal_encode_uuid (id, rec->id))
+    {
+      rec->flags |= JR_FLAG_UUID;
+    }
+  else if (len > 0 && len <= JR_ID_LEN)
+    {
+      memcpy (rec->id, id, len);
+    }
+  else
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "id not supported by journal: '%s'", id);
+      return FALSE;
     }
 
-  if (ok)
-    ok = bolt_fdatasync (fd, error);
+  rec->ts = GUINT64_TO_LE (ts);
+  rec->op = (guint8) bolt_journal_op_to_string (op)[0];
+  rec->crc = GUINT32_TO_LE (journal_crc32 ((const guint8 *) rec, JR_CRC_LEN));
 
-  if (ok)
-    ok = bolt_faddflags (fd, O_APPEND, error);
+  return TRUE;
+}
 
-  if (ok)
-    ok = bolt_rename (path, base, error);
+static void
+journal_checkpoint_encode (JournalRecord *rec,
+                           guint32        count,
+                           guint64        ts)
+{
+  memset (rec, 0, sizeof (JournalRecord));
 
-  if (ok)
-    bolt_swap (journal->fd, fd);
+  count = GUINT32_TO_LE (count);
+  memcpy (rec->id, &count, sizeof (count));
 
-  return ok;
+  rec->ts = GUINT64_TO_LE (ts);
+  rec->op = (guint8) '=';
+  rec->flags = JR_FLAG_CHECKPOINT;
+  rec->crc = GUINT32_TO_LE (journal_crc32 ((const guint8 *) rec, JR_CRC_LEN));
 }
 
-GPtrArray *
-bolt_journal_list (BoltJournal *journal,
-                   GError     **error)
+static gboolean
+journal_record_valid (const JournalRecord *rec)
 {
-  g_autoptr(GInputStream) is = NULL;
-  g_autoptr(GDataInputStream) ds = NULL;
-  GPtrArray *res = NULL;
-  off_t pos;
+  guint32 crc = journal_crc32 ((const guint8 *) rec, JR_CRC_LEN);
 
-  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), NULL);
-  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+  return crc == GUINT32_FROM_LE (rec->crc);
+}
 
-  pos = lseek (journal->fd, 0, SEEK_SET);
+/* decodes the record into the caller supplied buffer for
+ * the id, which must be at least JR_ID_STRLEN + 1 bytes */
+static gboolean
+journal_record_decode (const JournalRecord *rec,
+                       char                *id,
+                       BoltJournalOp       *op,
+                       guint64             *ts,
+                       GError             **error)
+{
+  const char opstr[2] = {(char) rec->op, '\0'};
 
-  if (pos == (off_t) -1)
+  if (!journal_record_valid (rec))
     {
-      int code = errno;
-      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (code),
-                   "could not read from journal: %s", g_strerror (code));
-      return NULL;
+      g_set_error_literal (error, BOLT_ERROR, BOLT_ERROR_FAILED,
+                           "checksum mismatch");
+      return FALSE;
     }
 
-  res = g_ptr_array_new_full (16, (GDestroyNotify) bolt_journal_item_free);
+  *op = bolt_journal_op_from_string (opstr, error);
 
-  is = g_unix_input_stream_new (journal->fd, FALSE);
-  ds = g_data_input_stream_new (is);
+  if (*op == BOLT_JOURNAL_FAILED && rec->op != '!')
+    return FALSE;
 
-  g_return_val_if_fail (ds != NULL, res);
+  *ts = GUINT64_FROM_LE (rec->ts);
 
-  for (;; )
+  if (rec->flags & JR_FLAG_UUID)
     {
-      g_autoptr(GError) err = NULL;
-      g_autofree char *l = NULL;
-      g_autofree char *name = NULL;
-      g_autofree char *opstr = NULL;
-      BoltJournalItem *i;
-      BoltJournalOp op;
+      const guint8 *u = rec->id;
+
+      g_snprintf (id, JR_ID_STRLEN + 1,
+                  "%02x%02x%02x%02x-%02x%02x-%02x%02x-"
+                  "%02x%02x-%02x%02x%02x%02x%02x%02x",
+                  u[0], u[1], u[2], u[3], u[4], u[5],
+                  u[6], u[7], u[8], u[9], u[10], u[11],
+                  u[12], u[13], u[14], u[15]);
+    }
+  else
+    {
+      gsize len = strnlen ((const char *) rec->id, JR_ID_LEN);
+
+      memcpy (id, rec->id, len);
+      id[len] = '\0';
+    }
+
+  return TRUE;
+}
+
+static gboolean
+journal_detect_format (int            fd,
+                       off_t          size,
+                       JournalFormat *format,
+                       GError       **error)
+{
+  JournalHeader hdr;
+  gboolean ok;
+  gsize n = 0;
+
+  if (size == 0)
+    {
+      *format = JOURNAL_EMPTY;
+      return TRUE;
+    }
+
+  ok = bolt_read_all (fd, &hdr, sizeof (hdr), &n, error);
+
+  if (!ok)
+    return FALSE;
+
+  if (n < sizeof (hdr) || memcmp (hdr.magic, JR_MAGIC, 8) != 0)
+    {
+      *format = JOURNAL_TEXT;
+      return TRUE;
+    }
+
+  if (GUINT32_FROM_LE (hdr.version) != JR_VERSION ||
+      GUINT32_FROM_LE (hdr.recsize) != sizeof (JournalRecord))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "unsupported journal version: %u",
+                   GUINT32_FROM_LE (hdr.version));
+      return FALSE;
+    }
+
+  *format = JOURNAL_BINARY;
+  return TRUE;
+}
+
+static void
+journal_header_init (JournalHeader *hdr)
+{
+  memcpy (hdr->magic, JR_MAGIC, sizeof (hdr->magic));
+  hdr->version = GUINT32_TO_LE (JR_VERSION);
+  hdr->recsize = GUINT32_TO_LE (sizeof (JournalRecord));
+}
+
+static gboolean
+journal_write_header (int      fd,
+                      GError **error)
+{
+  JournalHeader hdr;
+
+  journal_header_init (&hdr);
+
+  return bolt_write_all (fd, &hdr, sizeof (hdr), error);
+}
+
+static gboolean
+journal_read_record (int            fd,
+                     gsize          idx,
+                     JournalRecord *rec,
+                     GError       **error)
+{
+  off_t off = sizeof (JournalHeader) + idx * sizeof (JournalRecord);
+  gboolean ok;
+  gsize n = 0;
+
+  ok = bolt_lseek (fd, off, SEEK_SET, NULL, error);
+
+  if (ok)
+    ok = bolt_read_all (fd, rec, sizeof (JournalRecord), &n, error);
+
+  if (ok && n != sizeof (JournalRecord))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "short read of journal record %" G_GSIZE_FORMAT, idx);
+      return FALSE;
+    }
+
+  return ok;
+}
+
+/* drops incompletely written records and diffs at the
+ * end of the journal and reads the checkpoint, if any */
+static gboolean
+journal_recover (BoltJournal *journal,
+                 int          fd,
+                 off_t        size,
+                 GError     **error)
+{
+  JournalRecord rec;
+  gboolean ok;
+  gsize total;
+  gsize end;
+  off_t len;
+
+  total = (size - sizeof (JournalHeader)) / sizeof (JournalRecord);
+
+  for (end = total; end > 0; end--)
+    {
+      ok = journal_read_record (fd, end - 1, &rec, error);
+
+      if (!ok)
+        return FALSE;
+
+      if (journal_record_valid (&rec) && !(rec.flags & JR_FLAG_BATCH))
+        break;
+    }
+
+  len = sizeof (JournalHeader) + end * sizeof (JournalRecord);
+
+  if (len != size)
+    {
+      bolt_warn (LOG_TOPIC ("journal"),
+                 "'%.13s': dropping %" G_GINT64_FORMAT " bytes of "
+                 "incomplete entries", journal->name, (gint64) (size - len));
+
+      ok = bolt_ftruncate (fd, len, error);
+
+      if (!ok)
+        return FALSE;
+    }
+
+  journal->snap_len = 0;
+  journal->tail_len = end;
+
+  if (end == 0)
+    return TRUE;
+
+  ok = journal_read_record (fd, 0, &rec, error);
+
+  if (!ok)
+    return FALSE;
+
+  if (journal_record_valid (&rec) && rec.flags & JR_FLAG_CHECKPOINT)
+    {
+      guint32 count;
+
+      memcpy (&count, rec.id, sizeof (count));
+      count = GUINT32_FROM_LE (count);
+
+      journal->snap_len = MIN (count, end - 1);
+      journal->tail_len = end - 1 - journal->snap_len;
+    }
+
+  if (journal->tail_len > 0)
+    {
+      ok = journal_read_record (fd, end - journal->tail_len, &rec, error);
+
+      if (!ok)
+        return FALSE;
+
+      journal->active_since = GUINT64_FROM_LE (rec.ts);
+    }
+
+  bolt_debug (LOG_TOPIC ("journal"), "snapshot: %u, tail: %u",
+              journal->snap_len, journal->tail_len);
+
+  return TRUE;
+}
+
+static gboolean
+bolt_journal_write_entry (int           fd,
+                          JournalFormat format,
+                          const char   *id,
+                          BoltJournalOp op,
+                          guint64       ts,
+                          GError      **error)
+{
+  g_autoptr(GError) err = NULL;
+  g_autofree char *data = NULL;
+  JournalRecord rec;
+  const char *opstr;
+  gboolean ok;
+  size_t l;
+
+  g_return_val_if_fail (fd > -1, FALSE);
+
+  if (format == JOURNAL_BINARY)
+    {
+      ok = journal_record_encode (&rec, id, op, ts, 0, error);
+
+      if (!ok)
+        return FALSE;
+
+      ok = bolt_write_all (fd, &rec, sizeof (rec), &err);
+      if (!ok)
+        {
+          g_propagate_prefixed_error (error, g_steal_pointer (&err),
+                                      "could not add journal entry: ");
+          return FALSE;
+        }
+
+      bolt_debug (LOG_TOPIC ("journal"), "wrote '%s %c' to %d",
+                  id, rec.op, fd);
+
+      return TRUE;
+    }
+
+  opstr = bolt_journal_op_to_string (op);
+
+  data = g_strdup_printf ("%s %s %016"G_GINT64_MODIFIER "X\n",
+                          id, opstr, ts);
+
+  l = strlen (data);
+  ok = bolt_write_all (fd, data, l, &err);
+  if (!ok)
+    {
+      g_propagate_prefixed_error (error, g_steal_pointer (&err),
+                                  "could not add journal entry: ");
+      return FALSE;
+    }
+
+  bolt_debug (LOG_TOPIC ("journal"), "wrote '%.*s' to %d",
+              l - 1, data, fd);
+
+  return TRUE;
+}
+
+static GPtrArray *
+journal_list_text (BoltJournal *journal,
+                   GError     **error)
+{
+  g_autoptr(GInputStream) is = NULL;
+  g_autoptr(GDataInputStream) ds = NULL;
+  GPtrArray *res = NULL;
+  gboolean ok;
+
+  ok = bolt_lseek (journal->fd, 0, SEEK_SET, NULL, error);
+
+  if (!ok)
+    return NULL;
+
+  res = g_ptr_array_new_full (16, (GDestroyNotify) bolt_journal_item_free);
+
+  is = g_unix_input_stream_new (journal->fd, FALSE);
+  ds = g_data_input_stream_new (is);
+
+  g_return_val_if_fail (ds != NULL, res);
+
+  for (;; )
+    {
+      g_autoptr(GError) err = NULL;
+      g_autofree char *l = NULL;
+      g_autofree char *name = NULL;
+      g_autofree char *opstr = NULL;
+      BoltJournalItem *i;
+      BoltJournalOp op;
       guint64 ts;
       int n;
 
-      l = g_data_input_stream_read_line (ds, NULL, NULL, &err);
+      l = g_data_input_stream_read_line (ds, NULL, NULL, &err);
+
+      if (l == NULL)
+        {
+          if (err)
+            bolt_warn_err (err, LOG_TOPIC ("journal"),
+                           "error reading from journal");
+          break;
+        }
+
+      n = sscanf (l, "%ms %ms %016" G_GINT64_MODIFIER "X",
+                  &name, &opstr, &ts);
+
+      if (n != 3)
+        {
+          bolt_warn (LOG_TOPIC ("journal"), "invalid entry: '%s'", l);
+          continue;
+        }
+
+      op = bolt_journal_op_from_string (opstr, &err);
+
+      if (err != NULL)
+        {
+          bolt_warn_err (err, LOG_TOPIC ("journal"),
+                         "skipping entry '%s'", l);
+          continue;
+        }
+
+      i = g_slice_new (BoltJournalItem);
+      i->id = g_strdup (name);
+      i->ts = ts;
+      i->op = op;
+
+      g_ptr_array_add (res, i);
+    }
+
+  return res;
+}
+
+/* converts a text journal to the binary format,
+ * keeping all the entries, including their time */
+static gboolean
+journal_upgrade (BoltJournal *journal,
+                 GError     **error)
+{
+  g_autoptr(GPtrArray) items = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *base = NULL;
+  bolt_autoclose int fd = -1;
+  gboolean ok;
+
+  items = journal_list_text (journal, error);
+
+  if (items == NULL)
+    return FALSE;
+
+  for (guint i = 0; i < items->len; i++)
+    {
+      BoltJournalItem *item = g_ptr_array_index (items, i);
+      JournalRecord rec;
+
+      ok = journal_record_encode (&rec, item->id, item->op, item->ts,
+                                  0, NULL);
+
+      if (!ok)
+        {
+          bolt_info (LOG_TOPIC ("journal"),
+                     "'%.13s' has unsupported ids, keeping text format",
+                     journal->name);
+          return TRUE;
+        }
+    }
+
+  base = g_file_get_path (journal->path);
+  path = g_strdup_printf ("%s.lock", base);
+
+  fd = bolt_open (path,
+                  O_RDWR | O_CREAT | O_CLOEXEC | O_TRUNC,
+                  0666,
+                  error);
+
+  if (fd < 0)
+    return FALSE;
+
+  ok = journal_write_header (fd, error);
+
+  for (guint i = 0; ok && i < items->len; i++)
+    {
+      BoltJournalItem *item = g_ptr_array_index (items, i);
+
+      ok = bolt_journal_write_entry (fd, JOURNAL_BINARY,
+                                     item->id, item->op, item->ts,
+                                     error);
+    }
+
+  if (ok)
+    ok = bolt_fdatasync (fd, error);
+
+  if (ok)
+    ok = bolt_faddflags (fd, O_APPEND, error);
+
+  if (ok)
+    ok = bolt_rename (path, base, error);
+
+  if (!ok)
+    return FALSE;
+
+  bolt_swap (journal->fd, fd);
+  journal->format = JOURNAL_BINARY;
+  journal->snap_len = 0;
+  journal->tail_len = items->len;
+
+  bolt_info (LOG_TOPIC ("journal"), "'%.13s' converted to binary format",
+             journal->name);
+
+  return TRUE;
+}
+
+/* makes sure the journal is ready to be appended to; the
+ * binary format is only used if it can represent the ids
+ * that are about to be written, see 'supported' */
+static gboolean
+journal_prepare_write (BoltJournal *journal,
+                       gboolean     supported,
+                       GError     **error)
+{
+  gboolean ok;
+
+  switch (journal->format)
+    {
+    case JOURNAL_EMPTY:
+      if (!supported)
+        {
+          journal->format = JOURNAL_TEXT;
+          return TRUE;
+        }
+
+      ok = journal_write_header (journal->fd, error);
+
+      if (ok)
+        journal->format = JOURNAL_BINARY;
+
+      return ok;
+
+    case JOURNAL_TEXT:
+      if (!supported)
+        return TRUE;
+
+      return journal_upgrade (journal, error);
+
+    case JOURNAL_BINARY:
+      if (supported)
+        return TRUE;
+
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "id not supported by binary journal '%.13s'",
+                   journal->name);
+      return FALSE;
+    }
+
+  g_assert_not_reached ();
+  return FALSE;
+}
+
+/* group commit: entries are written to the journal right
+ * away, but the flush to disk is deferred, so that all the
+ * entries added within the commit window (or the current
+ * main loop iteration) share a single fdatasync */
+static gboolean
+journal_commit (BoltJournal *journal,
+                GError     **error)
+{
+  g_autoptr(GPtrArray) queue = NULL;
+  g_autoptr(GError) err = NULL;
+  gboolean ok;
+
+  if (journal->commit_id > 0)
+    {
+      g_source_remove (journal->commit_id);
+      journal->commit_id = 0;
+    }
+
+  queue = g_steal_pointer (&journal->commit_queue);
+
+  ok = bolt_fdatasync (journal->fd, &err);
+
+  if (queue != NULL)
+    bolt_debug (LOG_TOPIC ("journal"), "committed %u entries for '%.13s'",
+                queue->len, journal->name);
+
+  for (guint i = 0; queue != NULL && i < queue->len; i++)
+    {
+      GTask *task = g_ptr_array_index (queue, i);
+
+      if (ok)
+        g_task_return_boolean (task, TRUE);
+      else
+        g_task_return_error (task, g_error_copy (err));
+    }
+
+  if (!ok)
+    return bolt_error_propagate (error, &err);
+
+  return TRUE;
+}
+
+static gboolean
+journal_commit_timeout (gpointer user_data)
+{
+  g_autoptr(GError) err = NULL;
+  BoltJournal *journal = user_data;
+  gboolean ok;
+
+  journal->commit_id = 0;
+
+  ok = journal_commit (journal, &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_TOPIC ("journal"),
+                   "could not flush (fdatasync) journal");
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+journal_commit_schedule (BoltJournal *journal)
+{
+  if (journal->commit_id > 0)
+    return;
+
+  if (journal->commit_window > 0)
+    journal->commit_id = g_timeout_add (journal->commit_window,
+                                        journal_commit_timeout,
+                                        journal);
+  else
+    journal->commit_id = g_idle_add (journal_commit_timeout,
+                                     journal);
+}
+
+/* writes out everything that is pending, so that
+ * operations that replace the file see all entries */
+static gboolean
+journal_commit_pending (BoltJournal *journal,
+                        GError     **error)
+{
+  if (journal->commit_id == 0 && journal->commit_queue == NULL)
+    return TRUE;
+
+  return journal_commit (journal, error);
+}
+
+/* atomically replaces the journal with the given contents */
+static gboolean
+journal_replace (BoltJournal *journal,
+                 const void  *data,
+                 gsize        len,
+                 GError     **error)
+{
+  g_autofree char *path = NULL;
+  g_autofree char *base = NULL;
+  bolt_autoclose int fd = -1;
+  gboolean ok;
+
+  base = g_file_get_path (journal->path);
+  path = g_strdup_printf ("%s.lock", base);
+
+  fd = bolt_open (path,
+                  O_RDWR | O_CREAT | O_CLOEXEC | O_TRUNC,
+                  0666,
+                  error);
+
+  if (fd < 0)
+    return FALSE;
+
+  ok = bolt_write_all (fd, data, len, error);
+
+  if (ok)
+    ok = bolt_fdatasync (fd, error);
+
+  if (ok)
+    ok = bolt_faddflags (fd, O_APPEND, error);
+
+  if (ok)
+    ok = bolt_rename (path, base, error);
+
+  if (!ok)
+    return FALSE;
+
+  bolt_swap (journal->fd, fd);
+
+  return TRUE;
+}
+
+/* segments */
+static char *
+journal_segment_path (BoltJournal *journal,
+                      guint        num)
+{
+  g_autofree char *base = NULL;
+
+  base = g_file_get_path (journal->path);
+
+  return g_strdup_printf ("%s.%u", base, num);
+}
+
+static int
+journal_segment_cmp (gconstpointer a,
+                     gconstpointer b)
+{
+  guint x = *(const guint *) a;
+  guint y = *(const guint *) b;
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static gboolean
+journal_segments_scan (BoltJournal *journal,
+                       GError     **error)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GDir) d = NULL;
+  g_autofree char *path = NULL;
+  const char *name;
+  gsize len;
+
+  g_array_set_size (journal->segments, 0);
+
+  path = g_file_get_path (journal->root);
+  len = strlen (journal->name);
+
+  d = g_dir_open (path, 0, &err);
+  if (d == NULL)
+    return bolt_error_propagate (error, &err);
+
+  while ((name = g_dir_read_name (d)) != NULL)
+    {
+      const char *suffix;
+      guint64 num;
+      guint seg;
+      gboolean ok;
+
+      if (strncmp (name, journal->name, len) || name[len] != '.')
+        continue;
+
+      suffix = name + len + 1;
+
+      if (*suffix == '\0' || strspn (suffix, "0123456789") != strlen (suffix))
+        continue;
+
+      ok = bolt_str_parse_as_uint64 (suffix, &num, NULL);
+
+      if (!ok || num > G_MAXUINT)
+        continue;
+
+      seg = (guint) num;
+      g_array_append_val (journal->segments, seg);
+    }
+
+  g_array_sort (journal->segments, journal_segment_cmp);
+
+  if (journal->segments->len > 0)
+    bolt_debug (LOG_TOPIC ("journal"), "'%.13s' has %u sealed segments",
+                journal->name, journal->segments->len);
+
+  return TRUE;
+}
+
+/* the effects of the sealed segments must have been
+ * checkpointed into the active segment before this */
+static void
+journal_segments_drop (BoltJournal *journal)
+{
+  for (guint i = 0; i < journal->segments->len; i++)
+    {
+      g_autoptr(GError) err = NULL;
+      g_autofree char *path = NULL;
+      guint num = g_array_index (journal->segments, guint, i);
+      gboolean ok;
+
+      path = journal_segment_path (journal, num);
+      ok = bolt_unlink (path, &err);
+
+      if (!ok && !bolt_err_notfound (err))
+        bolt_warn_err (err, LOG_TOPIC ("journal"),
+                       "could not remove segment %u", num);
+    }
+
+  g_array_set_size (journal->segments, 0);
+}
+
+/* seals the active segment and starts a new one */
+static gboolean
+journal_rotate (BoltJournal *journal,
+                GError     **error)
+{
+  g_autofree char *base = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *lock = NULL;
+  bolt_autoclose int fd = -1;
+  gboolean ok;
+  guint num = 0;
+
+  g_return_val_if_fail (journal->format == JOURNAL_BINARY, FALSE);
+
+  ok = journal_commit_pending (journal, error);
+
+  if (!ok)
+    return FALSE;
+
+  if (journal->segments->len > 0)
+    num = g_array_index (journal->segments, guint,
+                         journal->segments->len - 1) + 1;
+
+  base = g_file_get_path (journal->path);
+  lock = g_strdup_printf ("%s.lock", base);
+  path = journal_segment_path (journal, num);
+
+  fd = bolt_open (lock,
+                  O_RDWR | O_CREAT | O_CLOEXEC | O_TRUNC,
+                  0666,
+                  error);
+
+  if (fd < 0)
+    return FALSE;
+
+  ok = journal_write_header (fd, error);
+
+  if (ok)
+    ok = bolt_fdatasync (fd, error);
+
+  if (ok)
+    ok = bolt_faddflags (fd, O_APPEND, error);
+
+  if (ok)
+    ok = bolt_rename (base, path, error);
+
+  if (!ok)
+    return FALSE;
+
+  ok = bolt_rename (lock, base, error);
+
+  if (!ok)
+    {
+      /* undo the sealing, so we keep on appending */
+      (void) bolt_rename (path, base, NULL);
+      return FALSE;
+    }
+
+  bolt_swap (journal->fd, fd);
+  g_array_append_val (journal->segments, num);
+
+  bolt_info (LOG_TOPIC ("journal"), "'%.13s' rotated: sealed segment %u",
+             journal->name, num);
+
+  journal->snap_len = 0;
+  journal->tail_len = 0;
+  journal->active_since = 0;
+
+  return TRUE;
+}
+
+/* checkpoints the last entry for every id, in the order they
+ * were written, into the active segment, which then replaces
+ * all the entries in the active and the sealed segments */
+static gboolean
+journal_compact (BoltJournal *journal,
+                 GError     **error)
+{
+  g_autofree const char **ids = NULL;
+  g_autoptr(GByteArray) buf = NULL;
+  JournalHeader hdr;
+  JournalRecord rec;
+  gboolean ok;
+  guint total;
+  guint count;
+
+  g_return_val_if_fail (journal->format == JOURNAL_BINARY, FALSE);
+
+  ok = journal_commit_pending (journal, error);
+
+  if (!ok)
+    return FALSE;
+
+  total = journal->snap_len + journal->tail_len;
+  ids = journal_index_list (journal, &count);
+  buf = g_byte_array_sized_new (sizeof (hdr) + (count + 1) * sizeof (rec));
+
+  journal_header_init (&hdr);
+  g_byte_array_append (buf, (const guint8 *) &hdr, sizeof (hdr));
+
+  if (count > 0)
+    {
+      journal_checkpoint_encode (&rec, count, (guint64) g_get_real_time ());
+      g_byte_array_append (buf, (const guint8 *) &rec, sizeof (rec));
+    }
+
+  for (guint i = 0; i < count; i++)
+    {
+      JournalIndexEntry *entry = g_hash_table_lookup (journal->index, ids[i]);
+
+      ok = journal_record_encode (&rec, ids[i], entry->op, entry->ts,
+                                  0, error);
+
+      if (!ok)
+        return FALSE;
+
+      g_byte_array_append (buf, (const guint8 *) &rec, sizeof (rec));
+    }
+
+  ok = journal_replace (journal, buf->data, buf->len, error);
+
+  if (!ok)
+    return FALSE;
+
+  bolt_info (LOG_TOPIC ("journal"), "'%.13s' compacted: %u -> %u entries, "
+             "%u segments dropped", journal->name, total, count,
+             journal->segments->len);
+
+  journal_segments_drop (journal);
+
+  journal->snap_len = count;
+  journal->tail_len = 0;
+  journal->active_since = 0;
+
+  return TRUE;
+}
+
+static void
+journal_maybe_rotate (BoltJournal *journal)
+{
+  g_autoptr(GError) err = NULL;
+  gboolean rotate = FALSE;
+  gboolean ok;
+
+  if (journal->format != JOURNAL_BINARY || journal->tail_len == 0)
+    return;
+
+  /* a checkpoint does not count, it would otherwise
+   * lead to constant rotation for big snapshots */
+  if (journal->max_size > 0)
+    rotate = journal->tail_len * sizeof (JournalRecord) >= journal->max_size;
+
+  if (journal->max_age > 0 && journal->active_since > 0)
+    {
+      guint64 now = (guint64) g_get_real_time ();
+      guint64 age = now > journal->active_since ? now - journal->active_since : 0;
+
+      rotate = rotate || age / G_USEC_PER_SEC >= journal->max_age;
+    }
+
+  if (!rotate)
+    return;
+
+  ok = journal_rotate (journal, &err);
+
+  if (!ok)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("journal"), "could not rotate journal");
+      return;
+    }
+
+  if (journal->segments->len <= JOURNAL_SEGMENTS_MAX)
+    return;
+
+  ok = journal_compact (journal, &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_TOPIC ("journal"), "could not compact journal");
+}
+
+static void
+journal_maybe_compact (BoltJournal *journal)
+{
+  g_autoptr(GError) err = NULL;
+  guint limit;
+  gboolean ok;
+
+  if (journal->format != JOURNAL_BINARY)
+    return;
+
+  limit = JOURNAL_COMPACT_RATIO * MAX (journal->snap_len, JOURNAL_COMPACT_MIN);
+
+  if (journal->tail_len < limit)
+    return;
+
+  ok = journal_compact (journal, &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_TOPIC ("journal"), "could not compact journal");
+}
+
+/* called after entries were added */
+static void
+journal_maintain (BoltJournal *journal)
+{
+  if (journal->active_since == 0 && journal->tail_len > 0)
+    journal->active_since = (guint64) g_get_real_time ();
+
+  journal_maybe_rotate (journal);
+  journal_maybe_compact (journal);
+}
+
+static gboolean
+journal_diff_op (int            opcode,
+                 BoltJournalOp *op,
+                 GError       **error)
+{
+  switch (opcode)
+    {
+    case '+':
+      *op = BOLT_JOURNAL_ADDED;
+      return TRUE;
+
+    case '-':
+      *op = BOLT_JOURNAL_REMOVED;
+      return TRUE;
+    }
+
+  g_set_error (error, BOLT_ERROR, BOLT_ERROR_FAILED,
+               "unsupported op-code in diff: %c", opcode);
+
+  return FALSE;
+}
+
+/* appends all the entries of the diff with one write */
+static gboolean
+journal_put_diff_binary (BoltJournal *journal,
+                         GHashTable  *diff,
+                         guint64      now,
+                         GError     **error)
+{
+  g_autoptr(GByteArray) buf = NULL;
+  g_autoptr(GError) err = NULL;
+  GHashTableIter iter;
+  gpointer key, val;
+  struct stat st;
+  gboolean ok;
+  guint n, k = 0;
+
+  n = g_hash_table_size (diff);
+
+  if (n == 0)
+    return TRUE;
+
+  buf = g_byte_array_sized_new (n * sizeof (JournalRecord));
+
+  g_hash_table_iter_init (&iter, diff);
+  while (g_hash_table_iter_next (&iter, &key, &val))
+    {
+      const char *uid = key;
+      JournalRecord rec;
+      BoltJournalOp op;
+      guint8 flags;
+
+      ok = journal_diff_op (GPOINTER_TO_INT (val), &op, error);
+
+      if (!ok)
+        return FALSE;
+
+      flags = ++k < n ? JR_FLAG_BATCH : 0;
+      ok = journal_record_encode (&rec, uid, op, now, flags, error);
+
+      if (!ok)
+        return FALSE;
+
+      g_byte_array_append (buf, (const guint8 *) &rec, sizeof (rec));
+    }
+
+  memset (&st, 0, sizeof (st));
+  ok = bolt_fstat (journal->fd, &st, &err);
+
+  if (ok)
+    ok = bolt_write_all (journal->fd, buf->data, buf->len, &err);
+
+  if (!ok)
+    {
+      /* don't leave a partial diff behind */
+      if (st.st_size > 0)
+        (void) bolt_ftruncate (journal->fd, st.st_size, NULL);
+
+      g_propagate_prefixed_error (error, g_steal_pointer (&err),
+                                  "could not add journal entries: ");
+      return FALSE;
+    }
+
+  journal->tail_len += n;
+
+  return journal_commit (journal, error);
+}
+
+/* text journals are copied, with the diff appended,
+ * and then atomically replaced */
+static gboolean
+journal_put_diff_text (BoltJournal *journal,
+                       GHashTable  *diff,
+                       guint64      now,
+                       GError     **error)
+{
+  g_autoptr(GError) err = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *base = NULL;
+  bolt_autoclose int fd = -1;
+  struct stat st;
+  GHashTableIter iter;
+  gpointer key, val;
+  gboolean ok = TRUE;
+
+  base = g_file_get_path (journal->path);
+  path = g_strdup_printf ("%s.lock", base);
+
+  fd = bolt_open (path,
+                  O_RDWR |  O_CREAT | O_CLOEXEC | O_TRUNC,
+                  0666,
+                  error);
+
+  if (fd < 0)
+    return FALSE;
+
+  memset (&st, 0, sizeof (st));
+  ok = bolt_fstat (journal->fd, &st, &err);
+  if (!ok)
+    {
+      g_propagate_prefixed_error (error, g_steal_pointer (&err),
+                                  "could not query journal: ");
+      return FALSE;
+    }
+
+  ok = bolt_lseek (journal->fd, 0, SEEK_SET, NULL, error);
+
+  if (ok)
+    ok = bolt_copy_bytes (journal->fd, fd, st.st_size, error);
+
+  g_hash_table_iter_init (&iter, diff);
+  while (ok && g_hash_table_iter_next (&iter, &key, &val))
+    {
+      const char *uid = key;
+      BoltJournalOp op;
+
+      ok = journal_diff_op (GPOINTER_TO_INT (val), &op, error);
+
+      if (ok)
+        ok = bolt_journal_write_entry (fd, journal->format,
+                                       uid, op, now,
+                                       error);
+    }
+
+  if (ok)
+    ok = bolt_fdatasync (fd, error);
+
+  if (ok)
+    ok = bolt_faddflags (fd, O_APPEND, error);
+
+  if (ok)
+    ok = bolt_rename (path, base, error);
+
+  if (ok)
+    bolt_swap (journal->fd, fd);
+
+  return ok;
+}
+
+/* public methods */
+
+BoltJournal *
+bolt_journal_new (GFile      *root,
+                  const char *name,
+                  GError    **error)
+{
+  return g_initable_new (BOLT_TYPE_JOURNAL,
+                         NULL, error,
+                         "root", root,
+                         "name", name,
+                         NULL);
+}
+
+gboolean
+bolt_journal_is_fresh (BoltJournal *journal)
+{
+  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), FALSE);
+
+  return journal->fresh;
+}
+
+void
+bolt_journal_set_commit_window (BoltJournal *journal,
+                                int          msec)
+{
+  g_return_if_fail (BOLT_IS_JOURNAL (journal));
+  g_return_if_fail (msec >= -1);
+
+  if (journal->commit_window == msec)
+    return;
+
+  journal->commit_window = msec;
+  g_object_notify_by_pspec (G_OBJECT (journal),
+                            journal_props[PROP_COMMIT_WINDOW]);
+}
+
+void
+bolt_journal_set_limits (BoltJournal *journal,
+                         guint64      max_size,
+                         guint64      max_age)
+{
+  g_return_if_fail (BOLT_IS_JOURNAL (journal));
+
+  g_object_freeze_notify (G_OBJECT (journal));
+
+  if (journal->max_size != max_size)
+    {
+      journal->max_size = max_size;
+      g_object_notify_by_pspec (G_OBJECT (journal),
+                                journal_props[PROP_MAX_SIZE]);
+    }
+
+  if (journal->max_age != max_age)
+    {
+      journal->max_age = max_age;
+      g_object_notify_by_pspec (G_OBJECT (journal),
+                                journal_props[PROP_MAX_AGE]);
+    }
+
+  g_object_thaw_notify (G_OBJECT (journal));
+}
+
+gboolean
+bolt_journal_put (BoltJournal  *journal,
+                  const char   *id,
+                  BoltJournalOp op,
+                  GError      **error)
+{
+  g_autoptr(GError) err = NULL;
+  gboolean ok;
+  guint64 now;
+
+  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), FALSE);
+  g_return_val_if_fail (id != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-      if (l == NULL)
-        {
-          if (err)
-            bolt_warn_err (err, LOG_TOPIC ("journal"),
-                           "error reading from journal");
-          break;
-        }
+  now = (guint64) g_get_real_time ();
+  ok = journal_prepare_write (journal, journal_id_supported (id), error);
 
-      n = sscanf (l, "%ms %ms %016" G_GINT64_MODIFIER "X",
-                  &name, &opstr, &ts);
+  if (ok)
+    ok = bolt_journal_write_entry (journal->fd, journal->format,
+                                   id, op, now,
+                                   error);
 
-      if (n != 3)
-        {
-          bolt_warn (LOG_TOPIC ("journal"), "invalid entry: '%s'", l);
-          continue;
-        }
+  if (!ok)
+    return FALSE;
 
-      op = bolt_journal_op_from_string (opstr, &err);
+  journal->fresh = FALSE;
+  journal->tail_len++;
+  journal_index_update (journal, id, op, now);
 
-      if (err != NULL)
-        {
-          bolt_warn_err (err, LOG_TOPIC ("journal"),
-                         "skipping entry '%s'", l);
-          continue;
-        }
+  if (journal->commit_window > -1)
+    {
+      journal_commit_schedule (journal);
+    }
+  else
+    {
+      ok = journal_commit (journal, &err);
+      if (!ok)
+        bolt_warn_err (err, LOG_TOPIC ("journal"),
+                       "could not flush (fdatasync) journal");
+    }
 
-      i = g_slice_new (BoltJournalItem);
-      i->id = g_strdup (name);
-      i->ts = ts;
-      i->op = op;
+  journal_maintain (journal);
 
-      g_ptr_array_add (res, i);
+  return TRUE;
+}
+
+void
+bolt_journal_put_async (BoltJournal        *journal,
+                        const char         *id,
+                        BoltJournalOp       op,
+                        GCancellable       *cancellable,
+                        GAsyncReadyCallback callback,
+                        gpointer            user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  GError *err = NULL;
+  gboolean ok;
+  guint64 now;
+
+  g_return_if_fail (BOLT_IS_JOURNAL (journal));
+  g_return_if_fail (id != NULL);
+
+  task = g_task_new (journal, cancellable, callback, user_data);
+  g_task_set_source_tag (task, bolt_journal_put_async);
+  g_task_set_check_cancellable (task, FALSE);
+
+  now = (guint64) g_get_real_time ();
+  ok = journal_prepare_write (journal, journal_id_supported (id), &err);
+
+  if (ok)
+    ok = bolt_journal_write_entry (journal->fd, journal->format,
+                                   id, op, now,
+                                   &err);
+
+  if (!ok)
+    {
+      g_task_return_error (task, err);
+      return;
+    }
+
+  journal->fresh = FALSE;
+  journal->tail_len++;
+  journal_index_update (journal, id, op, now);
+
+  if (journal->commit_queue == NULL)
+    journal->commit_queue = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_ptr_array_add (journal->commit_queue, g_steal_pointer (&task));
+  journal_commit_schedule (journal);
+
+  journal_maintain (journal);
+}
+
+gboolean
+bolt_journal_put_finish (BoltJournal  *journal,
+                         GAsyncResult *res,
+                         GError      **error)
+{
+  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), FALSE);
+  g_return_val_if_fail (g_task_is_valid (res, journal), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+gboolean
+bolt_journal_flush (BoltJournal *journal,
+                    GError     **error)
+{
+  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  return journal_commit_pending (journal, error);
+}
+
+gboolean
+bolt_journal_put_diff (BoltJournal *journal,
+                       GHashTable  *diff,
+                       GError     **error)
+{
+  GHashTableIter iter;
+  gpointer key, val;
+  gboolean ok;
+  guint64 now;
+
+  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), FALSE);
+  g_return_val_if_fail (diff != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  ok = journal_commit_pending (journal, error);
+
+  if (ok)
+    ok = journal_prepare_write (journal, journal_diff_supported (diff), error);
+
+  if (!ok)
+    return FALSE;
+
+  now = (guint64) g_get_real_time ();
+
+  if (journal->format == JOURNAL_BINARY)
+    ok = journal_put_diff_binary (journal, diff, now, error);
+  else
+    ok = journal_put_diff_text (journal, diff, now, error);
+
+  if (!ok)
+    return FALSE;
+
+  journal->fresh = FALSE;
+
+  /* same order as they were written */
+  g_hash_table_iter_init (&iter, diff);
+  while (g_hash_table_iter_next (&iter, &key, &val))
+    {
+      BoltJournalOp op = BOLT_JOURNAL_FAILED;
+
+      journal_diff_op (GPOINTER_TO_INT (val), &op, NULL);
+      journal_index_update (journal, key, op, now);
+    }
+
+  journal_maintain (journal);
+
+  return TRUE;
+}
+
+gboolean
+bolt_journal_compact (BoltJournal *journal,
+                      GError     **error)
+{
+  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (journal->format != JOURNAL_BINARY)
+    return TRUE;
+
+  return journal_compact (journal, error);
+}
+
+GPtrArray *
+bolt_journal_list (BoltJournal *journal,
+                   GError     **error)
+{
+  g_autoptr(BoltJournalIter) iter = NULL;
+  GPtrArray *res;
+  const char *id;
+  BoltJournalOp op;
+  guint64 ts;
+
+  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if (journal->format == JOURNAL_TEXT)
+    return journal_list_text (journal, error);
+
+  iter = bolt_journal_iter_new (journal, BOLT_JOURNAL_ITER_FORWARD, error);
+
+  if (iter == NULL)
+    return NULL;
+
+  res = g_ptr_array_new_full (iter->n, (GDestroyNotify) bolt_journal_item_free);
+
+  while (bolt_journal_iter_next (iter, &id, &op, &ts))
+    {
+      BoltJournalItem *item = g_slice_new (BoltJournalItem);
+
+      item->id = g_strdup (id);
+      item->op = op;
+      item->ts = ts;
+
+      g_ptr_array_add (res, item);
+    }
+
+  return res;
+}
+
+gboolean
+bolt_journal_lookup (BoltJournal   *journal,
+                     const char    *id,
+                     BoltJournalOp *op,
+                     guint64       *ts)
+{
+  JournalIndexEntry *entry;
+
+  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), FALSE);
+  g_return_val_if_fail (id != NULL, FALSE);
+
+  entry = g_hash_table_lookup (journal->index, id);
+
+  if (entry == NULL)
+    return FALSE;
+
+  if (op)
+    *op = entry->op;
+
+  if (ts)
+    *ts = entry->ts;
+
+  return TRUE;
+}
+
+GPtrArray *
+bolt_journal_list_latest (BoltJournal *journal)
+{
+  g_autofree const char **ids = NULL;
+  GPtrArray *res;
+  guint n;
+
+  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), NULL);
+
+  ids = journal_index_list (journal, &n);
+
+  res = g_ptr_array_new_full (n, (GDestroyNotify) bolt_journal_item_free);
+
+  for (guint i = 0; i < n; i++)
+    {
+      JournalIndexEntry *entry = g_hash_table_lookup (journal->index, ids[i]);
+      BoltJournalItem *item = g_slice_new (BoltJournalItem);
+
+      item->id = g_strdup (ids[i]);
+      item->op = entry->op;
+      item->ts = entry->ts;
+
+      g_ptr_array_add (res, item);
     }
 
   return res;
@@ -514,10 +2123,24 @@ bolt_journal_reset (BoltJournal *journal,
   g_return_val_if_fail (BOLT_IS_JOURNAL (journal), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  ok = bolt_ftruncate (journal->fd, 0, error);
+  ok = journal_commit_pending (journal, error);
+
+  if (ok)
+    ok = bolt_ftruncate (journal->fd, 0, error);
 
   if (ok)
-    journal->fresh = TRUE;
+    {
+      journal->fresh = TRUE;
+      journal->format = JOURNAL_EMPTY;
+      journal->snap_len = 0;
+      journal->tail_len = 0;
+      journal->active_since = 0;
+
+      g_hash_table_remove_all (journal->index);
+      journal->seq = 0;
+
+      journal_segments_drop (journal);
+    }
 
   return ok;
 }
@@ -586,3 +2209,196 @@ bolt_journal_item_free (BoltJournalItem *entry)
   g_free (entry->id);
   g_slice_free (BoltJournalItem, entry);
 }
+
+/* BoltJournalIter */
+static void
+journal_iter_add_map (BoltJournalIter *iter,
+                      GMappedFile     *map,
+                      const char      *what)
+{
+  const JournalHeader *hdr;
+  const char *data;
+  JournalSpan span;
+  gsize size;
+
+  data = g_mapped_file_get_contents (map);
+  size = g_mapped_file_get_length (map);
+
+  if (size < sizeof (JournalHeader))
+    return;
+
+  hdr = (const JournalHeader *) data;
+
+  if (memcmp (hdr->magic, JR_MAGIC, sizeof (hdr->magic)) != 0 ||
+      GUINT32_FROM_LE (hdr->version) != JR_VERSION ||
+      GUINT32_FROM_LE (hdr->recsize) != sizeof (JournalRecord))
+    {
+      bolt_warn (LOG_TOPIC ("journal"), "invalid entry: bad header in %s",
+                 what);
+      return;
+    }
+
+  span.n = (size - sizeof (JournalHeader)) / sizeof (JournalRecord);
+
+  if (size > sizeof (JournalHeader) + span.n * sizeof (JournalRecord))
+    bolt_warn (LOG_TOPIC ("journal"), "invalid entry: trailing data");
+
+  /* records are read directly from the mapping */
+  span.recs = (const JournalRecord *) (data + sizeof (JournalHeader));
+
+  g_ptr_array_add (iter->maps, g_mapped_file_ref (map));
+  g_array_append_val (iter->spans, span);
+  iter->n += span.n;
+}
+
+BoltJournalIter *
+bolt_journal_iter_new (BoltJournal             *journal,
+                       BoltJournalIterDirection direction,
+                       GError                 **error)
+{
+  g_autoptr(BoltJournalIter) iter = NULL;
+  g_autoptr(GMappedFile) map = NULL;
+
+  g_return_val_if_fail (BOLT_IS_JOURNAL (journal), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  iter = g_new0 (BoltJournalIter, 1);
+  iter->journal = g_object_ref (journal);
+  iter->reverse = direction == BOLT_JOURNAL_ITER_REVERSE;
+
+  if (journal->format == JOURNAL_TEXT)
+    {
+      /* legacy, converted on the first write */
+      iter->items = journal_list_text (journal, error);
+
+      if (iter->items == NULL)
+        return NULL;
+
+      iter->n = iter->items->len;
+      return g_steal_pointer (&iter);
+    }
+
+  iter->maps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_mapped_file_unref);
+  iter->spans = g_array_new (FALSE, FALSE, sizeof (JournalSpan));
+
+  for (guint i = 0; i < journal->segments->len; i++)
+    {
+      g_autoptr(GMappedFile) seg = NULL;
+      g_autoptr(GError) err = NULL;
+      g_autofree char *path = NULL;
+      guint num = g_array_index (journal->segments, guint, i);
+
+      path = journal_segment_path (journal, num);
+      seg = g_mapped_file_new (path, FALSE, &err);
+
+      if (seg == NULL)
+        {
+          bolt_warn_err (err, LOG_TOPIC ("journal"),
+                         "could not read segment %u", num);
+          continue;
+        }
+
+      journal_iter_add_map (iter, seg, path);
+    }
+
+  if (journal->format == JOURNAL_EMPTY)
+    return g_steal_pointer (&iter);
+
+  map = g_mapped_file_new_from_fd (journal->fd, FALSE, error);
+
+  if (map == NULL)
+    return NULL;
+
+  journal_iter_add_map (iter, map, journal->name);
+
+  return g_steal_pointer (&iter);
+}
+
+gboolean
+bolt_journal_iter_next (BoltJournalIter *iter,
+                        const char     **id,
+                        BoltJournalOp   *op,
+                        guint64         *ts)
+{
+  g_return_val_if_fail (iter != NULL, FALSE);
+
+  while (iter->pos < iter->n)
+    {
+      g_autoptr(GError) err = NULL;
+      const JournalRecord *rec = NULL;
+      BoltJournalOp o;
+      gboolean ok;
+      guint64 t;
+      gsize idx;
+      gsize k;
+
+      idx = iter->reverse ? iter->n - 1 - iter->pos : iter->pos;
+      iter->pos++;
+
+      if (iter->items != NULL)
+        {
+          BoltJournalItem *item = g_ptr_array_index (iter->items, idx);
+
+          if (id)
+            *id = item->id;
+          if (op)
+            *op = item->op;
+          if (ts)
+            *ts = item->ts;
+
+          return TRUE;
+        }
+
+      k = idx;
+      for (guint i = 0; i < iter->spans->len; i++)
+        {
+          JournalSpan *span = &g_array_index (iter->spans, JournalSpan, i);
+
+          if (k < span->n)
+            {
+              rec = span->recs + k;
+              break;
+            }
+
+          k -= span->n;
+        }
+
+      g_assert (rec != NULL);
+
+      if (rec->flags & JR_FLAG_CHECKPOINT)
+        continue;
+
+      ok = journal_record_decode (rec, iter->id, &o, &t, &err);
+
+      if (!ok)
+        {
+          bolt_warn_err (err, LOG_TOPIC ("journal"),
+                         "invalid entry at %" G_GSIZE_FORMAT, idx);
+          continue;
+        }
+
+      if (id)
+        *id = iter->id;
+      if (op)
+        *op = o;
+      if (ts)
+        *ts = t;
+
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+void
+bolt_journal_iter_free (BoltJournalIter *iter)
+{
+  if (iter == NULL)
+    return;
+
+  g_clear_pointer (&iter->items, g_ptr_array_unref);
+  g_clear_pointer (&iter->spans, g_array_unref);
+  g_clear_pointer (&iter->maps, g_ptr_array_unref);
+  g_clear_object (&iter->journal);
+  g_free (iter);
+}
@@ -35,6 +35,13 @@ typedef enum BoltJournalOp {
   BOLT_JOURNAL_REMOVED   =  '-',
 } BoltJournalOp;
 
+typedef enum BoltJournalIterDirection {
+  BOLT_JOURNAL_ITER_FORWARD,
+  BOLT_JOURNAL_ITER_REVERSE,
+} BoltJournalIterDirection;
+
+typedef struct _BoltJournalIter BoltJournalIter;
+
 typedef struct BoltJournalItem
 {
   char         *id;
@@ -48,18 +55,53 @@ BoltJournal *      bolt_journal_new (GFile      *root,
 
 gboolean           bolt_journal_is_fresh (BoltJournal *journal);
 
+/* max_size in bytes, max_age in seconds, 0 for no limit */
+void               bolt_journal_set_limits (BoltJournal *journal,
+                                            guint64      max_size,
+                                            guint64      max_age);
+
+/* journals in the binary format only accept ids that are
+ * canonical uuids or at most 16 bytes long; other ids keep
+ * (or make) a text journal, see bolt-journal.c */
 gboolean           bolt_journal_put (BoltJournal  *journal,
                                      const char   *id,
                                      BoltJournalOp op,
                                      GError      **error);
 
+void               bolt_journal_set_commit_window (BoltJournal *journal,
+                                                   int          msec);
+
+void               bolt_journal_put_async (BoltJournal        *journal,
+                                           const char         *id,
+                                           BoltJournalOp       op,
+                                           GCancellable       *cancellable,
+                                           GAsyncReadyCallback callback,
+                                           gpointer            user_data);
+
+gboolean           bolt_journal_put_finish (BoltJournal  *journal,
+                                            GAsyncResult *res,
+                                            GError      **error);
+
+gboolean           bolt_journal_flush (BoltJournal *journal,
+                                       GError     **error);
+
 gboolean           bolt_journal_put_diff (BoltJournal *journal,
                                           GHashTable  *diff,
                                           GError     **error);
 
+gboolean           bolt_journal_compact (BoltJournal *journal,
+                                         GError     **error);
+
 GPtrArray *        bolt_journal_list (BoltJournal *journal,
                                       GError     **error);
 
+gboolean           bolt_journal_lookup (BoltJournal   *journal,
+                                        const char    *id,
+                                        BoltJournalOp *op,
+                                        guint64       *ts);
+
+GPtrArray *        bolt_journal_list_latest (BoltJournal *journal);
+
 gboolean           bolt_journal_reset (BoltJournal *journal,
                                        GError     **error);
 
@@ -70,3 +112,17 @@ BoltJournalOp     bolt_journal_op_from_string (const char *data,
                                                GError    **error);
 /* BoltJournalItem */
 void               bolt_journal_item_free (BoltJournalItem *entry);
+
+/* BoltJournalIter */
+BoltJournalIter *  bolt_journal_iter_new (BoltJournal             *journal,
+                                          BoltJournalIterDirection direction,
+                                          GError                 **error);
+
+gboolean           bolt_journal_iter_next (BoltJournalIter *iter,
+                                           const char     **id,
+                                           BoltJournalOp   *op,
+                                           guint64         *ts);
+
+void               bolt_journal_iter_free (BoltJournalIter *iter);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (BoltJournalIter, bolt_journal_iter_free);
@@ -27,6 +27,7 @@
 #include "bolt-error.h"
 #include "bolt-log.h"
 #include "bolt-power.h"
+#include "bolt-registry.h"
 #include "bolt-store.h"
 #include "bolt-str.h"
 #include "bolt-sysfs.h"
@@ -40,6 +41,10 @@
 
 #define MSEC_PER_USEC 1000LL
 #define PROBING_SETTLE_TIME_MS 2000 /* in milli-seconds */
+#define UEVENT_WINDOW_MS 20 /* in milli-seconds */
+#define POWER_WAIT_TIME_MS 5000 /* in milli-seconds */
+#define RATE_LIMIT 100 /* calls per second and client */
+#define RATE_LIMIT_BURST 200
 
 typedef struct udev_device udev_device;
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (udev_device, udev_device_unref);
@@ -55,6 +60,8 @@ static gboolean bolt_manager_initialize (GInitable    *initable,
 /* internal manager functions */
 static void          manager_sd_notify_status (BoltManager *mgr);
 
+static void          manager_store_commit (BoltManager *mgr);
+
 /* domain related functions */
 static gboolean      manager_load_domains (BoltManager *mgr,
                                            GError     **error);
@@ -87,6 +94,8 @@ static void          manager_deregister_device (BoltManager *mgr,
 static BoltDevice *  manager_find_device_by_syspath (BoltManager *mgr,
                                                      const char  *sysfs);
 
+static void          manager_prepare_managed_objects (BoltExported *exported);
+
 static BoltDevice *  manager_find_device_by_uid (BoltManager *mgr,
                                                  const char  *uid,
                                                  GError     **error);
@@ -167,11 +176,16 @@ static void          manager_probing_device_removed (BoltManager        *mgr,
 static void          manager_probing_domain_added (BoltManager        *mgr,
                                                    struct udev_device *domain);
 
+typedef struct ProbingRoot ProbingRoot;
+
 static void          manager_probing_activity (BoltManager *mgr,
+                                               ProbingRoot *root,
                                                gboolean     weak);
 
 /* force powering */
-static BoltPowerGuard *  manager_maybe_power_controller (BoltManager *mgr);
+static void          manager_maybe_power_controller (BoltManager *mgr);
+
+static void          manager_power_domain_added (BoltManager *mgr);
 
 /* config */
 static void          manager_load_user_config (BoltManager *mgr);
@@ -198,20 +212,35 @@ static GVariant *  handle_list_devices (BoltExported          *object,
                                         GDBusMethodInvocation *invocation,
                                         GError               **error);
 
+static GVariant *  handle_list_devices_paged (BoltExported          *object,
+                                              GVariant              *params,
+                                              GDBusMethodInvocation *invocation,
+                                              GError               **error);
+
+static GVariant *  handle_list_devices_with_properties (BoltExported          *object,
+                                                        GVariant              *params,
+                                                        GDBusMethodInvocation *invocation,
+                                                        GError               **error);
+
+static GVariant *  handle_get_topology (BoltExported          *object,
+                                        GVariant              *params,
+                                        GDBusMethodInvocation *inv,
+                                        GError               **error);
+
 static GVariant *  handle_device_by_uid (BoltExported          *object,
                                          GVariant              *params,
                                          GDBusMethodInvocation *invocation,
                                          GError               **error);
 
-static GVariant *  handle_enroll_device (BoltExported          *object,
+static void        handle_enroll_device (BoltExported          *object,
                                          GVariant              *params,
                                          GDBusMethodInvocation *invocation,
-                                         GError               **error);
+                                         GTask                 *task);
 
-static GVariant *  handle_forget_device (BoltExported          *object,
+static void        handle_forget_device (BoltExported          *object,
                                          GVariant              *params,
                                          GDBusMethodInvocation *invocation,
-                                         GError               **error);
+                                         GTask                 *task);
 
 /*  */
 struct _BoltManager
@@ -224,7 +253,7 @@ struct _BoltManager
   /* state */
   BoltStore   *store;
   BoltDomain  *domains;
-  GPtrArray   *devices;
+  BoltRegistry *devices;
   BoltPower   *power;
   BoltSecurity security;
   BoltAuthMode authmode;
@@ -236,14 +265,47 @@ struct _BoltManager
   GKeyFile  *config;
   BoltPolicy policy;          /* default enrollment policy, unless specified */
 
+  /* cached object path lists ("ao"), NULL if invalid */
+  GVariant *list_devices;
+  GVariant *list_domains;
+
+  /* uids of all devices in listing order, NULL if invalid:
+   * unstored ones in registry order, then stored ones by uid */
+  GPtrArray *list_uids;
+
   /* probing indicator  */
   guint      authorizing;     /* number of devices currently authorizing */
-  GPtrArray *probing_roots;   /* pci device tree root */
-  guint      probing_timeout; /* signal id & indicator */
+  GPtrArray *probing_roots;   /* ProbingRoot, pci device tree root */
+  gboolean   probing;         /* indicator */
+  guint      probing_timeout; /* deadline, armed after the last activity */
+  gint64     probing_tstart;  /* time stamp of the first activity */
   gint64     probing_tstamp;  /* time stamp of last activity */
   guint      probing_tsettle; /* how long to indicate after the last activity */
+
+  /* force power at startup */
+  BoltPowerGuard *power_guard; /* held until the domain is up */
+  guint           power_timeout;
+};
+
+struct ProbingRoot
+{
+  char   *syspath;
+
+  gint64  tstart;   /* first activity, 0 if settled */
+  gint64  tlast;    /* last activity */
+  guint64 duration; /* of the last probe, in ms */
+  guint   probes;   /* number of settled probes */
 };
 
+static void
+probing_root_free (gpointer data)
+{
+  ProbingRoot *root = data;
+
+  g_free (root->syspath);
+  g_slice_free (ProbingRoot, root);
+}
+
 enum {
   PROP_0,
 
@@ -253,6 +315,7 @@ enum {
   PROP_SECURITY,
   PROP_AUTHMODE,
   PROP_POWERSTATE,
+  PROP_PROBE_DURATIONS,
 
   PROP_LAST,
   PROP_EXPORTED = PROP_VERSION
@@ -282,8 +345,20 @@ bolt_manager_finalize (GObject *object)
 
   g_clear_pointer (&mgr->probing_roots, g_ptr_array_unref);
 
+  if (mgr->power_timeout)
+    {
+      g_source_remove (mgr->power_timeout);
+      mgr->power_timeout = 0;
+    }
+
+  g_clear_object (&mgr->power_guard);
+
+  g_clear_pointer (&mgr->list_devices, g_variant_unref);
+  g_clear_pointer (&mgr->list_domains, g_variant_unref);
+  g_clear_pointer (&mgr->list_uids, g_ptr_array_unref);
+
   g_clear_object (&mgr->store);
-  g_ptr_array_free (mgr->devices, TRUE);
+  g_clear_object (&mgr->devices);
   bolt_domain_clear (&mgr->domains);
 
   g_clear_object (&mgr->power);
@@ -308,7 +383,7 @@ bolt_manager_get_property (GObject    *object,
       break;
 
     case PROP_PROBING:
-      g_value_set_boolean (value, mgr->probing_timeout > 0);
+      g_value_set_boolean (value, mgr->probing);
       break;
 
     case PROP_POLICY:
@@ -327,6 +402,10 @@ bolt_manager_get_property (GObject    *object,
       g_value_set_enum (value, bolt_power_get_state (mgr->power));
       break;
 
+    case PROP_PROBE_DURATIONS:
+      g_value_take_variant (value, bolt_manager_get_probe_durations (mgr));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -335,10 +414,10 @@ bolt_manager_get_property (GObject    *object,
 static void
 bolt_manager_init (BoltManager *mgr)
 {
-  mgr->devices = g_ptr_array_new_with_free_func (g_object_unref);
+  mgr->devices = bolt_registry_new ();
   mgr->store = bolt_store_new (bolt_get_store_path ());
 
-  mgr->probing_roots = g_ptr_array_new_with_free_func (g_free);
+  mgr->probing_roots = g_ptr_array_new_with_free_func (probing_root_free);
   mgr->probing_tsettle = PROBING_SETTLE_TIME_MS; /* milliseconds */
 
   mgr->security = BOLT_SECURITY_UNKNOWN;
@@ -346,6 +425,7 @@ bolt_manager_init (BoltManager *mgr)
   /* default configuration */
   mgr->policy = BOLT_POLICY_AUTO;
   mgr->authmode = BOLT_AUTH_ENABLED;
+  bolt_exported_set_rate_limit (RATE_LIMIT, RATE_LIMIT_BURST);
 
   g_signal_connect_object (mgr->store, "device-added",
                            G_CALLBACK (handle_store_device_added),
@@ -365,6 +445,8 @@ bolt_manager_class_init (BoltManagerClass *klass)
   gobject_class->finalize = bolt_manager_finalize;
   gobject_class->get_property = bolt_manager_get_property;
 
+  exported_class->prepare_managed_objects = manager_prepare_managed_objects;
+
   props[PROP_VERSION] =
     g_param_spec_uint ("version", "Version", "Version",
                        0, G_MAXUINT32, 0,
@@ -405,6 +487,13 @@ bolt_manager_class_init (BoltManagerClass *klass)
                        G_PARAM_READABLE |
                        G_PARAM_STATIC_STRINGS);
 
+  props[PROP_PROBE_DURATIONS] =
+    g_param_spec_variant ("probe-durations", "ProbeDurations", NULL,
+                          G_VARIANT_TYPE ("a{st}"),
+                          NULL,
+                          G_PARAM_READABLE |
+                          G_PARAM_STATIC_STRINGS);
+
   g_object_class_install_properties (gobject_class, PROP_LAST, props);
 
 
@@ -434,16 +523,28 @@ bolt_manager_class_init (BoltManagerClass *klass)
                                      handle_list_devices);
 
   bolt_exported_class_export_method (exported_class,
-                                     "DeviceByUid",
-                                     handle_device_by_uid);
+                                     "ListDevicesPaged",
+                                     handle_list_devices_paged);
 
   bolt_exported_class_export_method (exported_class,
-                                     "EnrollDevice",
-                                     handle_enroll_device);
+                                     "ListDevicesWithProperties",
+                                     handle_list_devices_with_properties);
 
   bolt_exported_class_export_method (exported_class,
-                                     "ForgetDevice",
-                                     handle_forget_device);
+                                     "GetTopology",
+                                     handle_get_topology);
+
+  bolt_exported_class_export_method (exported_class,
+                                     "DeviceByUid",
+                                     handle_device_by_uid);
+
+  bolt_exported_class_export_async_method (exported_class,
+                                           "EnrollDevice",
+                                           handle_enroll_device);
+
+  bolt_exported_class_export_async_method (exported_class,
+                                           "ForgetDevice",
+                                           handle_forget_device);
 }
 
 static void
@@ -457,7 +558,6 @@ bolt_manager_initialize (GInitable    *initable,
                          GCancellable *cancellable,
                          GError      **error)
 {
-  g_autoptr(BoltPowerGuard) power = NULL;
   BoltManager *mgr;
   struct udev_enumerate *enumerate;
   struct udev_list_entry *l, *devices;
@@ -482,6 +582,9 @@ bolt_manager_initialize (GInitable    *initable,
   if (mgr->udev == NULL)
     return FALSE;
 
+  /* coalesce the burst of uevents when a chain is plugged */
+  bolt_udev_set_window (mgr->udev, UEVENT_WINDOW_MS);
+
   g_signal_connect_object (mgr->udev, "uevent",
                            (GCallback) handle_uevent_udev,
                            mgr, 0);
@@ -502,12 +605,9 @@ bolt_manager_initialize (GInitable    *initable,
                            G_CALLBACK (handle_power_state_changed),
                            mgr, 0);
 
-  /* if we don't see any tb device, we try to force power */
-  power = manager_maybe_power_controller (mgr);
-
-  if (power != NULL)
-    bolt_info (LOG_TOPIC ("manager"), "acquired power guard '%s'",
-               bolt_power_guard_get_id (power));
+  /* if we don't see any tb device, we try to force power;
+   * the domain will then be picked up via its uevent */
+  manager_maybe_power_controller (mgr);
 
   /* TODO: error checking */
   enumerate =  bolt_udev_new_enumerate (mgr->udev, NULL);
@@ -518,6 +618,9 @@ bolt_manager_initialize (GInitable    *initable,
   udev_enumerate_scan_devices (enumerate);
   devices = udev_enumerate_get_list_entry (enumerate);
 
+  /* domains and imported devices are stored in one go */
+  bolt_store_begin (mgr->store);
+
   udev_list_entry_foreach (l, devices)
     {
       g_autoptr(GError) err = NULL;
@@ -549,12 +652,27 @@ bolt_manager_initialize (GInitable    *initable,
 
   udev_enumerate_unref (enumerate);
 
+  manager_store_commit (mgr);
+
   manager_sd_notify_status (mgr);
 
   return TRUE;
 }
 
 /* internal functions */
+static void
+manager_store_commit (BoltManager *mgr)
+{
+  g_autoptr(GError) err = NULL;
+  gboolean ok;
+
+  ok = bolt_store_commit (mgr->store, &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_TOPIC ("store"),
+                   "failed to commit changes");
+}
+
 static void
 manager_sd_notify_status (BoltManager *mgr)
 {
@@ -654,6 +772,7 @@ static void
 manager_bootacl_inital_sync (BoltManager *mgr,
                              BoltDomain  *domain)
 {
+  g_autoptr(GPtrArray) entries = NULL;
   g_autoptr(GError) err = NULL;
   g_auto(GStrv) acl = NULL;
   gboolean ok;
@@ -674,13 +793,16 @@ manager_bootacl_inital_sync (BoltManager *mgr,
   bolt_info (LOG_TOPIC ("bootacl"), LOG_DOM (domain),
              "sync start [slots: %u free: %u]", n, empty);
 
-  for (guint i = 0; i < mgr->devices->len; i++)
+  /* only stored devices can have the 'auto' policy */
+  entries = bolt_store_list_entries (mgr->store);
+
+  for (guint i = 0; i < entries->len; i++)
     {
-      BoltDevice *dev = g_ptr_array_index (mgr->devices, i);
-      const char *duid = bolt_device_get_uid (dev);
+      BoltStoreEntry *entry = g_ptr_array_index (entries, i);
+      const char *duid = entry->uid;
       gboolean polok, inacl, sync;
 
-      polok = bolt_device_get_policy (dev) == BOLT_POLICY_AUTO;
+      polok = entry->policy == BOLT_POLICY_AUTO;
       inacl = bolt_domain_bootacl_contains (domain, duid);
       sync = polok && !inacl;
 
@@ -710,6 +832,22 @@ manager_bootacl_inital_sync (BoltManager *mgr,
              bolt_yesno (ok), empty);
 }
 
+static void
+manager_domain_stored (GObject      *store,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+  g_autoptr(BoltDomain) domain = user_data;
+  g_autoptr(GError) err = NULL;
+  gboolean ok;
+
+  ok = bolt_store_put_domain_finish (BOLT_STORE (store), res, &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_TOPIC ("store"), LOG_DOM (domain),
+                   "could not store domain");
+}
+
 static BoltDomain *
 manager_domain_ensure (BoltManager        *mgr,
                        struct udev_device *dev)
@@ -725,7 +863,6 @@ manager_domain_ensure (BoltManager        *mgr,
   const char *op;
   const char *uid;
   gboolean iommu;
-  gboolean ok;
 
   /* check if we already know a domain that is the parent
    * of the device (dev); if not then 'dev' is very likely
@@ -785,15 +922,20 @@ manager_domain_ensure (BoltManager        *mgr,
   /* registering the domain will add one reference */
   g_object_unref (domain);
 
-  /* add all devices with POLICY_AUTO to the bootacl */
+  /* add all devices with POLICY_AUTO to the bootacl; the
+   * domain is not stored yet, so this does not write */
   manager_bootacl_inital_sync (mgr, domain);
 
   /* now store the domain (with an updated bootacl) */
   bolt_info (LOG_TOPIC ("store"), LOG_DOM (domain),
              "storing newly connected domain");
 
-  ok = bolt_store_put_domain (mgr->store, domain, &err);
-  if (!ok)
+  /* during startup, this is part of the enumeration transaction */
+  if (!bolt_store_in_transaction (mgr->store))
+    bolt_store_put_domain_async (mgr->store, domain, NULL,
+                                 manager_domain_stored,
+                                 g_object_ref (domain));
+  else if (!bolt_store_put_domain (mgr->store, domain, &err))
     bolt_warn_err (err, LOG_TOPIC ("store"), LOG_DOM (domain),
                    "could not store domain");
 
@@ -884,6 +1026,19 @@ bootacl_alloc (BoltDomain  *domain,
 }
 
 
+static void
+handle_object_path_changed (GObject    *gobject,
+                            GParamSpec *pspec,
+                            gpointer    user_data)
+{
+  BoltManager *mgr = BOLT_MANAGER (user_data);
+
+  if (BOLT_IS_DOMAIN (gobject))
+    g_clear_pointer (&mgr->list_domains, g_variant_unref);
+  else
+    g_clear_pointer (&mgr->list_devices, g_variant_unref);
+}
+
 static void
 manager_register_domain (BoltManager *mgr,
                          BoltDomain  *domain)
@@ -891,6 +1046,7 @@ manager_register_domain (BoltManager *mgr,
   guint n_slots, n_free;
 
   mgr->domains = bolt_domain_insert (mgr->domains, domain);
+  g_clear_pointer (&mgr->list_domains, g_variant_unref);
 
   n_slots = bolt_domain_bootacl_slots (domain, &n_free);
 
@@ -904,6 +1060,10 @@ manager_register_domain (BoltManager *mgr,
   g_signal_connect_object (domain, "notify::security",
                            G_CALLBACK (handle_domain_security_changed),
                            mgr, G_CONNECT_SWAPPED);
+
+  g_signal_connect_object (domain, "notify::object-path",
+                           G_CALLBACK (handle_object_path_changed),
+                           mgr, 0);
 }
 
 static void
@@ -916,6 +1076,7 @@ manager_deregister_domain (BoltManager *mgr,
   bolt_info (LOG_TOPIC ("domain"), "'%s' removed", name);
 
   mgr->domains = bolt_domain_remove (mgr->domains, domain);
+  g_clear_pointer (&mgr->list_domains, g_variant_unref);
 }
 
 /* device related functions */
@@ -923,35 +1084,26 @@ static gboolean
 manager_load_devices (BoltManager *mgr,
                       GError     **error)
 {
-  g_auto(GStrv) ids = NULL;
+  gint64 start;
+  gboolean ok;
 
-  ids = bolt_store_list_uids (mgr->store, "devices", error);
-  if (ids == NULL)
+  bolt_info (LOG_TOPIC ("store"), "loading devices");
+  start = g_get_monotonic_time ();
+
+  /* Only the index of the stored devices is loaded; the
+   * device objects are created on demand, i.e. when the
+   * device is connected, looked up by its uid or when all
+   * devices are listed, see manager_materialize_device */
+  ok = bolt_store_load_index (mgr->store, error);
+  if (!ok)
     {
-      g_prefix_error (error, "failed to list devices in store: ");
+      g_prefix_error (error, "failed to load devices from store: ");
       return FALSE;
     }
 
-  bolt_info (LOG_TOPIC ("store"), "loading devices");
-  for (guint i = 0; i < g_strv_length (ids); i++)
-    {
-      g_autoptr(GError) err = NULL;
-      BoltDevice *dev = NULL;
-      const char *uid = ids[i];
-
-      bolt_info (LOG_DEV_UID (uid), LOG_TOPIC ("store"), "loading device");
-
-      dev = bolt_store_get_device (mgr->store, uid, &err);
-      if (dev == NULL)
-        {
-          bolt_warn_err (err, LOG_TOPIC ("store"),
-                         LOG_DIRECT (BOLT_LOG_DEVICE_UID, uid),
-                         "failed to load device (%.7s)", uid);
-          continue;
-        }
-
-      manager_register_device (mgr, dev);
-    }
+  bolt_info (LOG_TOPIC ("store"), "indexed %u devices in %" G_GINT64_FORMAT " ms",
+             bolt_store_count_devices (mgr->store),
+             (g_get_monotonic_time () - start) / 1000);
 
   return TRUE;
 }
@@ -960,39 +1112,210 @@ static void
 manager_register_device (BoltManager *mgr,
                          BoltDevice  *dev)
 {
-
-  g_ptr_array_add (mgr->devices, dev);
+  bolt_registry_add (mgr->devices, dev);
   bolt_bouncer_add_client (mgr->bouncer, dev);
   g_signal_connect_object (dev, "status-changed",
                            G_CALLBACK (handle_device_status_changed),
                            mgr, 0);
+
+  g_signal_connect_object (dev, "notify::object-path",
+                           G_CALLBACK (handle_object_path_changed),
+                           mgr, 0);
+
+  g_clear_pointer (&mgr->list_devices, g_variant_unref);
+
+  /* stored devices are already listed via the store index */
+  if (!bolt_device_get_stored (dev))
+    g_clear_pointer (&mgr->list_uids, g_ptr_array_unref);
+
+  /* the registry holds its own reference */
+  g_object_unref (dev);
 }
 
 static void
 manager_deregister_device (BoltManager *mgr,
                            BoltDevice  *dev)
 {
-  g_ptr_array_remove_fast (mgr->devices, dev);
+  bolt_registry_remove (mgr->devices, dev);
+  g_clear_pointer (&mgr->list_devices, g_variant_unref);
+  g_clear_pointer (&mgr->list_uids, g_ptr_array_unref);
+}
+
+static void
+manager_export_device (BoltManager *mgr,
+                       BoltDevice  *dev)
+{
+  g_autoptr(GError) err = NULL;
+  GDBusConnection *bus;
+  const char *opath;
+
+  bus = bolt_exported_get_connection (BOLT_EXPORTED (mgr));
+  if (bus == NULL)
+    return;
+
+  opath = bolt_device_export (dev, bus, &err);
+  if (opath == NULL)
+    bolt_warn_err (err, LOG_DEV (dev), LOG_TOPIC ("dbus"),
+                   "error exporting a device");
+  else
+    bolt_debug (LOG_DEV (dev), LOG_TOPIC ("dbus"),
+                "exported device at %.43s...", opath);
 }
 
 static BoltDevice *
-manager_find_device_by_syspath (BoltManager *mgr,
-                                const char  *sysfs)
+manager_materialize_device (BoltManager *mgr,
+                            const char  *uid)
 {
+  g_autoptr(BoltStoreEntry) entry = NULL;
+  g_autoptr(GError) err = NULL;
+  BoltDevice *dev;
 
-  g_return_val_if_fail (sysfs != NULL, NULL);
+  entry = bolt_store_lookup_entry (mgr->store, uid);
+
+  if (entry == NULL)
+    return NULL;
+
+  dev = bolt_store_get_device (mgr->store, uid, &err);
 
-  for (guint i = 0; i < mgr->devices->len; i++)
+  if (dev == NULL)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("store"), LOG_DEV_UID (uid),
+                     "failed to load device (%.7s)", uid);
+      return NULL;
+    }
+
+  bolt_debug (LOG_DEV (dev), LOG_TOPIC ("store"), "materialized");
+
+  /* the registry now owns the reference */
+  manager_register_device (mgr, dev);
+  manager_export_device (mgr, dev);
+
+  return dev;
+}
+
+/* load and register all of 'uids' that are stored
+ * but not yet in the registry */
+static void
+manager_materialize_uids (BoltManager *mgr,
+                          char       **uids,
+                          guint        n)
+{
+  g_autoptr(GPtrArray) missing = NULL;
+  g_autoptr(GPtrArray) devs = NULL;
+
+  missing = g_ptr_array_sized_new (n + 1);
+
+  for (guint i = 0; i < n; i++)
+    if (bolt_registry_lookup_uid (mgr->devices, uids[i]) == NULL)
+      g_ptr_array_add (missing, uids[i]);
+
+  if (missing->len == 0)
+    return;
+
+  g_ptr_array_add (missing, NULL);
+
+  /* parsing is done in parallel, registering in order */
+  devs = bolt_store_get_devices (mgr->store, (const char **) missing->pdata);
+
+  for (guint i = 0; i < devs->len; i++)
     {
-      BoltDevice *dev = g_ptr_array_index (mgr->devices, i);
-      const char *have = bolt_device_get_syspath (dev);
+      BoltDevice *dev = g_ptr_array_index (devs, i);
+
+      manager_register_device (mgr, g_object_ref (dev));
+      manager_export_device (mgr, dev);
+    }
+
+  bolt_info (LOG_TOPIC ("store"), "materialized %u devices", devs->len);
+}
+
+static void
+manager_materialize_devices (BoltManager *mgr)
+{
+  g_autoptr(GPtrArray) entries = NULL;
+  g_autoptr(GPtrArray) uids = NULL;
 
-      if (bolt_streq (have, sysfs))
-        return g_object_ref (dev);
+  entries = bolt_store_list_entries (mgr->store);
+  uids = g_ptr_array_sized_new (entries->len);
 
+  for (guint i = 0; i < entries->len; i++)
+    {
+      BoltStoreEntry *entry = g_ptr_array_index (entries, i);
+      g_ptr_array_add (uids, entry->uid);
     }
 
-  return NULL;
+  manager_materialize_uids (mgr, (char **) uids->pdata, uids->len);
+}
+
+static gint
+manager_entry_cmp_uid (gconstpointer a,
+                       gconstpointer b)
+{
+  const BoltStoreEntry *ea = *((BoltStoreEntry **) a);
+  const BoltStoreEntry *eb = *((BoltStoreEntry **) b);
+
+  return g_strcmp0 (ea->uid, eb->uid);
+}
+
+/* the order is stable while stored devices get materialized,
+ * so that it can be paged over without loading all of them */
+static GPtrArray *
+manager_list_device_uids (BoltManager *mgr)
+{
+  g_autoptr(GPtrArray) entries = NULL;
+  GPtrArray *uids;
+  guint n;
+
+  if (mgr->list_uids != NULL)
+    return mgr->list_uids;
+
+  entries = bolt_store_list_entries (mgr->store);
+  n = bolt_registry_get_count (mgr->devices);
+
+  uids = g_ptr_array_new_full (entries->len + n, g_free);
+
+  for (guint i = 0; i < n; i++)
+    {
+      BoltDevice *d = bolt_registry_get_nth (mgr->devices, i);
+
+      if (!bolt_device_get_stored (d))
+        g_ptr_array_add (uids, g_strdup (bolt_device_get_uid (d)));
+    }
+
+  /* the index is a hash table, give the stored ones an order */
+  g_ptr_array_sort (entries, manager_entry_cmp_uid);
+
+  for (guint i = 0; i < entries->len; i++)
+    {
+      BoltStoreEntry *entry = g_ptr_array_index (entries, i);
+      g_ptr_array_add (uids, g_steal_pointer (&entry->uid));
+    }
+
+  mgr->list_uids = uids;
+  return uids;
+}
+
+static void
+manager_prepare_managed_objects (BoltExported *exported)
+{
+  /* stored devices are only exported once they are needed,
+   * GetManagedObjects must include them */
+  manager_materialize_devices (BOLT_MANAGER (exported));
+}
+
+static BoltDevice *
+manager_find_device_by_syspath (BoltManager *mgr,
+                                const char  *sysfs)
+{
+  BoltDevice *dev;
+
+  g_return_val_if_fail (sysfs != NULL, NULL);
+
+  dev = bolt_registry_lookup_syspath (mgr->devices, sysfs);
+
+  if (dev == NULL)
+    return NULL;
+
+  return g_object_ref (dev);
 }
 
 static BoltDevice *
@@ -1000,6 +1323,8 @@ manager_find_device_by_uid (BoltManager *mgr,
                             const char  *uid,
                             GError     **error)
 {
+  BoltDevice *dev;
+
   if (uid == NULL || uid[0] == '\0')
     {
       g_set_error_literal (error, G_IO_ERROR,
@@ -1008,14 +1333,13 @@ manager_find_device_by_uid (BoltManager *mgr,
       return NULL;
     }
 
-  for (guint i = 0; i < mgr->devices->len; i++)
-    {
-      BoltDevice *dev = g_ptr_array_index (mgr->devices, i);
+  dev = bolt_registry_lookup_uid (mgr->devices, uid);
 
-      if (bolt_streq (bolt_device_get_uid (dev), uid))
-        return g_object_ref (dev);
+  if (dev == NULL)
+    dev = manager_materialize_device (mgr, uid);
 
-    }
+  if (dev != NULL)
+    return g_object_ref (dev);
 
   g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
                "device with id '%s' could not be found.",
@@ -1029,48 +1353,21 @@ static BoltDevice *
 bolt_manager_get_parent (BoltManager *mgr,
                          BoltDevice  *dev)
 {
-  g_autofree char *path = NULL;
-  const char *syspath;
-  const char *start;
-  char *pos;
+  BoltDevice *parent;
 
-  syspath = bolt_device_get_syspath (dev);
-  if (syspath == NULL)
-    return NULL;
-
-  path = g_strdup (syspath);
-  start = path + strlen ("/sys");
+  parent = bolt_registry_get_parent (mgr->devices, dev);
 
-  pos = strrchr (start, '/');
-  if (!pos || pos < start + 2)
+  if (parent == NULL)
     return NULL;
 
-  *pos = '\0';
-
-  return manager_find_device_by_syspath (mgr, path);
+  return g_object_ref (parent);
 }
 
 static GPtrArray *
 bolt_manager_get_children (BoltManager *mgr,
                            BoltDevice  *target)
 {
-  GPtrArray *res;
-
-  res = g_ptr_array_new_with_free_func (g_object_unref);
-
-  for (guint i = 0; i < mgr->devices->len; i++)
-    {
-      g_autoptr(BoltDevice) parent = NULL;
-      BoltDevice *dev = g_ptr_array_index (mgr->devices, i);
-
-      parent = bolt_manager_get_parent (mgr, dev);
-      if (parent != target)
-        continue;
-
-      g_ptr_array_add (res, g_object_ref (dev));
-    }
-
-  return res;
+  return bolt_registry_get_children (mgr->devices, target);
 }
 
 static void
@@ -1080,7 +1377,7 @@ bolt_manager_label_device (BoltManager *mgr,
   g_autofree char *label = NULL;
   const char *name;
   const char *vendor;
-  guint count = 0;
+  guint count;
   static struct
   {
     const char *from;
@@ -1093,17 +1390,11 @@ bolt_manager_label_device (BoltManager *mgr,
   name = bolt_device_get_name (target);
   vendor = bolt_device_get_vendor (target);
 
-  /* we count how many duplicate devices we have */
-  for (guint i = 0; i < mgr->devices->len; i++)
-    {
-      BoltDevice *dev = g_ptr_array_index (mgr->devices, i);
-      const char *dev_name = bolt_device_get_name (dev);
-      const char *dev_vendor = bolt_device_get_vendor (dev);
-
-      if (bolt_streq (dev_name, name) &&
-          bolt_streq (dev_vendor, vendor))
-        count++;
-    }
+  /* we count how many duplicate devices we have; not all
+   * stored devices are materialized, so they are counted
+   * via the store index, the rest via the registry */
+  count = bolt_store_count_name (mgr->store, vendor, name) +
+          bolt_registry_count_name_unstored (mgr->devices, vendor, name);
 
   /* cleanup name: nicer display names for vendors  */
   for (guint i = 0; i < G_N_ELEMENTS (vendors); i++)
@@ -1231,11 +1522,26 @@ manager_auto_authorize (BoltManager *mgr,
   bolt_device_authorize_idle (dev, auth, auto_auth_done, mgr);
 }
 
+static void
+import_device_done (GObject      *store,
+                    GAsyncResult *res,
+                    gpointer      user_data)
+{
+  g_autoptr(BoltDevice) dev = user_data;
+  g_autoptr(GError) err = NULL;
+  gboolean ok;
+
+  ok = bolt_store_put_device_finish (BOLT_STORE (store), res, &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_DEV (dev), LOG_TOPIC ("import"),
+                   "failed to store device");
+}
+
 static void
 manager_maybe_import (BoltManager *mgr,
                       BoltDevice  *dev)
 {
-  g_autoptr(GError) err = NULL;
   g_autoptr(BoltKey) key = NULL;
   BoltSecurity level;
   BoltPolicy policy;
@@ -1245,7 +1551,6 @@ manager_maybe_import (BoltManager *mgr,
   gboolean boot, pcie;
   gboolean import;
   gboolean iommu;
-  gboolean ok;
 
   if (bolt_device_get_device_type (dev) == BOLT_DEVICE_HOST)
     return;
@@ -1287,34 +1592,66 @@ manager_maybe_import (BoltManager *mgr,
   if (!import)
     return;
 
-  ok = bolt_store_put_device (mgr->store,
-                              dev,
-                              policy,
-                              key, &
-                              err);
+  /* during startup all imports are part of the enumeration
+   * transaction, see bolt_manager_initialize, and thus are
+   * committed, and synced, in one go */
+  if (bolt_store_in_transaction (mgr->store))
+    {
+      g_autoptr(GError) err = NULL;
+      gboolean ok;
 
-  if (!ok)
-    bolt_warn_err (err, LOG_DEV (dev), LOG_TOPIC ("import"),
-                   "failed to store device");
+      ok = bolt_store_put_device (mgr->store, dev, policy, key, &err);
+
+      if (!ok)
+        bolt_warn_err (err, LOG_DEV (dev), LOG_TOPIC ("import"),
+                       "failed to store device");
+      return;
+    }
+
+  bolt_store_put_device_async (mgr->store,
+                               dev,
+                               policy,
+                               key,
+                               NULL,
+                               import_device_done,
+                               g_object_ref (dev));
 }
 
 static void
-auto_enroll_done (GObject      *device,
-                  GAsyncResult *res,
-                  gpointer      user_data)
+auto_enroll_stored (GObject      *store,
+                    GAsyncResult *res,
+                    gpointer      user_data)
 {
+  g_autoptr(BoltDevice) dev = user_data;
   g_autoptr(GError) err = NULL;
-  BoltDevice *dev = BOLT_DEVICE (device);
-  BoltAuth *auth = BOLT_AUTH (res);
-  BoltManager *mgr;
-  BoltPolicy policy;
-  BoltKey *key;
   gboolean ok;
 
-  mgr = BOLT_MANAGER (bolt_auth_get_origin (auth));
-  ok = bolt_auth_check (auth, &err);
+  ok = bolt_store_put_device_finish (BOLT_STORE (store), res, &err);
 
-  if (!ok)
+  if (ok)
+    bolt_msg (LOG_DEV (dev), LOG_TOPIC ("auto-enroll"), "done");
+  else
+    bolt_warn_err (err, LOG_DEV (dev), LOG_TOPIC ("auto-enroll"),
+                   "failed to store the device");
+}
+
+static void
+auto_enroll_done (GObject      *device,
+                  GAsyncResult *res,
+                  gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  BoltDevice *dev = BOLT_DEVICE (device);
+  BoltAuth *auth = BOLT_AUTH (res);
+  BoltManager *mgr;
+  BoltPolicy policy;
+  BoltKey *key;
+  gboolean ok;
+
+  mgr = BOLT_MANAGER (bolt_auth_get_origin (auth));
+  ok = bolt_auth_check (auth, &err);
+
+  if (!ok)
     {
       bolt_warn_err (err, LOG_DEV (dev), LOG_TOPIC ("auto-enroll"),
                      "failed to authorize the new device");
@@ -1324,13 +1661,13 @@ auto_enroll_done (GObject      *device,
   key = bolt_auth_get_key (auth);
   policy = bolt_auth_get_policy (auth);
 
-  ok = bolt_store_put_device (mgr->store, dev, policy, key, &err);
-
-  if (ok)
-    bolt_msg (LOG_DEV (dev), LOG_TOPIC ("auto-enroll"), "done");
-  else
-    bolt_warn_err (err, LOG_DEV (dev), LOG_TOPIC ("auto-enroll"),
-                   "failed to store the device");
+  bolt_store_put_device_async (mgr->store,
+                               dev,
+                               policy,
+                               key,
+                               NULL,
+                               auto_enroll_stored,
+                               g_object_ref (dev));
 }
 
 static BoltAuth *
@@ -1475,6 +1812,7 @@ handle_udev_domain_event (BoltManager        *mgr,
   if (g_str_equal (action, "add"))
     {
       manager_probing_domain_added (mgr, device);
+      manager_power_domain_added (mgr);
 
       /* the creation of the actual domain object and
        * its registration is handled on-demand: only
@@ -1833,6 +2171,8 @@ handle_store_device_added (BoltStore   *store,
   BoltDomain *dom = mgr->domains;
   BootaclCtx ctx = {mgr, uid};
 
+  g_clear_pointer (&mgr->list_uids, g_ptr_array_unref);
+
   dev = manager_find_device_by_uid (mgr, uid, NULL);
 
   if (dev == NULL || dom == NULL)
@@ -1860,10 +2200,16 @@ handle_store_device_removed (BoltStore   *store,
   BoltStatus status;
   const char *opath;
 
+  g_clear_pointer (&mgr->list_uids, g_ptr_array_unref);
+
   dev = manager_find_device_by_uid (mgr, uid, NULL);
 
   if (!dev)
-    return;
+    {
+      /* never materialized, see manager_load_devices */
+      bolt_domain_foreach (dom, bootacl_del_dev, &ctx);
+      return;
+    }
 
   bolt_msg (LOG_DEV (dev), "removed from store");
 
@@ -1933,7 +2279,7 @@ handle_device_status_changed (BoltDevice  *dev,
   else if (old == BOLT_STATUS_AUTHORIZING)
     mgr->authorizing -= 1;
 
-  manager_probing_activity (mgr, !mgr->authorizing);
+  manager_probing_activity (mgr, NULL, !mgr->authorizing);
 
   if (now != BOLT_STATUS_AUTHORIZED)
     return;
@@ -1976,43 +2322,87 @@ static gboolean
 probing_timeout (gpointer user_data)
 {
   BoltManager *mgr;
-  gint64 now, dt, timeout;
+  GPtrArray *roots;
+  gboolean probed = FALSE;
+  gint64 dt;
 
   mgr = BOLT_MANAGER (user_data);
+  roots = mgr->probing_roots;
 
-  if (mgr->authorizing > 0)
-    return G_SOURCE_CONTINUE;
+  /* nothing happened for probing_tsettle, we are done */
+  mgr->probing_timeout = 0;
+  mgr->probing = FALSE;
 
-  now = g_get_monotonic_time ();
-  dt = now - mgr->probing_tstamp;
+  for (guint i = 0; i < roots->len; i++)
+    {
+      ProbingRoot *r = g_ptr_array_index (roots, i);
 
-  /* dt is in microseconds, probing timeout in
-   * milli seconds  */
-  timeout = mgr->probing_tsettle * MSEC_PER_USEC;
-  if (dt < timeout)
-    return G_SOURCE_CONTINUE;
+      if (r->tstart == 0)
+        continue;
+
+      r->duration = (r->tlast - r->tstart) / MSEC_PER_USEC;
+      r->tstart = 0;
+      r->probes++;
+      probed = TRUE;
+
+      bolt_info (LOG_TOPIC ("probing"), "%s settled after %" G_GUINT64_FORMAT " ms",
+                 r->syspath, r->duration);
+    }
+
+  dt = (mgr->probing_tstamp - mgr->probing_tstart) / MSEC_PER_USEC;
+  bolt_info (LOG_TOPIC ("probing"), "done: activity for %" G_GINT64_FORMAT " ms", dt);
+
+  if (probed)
+    g_object_notify_by_pspec (G_OBJECT (mgr), props[PROP_PROBE_DURATIONS]);
 
-  /* we are done, remove us */
-  mgr->probing_timeout = 0;
   g_object_notify_by_pspec (G_OBJECT (mgr), props[PROP_PROBING]);
-  bolt_info (LOG_TOPIC ("probing"), "timeout, done: [%ld] (%ld)", dt, timeout);
+
   return G_SOURCE_REMOVE;
 }
 
 static void
 manager_probing_activity (BoltManager *mgr,
+                          ProbingRoot *root,
                           gboolean     weak)
 {
-  guint dt;
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+  mgr->probing_tstamp = now;
 
-  mgr->probing_tstamp = g_get_monotonic_time ();
-  if (mgr->probing_timeout || weak)
+  if (root != NULL)
+    {
+      if (root->tstart == 0)
+        root->tstart = now;
+      root->tlast = now;
+    }
+
+  if (!mgr->probing && weak)
     return;
 
-  dt = mgr->probing_tsettle / 2;
-  bolt_info (LOG_TOPIC ("probing"), "started [%u]", dt);
-  mgr->probing_timeout = g_timeout_add (dt, probing_timeout, mgr);
-  g_object_notify_by_pspec (G_OBJECT (mgr), props[PROP_PROBING]);
+  if (!mgr->probing)
+    {
+      mgr->probing = TRUE;
+      mgr->probing_tstart = now;
+      bolt_info (LOG_TOPIC ("probing"), "started [%u]", mgr->probing_tsettle);
+      g_object_notify_by_pspec (G_OBJECT (mgr), props[PROP_PROBING]);
+    }
+
+  /* move the deadline; while devices are authorizing there
+   * is no deadline at all, the status change of the last
+   * device that finishes will re-arm it */
+  if (mgr->probing_timeout)
+    {
+      g_source_remove (mgr->probing_timeout);
+      mgr->probing_timeout = 0;
+    }
+
+  if (mgr->authorizing > 0)
+    return;
+
+  mgr->probing_timeout = g_timeout_add (mgr->probing_tsettle,
+                                        probing_timeout,
+                                        mgr);
 }
 
 static gboolean
@@ -2028,37 +2418,41 @@ device_is_thunderbolt_root (struct udev_device *dev)
          bolt_streq (driver, "thunderbolt");
 }
 
-static gboolean
+static ProbingRoot *
 probing_add_root (BoltManager        *mgr,
                   struct udev_device *dev)
 {
+  ProbingRoot *root;
   const char *syspath;
   GPtrArray *roots;
 
-  g_return_val_if_fail (device_is_thunderbolt_root (dev), FALSE);
+  g_return_val_if_fail (device_is_thunderbolt_root (dev), NULL);
 
   /* we go two levels up */
   for (guint i = 0; dev != NULL && i < 2; i++)
     dev = udev_device_get_parent (dev);
 
   if (dev == NULL)
-    return FALSE;
+    return NULL;
 
   roots = mgr->probing_roots;
   syspath = udev_device_get_syspath (dev);
-  g_ptr_array_add (roots, g_strdup (syspath));
+
+  root = g_slice_new0 (ProbingRoot);
+  root->syspath = g_strdup (syspath);
+  g_ptr_array_add (roots, root);
   bolt_info (LOG_TOPIC ("probing"), "adding %s to roots", syspath);
 
-  return TRUE;
+  return root;
 }
 
 static void
 manager_probing_device_added (BoltManager        *mgr,
                               struct udev_device *dev)
 {
+  ProbingRoot *root;
   const char *syspath;
   GPtrArray *roots;
-  gboolean added;
 
   syspath = udev_device_get_syspath (dev);
 
@@ -2068,12 +2462,11 @@ manager_probing_device_added (BoltManager        *mgr,
   roots = mgr->probing_roots;
   for (guint i = 0; i < roots->len; i++)
     {
-      const char *r = g_ptr_array_index (roots, i);
-      if (g_str_has_prefix (syspath, r))
+      ProbingRoot *r = g_ptr_array_index (roots, i);
+      if (g_str_has_prefix (syspath, r->syspath))
         {
           bolt_debug (LOG_TOPIC ("probing"), "match %s", syspath);
-          /* do something */
-          manager_probing_activity (mgr, FALSE);
+          manager_probing_activity (mgr, r, FALSE);
           return;
         }
     }
@@ -2084,9 +2477,9 @@ manager_probing_device_added (BoltManager        *mgr,
   if (!device_is_thunderbolt_root (dev))
     return;
 
-  added = probing_add_root (mgr, dev);
-  if (added)
-    manager_probing_activity (mgr, FALSE);
+  root = probing_add_root (mgr, dev);
+  if (root != NULL)
+    manager_probing_activity (mgr, root, FALSE);
 }
 
 static void
@@ -2107,8 +2500,8 @@ manager_probing_device_removed (BoltManager        *mgr,
   found = FALSE;
   for (index = 0; index < roots->len; index++)
     {
-      const char *r = g_ptr_array_index (roots, index);
-      found = g_str_equal (syspath, r);
+      ProbingRoot *r = g_ptr_array_index (roots, index);
+      found = g_str_equal (syspath, r->syspath);
       if (found)
         break;
     }
@@ -2136,7 +2529,27 @@ manager_probing_domain_added (BoltManager        *mgr,
   probing_add_root (mgr, p);
 }
 
-static BoltPowerGuard *
+static gboolean
+power_wait_timeout (gpointer user_data)
+{
+  BoltManager *mgr = BOLT_MANAGER (user_data);
+  int n;
+
+  mgr->power_timeout = 0;
+
+  n = bolt_udev_count_domains (mgr->udev, NULL);
+  if (n < 1)
+    bolt_warn (LOG_TOPIC ("power"), "no domain after forcing power");
+
+  bolt_info (LOG_TOPIC ("power"), "releasing power guard '%s'",
+             bolt_power_guard_get_id (mgr->power_guard));
+
+  g_clear_object (&mgr->power_guard);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
 manager_maybe_power_controller (BoltManager *mgr)
 {
   g_autoptr(GError) err = NULL;
@@ -2147,18 +2560,20 @@ manager_maybe_power_controller (BoltManager *mgr)
   can_force_power = bolt_power_can_force (mgr->power);
 
   if (can_force_power == FALSE)
-    return NULL;
+    return;
 
   n = bolt_udev_count_domains (mgr->udev, &err);
   if (n < 0)
     {
       bolt_warn_err (err, LOG_TOPIC ("udev"),
                      "failed to count domains");
-      return NULL;
+      return;
     }
   else if (n > 0)
     {
-      goto out;
+      bolt_info (LOG_TOPIC ("udev"), "found %d domain%s",
+                 n, n > 1 ? "s" : "");
+      return;
     }
 
   guard = bolt_power_acquire (mgr->power, &err);
@@ -2167,21 +2582,37 @@ manager_maybe_power_controller (BoltManager *mgr)
     {
       bolt_warn_err (err, LOG_TOPIC ("power"),
                      "could not force power");
-      return NULL;
+      return;
     }
 
-  /* we wait for a total of 5.0 seconds, should hopefully
-   * be enough for at least the domain to show up. */
-  for (int i = 0; i < 25 && n < 1; i++)
-    {
-      g_usleep (200000); /* 200 000 us = 0.2s */
-      n = bolt_udev_count_domains (mgr->udev, NULL);
-    }
+  bolt_info (LOG_TOPIC ("manager"), "acquired power guard '%s'",
+             bolt_power_guard_get_id (guard));
+
+  /* we do not wait here, but keep the guard until the
+   * domain shows up (see manager_power_domain_added) or
+   * the timeout hits, whatever comes first */
+  mgr->power_guard = guard;
+  mgr->power_timeout = g_timeout_add (POWER_WAIT_TIME_MS,
+                                      power_wait_timeout,
+                                      mgr);
+}
+
+static void
+manager_power_domain_added (BoltManager *mgr)
+{
+  if (mgr->power_guard == NULL)
+    return;
+
+  bolt_info (LOG_TOPIC ("power"), "domain appeared");
 
-out:
-  bolt_info (LOG_TOPIC ("udev"), "found %d domain%s",
-             n, n > 1 ? "s" : "");
-  return guard;
+  /* give the devices of the domain some time to show
+   * up before we release the guard */
+  if (mgr->power_timeout)
+    g_source_remove (mgr->power_timeout);
+
+  mgr->power_timeout = g_timeout_add (mgr->probing_tsettle,
+                                      power_wait_timeout,
+                                      mgr);
 }
 
 
@@ -2192,6 +2623,8 @@ manager_load_user_config (BoltManager *mgr)
   g_autoptr(GError) err = NULL;
   BoltPolicy policy;
   BoltAuthMode authmode;
+  guint rate, burst;
+  guint latency;
   BoltTri res;
 
   bolt_info (LOG_TOPIC ("config"), "loading user config");
@@ -2236,6 +2669,34 @@ manager_load_user_config (BoltManager *mgr)
       mgr->authmode = authmode;
       g_object_notify_by_pspec (G_OBJECT (mgr), props[PROP_POLICY]);
     }
+
+  res = bolt_config_load_rate_limit (mgr->config, &rate, &burst, &err);
+  if (res == TRI_ERROR)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("config"),
+                     "failed to load rate limit");
+      g_clear_error (&err);
+    }
+  else if (res == TRI_YES)
+    {
+      bolt_info (LOG_TOPIC ("config"), "rate limit set to %u/s (burst %u)",
+                 rate, burst);
+      bolt_exported_set_rate_limit (rate, burst);
+    }
+
+  res = bolt_config_load_changes_latency (mgr->config, &latency, &err);
+  if (res == TRI_ERROR)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("config"),
+                     "failed to load changes latency");
+      g_clear_error (&err);
+    }
+  else if (res == TRI_YES)
+    {
+      bolt_info (LOG_TOPIC ("config"), "changes latency set to %u ms",
+                 latency);
+      bolt_exported_set_changes_latency (latency);
+    }
 }
 
 /* dbus property setter */
@@ -2291,23 +2752,32 @@ handle_list_domains (BoltExported          *object,
                      GError               **error)
 {
   BoltManager *mgr = BOLT_MANAGER (object);
-  const char **domains;
-  BoltDomain *iter;
-  guint count;
-
-  count = bolt_domain_count (mgr->domains);
-  domains = g_newa (const char *, count + 1);
 
-  iter = mgr->domains;
-  for (guint i = 0; i < count; i++)
+  if (mgr->list_domains == NULL)
     {
-      domains[i] = bolt_exported_get_object_path (BOLT_EXPORTED (iter));
-      iter = bolt_domain_next (iter);
-    }
+      GVariantBuilder builder;
+      BoltDomain *iter;
+      guint count;
+
+      g_variant_builder_init (&builder, G_VARIANT_TYPE ("ao"));
+
+      count = bolt_domain_count (mgr->domains);
+      iter = mgr->domains;
+      for (guint i = 0; i < count; i++)
+        {
+          const char *opath;
 
-  domains[count] = NULL;
+          opath = bolt_exported_get_object_path (BOLT_EXPORTED (iter));
+          if (opath != NULL)
+            g_variant_builder_add (&builder, "o", opath);
+
+          iter = bolt_domain_next (iter);
+        }
+
+      mgr->list_domains = g_variant_ref_sink (g_variant_builder_end (&builder));
+    }
 
-  return g_variant_new ("(^ao)", domains);
+  return g_variant_new ("(@ao)", mgr->list_domains);
 }
 
 static GVariant *
@@ -2340,7 +2810,54 @@ handle_domain_by_id (BoltExported          *object,
   return g_variant_new ("(o)", op);
 }
 
+/* object paths of uids[start, end), materializing as needed */
+static void
+manager_list_device_paths (BoltManager     *mgr,
+                           GPtrArray       *uids,
+                           guint            start,
+                           guint            end,
+                           GVariantBuilder *builder)
+{
+  manager_materialize_uids (mgr, (char **) uids->pdata + start, end - start);
+
+  for (guint i = start; i < end; i++)
+    {
+      const char *uid = g_ptr_array_index (uids, i);
+      BoltDevice *d = bolt_registry_lookup_uid (mgr->devices, uid);
+      const char *opath;
+
+      if (d == NULL)
+        continue;
+
+      opath = bolt_device_get_object_path (d);
+
+      if (opath != NULL)
+        g_variant_builder_add (builder, "o", opath);
+    }
+}
+
 /* dbus methods: device related */
+static GVariant *
+manager_list_devices (BoltManager *mgr)
+{
+  g_autoptr(GPtrArray) uids = NULL;
+  GVariantBuilder builder;
+
+  if (mgr->list_devices != NULL && mgr->list_uids != NULL)
+    return mgr->list_devices;
+
+  /* materializing might invalidate the cached list */
+  uids = g_ptr_array_ref (manager_list_device_uids (mgr));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("ao"));
+  manager_list_device_paths (mgr, uids, 0, uids->len, &builder);
+
+  g_clear_pointer (&mgr->list_devices, g_variant_unref);
+  mgr->list_devices = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  return mgr->list_devices;
+}
+
 static GVariant *
 handle_list_devices (BoltExported          *obj,
                      GVariant              *params,
@@ -2348,19 +2865,128 @@ handle_list_devices (BoltExported          *obj,
                      GError               **error)
 {
   BoltManager *mgr = BOLT_MANAGER (obj);
-  const char **devs;
+  GVariant *devices;
+
+  devices = manager_list_devices (mgr);
+
+  return g_variant_new ("(@ao)", devices);
+}
+
+static GVariant *
+handle_list_devices_paged (BoltExported          *obj,
+                           GVariant              *params,
+                           GDBusMethodInvocation *inv,
+                           GError               **error)
+{
+  g_autoptr(GPtrArray) uids = NULL;
+  BoltManager *mgr = BOLT_MANAGER (obj);
+  GVariantBuilder builder;
+  guint32 offset;
+  guint32 count;
+  gsize start;
+  gsize end;
+
+  g_variant_get (params, "(uu)", &offset, &count);
+
+  /* only the devices on the page are materialized */
+  uids = g_ptr_array_ref (manager_list_device_uids (mgr));
+
+  start = MIN ((gsize) offset, uids->len);
+  end = MIN ((gsize) offset + count, uids->len);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("ao"));
+  manager_list_device_paths (mgr, uids, start, end, &builder);
+
+  return g_variant_new ("(aou)", &builder, uids->len);
+}
+
+static GVariant *
+handle_list_devices_with_properties (BoltExported          *obj,
+                                     GVariant              *params,
+                                     GDBusMethodInvocation *inv,
+                                     GError               **error)
+{
+  BoltManager *mgr = BOLT_MANAGER (obj);
+  GVariantBuilder builder;
+  guint n;
 
-  devs = g_newa (const char *, mgr->devices->len + 1);
+  manager_materialize_devices (mgr);
 
-  for (guint i = 0; i < mgr->devices->len; i++)
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oa{sv}}"));
+
+  n = bolt_registry_get_count (mgr->devices);
+  for (guint i = 0; i < n; i++)
     {
-      BoltDevice *d = g_ptr_array_index (mgr->devices, i);
-      devs[i] = bolt_device_get_object_path (d);
+      g_autoptr(GVariant) props = NULL;
+      BoltDevice *d = bolt_registry_get_nth (mgr->devices, i);
+      const char *opath = bolt_device_get_object_path (d);
+
+      if (opath == NULL)
+        continue;
+
+      props = bolt_exported_get_properties (BOLT_EXPORTED (d));
+      g_variant_builder_add (&builder, "{o@a{sv}}", opath, props);
     }
 
-  devs[mgr->devices->len] = NULL;
+  return g_variant_new ("(a{oa{sv}})", &builder);
+}
+
+static GVariant *
+handle_get_topology (BoltExported          *obj,
+                     GVariant              *params,
+                     GDBusMethodInvocation *inv,
+                     GError               **error)
+{
+  BoltManager *mgr = BOLT_MANAGER (obj);
+  GVariantBuilder b;
+  guint n;
+
+  g_variant_builder_init (&b, G_VARIANT_TYPE ("a(ooo)"));
+
+  n = bolt_registry_get_count (mgr->devices);
+  for (guint i = 0; i < n; i++)
+    {
+      g_autoptr(GPtrArray) tree = NULL;
+      BoltDevice *root = bolt_registry_get_nth (mgr->devices, i);
+
+      /* we start at the roots, i.e. connected devices without
+       * a (known) parent, which are normally the hosts */
+      if (!bolt_device_is_connected (root) ||
+          bolt_registry_get_parent (mgr->devices, root) != NULL)
+        continue;
+
+      /* parents are guaranteed to be listed before children */
+      tree = bolt_registry_get_subtree (mgr->devices, root);
 
-  return g_variant_new ("(^ao)", devs);
+      for (guint k = 0; k < tree->len; k++)
+        {
+          BoltDevice *dev = g_ptr_array_index (tree, k);
+          BoltDevice *parent;
+          BoltDomain *domain;
+          const char *opath;
+          const char *ppath = NULL;
+          const char *dpath = NULL;
+
+          opath = bolt_device_get_object_path (dev);
+          if (opath == NULL)
+            continue;
+
+          parent = bolt_registry_get_parent (mgr->devices, dev);
+          if (parent != NULL)
+            ppath = bolt_device_get_object_path (parent);
+
+          domain = bolt_device_get_domain (dev);
+          if (domain != NULL)
+            dpath = bolt_exported_get_object_path (BOLT_EXPORTED (domain));
+
+          g_variant_builder_add (&b, "(ooo)",
+                                 opath,
+                                 ppath ? : "/",
+                                 dpath ? : "/");
+        }
+    }
+
+  return g_variant_new ("(a(ooo))", &b);
 }
 
 static GVariant *
@@ -2386,50 +3012,101 @@ handle_device_by_uid (BoltExported          *obj,
   return g_variant_new ("(o)", opath);
 }
 
+typedef struct
+{
+  GTask      *task;
+  BoltDevice *dev;
+} EnrollCtx;
+
+static EnrollCtx *
+enroll_ctx_new (GTask      *task,
+                BoltDevice *dev)
+{
+  EnrollCtx *ctx = g_slice_new0 (EnrollCtx);
+
+  ctx->task = g_object_ref (task);
+  ctx->dev = g_object_ref (dev);
+
+  return ctx;
+}
+
+static void
+enroll_ctx_free (EnrollCtx *ctx)
+{
+  g_clear_object (&ctx->task);
+  g_clear_object (&ctx->dev);
+  g_slice_free (EnrollCtx, ctx);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (EnrollCtx, enroll_ctx_free);
+
+static void
+enroll_device_stored (GObject      *store,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+  g_autoptr(EnrollCtx) ctx = user_data;
+  GError *error = NULL;
+  const char *opath;
+  gboolean ok;
+
+  ok = bolt_store_put_device_finish (BOLT_STORE (store), res, &error);
+
+  if (!ok)
+    {
+      bolt_warn_err (error, LOG_DEV (ctx->dev), LOG_TOPIC ("store"),
+                     "failed to store device");
+      g_task_return_error (ctx->task, error);
+      return;
+    }
+
+  opath = bolt_device_get_object_path (ctx->dev);
+  g_task_return_pointer (ctx->task,
+                         g_variant_new ("(o)", opath),
+                         (GDestroyNotify) g_variant_unref);
+}
+
 static void
 enroll_device_done (GObject      *device,
                     GAsyncResult *res,
                     gpointer      user_data)
 {
-  GDBusMethodInvocation *inv = user_data;
+  g_autoptr(GTask) task = user_data;
   BoltDevice *dev = BOLT_DEVICE (device);
   BoltAuth *auth = BOLT_AUTH (res);
   GError *error = NULL;
   BoltManager *mgr;
-  const char *opath;
   gboolean ok;
 
   mgr = BOLT_MANAGER (bolt_auth_get_origin (auth));
   ok = bolt_auth_check (auth, &error);
 
-  if (ok)
-    {
-      ok = bolt_store_put_device (mgr->store,
-                                  dev,
-                                  bolt_auth_get_policy (auth),
-                                  bolt_auth_get_key (auth),
-                                  &error);
-    }
-
   if (!ok)
     {
-      g_dbus_method_invocation_take_error (inv, error);
+      g_task_return_error (task, error);
       return;
     }
 
-  opath = bolt_device_get_object_path (dev);
-  g_dbus_method_invocation_return_value (inv, g_variant_new ("(o)", opath));
+  /* the key is in sysfs now, so the device must be stored
+   * even if the caller goes away; do not pass the cancellable
+   * of the task along */
+  bolt_store_put_device_async (mgr->store,
+                               dev,
+                               bolt_auth_get_policy (auth),
+                               bolt_auth_get_key (auth),
+                               NULL,
+                               enroll_device_stored,
+                               enroll_ctx_new (task, dev));
 }
 
-static GVariant *
+static void
 enroll_device_store_authorized (BoltManager *mgr,
                                 BoltDevice  *dev,
                                 BoltPolicy   policy,
-                                GError     **error)
+                                GTask       *task)
 {
   g_autoptr(GError) err = NULL;
   g_autoptr(BoltKey) key = NULL;
-  const char *opath;
   gboolean ok;
 
   bolt_info (LOG_DEV (dev), "enrolling an authorized device (%s)",
@@ -2440,33 +3117,31 @@ enroll_device_store_authorized (BoltManager *mgr,
     {
       bolt_warn_err (err, LOG_DEV (dev), LOG_TOPIC ("udev"),
                      "failed to read key from sysfs");
-      g_propagate_prefixed_error (error, g_steal_pointer (&err), "%s",
-                                  "could not determine existing authorization: ");
-      return NULL;
-    }
-
-  ok = bolt_store_put_device (mgr->store, dev, policy, key, &err);
-
-  if (!ok)
-    {
-      bolt_warn_err (err, LOG_DEV (dev), LOG_TOPIC ("store"),
-                     "failed to store device");
-      bolt_error_propagate (error, &err);
-      return NULL;
+      g_prefix_error (&err, "%s", "could not determine existing authorization: ");
+      g_task_return_error (task, g_steal_pointer (&err));
+      return;
     }
 
-  opath = bolt_device_get_object_path (dev);
-  return g_variant_new ("(o)", opath);
+  /* task is completed from enroll_device_stored; the device is
+   * already authorized, store it even if the caller vanishes */
+  bolt_store_put_device_async (mgr->store,
+                               dev,
+                               policy,
+                               key,
+                               NULL,
+                               enroll_device_stored,
+                               enroll_ctx_new (task, dev));
 }
 
-static GVariant *
+static void
 handle_enroll_device (BoltExported          *obj,
                       GVariant              *params,
                       GDBusMethodInvocation *inv,
-                      GError               **error)
+                      GTask                 *task)
 {
   g_autoptr(BoltDevice) dev = NULL;
   g_autoptr(BoltAuth) auth = NULL;
+  GError *error = NULL;
   BoltManager *mgr;
   const char *uid;
   BoltPolicy pol;
@@ -2476,18 +3151,22 @@ handle_enroll_device (BoltExported          *obj,
 
   g_variant_get_child (params, 0, "&s", &uid);
   g_variant_get_child (params, 1, "&s", &policy);
-  dev = manager_find_device_by_uid (mgr, uid, error);
+  dev = manager_find_device_by_uid (mgr, uid, &error);
 
   if (dev == NULL)
-    return NULL;
+    {
+      g_task_return_error (task, error);
+      return;
+    }
 
-  pol = bolt_enum_from_string (BOLT_TYPE_POLICY, policy, error);
+  pol = bolt_enum_from_string (BOLT_TYPE_POLICY, policy, &error);
   if (pol == BOLT_POLICY_UNKNOWN)
     {
-      if (*error == NULL)
-        g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+      if (error == NULL)
+        g_set_error (&error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
                      "invalid policy: %s", policy);
-      return NULL;
+      g_task_return_error (task, error);
+      return;
     }
   else if (pol == BOLT_POLICY_DEFAULT)
     {
@@ -2503,49 +3182,75 @@ handle_enroll_device (BoltExported          *obj,
 
   if (bolt_device_get_stored (dev))
     {
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_EXISTS,
-                   "device with id '%s' already enrolled.",
-                   uid);
-      return NULL;
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_EXISTS,
+                               "device with id '%s' already enrolled.",
+                               uid);
+      return;
     }
 
   /* if the device is already authorized, we just store it */
   if (bolt_device_is_authorized (dev))
-    return enroll_device_store_authorized (mgr, dev, pol, error);
+    {
+      enroll_device_store_authorized (mgr, dev, pol, task);
+      return;
+    }
 
-  auth = manager_enroll_device_prepare (mgr, dev, error);
+  auth = manager_enroll_device_prepare (mgr, dev, &error);
 
   if (auth == NULL)
-    return NULL;
+    {
+      g_task_return_error (task, error);
+      return;
+    }
 
   bolt_auth_set_policy (auth, pol);
-  bolt_device_authorize (dev, auth, enroll_device_done, inv);
-  return NULL;
+  bolt_device_authorize (dev, auth, enroll_device_done, g_object_ref (task));
+}
 
+static void
+forget_device_done (GObject      *store,
+                    GAsyncResult *res,
+                    gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  GError *error = NULL;
+  gboolean ok;
+
+  ok = bolt_store_del_finish (BOLT_STORE (store), res, &error);
+
+  if (!ok)
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, NULL, NULL);
 }
 
-static GVariant *
+static void
 handle_forget_device (BoltExported          *obj,
                       GVariant              *params,
                       GDBusMethodInvocation *inv,
-                      GError               **error)
+                      GTask                 *task)
 {
   g_autoptr(BoltDevice) dev = NULL;
+  GError *error = NULL;
   BoltManager *mgr;
-  gboolean ok;
   const char *uid;
 
   mgr = BOLT_MANAGER (obj);
 
   g_variant_get (params, "(&s)", &uid);
-  dev = manager_find_device_by_uid (mgr, uid, error);
+  dev = manager_find_device_by_uid (mgr, uid, &error);
 
   if (dev == NULL)
-    return FALSE;
-
-  ok = bolt_store_del (mgr->store, dev, error);
+    {
+      g_task_return_error (task, error);
+      return;
+    }
 
-  return ok ? g_variant_new ("()") : NULL;
+  /* task is completed from forget_device_done */
+  bolt_store_del_async (mgr->store, dev,
+                        g_task_get_cancellable (task),
+                        forget_device_done,
+                        g_object_ref (task));
 }
 
 /* public methods */
@@ -2563,6 +3268,10 @@ bolt_manager_export (BoltManager     *mgr,
                              error))
     return FALSE;
 
+  /* all domains and devices are below the manager */
+  if (!bolt_exported_export_object_manager (BOLT_EXPORTED (mgr), error))
+    return FALSE;
+
   ok = bolt_exported_export (BOLT_EXPORTED (mgr->power),
                              connection,
                              BOLT_DBUS_PATH,
@@ -2579,10 +3288,10 @@ bolt_manager_export (BoltManager     *mgr,
                        (GFunc) bolt_domain_export,
                        connection);
 
-  for (guint i = 0; i < mgr->devices->len; i++)
+  for (guint i = 0; i < bolt_registry_get_count (mgr->devices); i++)
     {
 
-      BoltDevice *dev = g_ptr_array_index (mgr->devices, i);
+      BoltDevice *dev = bolt_registry_get_nth (mgr->devices, i);
       const char *opath;
 
       opath = bolt_device_export (dev, connection, &err);
@@ -2608,9 +3317,9 @@ bolt_manager_got_the_name (BoltManager *mgr)
   /* emit DeviceAdded signals now that we have the name
    * for all devices that are not stored and connected
    */
-  for (guint i = 0; i < mgr->devices->len; i++)
+  for (guint i = 0; i < bolt_registry_get_count (mgr->devices); i++)
     {
-      BoltDevice *dev = g_ptr_array_index (mgr->devices, i);
+      BoltDevice *dev = bolt_registry_get_nth (mgr->devices, i);
       BoltStatus status;
       gboolean stored;
       const char *opath;
@@ -2633,3 +3342,27 @@ bolt_manager_got_the_name (BoltManager *mgr)
                                  NULL);
     }
 }
+
+GVariant *
+bolt_manager_get_probe_durations (BoltManager *mgr)
+{
+  GVariantBuilder builder;
+  GPtrArray *roots;
+
+  g_return_val_if_fail (BOLT_IS_MANAGER (mgr), NULL);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+
+  roots = mgr->probing_roots;
+  for (guint i = 0; i < roots->len; i++)
+    {
+      ProbingRoot *r = g_ptr_array_index (roots, i);
+
+      if (r->probes == 0)
+        continue;
+
+      g_variant_builder_add (&builder, "{st}", r->syspath, r->duration);
+    }
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
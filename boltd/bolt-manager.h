@@ -33,4 +33,7 @@ gboolean         bolt_manager_export (BoltManager     *mgr,
 
 void             bolt_manager_got_the_name (BoltManager *mgr);
 
+/* a{st}: root port syspath -> duration (ms) of its last probe */
+GVariant *       bolt_manager_get_probe_durations (BoltManager *mgr);
+
 G_END_DECLS
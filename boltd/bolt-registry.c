@@ -0,0 +1,617 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-registry.h"
+
+#include "bolt-log.h"
+#include "bolt-str.h"
+
+/* per device bookkeeping */
+typedef struct _RegEntry
+{
+  BoltDevice *dev;
+  guint       index;    /* position in registry->devices */
+
+  /* the keys under which the device is currently indexed,
+   * we need our own copies since the device properties
+   * have already changed when we get notified */
+  char *syspath;
+  char *opath;
+  char *parent;
+  char *namekey;
+  gboolean stored;
+} RegEntry;
+
+static void    handle_device_syspath_changed (GObject    *gobject,
+                                              GParamSpec *pspec,
+                                              gpointer    user_data);
+
+static void    handle_device_opath_changed (GObject    *gobject,
+                                            GParamSpec *pspec,
+                                            gpointer    user_data);
+
+static void    handle_device_parent_changed (GObject    *gobject,
+                                             GParamSpec *pspec,
+                                             gpointer    user_data);
+
+static void    handle_device_stored_changed (GObject    *gobject,
+                                             GParamSpec *pspec,
+                                             gpointer    user_data);
+
+struct _BoltRegistry
+{
+  GObject object;
+
+  /* all devices, in insertion order (modulo removal) */
+  GPtrArray *devices;
+
+  /* BoltDevice * -> RegEntry */
+  GHashTable *entries;
+
+  /* indices, all values are BoltDevice * (transfer none) */
+  GHashTable *by_uid;
+  GHashTable *by_syspath;
+  GHashTable *by_opath;
+
+  /* topology: parent uid -> GPtrArray of BoltDevice *
+   * (transfer none), updated via the "parent" property */
+  GHashTable *children;
+
+  /* "vendor\nname" -> count, of all devices
+   * and of the ones that are not stored */
+  GHashTable *names;
+  GHashTable *unstored;
+};
+
+
+G_DEFINE_TYPE (BoltRegistry, bolt_registry, G_TYPE_OBJECT);
+
+static void
+reg_entry_free (gpointer data)
+{
+  RegEntry *entry = data;
+
+  g_free (entry->syspath);
+  g_free (entry->opath);
+  g_free (entry->parent);
+  g_free (entry->namekey);
+  g_slice_free (RegEntry, entry);
+}
+
+static void
+bolt_registry_finalize (GObject *object)
+{
+  BoltRegistry *reg = BOLT_REGISTRY (object);
+
+  for (guint i = 0; i < reg->devices->len; i++)
+    {
+      BoltDevice *dev = g_ptr_array_index (reg->devices, i);
+      g_signal_handlers_disconnect_by_data (dev, reg);
+    }
+
+  g_clear_pointer (&reg->by_uid, g_hash_table_unref);
+  g_clear_pointer (&reg->by_syspath, g_hash_table_unref);
+  g_clear_pointer (&reg->by_opath, g_hash_table_unref);
+  g_clear_pointer (&reg->children, g_hash_table_unref);
+  g_clear_pointer (&reg->names, g_hash_table_unref);
+  g_clear_pointer (&reg->unstored, g_hash_table_unref);
+  g_clear_pointer (&reg->entries, g_hash_table_unref);
+  g_clear_pointer (&reg->devices, g_ptr_array_unref);
+
+  G_OBJECT_CLASS (bolt_registry_parent_class)->finalize (object);
+}
+
+static void
+bolt_registry_init (BoltRegistry *reg)
+{
+  reg->devices = g_ptr_array_new_with_free_func (g_object_unref);
+  reg->entries = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                        NULL, reg_entry_free);
+
+  /* all keys are owned by the respective RegEntry or device */
+  reg->by_uid = g_hash_table_new (g_str_hash, g_str_equal);
+  reg->by_syspath = g_hash_table_new (g_str_hash, g_str_equal);
+  reg->by_opath = g_hash_table_new (g_str_hash, g_str_equal);
+
+  reg->children = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, (GDestroyNotify) g_ptr_array_unref);
+
+  reg->names = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                      g_free, NULL);
+  reg->unstored = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, NULL);
+}
+
+static void
+bolt_registry_class_init (BoltRegistryClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = bolt_registry_finalize;
+}
+
+/* internal methods */
+static char *
+registry_make_namekey (const char *vendor,
+                       const char *name)
+{
+  return g_strdup_printf ("%s\n%s",
+                          vendor ? : "",
+                          name ? : "");
+}
+
+static void
+registry_names_adjust (GHashTable *names,
+                       const char *key,
+                       gboolean    add)
+{
+  guint count;
+
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (names, key));
+
+  if (add)
+    g_hash_table_insert (names, g_strdup (key), GUINT_TO_POINTER (count + 1));
+  else if (count > 1)
+    g_hash_table_insert (names, g_strdup (key), GUINT_TO_POINTER (count - 1));
+  else
+    g_hash_table_remove (names, key);
+}
+
+/* re-index 'dev' in 'index': drop the old key, if it still
+ * points to 'dev', and insert the device under the new key
+ * (if any); the key is owned by the entry, i.e. 'key' */
+static void
+registry_index_update (GHashTable *index,
+                       char      **key,
+                       const char *val,
+                       BoltDevice *dev)
+{
+  if (bolt_streq (*key, val))
+    return;
+
+  if (*key != NULL && g_hash_table_lookup (index, *key) == dev)
+    g_hash_table_remove (index, *key);
+
+  g_free (*key);
+  *key = g_strdup (val);
+
+  /* replace, not insert, so that the key pointer is
+   * updated to the one we own as well */
+  if (*key != NULL)
+    g_hash_table_replace (index, *key, dev);
+}
+
+/* move 'dev' from the children list of its old parent
+ * to the one of the new parent (if any) */
+static void
+registry_parent_update (BoltRegistry *reg,
+                        RegEntry     *entry,
+                        const char   *parent)
+{
+  BoltDevice *dev = entry->dev;
+  GPtrArray *children;
+
+  if (bolt_streq (entry->parent, parent))
+    return;
+
+  if (entry->parent != NULL)
+    {
+      children = g_hash_table_lookup (reg->children, entry->parent);
+
+      if (children != NULL)
+        g_ptr_array_remove_fast (children, dev);
+
+      if (children != NULL && children->len == 0)
+        g_hash_table_remove (reg->children, entry->parent);
+    }
+
+  g_free (entry->parent);
+  entry->parent = g_strdup (parent);
+
+  if (entry->parent == NULL)
+    return;
+
+  children = g_hash_table_lookup (reg->children, entry->parent);
+
+  if (children == NULL)
+    {
+      children = g_ptr_array_new ();
+      g_hash_table_insert (reg->children,
+                           g_strdup (entry->parent),
+                           children);
+    }
+
+  g_ptr_array_add (children, dev);
+}
+
+static void
+handle_device_syspath_changed (GObject    *gobject,
+                               GParamSpec *pspec,
+                               gpointer    user_data)
+{
+  BoltRegistry *reg = BOLT_REGISTRY (user_data);
+  BoltDevice *dev = BOLT_DEVICE (gobject);
+  RegEntry *entry;
+
+  entry = g_hash_table_lookup (reg->entries, dev);
+  g_return_if_fail (entry != NULL);
+
+  registry_index_update (reg->by_syspath,
+                         &entry->syspath,
+                         bolt_device_get_syspath (dev),
+                         dev);
+}
+
+static void
+handle_device_opath_changed (GObject    *gobject,
+                             GParamSpec *pspec,
+                             gpointer    user_data)
+{
+  BoltRegistry *reg = BOLT_REGISTRY (user_data);
+  BoltDevice *dev = BOLT_DEVICE (gobject);
+  RegEntry *entry;
+
+  entry = g_hash_table_lookup (reg->entries, dev);
+  g_return_if_fail (entry != NULL);
+
+  registry_index_update (reg->by_opath,
+                         &entry->opath,
+                         bolt_device_get_object_path (dev),
+                         dev);
+}
+
+static void
+handle_device_parent_changed (GObject    *gobject,
+                              GParamSpec *pspec,
+                              gpointer    user_data)
+{
+  BoltRegistry *reg = BOLT_REGISTRY (user_data);
+  BoltDevice *dev = BOLT_DEVICE (gobject);
+  RegEntry *entry;
+
+  entry = g_hash_table_lookup (reg->entries, dev);
+  g_return_if_fail (entry != NULL);
+
+  registry_parent_update (reg, entry, bolt_device_get_parent (dev));
+}
+
+static void
+handle_device_stored_changed (GObject    *gobject,
+                              GParamSpec *pspec,
+                              gpointer    user_data)
+{
+  BoltRegistry *reg = BOLT_REGISTRY (user_data);
+  BoltDevice *dev = BOLT_DEVICE (gobject);
+  RegEntry *entry;
+  gboolean stored;
+
+  entry = g_hash_table_lookup (reg->entries, dev);
+  g_return_if_fail (entry != NULL);
+
+  stored = bolt_device_get_stored (dev);
+
+  if (entry->stored == stored)
+    return;
+
+  entry->stored = stored;
+  registry_names_adjust (reg->unstored, entry->namekey, !stored);
+}
+
+/* public methods */
+BoltRegistry *
+bolt_registry_new (void)
+{
+  BoltRegistry *reg;
+
+  reg = g_object_new (BOLT_TYPE_REGISTRY, NULL);
+
+  return reg;
+}
+
+void
+bolt_registry_add (BoltRegistry *reg,
+                   BoltDevice   *dev)
+{
+  RegEntry *entry;
+  const char *uid;
+
+  g_return_if_fail (BOLT_IS_REGISTRY (reg));
+  g_return_if_fail (BOLT_IS_DEVICE (dev));
+  g_return_if_fail (!g_hash_table_contains (reg->entries, dev));
+
+  uid = bolt_device_get_uid (dev);
+
+  entry = g_slice_new0 (RegEntry);
+  entry->dev = dev;
+  entry->index = reg->devices->len;
+
+  g_ptr_array_add (reg->devices, g_object_ref (dev));
+  g_hash_table_insert (reg->entries, dev, entry);
+
+  /* the uid is construct-only, we can use the string
+   * of the device itself as key, since we hold a ref */
+  if (uid != NULL)
+    g_hash_table_replace (reg->by_uid, (gpointer) uid, dev);
+
+  registry_index_update (reg->by_syspath,
+                         &entry->syspath,
+                         bolt_device_get_syspath (dev),
+                         dev);
+
+  registry_index_update (reg->by_opath,
+                         &entry->opath,
+                         bolt_device_get_object_path (dev),
+                         dev);
+
+  registry_parent_update (reg, entry, bolt_device_get_parent (dev));
+
+  /* vendor and name are also construct-only */
+  entry->namekey = registry_make_namekey (bolt_device_get_vendor (dev),
+                                          bolt_device_get_name (dev));
+
+  registry_names_adjust (reg->names, entry->namekey, TRUE);
+
+  entry->stored = bolt_device_get_stored (dev);
+  if (!entry->stored)
+    registry_names_adjust (reg->unstored, entry->namekey, TRUE);
+
+  g_signal_connect (dev, "notify::sysfs-path",
+                    G_CALLBACK (handle_device_syspath_changed),
+                    reg);
+
+  g_signal_connect (dev, "notify::object-path",
+                    G_CALLBACK (handle_device_opath_changed),
+                    reg);
+
+  g_signal_connect (dev, "notify::parent",
+                    G_CALLBACK (handle_device_parent_changed),
+                    reg);
+
+  g_signal_connect (dev, "notify::stored",
+                    G_CALLBACK (handle_device_stored_changed),
+                    reg);
+}
+
+gboolean
+bolt_registry_remove (BoltRegistry *reg,
+                      BoltDevice   *dev)
+{
+  RegEntry *entry;
+  const char *uid;
+  guint index;
+
+  g_return_val_if_fail (BOLT_IS_REGISTRY (reg), FALSE);
+  g_return_val_if_fail (BOLT_IS_DEVICE (dev), FALSE);
+
+  entry = g_hash_table_lookup (reg->entries, dev);
+  if (entry == NULL)
+    return FALSE;
+
+  g_signal_handlers_disconnect_by_data (dev, reg);
+
+  uid = bolt_device_get_uid (dev);
+  if (uid != NULL && g_hash_table_lookup (reg->by_uid, uid) == dev)
+    g_hash_table_remove (reg->by_uid, uid);
+
+  registry_index_update (reg->by_syspath, &entry->syspath, NULL, dev);
+  registry_index_update (reg->by_opath, &entry->opath, NULL, dev);
+  registry_parent_update (reg, entry, NULL);
+
+  registry_names_adjust (reg->names, entry->namekey, FALSE);
+
+  if (!entry->stored)
+    registry_names_adjust (reg->unstored, entry->namekey, FALSE);
+
+  /* O(1) removal: the last element is moved to the
+   * now empty slot, so its index needs updating */
+  index = entry->index;
+  g_hash_table_remove (reg->entries, dev);
+
+  if (index + 1 < reg->devices->len)
+    {
+      BoltDevice *last = g_ptr_array_index (reg->devices,
+                                            reg->devices->len - 1);
+      RegEntry *moved = g_hash_table_lookup (reg->entries, last);
+
+      moved->index = index;
+    }
+
+  /* NB: this might drop the last reference to dev */
+  g_ptr_array_remove_index_fast (reg->devices, index);
+
+  return TRUE;
+}
+
+guint
+bolt_registry_get_count (BoltRegistry *reg)
+{
+  g_return_val_if_fail (BOLT_IS_REGISTRY (reg), 0);
+
+  return reg->devices->len;
+}
+
+BoltDevice *
+bolt_registry_get_nth (BoltRegistry *reg,
+                       guint         index)
+{
+  g_return_val_if_fail (BOLT_IS_REGISTRY (reg), NULL);
+  g_return_val_if_fail (index < reg->devices->len, NULL);
+
+  return g_ptr_array_index (reg->devices, index);
+}
+
+BoltDevice *
+bolt_registry_lookup_uid (BoltRegistry *reg,
+                          const char   *uid)
+{
+  g_return_val_if_fail (BOLT_IS_REGISTRY (reg), NULL);
+
+  if (uid == NULL)
+    return NULL;
+
+  return g_hash_table_lookup (reg->by_uid, uid);
+}
+
+BoltDevice *
+bolt_registry_lookup_syspath (BoltRegistry *reg,
+                              const char   *syspath)
+{
+  g_return_val_if_fail (BOLT_IS_REGISTRY (reg), NULL);
+
+  if (syspath == NULL)
+    return NULL;
+
+  return g_hash_table_lookup (reg->by_syspath, syspath);
+}
+
+BoltDevice *
+bolt_registry_lookup_object_path (BoltRegistry *reg,
+                                  const char   *object_path)
+{
+  g_return_val_if_fail (BOLT_IS_REGISTRY (reg), NULL);
+
+  if (object_path == NULL)
+    return NULL;
+
+  return g_hash_table_lookup (reg->by_opath, object_path);
+}
+
+guint
+bolt_registry_count_name (BoltRegistry *reg,
+                          const char   *vendor,
+                          const char   *name)
+{
+  g_autofree char *key = NULL;
+  gpointer val;
+
+  g_return_val_if_fail (BOLT_IS_REGISTRY (reg), 0);
+
+  key = registry_make_namekey (vendor, name);
+  val = g_hash_table_lookup (reg->names, key);
+
+  return GPOINTER_TO_UINT (val);
+}
+
+guint
+bolt_registry_count_name_unstored (BoltRegistry *reg,
+                                   const char   *vendor,
+                                   const char   *name)
+{
+  g_autofree char *key = NULL;
+  gpointer val;
+
+  g_return_val_if_fail (BOLT_IS_REGISTRY (reg), 0);
+
+  key = registry_make_namekey (vendor, name);
+  val = g_hash_table_lookup (reg->unstored, key);
+
+  return GPOINTER_TO_UINT (val);
+}
+
+/* topology */
+BoltDevice *
+bolt_registry_get_parent (BoltRegistry *reg,
+                          BoltDevice   *dev)
+{
+  RegEntry *entry;
+
+  g_return_val_if_fail (BOLT_IS_REGISTRY (reg), NULL);
+  g_return_val_if_fail (BOLT_IS_DEVICE (dev), NULL);
+
+  entry = g_hash_table_lookup (reg->entries, dev);
+
+  if (entry == NULL || entry->parent == NULL)
+    return NULL;
+
+  return g_hash_table_lookup (reg->by_uid, entry->parent);
+}
+
+GPtrArray *
+bolt_registry_get_children (BoltRegistry *reg,
+                            BoltDevice   *dev)
+{
+  GPtrArray *children;
+  GPtrArray *res;
+  const char *uid;
+
+  g_return_val_if_fail (BOLT_IS_REGISTRY (reg), NULL);
+  g_return_val_if_fail (BOLT_IS_DEVICE (dev), NULL);
+
+  res = g_ptr_array_new_with_free_func (g_object_unref);
+
+  uid = bolt_device_get_uid (dev);
+  if (uid == NULL)
+    return res;
+
+  children = g_hash_table_lookup (reg->children, uid);
+  if (children == NULL)
+    return res;
+
+  for (guint i = 0; i < children->len; i++)
+    g_ptr_array_add (res, g_object_ref (g_ptr_array_index (children, i)));
+
+  return res;
+}
+
+GPtrArray *
+bolt_registry_get_subtree (BoltRegistry *reg,
+                           BoltDevice   *dev)
+{
+  GPtrArray *res;
+
+  g_return_val_if_fail (BOLT_IS_REGISTRY (reg), NULL);
+  g_return_val_if_fail (BOLT_IS_DEVICE (dev), NULL);
+
+  res = g_ptr_array_new_with_free_func (g_object_unref);
+  g_ptr_array_add (res, g_object_ref (dev));
+
+  /* breadth first, i.e. parents are always listed
+   * before their children; 'res' is the queue */
+  for (guint i = 0; i < res->len; i++)
+    {
+      BoltDevice *cur = g_ptr_array_index (res, i);
+      const char *uid = bolt_device_get_uid (cur);
+      GPtrArray *children;
+
+      if (uid == NULL)
+        continue;
+
+      children = g_hash_table_lookup (reg->children, uid);
+      if (children == NULL)
+        continue;
+
+      for (guint k = 0; k < children->len; k++)
+        {
+          BoltDevice *child = g_ptr_array_index (children, k);
+          g_ptr_array_add (res, g_object_ref (child));
+        }
+
+      /* guard against (bogus) cycles in the parent links */
+      if (res->len > reg->devices->len + 1)
+        {
+          bolt_bug (LOG_DEV (dev), "device tree contains cycles");
+          break;
+        }
+    }
+
+  return res;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+#include "bolt-device.h"
+
+G_BEGIN_DECLS
+
+/* BoltRegistry - indexed set of all known devices */
+#define BOLT_TYPE_REGISTRY bolt_registry_get_type ()
+G_DECLARE_FINAL_TYPE (BoltRegistry, bolt_registry, BOLT, REGISTRY, GObject);
+
+BoltRegistry *    bolt_registry_new (void);
+
+void              bolt_registry_add (BoltRegistry *registry,
+                                     BoltDevice   *dev);
+
+gboolean          bolt_registry_remove (BoltRegistry *registry,
+                                        BoltDevice   *dev);
+
+guint             bolt_registry_get_count (BoltRegistry *registry);
+
+BoltDevice *      bolt_registry_get_nth (BoltRegistry *registry,
+                                         guint         index);
+
+BoltDevice *      bolt_registry_lookup_uid (BoltRegistry *registry,
+                                            const char   *uid);
+
+BoltDevice *      bolt_registry_lookup_syspath (BoltRegistry *registry,
+                                                const char   *syspath);
+
+BoltDevice *      bolt_registry_lookup_object_path (BoltRegistry *registry,
+                                                    const char   *object_path);
+
+guint             bolt_registry_count_name (BoltRegistry *registry,
+                                            const char   *vendor,
+                                            const char   *name);
+
+guint             bolt_registry_count_name_unstored (BoltRegistry *registry,
+                                                     const char   *vendor,
+                                                     const char   *name);
+
+/* topology */
+BoltDevice *      bolt_registry_get_parent (BoltRegistry *registry,
+                                            BoltDevice   *dev);
+
+GPtrArray *       bolt_registry_get_children (BoltRegistry *registry,
+                                              BoltDevice   *dev);
+
+GPtrArray *       bolt_registry_get_subtree (BoltRegistry *registry,
+                                             BoltDevice   *dev);
+
+G_END_DECLS
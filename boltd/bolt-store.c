@@ -22,14 +22,20 @@
 
 #include "bolt-store.h"
 
+#include "bolt-database.h"
 #include "bolt-error.h"
 #include "bolt-fs.h"
 #include "bolt-io.h"
 #include "bolt-log.h"
+#include "bolt-macros.h"
+#include "bolt-names.h"
 #include "bolt-str.h"
 #include "bolt-time.h"
+#include "bolt-timetable.h"
 
+#include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 
 /* ************************************  */
 /* BoltStore */
@@ -43,6 +49,35 @@ struct _BoltStore
   GFile  *devices;
   GFile  *keys;
   GFile  *times;
+
+  /* single file device database, NULL if
+   * the directory layout is used instead */
+  BoltDatabase *db;
+
+  /* timestamps, NULL if the files in
+   * the 'times' directory are used */
+  BoltTimeTable *timetable;
+
+  /* transactions: target path -> temporary path */
+  guint       txn;
+  GThread    *owner;    /* the thread of the open transaction */
+  GHashTable *staged;
+  GHashTable *removed;  /* target paths, deleted on commit */
+
+  /* serializes all writers, held for the whole duration
+   * of a transaction; readers do not need it, see below */
+  GRecMutex    lock;
+  GThreadPool *io;
+
+  /* uid -> BoltStoreEntry and "vendor\nname" -> count;
+   * guarded by their own lock, so that lookups never
+   * have to wait for a transaction of the I/O thread;
+   * if both are needed, 'lock' must be taken first */
+  GMutex      index_lock;
+  GHashTable *index;
+  GHashTable *names;
+  gboolean    index_stale;
+  guint       index_gen;
 };
 
 
@@ -70,17 +105,45 @@ G_DEFINE_TYPE (BoltStore,
                bolt_store,
                G_TYPE_OBJECT)
 
+static void     store_init_backend (BoltStore *store);
+
+static void     store_init_times (BoltStore *store);
+
+static void     store_discard_staged (BoltStore *store);
+
+static void     store_index_invalidate (BoltStore *store);
+
 
 static void
 bolt_store_finalize (GObject *object)
 {
   BoltStore *store = BOLT_STORE (object);
 
+  /* every pending operation holds a reference to the
+   * store, so the queue must be empty by now */
+  if (store->io != NULL)
+    g_thread_pool_free (store->io, FALSE, FALSE);
+
+  if (store->txn > 0)
+    {
+      bolt_warn (LOG_TOPIC ("store"), "discarding uncommitted changes");
+      store_discard_staged (store);
+    }
+
+  g_clear_pointer (&store->staged, g_hash_table_unref);
+  g_clear_pointer (&store->removed, g_hash_table_unref);
+  g_clear_pointer (&store->index, g_hash_table_unref);
+  g_clear_pointer (&store->names, g_hash_table_unref);
+  g_mutex_clear (&store->index_lock);
+  g_rec_mutex_clear (&store->lock);
+
   g_clear_object (&store->root);
   g_clear_object (&store->domains);
   g_clear_object (&store->devices);
   g_clear_object (&store->keys);
   g_clear_object (&store->times);
+  g_clear_object (&store->db);
+  g_clear_object (&store->timetable);
 
   G_OBJECT_CLASS (bolt_store_parent_class)->finalize (object);
 }
@@ -88,6 +151,13 @@ bolt_store_finalize (GObject *object)
 static void
 bolt_store_init (BoltStore *store)
 {
+  store->staged = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, g_free);
+  store->removed = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, NULL);
+
+  g_rec_mutex_init (&store->lock);
+  g_mutex_init (&store->index_lock);
 }
 
 static void
@@ -144,6 +214,9 @@ bolt_store_constructed (GObject *obj)
   store->domains = g_file_get_child (store->root, "domains");
   store->keys = g_file_get_child (store->root, "keys");
   store->times = g_file_get_child (store->root, "times");
+
+  store_init_backend (store);
+  store_init_times (store);
 }
 
 static void
@@ -196,310 +269,1225 @@ bolt_store_class_init (BoltStoreClass *klass)
 #define USER_GROUP "user"
 
 #define CFG_FILE "boltd.conf"
+#define DB_FILE "devices.db"
+#define TIMES_FILE "times.db"
 
-/* public methods */
+/* limits for the journals, e.g. of the boot ACL */
+#define STORE_JOURNAL_MAX_SIZE (32 * 1024)
+#define STORE_JOURNAL_MAX_AGE  (30 * 24 * 60 * 60)
 
-BoltStore *
-bolt_store_new (const char *path)
+/* locking */
+static GRecMutex *
+store_lock (BoltStore *store)
 {
-  g_autoptr(GFile) root = NULL;
-  BoltStore *store;
-
-  root = g_file_new_for_path (path);
-  store = g_object_new (BOLT_TYPE_STORE,
-                        "root", root,
-                        NULL);
-
-  return store;
+  g_rec_mutex_lock (&store->lock);
+  return &store->lock;
 }
 
-GKeyFile *
-bolt_store_config_load (BoltStore *store,
-                        GError   **error)
+static void
+store_unlock (GRecMutex **lock)
 {
-  g_autoptr(GKeyFile) kf = NULL;
-  g_autoptr(GFile) sf = NULL;
-  g_autofree char *data  = NULL;
-  gboolean ok;
-  gsize len;
-
-  g_return_val_if_fail (store != NULL, NULL);
-  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
-
-  sf = g_file_get_child (store->root, CFG_FILE);
-  ok = g_file_load_contents (sf, NULL,
-                             &data, &len,
-                             NULL,
-                             error);
+  if (*lock != NULL)
+    g_rec_mutex_unlock (*lock);
+}
 
-  if (!ok)
-    return NULL;
+#define store_autolock bolt_cleanup (store_unlock) G_GNUC_UNUSED
 
-  kf = g_key_file_new ();
-  ok = g_key_file_load_from_data (kf, data, len, G_KEY_FILE_NONE, error);
+/* transactions
+ *
+ * While a transaction is open, files are not replaced directly
+ * but written to a hidden temporary file next to the target,
+ * without syncing. Deletions are staged too: the target is
+ * mapped to a temporary file that does not exist, and only
+ * removed on commit. On commit all temporary files are synced,
+ * renamed to their targets and finally the directories that
+ * contain them are synced, so the renames are durable as well.
+ * Reads during the transaction see the staged data, but only
+ * in the thread that owns the transaction, which also holds
+ * the lock. Readers in all other threads see the committed
+ * data, which is always replaced atomically on disk, so they
+ * do not need the lock, which is held across the syncs.
+ */
+static gboolean
+store_owns_txn (BoltStore *store)
+{
+  return g_atomic_pointer_get (&store->owner) == (gpointer) g_thread_self ();
+}
 
-  if (!ok)
-    return NULL;
+static gboolean
+store_other_txn (BoltStore *store)
+{
+  gpointer owner = g_atomic_pointer_get (&store->owner);
 
-  return g_steal_pointer (&kf);
+  return owner != NULL && owner != (gpointer) g_thread_self ();
 }
 
-gboolean
-bolt_store_config_save (BoltStore *store,
-                        GKeyFile  *config,
-                        GError   **error)
+static GFile *
+store_stage_file (BoltStore *store,
+                  GFile     *target)
 {
-  g_autoptr(GFile) sf = NULL;
-  g_autofree char *data  = NULL;
-  gboolean ok;
-  gsize len;
+  g_autoptr(GFile) parent = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *base = NULL;
+  g_autofree char *name = NULL;
+  const char *tmp;
+  GFile *staged;
 
-  g_return_val_if_fail (store != NULL, FALSE);
-  g_return_val_if_fail (config != NULL, FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  if (store->txn == 0)
+    return g_object_ref (target);
 
-  sf = g_file_get_child (store->root, CFG_FILE);
-  data = g_key_file_to_data (config, &len, error);
+  path = g_file_get_path (target);
+  tmp = g_hash_table_lookup (store->staged, path);
 
-  if (!data)
-    return FALSE;
+  if (tmp != NULL)
+    {
+      /* written again after it was deleted */
+      g_hash_table_remove (store->removed, path);
+      return g_file_new_for_path (tmp);
+    }
 
-  ok = g_file_replace_contents (sf,
-                                data, len,
-                                NULL, FALSE,
-                                0,
-                                NULL,
-                                NULL, error);
+  /* hidden, so it does not show up in listings */
+  parent = g_file_get_parent (target);
+  base = g_file_get_basename (target);
+  name = g_strdup_printf (".%s.txn", base);
+  staged = g_file_get_child (parent, name);
 
-  return ok;
+  g_hash_table_insert (store->staged,
+                       g_steal_pointer (&path),
+                       g_file_get_path (staged));
+
+  return staged;
 }
 
-GStrv
-bolt_store_list_uids (BoltStore  *store,
-                      const char *type,
-                      GError    **error)
+static GFile *
+store_resolve_file (BoltStore *store,
+                    GFile     *target)
 {
-  g_autoptr(GError) err = NULL;
-  g_autoptr(GDir) dir   = NULL;
   g_autofree char *path = NULL;
-  g_autoptr(GPtrArray) ids = NULL;
-  const char *name;
+  const char *tmp;
 
-  g_return_val_if_fail (BOLT_IS_STORE (store), NULL);
-  g_return_val_if_fail (type != NULL, NULL);
-  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+  if (!store_owns_txn (store) || g_hash_table_size (store->staged) == 0)
+    return g_object_ref (target);
 
-  if (bolt_streq (type, "devices"))
-    path = g_file_get_path (store->devices);
-  if (bolt_streq (type, "domains"))
-    path = g_file_get_path (store->domains);
+  path = g_file_get_path (target);
+  tmp = g_hash_table_lookup (store->staged, path);
 
-  if (path == NULL)
-    {
-      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
-                   "unknown stored typed '%s'", type);
-      return NULL;
-    }
+  if (tmp == NULL)
+    return g_object_ref (target);
 
-  ids = g_ptr_array_new ();
+  return g_file_new_for_path (tmp);
+}
 
-  dir = g_dir_open (path, 0, &err);
-  if (dir == NULL)
-    {
-      if (bolt_err_notfound (err))
-        return bolt_strv_from_ptr_array (&ids);
+static gboolean
+store_unstage_file (BoltStore *store,
+                    GFile     *target)
+{
+  g_autofree char *path = NULL;
+  const char *tmp;
 
-      bolt_error_propagate (error, &err);
-      return NULL;
-    }
+  if (g_hash_table_size (store->staged) == 0)
+    return FALSE;
 
-  while ((name = g_dir_read_name (dir)) != NULL)
-    {
-      if (g_str_has_prefix (name, "."))
-        continue;
+  path = g_file_get_path (target);
+  tmp = g_hash_table_lookup (store->staged, path);
 
-      g_ptr_array_add (ids, g_strdup (name));
-    }
+  if (tmp == NULL)
+    return FALSE;
 
-  return bolt_strv_from_ptr_array (&ids);
+  (void) unlink (tmp);
+  g_hash_table_remove (store->staged, path);
+
+  return TRUE;
 }
 
-gboolean
-bolt_store_put_domain (BoltStore  *store,
-                       BoltDomain *domain,
-                       GError    **error)
+static gboolean
+store_delete_file (BoltStore *store,
+                   GFile     *target,
+                   GError   **error)
 {
   g_autoptr(GError) err = NULL;
-  g_autoptr(GFile) entry = NULL;
-  g_autoptr(GKeyFile) kf = NULL;
   g_autofree char *path = NULL;
-  char * const * bootacl = NULL;
-  const char *uid;
+  gboolean exists;
   gboolean ok;
-  gsize len;
 
-  g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
-  g_return_val_if_fail (BOLT_IS_DOMAIN (domain), FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  if (store->txn == 0)
+    {
+      ok = g_file_delete (target, NULL, &err);
 
-  uid = bolt_domain_get_uid (domain);
-  g_assert (uid);
+      if (!ok)
+        return bolt_error_propagate (error, &err);
 
-  entry = g_file_get_child (store->domains, uid);
+      return TRUE;
+    }
 
-  ok = bolt_fs_make_parent_dirs (entry, error);
-  if (!ok)
-    return FALSE;
+  path = g_file_get_path (target);
 
-  kf = g_key_file_new ();
-  path = g_file_get_path (entry);
-  ok = g_key_file_load_from_file (kf,
-                                  path,
-                                  G_KEY_FILE_KEEP_COMMENTS,
-                                  &err);
+  if (g_hash_table_contains (store->removed, path))
+    exists = FALSE;
+  else if (store_unstage_file (store, target))
+    exists = TRUE; /* at least inside the transaction */
+  else
+    exists = g_file_query_exists (target, NULL);
 
-  if (!ok && !bolt_err_notfound (err))
+  if (!exists)
     {
-      bolt_warn_err (err, LOG_TOPIC ("store"),
-                     "error loading existing domain");
-      g_clear_error (&err);
-      /* not fatal, keep going */
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                   "could not delete '%s': not found", path);
+      return FALSE;
     }
 
-  bootacl = bolt_domain_get_bootacl (domain);
-  len = bolt_strv_length (bootacl);
-
-  g_key_file_set_string_list (kf,
-                              DOMAIN_GROUP,
-                              "bootacl",
-                              (const char * const *) bootacl,
-                              len);
+  /* the staged file is never created, reads of
+   * the target will therefore not find it */
+  g_object_unref (store_stage_file (store, target));
+  g_hash_table_add (store->removed, g_steal_pointer (&path));
 
-  ok = g_key_file_save_to_file (kf, path, error);
+  return TRUE;
+}
 
-  if (!ok)
-    return FALSE;
+static void
+store_discard_staged (BoltStore *store)
+{
+  GHashTableIter iter;
+  gpointer tmp;
 
-  g_object_set (G_OBJECT (domain),
-                "store", store,
-                NULL);
+  g_hash_table_iter_init (&iter, store->staged);
+  while (g_hash_table_iter_next (&iter, NULL, &tmp))
+    (void) unlink (tmp);
 
-  return ok;
+  g_hash_table_remove_all (store->staged);
+  g_hash_table_remove_all (store->removed);
 }
 
-BoltDomain *
-bolt_store_get_domain (BoltStore  *store,
-                       const char *uid,
-                       GError    **error)
+static gboolean
+store_sync_path (const char *path,
+                 int         flags,
+                 GError    **error)
 {
-  g_autoptr(GKeyFile) kf = NULL;
-  g_autoptr(GFile) db = NULL;
-  g_autoptr(GError) err = NULL;
-  g_autofree char *path = NULL;
-  g_auto(GStrv) bootacl = NULL;
-  BoltDomain *domain = NULL;
-  gboolean ok;
+  bolt_autoclose int fd = -1;
 
-  g_return_val_if_fail (store != NULL, NULL);
-  g_return_val_if_fail (uid != NULL, NULL);
-  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+  fd = bolt_open (path, flags | O_CLOEXEC, 0, error);
 
-  db = g_file_get_child (store->domains, uid);
-  path = g_file_get_path (db);
+  if (fd < 0)
+    return FALSE;
 
-  kf = g_key_file_new ();
-  ok = g_key_file_load_from_file (kf, path, G_KEY_FILE_NONE, error);
+  return bolt_fsync (fd, error);
+}
 
-  if (!ok)
-    return NULL;
+static gboolean
+store_commit_staged (BoltStore *store,
+                     GError   **error)
+{
+  g_autoptr(GHashTable) dirs = NULL;
+  GHashTableIter iter;
+  gpointer target, tmp;
+  gboolean ok = TRUE;
+  guint n;
 
-  bootacl = g_key_file_get_string_list (kf,
-                                        DOMAIN_GROUP,
-                                        "bootacl",
-                                        NULL,
-                                        &err);
+  n = g_hash_table_size (store->staged);
 
-  if (bootacl == NULL && !bolt_err_notfound (err))
+  if (n == 0)
+    return TRUE;
+
+  /* the data of the staged files is on disk before
+   * any of them replaces its target */
+  g_hash_table_iter_init (&iter, store->staged);
+  while (ok && g_hash_table_iter_next (&iter, &target, &tmp))
     {
-      bolt_warn_err (err, LOG_DOM_UID (uid), LOG_TOPIC ("store"),
-                     "failed to parse bootacl for domain '%s'",
-                     uid);
+      if (g_hash_table_contains (store->removed, target))
+        continue;
 
-      g_clear_error (&err);
+      ok = store_sync_path (tmp, O_RDONLY, error);
     }
 
-  if (bolt_strv_isempty (bootacl))
-    g_clear_pointer (&bootacl, g_strfreev);
+  if (!ok)
+    {
+      store_discard_staged (store);
+      return FALSE;
+    }
 
-  domain = g_object_new (BOLT_TYPE_DOMAIN,
-                         "store", store,
-                         "uid", uid,
-                         "bootacl", bootacl,
-                         NULL);
+  dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
-  return domain;
-}
+  g_hash_table_iter_init (&iter, store->staged);
+  while (g_hash_table_iter_next (&iter, &target, &tmp))
+    {
+      g_autoptr(GError) err = NULL;
+      gboolean done;
 
-gboolean
-bolt_store_del_domain (BoltStore  *store,
-                       BoltDomain *domain,
-                       GError    **error)
-{
-  g_autoptr(GFile) path = NULL;
-  const char *uid;
-  gboolean ok;
+      if (g_hash_table_contains (store->removed, target))
+        done = bolt_unlink (target, &err) || bolt_err_notfound (err);
+      else
+        done = bolt_rename (tmp, target, &err);
 
-  g_return_val_if_fail (store != NULL, FALSE);
-  g_return_val_if_fail (domain != NULL, FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+      if (done)
+        {
+          g_hash_table_add (dirs, g_path_get_dirname (target));
+          continue;
+        }
 
-  uid = bolt_domain_get_uid (domain);
+      (void) unlink (tmp);
 
-  path = g_file_get_child (store->domains, uid);
-  ok = g_file_delete (path, NULL, error);
+      /* report the first error, log the rest */
+      if (ok)
+        ok = bolt_error_propagate (error, &err);
+      else
+        bolt_warn_err (err, LOG_TOPIC ("store"), "failed to commit");
+    }
 
-  if (!ok)
-    return FALSE;
+  g_hash_table_remove_all (store->staged);
+  g_hash_table_remove_all (store->removed);
 
-  g_object_set (domain,
-                "store", NULL,
-                NULL);
+  /* make the renames and removals themselves durable */
+  g_hash_table_iter_init (&iter, dirs);
+  while (g_hash_table_iter_next (&iter, &target, NULL))
+    {
+      g_autoptr(GError) err = NULL;
 
-  return TRUE;
+      if (store_sync_path (target, O_RDONLY | O_DIRECTORY, &err))
+        continue;
+
+      if (ok)
+        ok = bolt_error_propagate (error, &err);
+      else
+        bolt_warn_err (err, LOG_TOPIC ("store"), "failed to sync");
+    }
+
+  bolt_debug (LOG_TOPIC ("store"), "committed %u files", n);
+
+  return ok;
 }
 
-gboolean
-bolt_store_put_device (BoltStore  *store,
-                       BoltDevice *device,
-                       BoltPolicy  policy,
-                       BoltKey    *key,
-                       GError    **error)
+static GPtrArray *
+store_list_dir (GFile   *dir,
+                GError **error)
 {
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GDir) d = NULL;
+  g_autofree char *path = NULL;
+  g_autoptr(GPtrArray) ids = NULL;
+  const char *name;
+
+  path = g_file_get_path (dir);
+  ids = g_ptr_array_new ();
+
+  d = g_dir_open (path, 0, &err);
+  if (d == NULL)
+    {
+      if (bolt_err_notfound (err))
+        return g_steal_pointer (&ids);
+
+      bolt_error_propagate (error, &err);
+      return NULL;
+    }
+
+  while ((name = g_dir_read_name (d)) != NULL)
+    {
+      if (g_str_has_prefix (name, "."))
+        continue;
+
+      g_ptr_array_add (ids, g_strdup (name));
+    }
+
+  return g_steal_pointer (&ids);
+}
+
+/* device records, i.e. a{sv} dictionaries with the stored
+ * properties of a device; the directory backend stores
+ * them as key files, the database as is */
+static GVariant *
+store_load_device_file (BoltStore  *store,
+                        const char *uid,
+                        GError    **error)
+{
+  g_autoptr(GKeyFile) kf = NULL;
+  g_autoptr(GFile) entry = NULL;
+  g_autoptr(GFile) db = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *data  = NULL;
+  GVariantDict dict;
+  BoltKeyState key;
+  guint64 stime;
+  gboolean ok;
+  gsize len;
+  struct
+  {
+    const char *group;
+    const char *name;
+  } strs[] = {
+    {DEVICE_GROUP, "name"},
+    {DEVICE_GROUP, "vendor"},
+    {DEVICE_GROUP, "type"},
+    {USER_GROUP,   "policy"},
+    {USER_GROUP,   "label"},
+  };
+
+  entry = g_file_get_child (store->devices, uid);
+  db = store_resolve_file (store, entry);
+
+  ok = g_file_load_contents (db, NULL,
+                             &data, &len,
+                             NULL,
+                             error);
+
+  if (!ok)
+    return NULL;
+
+  kf = g_key_file_new ();
+  ok = g_key_file_load_from_data (kf, data, len, G_KEY_FILE_NONE, error);
+
+  if (!ok)
+    return NULL;
+
+  g_variant_dict_init (&dict, NULL);
+
+  for (guint i = 0; i < G_N_ELEMENTS (strs); i++)
+    {
+      g_autofree char *str = NULL;
+
+      str = g_key_file_get_string (kf, strs[i].group, strs[i].name, NULL);
+
+      if (str != NULL)
+        g_variant_dict_insert (&dict, strs[i].name, "s", str);
+    }
+
+  stime = g_key_file_get_uint64 (kf, USER_GROUP, "storetime", &err);
+  if (err != NULL && !bolt_err_notfound (err))
+    bolt_warn_err (err, LOG_TOPIC ("store"), "invalid enroll-time");
+
+  if (stime == 0)
+    {
+      g_autoptr(GFileInfo) info = NULL;
+
+      info = g_file_query_info (db,
+                                "time::changed",
+                                G_FILE_QUERY_INFO_NONE,
+                                NULL, NULL);
+      if (info != NULL)
+        stime = g_file_info_get_attribute_uint64 (info, "time::changed");
+    }
+
+  g_variant_dict_insert (&dict, "storetime", "t", stime);
+
+  key = bolt_store_have_key (store, uid);
+  g_variant_dict_insert (&dict, "key", "u", (guint32) key);
+
+  return g_variant_ref_sink (g_variant_dict_end (&dict));
+}
+
+static GVariant *
+store_load_device_record (BoltStore  *store,
+                          const char *uid,
+                          GError    **error)
+{
+  GVariant *record;
+
+  if (store->db == NULL)
+    return store_load_device_file (store, uid, error);
+
+  if (store_owns_txn (store))
+    record = bolt_database_lookup (store->db, uid);
+  else
+    record = bolt_database_lookup_committed (store->db, uid);
+
+  if (record == NULL)
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                 "device '%s' not found in store", uid);
+
+  return record;
+}
+
+static gboolean
+store_migrate_devices (BoltStore *store,
+                       GError   **error)
+{
+  g_autoptr(GPtrArray) ids = NULL;
+  g_autoptr(GFile) target = NULL;
+  g_autofree char *from = NULL;
+  g_autofree char *to = NULL;
+  guint count = 0;
+  gboolean ok;
+
+  ids = store_list_dir (store->devices, error);
+
+  if (ids == NULL)
+    return FALSE;
+
+  bolt_database_begin (store->db);
+
+  for (guint i = 0; i < ids->len; i++)
+    {
+      g_autoptr(GVariant) record = NULL;
+      g_autoptr(GError) err = NULL;
+      const char *uid = g_ptr_array_index (ids, i);
+
+      record = store_load_device_file (store, uid, &err);
+
+      if (record == NULL)
+        {
+          bolt_warn_err (err, LOG_TOPIC ("store"), LOG_DEV_UID (uid),
+                         "failed to migrate device");
+          continue;
+        }
+
+      ok = bolt_database_put (store->db, uid, record, error);
+      if (!ok)
+        {
+          bolt_database_rollback (store->db);
+          return FALSE;
+        }
+
+      count++;
+    }
+
+  /* writes the database, even if it is empty, so that
+   * the migration is only ever done once */
+  ok = bolt_database_commit (store->db, error);
+
+  if (!ok)
+    return FALSE;
+
+  bolt_info (LOG_TOPIC ("store"), "migrated %u devices", count);
+
+  if (ids->len == 0)
+    return TRUE;
+
+  /* keep the old entries around but out of the way */
+  target = g_file_get_child (store->root, "devices.migrated");
+  from = g_file_get_path (store->devices);
+  to = g_file_get_path (target);
+
+  return bolt_rename (from, to, error);
+}
+
+/* the database could not be opened: set it aside and restore
+ * the previous generation that the database keeps around on
+ * every write, which only loses the very last change; if that
+ * is not usable either, import the devices again from the
+ * directory layout kept around by store_migrate_devices */
+static gboolean
+store_recover_database (BoltStore *store,
+                        GFile     *dbfile,
+                        GError   **error)
+{
+  g_autoptr(BoltDatabase) prev = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GFile) migrated = NULL;
+  g_autofree char *dbpath = NULL;
+  g_autofree char *aside = NULL;
+  g_autofree char *from = NULL;
+  g_autofree char *to = NULL;
+  gboolean ok;
+
+  dbpath = g_file_get_path (dbfile);
+  aside = g_strconcat (dbpath, ".corrupt", NULL);
+
+  if (g_file_query_exists (dbfile, NULL))
+    {
+      ok = bolt_rename (dbpath, aside, error);
+      if (!ok)
+        return FALSE;
+    }
+
+  prev = bolt_database_new (store->root, DB_FILE BOLT_DATABASE_PREVIOUS, &err);
+
+  if (prev == NULL)
+    bolt_warn_err (err, LOG_TOPIC ("store"),
+                   "previous database generation unusable");
+
+  if (prev != NULL && !bolt_database_is_fresh (prev))
+    {
+      g_clear_object (&prev);
+      from = g_strconcat (dbpath, BOLT_DATABASE_PREVIOUS, NULL);
+
+      ok = bolt_rename (from, dbpath, error);
+      if (!ok)
+        return FALSE;
+
+      store->db = bolt_database_new (store->root, DB_FILE, error);
+
+      if (store->db == NULL)
+        return FALSE;
+
+      bolt_warn (LOG_TOPIC ("store"),
+                 "restored previous database generation, "
+                 "the last change is lost");
+      return TRUE;
+    }
+
+  migrated = g_file_get_child (store->root, "devices.migrated");
+
+  if (g_file_query_exists (migrated, NULL))
+    {
+      from = g_file_get_path (migrated);
+      to = g_file_get_path (store->devices);
+
+      ok = bolt_rename (from, to, error);
+      if (!ok)
+        return FALSE;
+
+      bolt_warn (LOG_TOPIC ("store"),
+                 "restoring devices from the migrated layout, "
+                 "changes since the migration are lost");
+    }
+  else
+    bolt_critical (LOG_TOPIC ("store"),
+                   "nothing to recover devices from, "
+                   "starting with an empty database");
+
+  store->db = bolt_database_new (store->root, DB_FILE, error);
+
+  if (store->db == NULL)
+    return FALSE;
+
+  ok = store_migrate_devices (store, error);
+
+  if (!ok)
+    g_clear_object (&store->db);
+
+  return ok;
+}
+
+static void
+store_init_backend (BoltStore *store)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GFile) dbfile = NULL;
+  const char *backend;
+  gboolean ok;
+
+  dbfile = g_file_get_child (store->root, DB_FILE);
+  backend = g_getenv (BOLT_ENV_STORE_BACKEND);
+
+  if (backend == NULL)
+    ok = g_file_query_exists (dbfile, NULL);
+  else if (bolt_streq (backend, "database"))
+    ok = TRUE;
+  else if (bolt_streq (backend, "directory"))
+    {
+      /* the devices were moved into the database, going back
+       * to the directories would make all of them disappear */
+      ok = g_file_query_exists (dbfile, NULL);
+
+      if (ok)
+        bolt_warn (LOG_TOPIC ("store"), "database exists, "
+                   "refusing to switch back to directories");
+    }
+  else
+    {
+      bolt_warn (LOG_TOPIC ("store"), "unknown backend: %s", backend);
+      ok = FALSE;
+    }
+
+  if (!ok)
+    return;
+
+  ok = bolt_fs_make_parent_dirs (dbfile, &err);
+
+  if (ok)
+    store->db = bolt_database_new (store->root, DB_FILE, &err);
+
+  if (store->db == NULL)
+    {
+      bolt_critical (LOG_TOPIC ("store"), LOG_ERR (err),
+                     "failed to open database, recovering");
+      g_clear_error (&err);
+
+      ok = store_recover_database (store, dbfile, &err);
+
+      if (!ok)
+        bolt_critical (LOG_TOPIC ("store"), LOG_ERR (err),
+                       "failed to recover database, using directories");
+
+      return;
+    }
+
+  if (!bolt_database_is_fresh (store->db))
+    return;
+
+  ok = store_migrate_devices (store, &err);
+
+  if (!ok)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("store"),
+                     "failed to migrate devices, using directories");
+      g_clear_object (&store->db);
+    }
+}
+
+static gboolean
+store_migrate_times (BoltStore *store,
+                     GError   **error)
+{
+  g_autoptr(GPtrArray) names = NULL;
+  g_autoptr(GFile) target = NULL;
+  g_autofree char *from = NULL;
+  g_autofree char *to = NULL;
+  guint count = 0;
+  gboolean ok;
+
+  names = store_list_dir (store->times, error);
+
+  if (names == NULL)
+    return FALSE;
+
+  for (guint i = 0; i < names->len; i++)
+    {
+      g_autoptr(GFileInfo) info = NULL;
+      g_autoptr(GFile) gf = NULL;
+      g_autoptr(GError) err = NULL;
+      g_autofree char *uid = NULL;
+      const char *name = g_ptr_array_index (names, i);
+      const char *timesel;
+      guint64 val;
+
+      timesel = strrchr (name, '.');
+
+      if (timesel == NULL || !bolt_time_table_supports (timesel + 1))
+        continue;
+
+      uid = g_strndup (name, timesel - name);
+      timesel++;
+
+      gf = g_file_get_child (store->times, name);
+      info = g_file_query_info (gf, "time::modified",
+                                G_FILE_QUERY_INFO_NONE,
+                                NULL, &err);
+
+      ok = info != NULL;
+
+      if (ok)
+        {
+          val = g_file_info_get_attribute_uint64 (info, "time::modified");
+          ok = bolt_time_table_put (store->timetable, uid, timesel, val, &err);
+        }
+
+      if (!ok)
+        {
+          bolt_warn_err (err, LOG_TOPIC ("store"), LOG_DEV_UID (uid),
+                         "failed to migrate timestamp '%s'", timesel);
+          continue;
+        }
+
+      count++;
+    }
+
+  ok = bolt_time_table_flush (store->timetable, error);
+
+  if (!ok)
+    return FALSE;
+
+  bolt_info (LOG_TOPIC ("store"), "migrated %u timestamps", count);
+
+  if (names->len == 0)
+    return TRUE;
+
+  /* keep the old files around but out of the way */
+  target = g_file_get_child (store->root, "times.migrated");
+  from = g_file_get_path (store->times);
+  to = g_file_get_path (target);
+
+  return bolt_rename (from, to, error);
+}
+
+static void
+store_init_times (BoltStore *store)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GFile) file = NULL;
+  gboolean ok;
+
+  file = g_file_get_child (store->root, TIMES_FILE);
+  ok = bolt_fs_make_parent_dirs (file, &err);
+
+  if (ok)
+    store->timetable = bolt_time_table_new (store->root, TIMES_FILE, &err);
+
+  if (store->timetable == NULL)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("store"),
+                     "failed to open time table, using files");
+      return;
+    }
+
+  if (!bolt_time_table_is_fresh (store->timetable))
+    return;
+
+  ok = store_migrate_times (store, &err);
+
+  if (!ok)
+    {
+      bolt_warn_err (err, LOG_TOPIC ("store"),
+                     "failed to migrate timestamps, using files");
+      g_clear_object (&store->timetable);
+      (void) g_file_delete (file, NULL, NULL);
+    }
+}
+
+/* public methods */
+
+BoltStore *
+bolt_store_new (const char *path)
+{
+  g_autoptr(GFile) root = NULL;
+  BoltStore *store;
+
+  root = g_file_new_for_path (path);
+  store = g_object_new (BOLT_TYPE_STORE,
+                        "root", root,
+                        NULL);
+
+  return store;
+}
+
+GKeyFile *
+bolt_store_config_load (BoltStore *store,
+                        GError   **error)
+{
+  g_autoptr(GKeyFile) kf = NULL;
+  g_autoptr(GFile) sf = NULL;
+  g_autofree char *data  = NULL;
+  gboolean ok;
+  gsize len;
+
+  g_return_val_if_fail (store != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  sf = g_file_get_child (store->root, CFG_FILE);
+  ok = g_file_load_contents (sf, NULL,
+                             &data, &len,
+                             NULL,
+                             error);
+
+  if (!ok)
+    return NULL;
+
+  kf = g_key_file_new ();
+  ok = g_key_file_load_from_data (kf, data, len, G_KEY_FILE_NONE, error);
+
+  if (!ok)
+    return NULL;
+
+  return g_steal_pointer (&kf);
+}
+
+gboolean
+bolt_store_config_save (BoltStore *store,
+                        GKeyFile  *config,
+                        GError   **error)
+{
+  g_autoptr(GFile) sf = NULL;
+  g_autofree char *data  = NULL;
+  gboolean ok;
+  gsize len;
+
+  g_return_val_if_fail (store != NULL, FALSE);
+  g_return_val_if_fail (config != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  sf = g_file_get_child (store->root, CFG_FILE);
+  data = g_key_file_to_data (config, &len, error);
+
+  if (!data)
+    return FALSE;
+
+  ok = g_file_replace_contents (sf,
+                                data, len,
+                                NULL, FALSE,
+                                0,
+                                NULL,
+                                NULL, error);
+
+  return ok;
+}
+
+void
+bolt_store_begin (BoltStore *store)
+{
+  g_return_if_fail (BOLT_IS_STORE (store));
+
+  /* released by commit or rollback */
+  g_rec_mutex_lock (&store->lock);
+
+  if (store->txn++ == 0)
+    g_atomic_pointer_set (&store->owner, g_thread_self ());
+
+  if (store->db != NULL)
+    bolt_database_begin (store->db);
+}
+
+gboolean
+bolt_store_commit (BoltStore *store,
+                   GError   **error)
+{
+  store_autolock GRecMutex *lock = NULL;
+  g_autoptr(GError) err = NULL;
+  gboolean ok;
+
+  g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
+  g_return_val_if_fail (store->txn > 0, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  /* pairs with the lock taken in begin */
+  lock = &store->lock;
+  store->txn--;
+
+  /* nested transaction, the outer one will commit */
+  if (store->txn > 0)
+    {
+      if (store->db != NULL)
+        return bolt_database_commit (store->db, error);
+
+      return TRUE;
+    }
+
+  g_atomic_pointer_set (&store->owner, NULL);
+
+  /* timestamps are not part of the transaction, but
+   * they are written now so they are covered by the
+   * sync below */
+  if (store->timetable != NULL)
+    {
+      ok = bolt_time_table_flush (store->timetable, &err);
+
+      if (!ok)
+        bolt_warn_err (err, LOG_TOPIC ("store"),
+                       "failed to write timestamps");
+    }
+
+  ok = store_commit_staged (store, error);
+
+  if (ok && store->db != NULL)
+    ok = bolt_database_commit (store->db, error);
+  else if (!ok && store->db != NULL)
+    bolt_database_rollback (store->db);
+
+  /* the index might not reflect what is on disk */
+  if (!ok)
+    store_index_invalidate (store);
+
+  return ok;
+}
+
+void
+bolt_store_rollback (BoltStore *store)
+{
+  store_autolock GRecMutex *lock = NULL;
+
+  g_return_if_fail (BOLT_IS_STORE (store));
+  g_return_if_fail (store->txn > 0);
+
+  /* pairs with the lock taken in begin */
+  lock = &store->lock;
+  store->txn--;
+
+  if (store->db != NULL)
+    bolt_database_rollback (store->db);
+
+  /* nested transaction, only the outer one
+   * can discard the changes */
+  if (store->txn > 0)
+    return;
+
+  g_atomic_pointer_set (&store->owner, NULL);
+  store_discard_staged (store);
+  store_index_invalidate (store);
+}
+
+/* whether the calling thread has a transaction open */
+gboolean
+bolt_store_in_transaction (BoltStore *store)
+{
+  g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
+
+  return store_owns_txn (store);
+}
+
+GStrv
+bolt_store_list_uids (BoltStore  *store,
+                      const char *type,
+                      GError    **error)
+{
+  g_autoptr(GPtrArray) ids = NULL;
+  GFile *dir = NULL;
+
+  g_return_val_if_fail (BOLT_IS_STORE (store), NULL);
+  g_return_val_if_fail (type != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  if (bolt_streq (type, "devices"))
+    dir = store->devices;
+  if (bolt_streq (type, "domains"))
+    dir = store->domains;
+
+  if (dir == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "unknown stored typed '%s'", type);
+      return NULL;
+    }
+
+  if (dir == store->devices && store->db != NULL && store_owns_txn (store))
+    return bolt_database_list_uids (store->db);
+  else if (dir == store->devices && store->db != NULL)
+    return bolt_database_list_committed (store->db);
+
+  ids = store_list_dir (dir, error);
+
+  if (ids == NULL)
+    return NULL;
+
+  return bolt_strv_from_ptr_array (&ids);
+}
+
+/* the I/O part of storing a domain, safe to call
+ * from the I/O thread */
+static gboolean
+store_put_domain_internal (BoltStore          *store,
+                           const char         *uid,
+                           const char * const *bootacl,
+                           GError            **error)
+{
+  store_autolock GRecMutex *lock = NULL;
+  g_autoptr(GError) err = NULL;
   g_autoptr(GFile) entry = NULL;
+  g_autoptr(GFile) source = NULL;
+  g_autoptr(GFile) target = NULL;
   g_autoptr(GKeyFile) kf = NULL;
-  g_autoptr(GError) err = NULL;
-  g_autofree char *data = NULL;
   g_autofree char *path = NULL;
-  BoltDeviceType type;
-  const char *uid;
-  const char *label;
-  gboolean fresh;
   gboolean ok;
-  guint64 ctime;
-  guint64 atime;
-  gint64 stime;
   gsize len;
-  guint keystate = 0;
+
+  lock = store_lock (store);
+
+  entry = g_file_get_child (store->domains, uid);
+
+  ok = bolt_fs_make_parent_dirs (entry, error);
+  if (!ok)
+    return FALSE;
+
+  kf = g_key_file_new ();
+  source = store_resolve_file (store, entry);
+  path = g_file_get_path (source);
+  ok = g_key_file_load_from_file (kf,
+                                  path,
+                                  G_KEY_FILE_KEEP_COMMENTS,
+                                  &err);
+
+  if (!ok && !bolt_err_notfound (err))
+    {
+      bolt_warn_err (err, LOG_TOPIC ("store"),
+                     "error loading existing domain");
+      g_clear_error (&err);
+      /* not fatal, keep going */
+    }
+
+  len = bolt_strv_length ((char * const *) bootacl);
+
+  g_key_file_set_string_list (kf,
+                              DOMAIN_GROUP,
+                              "bootacl",
+                              bootacl,
+                              len);
+
+  target = store_stage_file (store, entry);
+  g_clear_pointer (&path, g_free);
+  path = g_file_get_path (target);
+
+  return g_key_file_save_to_file (kf, path, error);
+}
+
+gboolean
+bolt_store_put_domain (BoltStore  *store,
+                       BoltDomain *domain,
+                       GError    **error)
+{
+  char * const * bootacl = NULL;
+  const char *uid;
+  gboolean ok;
 
   g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
-  g_return_val_if_fail (BOLT_IS_DEVICE (device), FALSE);
-  g_return_val_if_fail (key == NULL || BOLT_IS_KEY (key), FALSE);
+  g_return_val_if_fail (BOLT_IS_DOMAIN (domain), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  uid = bolt_device_get_uid (device);
+  uid = bolt_domain_get_uid (domain);
   g_assert (uid);
 
-  entry = g_file_get_child (store->devices, uid);
+  bootacl = bolt_domain_get_bootacl (domain);
+
+  ok = store_put_domain_internal (store, uid,
+                                  (const char * const *) bootacl,
+                                  error);
+
+  if (!ok)
+    return FALSE;
+
+  g_object_set (G_OBJECT (domain),
+                "store", store,
+                NULL);
+
+  return ok;
+}
+
+BoltDomain *
+bolt_store_get_domain (BoltStore  *store,
+                       const char *uid,
+                       GError    **error)
+{
+  g_autoptr(GKeyFile) kf = NULL;
+  g_autoptr(GFile) entry = NULL;
+  g_autoptr(GFile) db = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *path = NULL;
+  g_auto(GStrv) bootacl = NULL;
+  BoltDomain *domain = NULL;
+  gboolean ok;
+
+  g_return_val_if_fail (store != NULL, NULL);
+  g_return_val_if_fail (uid != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  entry = g_file_get_child (store->domains, uid);
+  db = store_resolve_file (store, entry);
+  path = g_file_get_path (db);
+
+  kf = g_key_file_new ();
+  ok = g_key_file_load_from_file (kf, path, G_KEY_FILE_NONE, error);
+
+  if (!ok)
+    return NULL;
+
+  bootacl = g_key_file_get_string_list (kf,
+                                        DOMAIN_GROUP,
+                                        "bootacl",
+                                        NULL,
+                                        &err);
+
+  if (bootacl == NULL && !bolt_err_notfound (err))
+    {
+      bolt_warn_err (err, LOG_DOM_UID (uid), LOG_TOPIC ("store"),
+                     "failed to parse bootacl for domain '%s'",
+                     uid);
+
+      g_clear_error (&err);
+    }
+
+  if (bolt_strv_isempty (bootacl))
+    g_clear_pointer (&bootacl, g_strfreev);
+
+  domain = g_object_new (BOLT_TYPE_DOMAIN,
+                         "store", store,
+                         "uid", uid,
+                         "bootacl", bootacl,
+                         NULL);
+
+  return domain;
+}
+
+gboolean
+bolt_store_del_domain (BoltStore  *store,
+                       BoltDomain *domain,
+                       GError    **error)
+{
+  store_autolock GRecMutex *lock = NULL;
+  g_autoptr(GFile) path = NULL;
+  const char *uid;
+  gboolean ok;
+
+  g_return_val_if_fail (store != NULL, FALSE);
+  g_return_val_if_fail (domain != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  lock = store_lock (store);
+
+  uid = bolt_domain_get_uid (domain);
+
+  path = g_file_get_child (store->domains, uid);
+  ok = store_delete_file (store, path, error);
+
+  if (!ok)
+    return FALSE;
+
+  g_object_set (domain,
+                "store", NULL,
+                NULL);
+
+  return TRUE;
+}
+
+/* snapshot of the stored properties of a device, so that
+ * it can be written from the I/O thread */
+typedef struct StoreRecord
+{
+  char          *uid;
+  char          *name;
+  char          *vendor;
+  char          *label;
+  BoltDeviceType type;
+  BoltPolicy     policy;
+  gint64         stime;
+  guint64        ctime;
+  guint64        atime;
+  BoltKey       *key;
+
+  /* result */
+  guint          keystate;
+} StoreRecord;
+
+static StoreRecord *
+store_record_new (BoltDevice *device,
+                  BoltPolicy  policy,
+                  BoltKey    *key)
+{
+  StoreRecord *rec = g_slice_new0 (StoreRecord);
+
+  rec->uid = g_strdup (bolt_device_get_uid (device));
+  rec->name = g_strdup (bolt_device_get_name (device));
+  rec->vendor = g_strdup (bolt_device_get_vendor (device));
+  rec->label = g_strdup (bolt_device_get_label (device));
+  rec->type = bolt_device_get_device_type (device);
+  rec->policy = policy;
+  rec->stime = bolt_device_get_storetime (device);
+  rec->ctime = bolt_device_get_conntime (device);
+  rec->atime = bolt_device_get_authtime (device);
+  rec->key = key ? g_object_ref (key) : NULL;
+
+  if (rec->stime < 1)
+    rec->stime = (gint64) bolt_now_in_seconds ();
+
+  return rec;
+}
+
+static void
+store_record_free (gpointer data)
+{
+  StoreRecord *rec = data;
+
+  g_free (rec->uid);
+  g_free (rec->name);
+  g_free (rec->vendor);
+  g_free (rec->label);
+  g_clear_object (&rec->key);
+
+  g_slice_free (StoreRecord, rec);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (StoreRecord, store_record_free);
+
+static gboolean
+store_put_device_file (BoltStore         *store,
+                       const StoreRecord *rec,
+                       GError           **error)
+{
+  g_autoptr(GFile) entry = NULL;
+  g_autoptr(GFile) source = NULL;
+  g_autoptr(GFile) target = NULL;
+  g_autoptr(GKeyFile) kf = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *data = NULL;
+  g_autofree char *path = NULL;
+  gboolean ok;
+  gsize len;
+
+  entry = g_file_get_child (store->devices, rec->uid);
 
   ok = bolt_fs_make_parent_dirs (entry, error);
   if (!ok)
@@ -507,7 +1495,8 @@ bolt_store_put_device (BoltStore  *store,
 
   kf = g_key_file_new ();
 
-  path = g_file_get_path (entry);
+  source = store_resolve_file (store, entry);
+  path = g_file_get_path (source);
 
   ok = g_key_file_load_from_file (kf,
                                   path,
@@ -515,79 +1504,204 @@ bolt_store_put_device (BoltStore  *store,
                                   &err);
 
   if (!ok && bolt_err_exists (err))
-    bolt_warn_err (err, LOG_TOPIC ("store"), LOG_DEV_UID (uid),
+    bolt_warn_err (err, LOG_TOPIC ("store"), LOG_DEV_UID (rec->uid),
                    "could not load previously stored device");
 
-  g_key_file_set_string (kf, DEVICE_GROUP, "name", bolt_device_get_name (device));
-  g_key_file_set_string (kf, DEVICE_GROUP, "vendor", bolt_device_get_vendor (device));
-
-  type = bolt_device_get_device_type (device);
-  g_key_file_set_string (kf, DEVICE_GROUP, "type", bolt_device_type_to_string (type));
+  g_key_file_set_string (kf, DEVICE_GROUP, "name", rec->name);
+  g_key_file_set_string (kf, DEVICE_GROUP, "vendor", rec->vendor);
+  g_key_file_set_string (kf, DEVICE_GROUP, "type", bolt_device_type_to_string (rec->type));
 
-  if (policy != BOLT_POLICY_DEFAULT)
+  if (rec->policy != BOLT_POLICY_DEFAULT)
     {
-      const char *str = bolt_policy_to_string (policy);
+      const char *str = bolt_policy_to_string (rec->policy);
       g_key_file_set_string (kf, USER_GROUP, "policy", str);
     }
 
-  label = bolt_device_get_label (device);
-
-  if (label != NULL)
-    g_key_file_set_string (kf, USER_GROUP, "label", label);
-
-  stime = bolt_device_get_storetime (device);
-
-  if (stime < 1)
-    stime = (gint64) bolt_now_in_seconds ();
+  if (rec->label != NULL)
+    g_key_file_set_string (kf, USER_GROUP, "label", rec->label);
 
-  g_key_file_set_uint64 (kf, USER_GROUP, "storetime", stime);
+  g_key_file_set_uint64 (kf, USER_GROUP, "storetime", rec->stime);
 
   data = g_key_file_to_data (kf, &len, error);
 
   if (!data)
     return FALSE;
 
-  if (key)
-    {
-      g_clear_error (&err);
-
-      ok = bolt_store_put_key (store, uid, key, &err);
-
-      if (!ok)
-        bolt_warn_err (err, "failed to store key");
-      else
-        keystate = bolt_key_get_state (key);
-    }
-
-  ok = g_file_replace_contents (entry,
+  target = store_stage_file (store, entry);
+  ok = g_file_replace_contents (target,
                                 data, len,
                                 NULL, FALSE,
                                 0,
                                 NULL,
                                 NULL, error);
 
+  return ok;
+}
+
+static gboolean
+store_put_device_record (BoltStore         *store,
+                         const StoreRecord *rec,
+                         GError           **error)
+{
+  g_autoptr(GVariantDict) dict = NULL;
+  g_autoptr(GVariant) old = NULL;
+  g_autoptr(GVariant) key = NULL;
+  const char *type;
+
+  dict = g_variant_dict_new (NULL);
+
+  /* the key state is the only thing that is carried over,
+   * everything else is taken from the new record */
+  old = bolt_database_lookup (store->db, rec->uid);
+
+  if (old != NULL)
+    key = g_variant_lookup_value (old, "key", NULL);
+
+  if (key != NULL)
+    g_variant_dict_insert_value (dict, "key", key);
+
+  g_variant_dict_insert (dict, "name", "s", rec->name);
+  g_variant_dict_insert (dict, "vendor", "s", rec->vendor);
+
+  type = bolt_device_type_to_string (rec->type);
+  g_variant_dict_insert (dict, "type", "s", type);
+
+  if (rec->policy != BOLT_POLICY_DEFAULT)
+    g_variant_dict_insert (dict, "policy", "s", bolt_policy_to_string (rec->policy));
+
+  if (rec->label != NULL)
+    g_variant_dict_insert (dict, "label", "s", rec->label);
+
+  g_variant_dict_insert (dict, "storetime", "t", (guint64) rec->stime);
+
+  return bolt_database_put (store->db, rec->uid, g_variant_dict_end (dict), error);
+}
+
+static guint
+store_put_device_key (BoltStore  *store,
+                      const char *uid,
+                      BoltKey    *key)
+{
+  g_autoptr(GError) err = NULL;
+  gboolean ok;
+
+  if (key == NULL)
+    return 0;
+
+  ok = bolt_store_put_key (store, uid, key, &err);
+
+  if (!ok)
+    {
+      bolt_warn_err (err, "failed to store key");
+      return 0;
+    }
+
+  return bolt_key_get_state (key);
+}
+
+/* index, see below */
+static void     store_index_put (BoltStore         *store,
+                                 const StoreRecord *rec);
+
+static void     store_index_del (BoltStore  *store,
+                                 const char *uid);
+
+static void     store_index_set_key (BoltStore   *store,
+                                     const char  *uid,
+                                     BoltKeyState key);
+
+static void     store_index_set_time (BoltStore  *store,
+                                      const char *uid,
+                                      const char *timesel,
+                                      guint64     val);
+
+/* the I/O part of storing a device, safe to call
+ * from the I/O thread */
+static gboolean
+store_put_device_internal (BoltStore   *store,
+                           StoreRecord *rec,
+                           GError     **error)
+{
+  gboolean ok;
+
+  /* the key and the device are committed together */
+  bolt_store_begin (store);
+
+  if (store->db != NULL)
+    ok = store_put_device_record (store, rec, error);
+  else
+    ok = store_put_device_file (store, rec, error);
+
+  /* the key state of the database record gets updated, so the
+   * key must be written after the record */
+  if (ok)
+    rec->keystate = store_put_device_key (store, rec->uid, rec->key);
+
+  if (ok)
+    ok = bolt_store_commit (store, error);
+  else
+    bolt_store_rollback (store);
+
   if (!ok)
     return FALSE;
 
+  store_index_put (store, rec);
+
+  bolt_store_put_times (store, rec->uid, NULL,
+                        "conntime", rec->ctime,
+                        "authtime", rec->atime,
+                        NULL);
+
+  return TRUE;
+}
+
+/* update the device object, must be called
+ * from the main thread */
+static void
+store_put_device_apply (BoltStore         *store,
+                        BoltDevice        *device,
+                        const StoreRecord *rec)
+{
+  gboolean fresh;
+
   fresh = bolt_device_get_stored (device) == FALSE;
 
-  g_object_set (device,
-                "store", store,
-                "policy", policy,
-                "key", keystate,
-                "storetime", stime,
-                NULL);
+  g_object_set (device,
+                "store", store,
+                "policy", rec->policy,
+                "key", rec->keystate,
+                "storetime", rec->stime,
+                NULL);
+
+  if (fresh)
+    g_signal_emit (store, signals[SIGNAL_DEVICE_ADDED], 0, rec->uid);
+}
+
+gboolean
+bolt_store_put_device (BoltStore  *store,
+                       BoltDevice *device,
+                       BoltPolicy  policy,
+                       BoltKey    *key,
+                       GError    **error)
+{
+  g_autoptr(StoreRecord) rec = NULL;
+  gboolean ok;
+
+  g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
+  g_return_val_if_fail (BOLT_IS_DEVICE (device), FALSE);
+  g_return_val_if_fail (key == NULL || BOLT_IS_KEY (key), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  g_assert (bolt_device_get_uid (device));
+
+  rec = store_record_new (device, policy, key);
+  ok = store_put_device_internal (store, rec, error);
 
-  if (fresh)
-    g_signal_emit (store, signals[SIGNAL_DEVICE_ADDED], 0, uid);
+  if (!ok)
+    return FALSE;
 
-  ctime = bolt_device_get_conntime (device);
-  atime = bolt_device_get_authtime (device);
+  store_put_device_apply (store, device, rec);
 
-  bolt_store_put_times (store, uid, NULL,
-                        "conntime", ctime,
-                        "authtime", atime,
-                        NULL);
   return TRUE;
 }
 
@@ -596,48 +1710,38 @@ bolt_store_get_device (BoltStore  *store,
                        const char *uid,
                        GError    **error)
 {
-  g_autoptr(GKeyFile) kf = NULL;
-  g_autoptr(GFile) db = NULL;
+  g_autoptr(GVariant) record = NULL;
   g_autoptr(GError) err = NULL;
-  g_autofree char *name = NULL;
-  g_autofree char *vendor = NULL;
-  g_autofree char *data  = NULL;
-  g_autofree char *typestr = NULL;
-  g_autofree char *polstr = NULL;
+  const char *name = NULL;
+  const char *vendor = NULL;
+  const char *typestr = NULL;
+  const char *polstr = NULL;
   g_autofree char *label = NULL;
   BoltDeviceType type;
   BoltPolicy policy;
-  BoltKeyState key;
-  gboolean ok;
-  guint64 stime;
+  guint32 key = BOLT_KEY_MISSING;
+  guint64 stime = 0;
   guint64 atime = 0;
   guint64 ctime = 0;
-  gsize len;
 
   g_return_val_if_fail (BOLT_IS_STORE (store), NULL);
   g_return_val_if_fail (uid != NULL, NULL);
   g_return_val_if_fail (error == NULL || *error == NULL, NULL);
 
-  db = g_file_get_child (store->devices, uid);
-  ok = g_file_load_contents (db, NULL,
-                             &data, &len,
-                             NULL,
-                             error);
-
-  if (!ok)
-    return NULL;
-
-  kf = g_key_file_new ();
-  ok = g_key_file_load_from_data (kf, data, len, G_KEY_FILE_NONE, error);
+  /* reading does not take the lock (see transactions),
+   * so devices can be loaded from several threads */
+  record = store_load_device_record (store, uid, error);
 
-  if (!ok)
+  if (record == NULL)
     return NULL;
 
-  name = g_key_file_get_string (kf, DEVICE_GROUP, "name", NULL);
-  vendor = g_key_file_get_string (kf, DEVICE_GROUP, "vendor", NULL);
-  typestr = g_key_file_get_string (kf, DEVICE_GROUP, "type", NULL);
-  polstr = g_key_file_get_string (kf, USER_GROUP, "policy", NULL);
-  label = g_key_file_get_string (kf, USER_GROUP, "label", NULL);
+  g_variant_lookup (record, "name", "&s", &name);
+  g_variant_lookup (record, "vendor", "&s", &vendor);
+  g_variant_lookup (record, "type", "&s", &typestr);
+  g_variant_lookup (record, "policy", "&s", &polstr);
+  g_variant_lookup (record, "label", "s", &label);
+  g_variant_lookup (record, "storetime", "t", &stime);
+  g_variant_lookup (record, "key", "u", &key);
 
   type = bolt_enum_from_string (BOLT_TYPE_DEVICE_TYPE, typestr, &err);
   if (type == BOLT_DEVICE_UNKNOWN_TYPE)
@@ -666,25 +1770,6 @@ bolt_store_get_device (BoltStore  *store,
                    "invalid device label: %s", label);
     }
 
-  stime = g_key_file_get_uint64 (kf, USER_GROUP, "storetime", &err);
-  if (err != NULL && !bolt_err_notfound (err))
-    bolt_warn_err (err, LOG_TOPIC ("store"), "invalid enroll-time");
-
-  if (stime == 0)
-    {
-      g_autoptr(GFileInfo) info = NULL;
-
-      info = g_file_query_info (db,
-                                "time::changed",
-                                G_FILE_QUERY_INFO_NONE,
-                                NULL, NULL);
-      if (info != NULL)
-        stime = g_file_info_get_attribute_uint64 (info, "time::changed");
-    }
-
-
-  key = bolt_store_have_key (store, uid);
-
   if (name == NULL || vendor == NULL)
     {
       g_set_error_literal (error, BOLT_ERROR, BOLT_ERROR_FAILED,
@@ -714,20 +1799,587 @@ bolt_store_get_device (BoltStore  *store,
                        NULL);
 }
 
+/* loading many devices at once */
+#define STORE_LOAD_MAX_THREADS 8
+
+typedef gpointer (*StoreLoadFunc) (BoltStore  *store,
+                                   const char *uid,
+                                   GError    **error);
+
+typedef struct
+{
+  BoltStore     *store;
+  StoreLoadFunc  func;
+  const char   **uids;
+  gpointer      *res;
+} StoreLoad;
+
+static void
+store_load_one (StoreLoad *load,
+                guint      i)
+{
+  g_autoptr(GError) err = NULL;
+  const char *uid = load->uids[i];
+
+  bolt_debug (LOG_DEV_UID (uid), LOG_TOPIC ("store"), "loading device");
+
+  load->res[i] = load->func (load->store, uid, &err);
+
+  if (load->res[i] == NULL)
+    bolt_warn_err (err, LOG_TOPIC ("store"),
+                   LOG_DIRECT (BOLT_LOG_DEVICE_UID, uid),
+                   "failed to load device (%.7s)", uid);
+}
+
+static void
+store_load_thread (gpointer data,
+                   gpointer user_data)
+{
+  /* indices are offset by one, NULL is not a valid task */
+  store_load_one (user_data, GPOINTER_TO_UINT (data) - 1);
+}
+
+/* calls func for all uids on a small thread pool, the
+ * results are returned in the order of the uids, failed
+ * ones as NULL; the workers only see committed data, so
+ * if the caller owns a transaction, they are loaded in
+ * the calling thread */
+static gpointer *
+store_load_parallel (BoltStore    *store,
+                     const char  **uids,
+                     StoreLoadFunc func,
+                     guint         max_threads)
+{
+  g_autoptr(GError) err = NULL;
+  GThreadPool *pool = NULL;
+  StoreLoad load;
+  guint n_threads;
+  guint n;
+
+  n = g_strv_length ((char **) uids);
+
+  load.store = store;
+  load.func = func;
+  load.uids = uids;
+  load.res = g_new0 (gpointer, n);
+
+  n_threads = MIN (g_get_num_processors (), max_threads);
+  n_threads = MIN (n_threads, n);
+
+  if (n_threads > 1 && !store_owns_txn (store))
+    pool = g_thread_pool_new (store_load_thread, &load,
+                              n_threads, FALSE, &err);
+
+  if (pool == NULL && err != NULL)
+    bolt_warn_err (err, LOG_TOPIC ("store"),
+                   "could not create thread pool");
+
+  for (guint i = 0; i < n; i++)
+    {
+      if (pool != NULL)
+        g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+      else
+        store_load_one (&load, i);
+    }
+
+  /* wait for all of them to finish */
+  if (pool != NULL)
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+  return load.res;
+}
+
+GPtrArray *
+bolt_store_get_devices (BoltStore   *store,
+                        const char **uids)
+{
+  g_autofree gpointer *devs = NULL;
+  GPtrArray *res;
+  guint n;
+
+  g_return_val_if_fail (BOLT_IS_STORE (store), NULL);
+  g_return_val_if_fail (uids != NULL, NULL);
+
+  n = g_strv_length ((char **) uids);
+  devs = store_load_parallel (store, uids,
+                              (StoreLoadFunc) bolt_store_get_device,
+                              STORE_LOAD_MAX_THREADS);
+
+  res = g_ptr_array_new_full (n, g_object_unref);
+
+  for (guint i = 0; i < n; i++)
+    if (devs[i] != NULL)
+      g_ptr_array_add (res, devs[i]);
+
+  return res;
+}
+
+/* index
+ *
+ * A lightweight in-memory copy of the most important
+ * attributes of all stored devices, so that the full
+ * device objects do not need to be created for every
+ * stored device. The index is built on request via
+ * bolt_store_load_index and then kept up to date. If
+ * a transaction is rolled back, it is rebuilt from the
+ * disk on the next access.
+ */
+void
+bolt_store_entry_free (BoltStoreEntry *entry)
+{
+  if (entry == NULL)
+    return;
+
+  g_free (entry->uid);
+  g_free (entry->name);
+  g_free (entry->vendor);
+
+  g_slice_free (BoltStoreEntry, entry);
+}
+
+static BoltStoreEntry *
+store_entry_copy (const BoltStoreEntry *entry)
+{
+  BoltStoreEntry *copy = g_slice_dup (BoltStoreEntry, entry);
+
+  copy->uid = g_strdup (entry->uid);
+  copy->name = g_strdup (entry->name);
+  copy->vendor = g_strdup (entry->vendor);
+
+  return copy;
+}
+
+static BoltStoreEntry *
+store_entry_load (BoltStore  *store,
+                  const char *uid,
+                  GError    **error)
+{
+  g_autoptr(GVariant) record = NULL;
+  BoltStoreEntry *entry;
+  const char *name = NULL;
+  const char *vendor = NULL;
+  const char *polstr = NULL;
+  guint32 key = BOLT_KEY_MISSING;
+
+  record = store_load_device_record (store, uid, error);
+
+  if (record == NULL)
+    return NULL;
+
+  g_variant_lookup (record, "name", "&s", &name);
+  g_variant_lookup (record, "vendor", "&s", &vendor);
+  g_variant_lookup (record, "policy", "&s", &polstr);
+  g_variant_lookup (record, "key", "u", &key);
+
+  if (name == NULL || vendor == NULL)
+    {
+      g_set_error_literal (error, BOLT_ERROR, BOLT_ERROR_FAILED,
+                           "invalid device entry in store");
+      return NULL;
+    }
+
+  entry = g_slice_new0 (BoltStoreEntry);
+  entry->uid = g_strdup (uid);
+  entry->name = g_strdup (name);
+  entry->vendor = g_strdup (vendor);
+  entry->key = key;
+
+  /* same fallback as in bolt_store_get_device */
+  entry->policy = bolt_enum_from_string (BOLT_TYPE_POLICY, polstr, NULL);
+  if (entry->policy == BOLT_POLICY_UNKNOWN)
+    entry->policy = BOLT_POLICY_MANUAL;
+
+  bolt_store_get_times (store, uid, NULL,
+                        "conntime", &entry->conntime,
+                        "authtime", &entry->authtime,
+                        NULL);
+
+  return entry;
+}
+
+static GMutex *
+store_index_lock (BoltStore *store)
+{
+  g_mutex_lock (&store->index_lock);
+  return &store->index_lock;
+}
+
+static void
+store_index_unlock (GMutex **lock)
+{
+  if (*lock != NULL)
+    g_mutex_unlock (*lock);
+}
+
+#define index_autolock bolt_cleanup (store_index_unlock) G_GNUC_UNUSED
+
+static char *
+store_make_namekey (const char *vendor,
+                    const char *name)
+{
+  return g_strdup_printf ("%s\n%s",
+                          vendor ? : "",
+                          name ? : "");
+}
+
+/* must be called with the index lock held */
+static void
+store_names_adjust (GHashTable           *names,
+                    const BoltStoreEntry *entry,
+                    gboolean              add)
+{
+  g_autofree char *key = NULL;
+  guint count;
+
+  key = store_make_namekey (entry->vendor, entry->name);
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (names, key));
+
+  if (add)
+    g_hash_table_insert (names, g_steal_pointer (&key),
+                         GUINT_TO_POINTER (count + 1));
+  else if (count > 1)
+    g_hash_table_insert (names, g_steal_pointer (&key),
+                         GUINT_TO_POINTER (count - 1));
+  else
+    g_hash_table_remove (names, key);
+}
+
+/* the index lock must not be held by the caller; if the
+ * index changed while it was built, or if the changes of
+ * a transaction of another thread might have been missed,
+ * it stays stale */
+static gboolean
+store_index_build (BoltStore *store,
+                   guint      max_threads,
+                   GError   **error)
+{
+  index_autolock GMutex *lock = NULL;
+  g_autofree gpointer *entries = NULL;
+  g_auto(GStrv) ids = NULL;
+  GHashTable *index;
+  GHashTable *names;
+  gboolean busy;
+  guint gen;
+  guint n;
+
+  g_mutex_lock (&store->index_lock);
+  gen = store->index_gen;
+  g_mutex_unlock (&store->index_lock);
+
+  busy = store_other_txn (store);
+
+  ids = bolt_store_list_uids (store, "devices", error);
+
+  if (ids == NULL)
+    return FALSE;
+
+  n = g_strv_length (ids);
+  entries = store_load_parallel (store, (const char **) ids,
+                                 (StoreLoadFunc) store_entry_load,
+                                 max_threads);
+
+  index = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                 NULL, (GDestroyNotify) bolt_store_entry_free);
+
+  names = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                 g_free, NULL);
+
+  for (guint i = 0; i < n; i++)
+    {
+      BoltStoreEntry *entry = entries[i];
+
+      if (entry == NULL)
+        continue;
+
+      g_hash_table_insert (index, entry->uid, entry);
+      store_names_adjust (names, entry, TRUE);
+    }
+
+  lock = store_index_lock (store);
+  g_clear_pointer (&store->index, g_hash_table_unref);
+  g_clear_pointer (&store->names, g_hash_table_unref);
+  store->index = index;
+  store->names = names;
+  busy = busy || store_other_txn (store);
+  store->index_stale = busy || gen != store->index_gen;
+
+  bolt_debug (LOG_TOPIC ("store"), "index with %u of %u devices",
+              g_hash_table_size (index), n);
+
+  return TRUE;
+}
+
+static void
+store_index_invalidate (BoltStore *store)
+{
+  index_autolock GMutex *lock = NULL;
+
+  lock = store_index_lock (store);
+  store->index_gen++;
+
+  if (store->index != NULL)
+    store->index_stale = TRUE;
+}
+
+/* lock the index, after rebuilding it if it became stale;
+ * only then the store lock is needed, otherwise readers
+ * are not blocked by transactions */
+static GMutex *
+store_index_lock_current (BoltStore *store)
+{
+  g_autoptr(GError) err = NULL;
+  gboolean stale;
+  gboolean ok;
+
+  g_mutex_lock (&store->index_lock);
+  stale = store->index != NULL && store->index_stale;
+
+  if (!stale)
+    return &store->index_lock;
+
+  g_mutex_unlock (&store->index_lock);
+
+  ok = store_index_build (store, 1, &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_TOPIC ("store"), "failed to rebuild index");
+
+  return store_index_lock (store);
+}
+
+static void
+store_index_put (BoltStore         *store,
+                 const StoreRecord *rec)
+{
+  index_autolock GMutex *lock = NULL;
+  BoltStoreEntry *entry;
+  BoltStoreEntry *old;
+
+  lock = store_index_lock (store);
+  store->index_gen++;
+
+  if (store->index == NULL)
+    return;
+
+  entry = g_slice_new0 (BoltStoreEntry);
+  entry->uid = g_strdup (rec->uid);
+  entry->name = g_strdup (rec->name);
+  entry->vendor = g_strdup (rec->vendor);
+  entry->policy = rec->policy;
+  entry->key = rec->keystate;
+  entry->conntime = rec->ctime;
+  entry->authtime = rec->atime;
+
+  old = g_hash_table_lookup (store->index, entry->uid);
+
+  if (old != NULL)
+    store_names_adjust (store->names, old, FALSE);
+
+  store_names_adjust (store->names, entry, TRUE);
+  g_hash_table_replace (store->index, entry->uid, entry);
+}
+
+static void
+store_index_del (BoltStore  *store,
+                 const char *uid)
+{
+  index_autolock GMutex *lock = NULL;
+  BoltStoreEntry *entry;
+
+  lock = store_index_lock (store);
+  store->index_gen++;
+
+  if (store->index == NULL)
+    return;
+
+  entry = g_hash_table_lookup (store->index, uid);
+
+  if (entry == NULL)
+    return;
+
+  store_names_adjust (store->names, entry, FALSE);
+  g_hash_table_remove (store->index, uid);
+}
+
+/* a stale index is rebuilt from the disk anyway, so
+ * there is no need to update it, but a build that is
+ * in progress might have missed the change */
+static void
+store_index_set_key (BoltStore   *store,
+                     const char  *uid,
+                     BoltKeyState key)
+{
+  index_autolock GMutex *lock = NULL;
+  BoltStoreEntry *entry;
+
+  lock = store_index_lock (store);
+  store->index_gen++;
+
+  if (store->index == NULL || store->index_stale)
+    return;
+
+  entry = g_hash_table_lookup (store->index, uid);
+
+  if (entry != NULL)
+    entry->key = key;
+}
+
+static void
+store_index_set_time (BoltStore  *store,
+                      const char *uid,
+                      const char *timesel,
+                      guint64     val)
+{
+  index_autolock GMutex *lock = NULL;
+  BoltStoreEntry *entry;
+
+  lock = store_index_lock (store);
+  store->index_gen++;
+
+  if (store->index == NULL || store->index_stale)
+    return;
+
+  entry = g_hash_table_lookup (store->index, uid);
+
+  if (entry == NULL)
+    return;
+
+  if (bolt_streq (timesel, "conntime"))
+    entry->conntime = val;
+  else if (bolt_streq (timesel, "authtime"))
+    entry->authtime = val;
+}
+
+gboolean
+bolt_store_load_index (BoltStore *store,
+                       GError   **error)
+{
+  g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  return store_index_build (store, STORE_LOAD_MAX_THREADS, error);
+}
+
+guint
+bolt_store_count_devices (BoltStore *store)
+{
+  index_autolock GMutex *lock = NULL;
+
+  g_return_val_if_fail (BOLT_IS_STORE (store), 0);
+
+  lock = store_index_lock_current (store);
+
+  g_return_val_if_fail (store->index != NULL, 0);
+
+  return g_hash_table_size (store->index);
+}
+
+BoltStoreEntry *
+bolt_store_lookup_entry (BoltStore  *store,
+                         const char *uid)
+{
+  index_autolock GMutex *lock = NULL;
+  BoltStoreEntry *entry;
+
+  g_return_val_if_fail (BOLT_IS_STORE (store), NULL);
+  g_return_val_if_fail (uid != NULL, NULL);
+
+  lock = store_index_lock_current (store);
+
+  g_return_val_if_fail (store->index != NULL, NULL);
+
+  entry = g_hash_table_lookup (store->index, uid);
+
+  if (entry == NULL)
+    return NULL;
+
+  return store_entry_copy (entry);
+}
+
+GPtrArray *
+bolt_store_list_entries (BoltStore *store)
+{
+  index_autolock GMutex *lock = NULL;
+  GHashTableIter iter;
+  GPtrArray *res;
+  gpointer value;
+
+  g_return_val_if_fail (BOLT_IS_STORE (store), NULL);
+
+  lock = store_index_lock_current (store);
+
+  g_return_val_if_fail (store->index != NULL, NULL);
+
+  res = g_ptr_array_new_full (g_hash_table_size (store->index),
+                              (GDestroyNotify) bolt_store_entry_free);
+
+  g_hash_table_iter_init (&iter, store->index);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    g_ptr_array_add (res, store_entry_copy (value));
+
+  return res;
+}
+
+guint
+bolt_store_count_name (BoltStore  *store,
+                       const char *vendor,
+                       const char *name)
+{
+  index_autolock GMutex *lock = NULL;
+  g_autofree char *key = NULL;
+  gpointer val;
+
+  g_return_val_if_fail (BOLT_IS_STORE (store), 0);
+
+  lock = store_index_lock_current (store);
+
+  g_return_val_if_fail (store->names != NULL, 0);
+
+  key = store_make_namekey (vendor, name);
+  val = g_hash_table_lookup (store->names, key);
+
+  return GPOINTER_TO_UINT (val);
+}
+
+static gboolean
+store_del_device_internal (BoltStore  *store,
+                           const char *uid,
+                           GError    **error)
+{
+  store_autolock GRecMutex *lock = NULL;
+  g_autoptr(GFile) devpath = NULL;
+  gboolean ok;
+
+  lock = store_lock (store);
+
+  if (store->db != NULL)
+    {
+      ok = bolt_database_del (store->db, uid, error);
+    }
+  else
+    {
+      devpath = g_file_get_child (store->devices, uid);
+      ok = store_delete_file (store, devpath, error);
+    }
+
+  if (ok)
+    store_index_del (store, uid);
+
+  return ok;
+}
+
 gboolean
 bolt_store_del_device (BoltStore  *store,
                        const char *uid,
                        GError    **error)
 {
-  g_autoptr(GFile) devpath = NULL;
   gboolean ok;
 
   g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
   g_return_val_if_fail (uid != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  devpath = g_file_get_child (store->devices, uid);
-  ok = g_file_delete (devpath, NULL, error);
+  ok = store_del_device_internal (store, uid, error);
 
   if (ok)
     g_signal_emit (store, signals[SIGNAL_DEVICE_REMOVED], 0, uid);
@@ -752,6 +2404,9 @@ bolt_store_get_time (BoltStore  *store,
   g_return_val_if_fail (timesel != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+  if (store->timetable && bolt_time_table_supports (timesel))
+    return bolt_time_table_get (store->timetable, uid, timesel, outval, error);
+
   fn = g_strdup_printf ("%s.%s", uid, timesel);
   gf = g_file_get_child (store->times, fn);
 
@@ -824,14 +2479,23 @@ bolt_store_put_time (BoltStore  *store,
   g_return_val_if_fail (timesel != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  fn = g_strdup_printf ("%s.%s", uid, timesel);
-  gf = g_file_get_child (store->times, fn);
+  if (store->timetable && bolt_time_table_supports (timesel))
+    {
+      ok = bolt_time_table_put (store->timetable, uid, timesel, val, error);
+    }
+  else
+    {
+      fn = g_strdup_printf ("%s.%s", uid, timesel);
+      gf = g_file_get_child (store->times, fn);
 
-  ok = bolt_fs_make_parent_dirs (gf, error);
-  if (!ok)
-    return FALSE;
+      ok = bolt_fs_make_parent_dirs (gf, error);
+
+      if (ok)
+        ok = bolt_fs_touch (gf, val, val, error);
+    }
 
-  ok = bolt_fs_touch (gf, val, val, error);
+  if (ok)
+    store_index_set_time (store, uid, timesel, val);
 
   return ok;
 }
@@ -906,9 +2570,19 @@ bolt_store_del_time (BoltStore  *store,
   g_return_val_if_fail (timesel != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  name = g_strdup_printf ("%s.%s", uid, timesel);
-  pathfile = g_file_get_child (store->times, name);
-  ok = g_file_delete (pathfile, NULL, error);
+  if (store->timetable && bolt_time_table_supports (timesel))
+    {
+      ok = bolt_time_table_del (store->timetable, uid, timesel, error);
+    }
+  else
+    {
+      name = g_strdup_printf ("%s.%s", uid, timesel);
+      pathfile = g_file_get_child (store->times, name);
+      ok = g_file_delete (pathfile, NULL, error);
+    }
+
+  if (ok)
+    store_index_set_time (store, uid, timesel, 0);
 
   return ok;
 }
@@ -954,13 +2628,39 @@ bolt_store_del_times (BoltStore  *store,
 }
 
 
+static gboolean
+store_update_key_state (BoltStore   *store,
+                        const char  *uid,
+                        BoltKeyState state,
+                        GError     **error)
+{
+  g_autoptr(GVariantDict) dict = NULL;
+  g_autoptr(GVariant) old = NULL;
+
+  if (store->db == NULL)
+    return TRUE;
+
+  /* the record will be created by put_device */
+  old = bolt_database_lookup (store->db, uid);
+
+  if (old == NULL)
+    return TRUE;
+
+  dict = g_variant_dict_new (old);
+  g_variant_dict_insert (dict, "key", "u", (guint32) state);
+
+  return bolt_database_put (store->db, uid, g_variant_dict_end (dict), error);
+}
+
 gboolean
 bolt_store_put_key (BoltStore  *store,
                     const char *uid,
                     BoltKey    *key,
                     GError    **error)
 {
+  store_autolock GRecMutex *lock = NULL;
   g_autoptr(GFile) keypath = NULL;
+  g_autoptr(GFile) target = NULL;
   gboolean ok;
 
   g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
@@ -968,11 +2668,22 @@ bolt_store_put_key (BoltStore  *store,
   g_return_val_if_fail (BOLT_IS_KEY (key), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+  lock = store_lock (store);
+
   keypath = g_file_get_child (store->keys, uid);
   ok = bolt_fs_make_parent_dirs (keypath, error);
 
   if (ok)
-    ok = bolt_key_save_file (key, keypath, error);
+    target = store_stage_file (store, keypath);
+
+  if (ok)
+    ok = bolt_key_save_file (key, target, error);
+
+  if (ok)
+    ok = store_update_key_state (store, uid, bolt_key_get_state (key), error);
+
+  if (ok)
+    store_index_set_key (store, uid, bolt_key_get_state (key));
 
   return ok;
 }
@@ -982,6 +2693,7 @@ bolt_store_have_key (BoltStore  *store,
                      const char *uid)
 {
   g_autoptr(GFileInfo) keyinfo = NULL;
+  g_autoptr(GFile) entry = NULL;
   g_autoptr(GFile) keypath = NULL;
   g_autoptr(GError) err = NULL;
   guint key = BOLT_KEY_MISSING;
@@ -989,7 +2701,9 @@ bolt_store_have_key (BoltStore  *store,
   g_return_val_if_fail (BOLT_IS_STORE (store), key);
   g_return_val_if_fail (uid != NULL, key);
 
-  keypath = g_file_get_child (store->keys, uid);
+  entry = g_file_get_child (store->keys, uid);
+  keypath = store_resolve_file (store, entry);
+
   keyinfo = g_file_query_info (keypath, "standard::*", 0, NULL, &err);
 
   if (keyinfo != NULL)
@@ -1005,13 +2719,15 @@ bolt_store_get_key (BoltStore  *store,
                     const char *uid,
                     GError    **error)
 {
+  g_autoptr(GFile) entry = NULL;
   g_autoptr(GFile) keypath = NULL;
 
   g_return_val_if_fail (BOLT_IS_STORE (store), NULL);
   g_return_val_if_fail (uid != NULL, NULL);
   g_return_val_if_fail (error == NULL || *error == NULL, NULL);
 
-  keypath = g_file_get_child (store->keys, uid);
+  entry = g_file_get_child (store->keys, uid);
+  keypath = store_resolve_file (store, entry);
 
   return bolt_key_load_file (keypath, error);
 }
@@ -1021,6 +2737,7 @@ bolt_store_del_key (BoltStore  *store,
                     const char *uid,
                     GError    **error)
 {
+  store_autolock GRecMutex *lock = NULL;
   g_autoptr(GFile) keypath = NULL;
   gboolean ok;
 
@@ -1028,37 +2745,49 @@ bolt_store_del_key (BoltStore  *store,
   g_return_val_if_fail (uid != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+  lock = store_lock (store);
+
   keypath = g_file_get_child (store->keys, uid);
-  ok = g_file_delete (keypath, NULL, error);
+  ok = store_delete_file (store, keypath, error);
+
+  if (ok)
+    ok = store_update_key_state (store, uid, BOLT_KEY_MISSING, error);
+
+  if (ok)
+    store_index_set_key (store, uid, BOLT_KEY_MISSING);
 
   return ok;
 }
 
-gboolean
-bolt_store_del (BoltStore  *store,
-                BoltDevice *dev,
-                GError    **error)
+/* the I/O part of removing a device, safe to call
+ * from the I/O thread */
+static gboolean
+store_del_internal (BoltStore  *store,
+                    const char *uid,
+                    GError    **error)
 {
   g_autoptr(GError) err = NULL;
-  const char *uid;
   gboolean ok;
 
-  g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
-  g_return_val_if_fail (BOLT_IS_DEVICE (dev), FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
-
-  uid = bolt_device_get_uid (dev);
+  bolt_store_begin (store);
 
   ok = bolt_store_del_key (store, uid, &err);
   if (!ok && !bolt_err_notfound (err))
     {
+      bolt_store_rollback (store);
+
       g_propagate_prefixed_error (error,
                                   g_steal_pointer (&err),
                                   "could not delete key: ");
       return FALSE;
     }
 
-  ok = bolt_store_del_device (store, uid, error);
+  ok = store_del_device_internal (store, uid, error);
+
+  if (ok)
+    ok = bolt_store_commit (store, error);
+  else
+    bolt_store_rollback (store);
 
   if (!ok)
     return FALSE;
@@ -1067,15 +2796,447 @@ bolt_store_del (BoltStore  *store,
                         "conntime", "authtime",
                         NULL);
 
+  return TRUE;
+}
+
+/* must be called from the main thread */
+static void
+store_del_apply (BoltStore  *store,
+                 BoltDevice *dev)
+{
+  const char *uid = bolt_device_get_uid (dev);
+
+  g_signal_emit (store, signals[SIGNAL_DEVICE_REMOVED], 0, uid);
+
   g_object_set (dev,
                 "store", NULL,
                 "key", BOLT_KEY_MISSING,
                 "policy", BOLT_POLICY_DEFAULT,
                 NULL);
+}
+
+gboolean
+bolt_store_del (BoltStore  *store,
+                BoltDevice *dev,
+                GError    **error)
+{
+  gboolean ok;
+
+  g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
+  g_return_val_if_fail (BOLT_IS_DEVICE (dev), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  ok = store_del_internal (store, bolt_device_get_uid (dev), error);
+
+  if (ok)
+    store_del_apply (store, dev);
 
   return ok;
 }
 
+/* asynchronous operations
+ *
+ * All asynchronous operations are queued to a single I/O
+ * thread, and thus are executed in the order they were
+ * submitted. Only the I/O part runs in that thread; any
+ * changes to objects, including the emission of signals,
+ * are done in the main thread once the I/O is done.
+ */
+typedef struct StoreOp StoreOp;
+
+typedef void (*StoreApplyFunc) (BoltStore *store,
+                                StoreOp   *op);
+
+struct StoreOp
+{
+  GTaskThreadFunc     func;
+  StoreApplyFunc      apply;
+  GAsyncReadyCallback callback;
+  gpointer            user_data;
+
+  /* data */
+  char        *uid;
+  BoltDevice  *dev;
+  StoreRecord *rec;
+  BoltKey     *key;
+  BoltDomain  *domain;
+  GStrv        bootacl;
+};
+
+static void
+store_op_free (gpointer data)
+{
+  StoreOp *op = data;
+
+  g_free (op->uid);
+  g_clear_object (&op->dev);
+  g_clear_pointer (&op->rec, store_record_free);
+  g_clear_object (&op->key);
+  g_clear_object (&op->domain);
+  g_clear_pointer (&op->bootacl, g_strfreev);
+
+  g_slice_free (StoreOp, op);
+}
+
+static StoreOp *
+store_op_new (GTaskThreadFunc     func,
+              StoreApplyFunc      apply,
+              const char         *uid,
+              GAsyncReadyCallback callback,
+              gpointer            user_data)
+{
+  StoreOp *op = g_slice_new0 (StoreOp);
+
+  op->func = func;
+  op->apply = apply;
+  op->uid = g_strdup (uid);
+  op->callback = callback;
+  op->user_data = user_data;
+
+  return op;
+}
+
+static void
+store_io_thread (gpointer data,
+                 gpointer user_data)
+{
+  g_autoptr(GTask) task = data;
+  StoreOp *op = g_task_get_task_data (task);
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  op->func (task,
+            g_task_get_source_object (task),
+            op,
+            g_task_get_cancellable (task));
+}
+
+static void
+store_io_done (GObject      *object,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+  BoltStore *store = BOLT_STORE (object);
+  GTask *task = G_TASK (res);
+  StoreOp *op = g_task_get_task_data (task);
+
+  if (op->apply != NULL && !g_task_had_error (task))
+    op->apply (store, op);
+
+  if (op->callback != NULL)
+    op->callback (object, res, op->user_data);
+}
+
+static void
+store_io_push (BoltStore    *store,
+               StoreOp      *op,
+               gpointer      source_tag,
+               GCancellable *cancellable)
+{
+  GTask *task;
+
+  task = g_task_new (store, cancellable, store_io_done, NULL);
+  g_task_set_source_tag (task, source_tag);
+  g_task_set_task_data (task, op, store_op_free);
+
+  /* once the I/O is done, the object state must be updated */
+  g_task_set_check_cancellable (task, FALSE);
+
+  if (store->io == NULL)
+    store->io = g_thread_pool_new (store_io_thread, NULL,
+                                   1, FALSE, NULL);
+
+  g_thread_pool_push (store->io, task, NULL);
+}
+
+static void
+store_put_device_thread (GTask        *task,
+                         gpointer      source,
+                         gpointer      data,
+                         GCancellable *cancellable)
+{
+  GError *error = NULL;
+  StoreOp *op = data;
+  gboolean ok;
+
+  ok = store_put_device_internal (BOLT_STORE (source), op->rec, &error);
+
+  if (!ok)
+    g_task_return_error (task, error);
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+store_put_device_done (BoltStore *store,
+                       StoreOp   *op)
+{
+  store_put_device_apply (store, op->dev, op->rec);
+}
+
+void
+bolt_store_put_device_async (BoltStore          *store,
+                             BoltDevice         *device,
+                             BoltPolicy          policy,
+                             BoltKey            *key,
+                             GCancellable       *cancellable,
+                             GAsyncReadyCallback callback,
+                             gpointer            user_data)
+{
+  StoreOp *op;
+
+  g_return_if_fail (BOLT_IS_STORE (store));
+  g_return_if_fail (BOLT_IS_DEVICE (device));
+  g_return_if_fail (key == NULL || BOLT_IS_KEY (key));
+
+  op = store_op_new (store_put_device_thread,
+                     store_put_device_done,
+                     bolt_device_get_uid (device),
+                     callback, user_data);
+
+  op->dev = g_object_ref (device);
+  op->rec = store_record_new (device, policy, key);
+
+  store_io_push (store, op, bolt_store_put_device_async, cancellable);
+}
+
+gboolean
+bolt_store_put_device_finish (BoltStore    *store,
+                              GAsyncResult *res,
+                              GError      **error)
+{
+  g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
+  g_return_val_if_fail (g_task_is_valid (res, store), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+static void
+store_put_key_thread (GTask        *task,
+                      gpointer      source,
+                      gpointer      data,
+                      GCancellable *cancellable)
+{
+  GError *error = NULL;
+  StoreOp *op = data;
+  gboolean ok;
+
+  ok = bolt_store_put_key (BOLT_STORE (source), op->uid, op->key, &error);
+
+  if (!ok)
+    g_task_return_error (task, error);
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+void
+bolt_store_put_key_async (BoltStore          *store,
+                          const char         *uid,
+                          BoltKey            *key,
+                          GCancellable       *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer            user_data)
+{
+  StoreOp *op;
+
+  g_return_if_fail (BOLT_IS_STORE (store));
+  g_return_if_fail (uid != NULL);
+  g_return_if_fail (BOLT_IS_KEY (key));
+
+  op = store_op_new (store_put_key_thread, NULL,
+                     uid, callback, user_data);
+
+  op->key = g_object_ref (key);
+
+  store_io_push (store, op, bolt_store_put_key_async, cancellable);
+}
+
+gboolean
+bolt_store_put_key_finish (BoltStore    *store,
+                           GAsyncResult *res,
+                           GError      **error)
+{
+  g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
+  g_return_val_if_fail (g_task_is_valid (res, store), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+static void
+store_put_domain_thread (GTask        *task,
+                         gpointer      source,
+                         gpointer      data,
+                         GCancellable *cancellable)
+{
+  GError *error = NULL;
+  StoreOp *op = data;
+  gboolean ok;
+
+  ok = store_put_domain_internal (BOLT_STORE (source),
+                                  op->uid,
+                                  (const char * const *) op->bootacl,
+                                  &error);
+
+  if (!ok)
+    g_task_return_error (task, error);
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+store_put_domain_done (BoltStore *store,
+                       StoreOp   *op)
+{
+  g_object_set (G_OBJECT (op->domain),
+                "store", store,
+                NULL);
+}
+
+void
+bolt_store_put_domain_async (BoltStore          *store,
+                             BoltDomain         *domain,
+                             GCancellable       *cancellable,
+                             GAsyncReadyCallback callback,
+                             gpointer            user_data)
+{
+  StoreOp *op;
+
+  g_return_if_fail (BOLT_IS_STORE (store));
+  g_return_if_fail (BOLT_IS_DOMAIN (domain));
+
+  op = store_op_new (store_put_domain_thread,
+                     store_put_domain_done,
+                     bolt_domain_get_uid (domain),
+                     callback, user_data);
+
+  op->domain = g_object_ref (domain);
+  op->bootacl = bolt_domain_dup_bootacl (domain);
+
+  store_io_push (store, op, bolt_store_put_domain_async, cancellable);
+}
+
+gboolean
+bolt_store_put_domain_finish (BoltStore    *store,
+                              GAsyncResult *res,
+                              GError      **error)
+{
+  g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
+  g_return_val_if_fail (g_task_is_valid (res, store), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+static void
+store_get_key_thread (GTask        *task,
+                      gpointer      source,
+                      gpointer      data,
+                      GCancellable *cancellable)
+{
+  GError *error = NULL;
+  StoreOp *op = data;
+  BoltKey *key;
+
+  key = bolt_store_get_key (BOLT_STORE (source), op->uid, &error);
+
+  if (key == NULL)
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, key, g_object_unref);
+}
+
+void
+bolt_store_get_key_async (BoltStore          *store,
+                          const char         *uid,
+                          GCancellable       *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer            user_data)
+{
+  StoreOp *op;
+
+  g_return_if_fail (BOLT_IS_STORE (store));
+  g_return_if_fail (uid != NULL);
+
+  op = store_op_new (store_get_key_thread, NULL,
+                     uid, callback, user_data);
+
+  store_io_push (store, op, bolt_store_get_key_async, cancellable);
+}
+
+BoltKey *
+bolt_store_get_key_finish (BoltStore    *store,
+                           GAsyncResult *res,
+                           GError      **error)
+{
+  g_return_val_if_fail (BOLT_IS_STORE (store), NULL);
+  g_return_val_if_fail (g_task_is_valid (res, store), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
+static void
+store_del_thread (GTask        *task,
+                  gpointer      source,
+                  gpointer      data,
+                  GCancellable *cancellable)
+{
+  GError *error = NULL;
+  StoreOp *op = data;
+  gboolean ok;
+
+  ok = store_del_internal (BOLT_STORE (source), op->uid, &error);
+
+  if (!ok)
+    g_task_return_error (task, error);
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+store_del_done (BoltStore *store,
+                StoreOp   *op)
+{
+  store_del_apply (store, op->dev);
+}
+
+void
+bolt_store_del_async (BoltStore          *store,
+                      BoltDevice         *dev,
+                      GCancellable       *cancellable,
+                      GAsyncReadyCallback callback,
+                      gpointer            user_data)
+{
+  StoreOp *op;
+
+  g_return_if_fail (BOLT_IS_STORE (store));
+  g_return_if_fail (BOLT_IS_DEVICE (dev));
+
+  op = store_op_new (store_del_thread,
+                     store_del_done,
+                     bolt_device_get_uid (dev),
+                     callback, user_data);
+
+  op->dev = g_object_ref (dev);
+
+  store_io_push (store, op, bolt_store_del_async, cancellable);
+}
+
+gboolean
+bolt_store_del_finish (BoltStore    *store,
+                       GAsyncResult *res,
+                       GError      **error)
+{
+  g_return_val_if_fail (BOLT_IS_STORE (store), FALSE);
+  g_return_val_if_fail (g_task_is_valid (res, store), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
 BoltJournal *
 bolt_store_open_journal (BoltStore  *store,
                          const char *type,
@@ -1094,5 +3255,17 @@ bolt_store_open_journal (BoltStore  *store,
 
   journal = bolt_journal_new (root, name, error);
 
+  if (journal == NULL)
+    return NULL;
+
+  /* boot ACL updates come in bursts, e.g. when a number
+   * of devices is enrolled, so let them share a flush */
+  bolt_journal_set_commit_window (journal, 0);
+
+  /* keep open and replay time bounded on long-lived hosts */
+  bolt_journal_set_limits (journal,
+                           STORE_JOURNAL_MAX_SIZE,
+                           STORE_JOURNAL_MAX_AGE);
+
   return journal;
 }
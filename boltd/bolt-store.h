@@ -20,7 +20,7 @@
 
 #pragma once
 
-#include <glib-object.h>
+#include <gio/gio.h>
 
 #include "bolt-device.h"
 #include "bolt-domain.h"
@@ -30,12 +30,37 @@
 
 G_BEGIN_DECLS
 
+/* BoltStoreEntry - lightweight index entry of a stored device */
+typedef struct _BoltStoreEntry
+{
+  char        *uid;
+  char        *name;
+  char        *vendor;
+  BoltPolicy   policy;
+  BoltKeyState key;
+  guint64      conntime;
+  guint64      authtime;
+} BoltStoreEntry;
+
+void              bolt_store_entry_free (BoltStoreEntry *entry);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (BoltStoreEntry, bolt_store_entry_free);
+
 /* BoltStore - database for devices, keys */
 #define BOLT_TYPE_STORE bolt_store_get_type ()
 G_DECLARE_FINAL_TYPE (BoltStore, bolt_store, BOLT, STORE, GObject);
 
 BoltStore *       bolt_store_new (const char *path);
 
+void              bolt_store_begin (BoltStore *store);
+
+gboolean          bolt_store_commit (BoltStore *store,
+                                     GError   **error);
+
+void              bolt_store_rollback (BoltStore *store);
+
+gboolean          bolt_store_in_transaction (BoltStore *store);
+
 GKeyFile *        bolt_store_config_load (BoltStore *store,
                                           GError   **error);
 
@@ -73,6 +98,24 @@ BoltDevice *      bolt_store_get_device (BoltStore  *store,
                                          const char *uid,
                                          GError    **error);
 
+GPtrArray *       bolt_store_get_devices (BoltStore   *store,
+                                          const char **uids);
+
+/* index of all stored devices */
+gboolean          bolt_store_load_index (BoltStore *store,
+                                         GError   **error);
+
+guint             bolt_store_count_devices (BoltStore *store);
+
+BoltStoreEntry *  bolt_store_lookup_entry (BoltStore  *store,
+                                           const char *uid);
+
+GPtrArray *       bolt_store_list_entries (BoltStore *store);
+
+guint             bolt_store_count_name (BoltStore  *store,
+                                         const char *vendor,
+                                         const char *name);
+
 gboolean          bolt_store_del_device (BoltStore  *store,
                                          const char *uid,
                                          GError    **error);
@@ -125,6 +168,60 @@ gboolean          bolt_store_del_key (BoltStore  *store,
                                       const char *uid,
                                       GError    **error);
 
+/* asynchronous variants, executed in order on a dedicated I/O thread */
+void              bolt_store_put_device_async (BoltStore          *store,
+                                               BoltDevice         *device,
+                                               BoltPolicy          policy,
+                                               BoltKey            *key,
+                                               GCancellable       *cancellable,
+                                               GAsyncReadyCallback callback,
+                                               gpointer            user_data);
+
+gboolean          bolt_store_put_device_finish (BoltStore    *store,
+                                                GAsyncResult *res,
+                                                GError      **error);
+
+void              bolt_store_put_key_async (BoltStore          *store,
+                                            const char         *uid,
+                                            BoltKey            *key,
+                                            GCancellable       *cancellable,
+                                            GAsyncReadyCallback callback,
+                                            gpointer            user_data);
+
+gboolean          bolt_store_put_key_finish (BoltStore    *store,
+                                             GAsyncResult *res,
+                                             GError      **error);
+
+void              bolt_store_put_domain_async (BoltStore          *store,
+                                               BoltDomain         *domain,
+                                               GCancellable       *cancellable,
+                                               GAsyncReadyCallback callback,
+                                               gpointer            user_data);
+
+gboolean          bolt_store_put_domain_finish (BoltStore    *store,
+                                                GAsyncResult *res,
+                                                GError      **error);
+
+void              bolt_store_get_key_async (BoltStore          *store,
+                                            const char         *uid,
+                                            GCancellable       *cancellable,
+                                            GAsyncReadyCallback callback,
+                                            gpointer            user_data);
+
+BoltKey *         bolt_store_get_key_finish (BoltStore    *store,
+                                             GAsyncResult *res,
+                                             GError      **error);
+
+void              bolt_store_del_async (BoltStore          *store,
+                                        BoltDevice         *dev,
+                                        GCancellable       *cancellable,
+                                        GAsyncReadyCallback callback,
+                                        gpointer            user_data);
+
+gboolean          bolt_store_del_finish (BoltStore    *store,
+                                         GAsyncResult *res,
+                                         GError      **error);
+
 BoltJournal *     bolt_store_open_journal (BoltStore  *store,
                                            const char *type,
                                            const char *name,
@@ -0,0 +1,735 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-timetable.h"
+
+#include "bolt-error.h"
+#include "bolt-io.h"
+#include "bolt-log.h"
+#include "bolt-macros.h"
+#include "bolt-str.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* On-disk format
+ *
+ * A small header followed by an array of fixed size records,
+ * one for each uid. Each record holds the uid, zero padded,
+ * and one slot for each supported timestamp, stored as little
+ * endian 64 bit integers, where zero means "not set". Records
+ * whose uid is empty are unused and get recycled.
+ *
+ * The whole table is read once when it is opened; changes are
+ * done in memory and written back in batches, where each run
+ * of adjacent modified records is written with a single call
+ * to pwrite.
+ */
+
+#define TT_MAGIC "BOLTTIME"
+#define TT_VERSION 1
+#define TT_UID_LEN 48
+#define TT_FLUSH_DELAY 2 /* seconds */
+
+typedef struct TimeHeader
+{
+  guint8  magic[8];
+  guint32 version;
+  guint32 recsize;
+} TimeHeader;
+
+G_STATIC_ASSERT (sizeof (TimeHeader) == 16);
+
+static const char *timesels[] = {
+  "conntime",
+  "authtime",
+};
+
+#define TT_N_SLOTS G_N_ELEMENTS (timesels)
+
+typedef struct TimeRecord
+{
+  char    uid[TT_UID_LEN];
+  guint64 stamps[TT_N_SLOTS];
+} TimeRecord;
+
+G_STATIC_ASSERT (sizeof (TimeRecord) == 64);
+
+/* ************************************  */
+/* BoltTimeTable */
+
+static void     bolt_time_table_initable_iface_init (GInitableIface *iface);
+
+static gboolean bolt_time_table_initialize (GInitable    *initable,
+                                            GCancellable *cancellable,
+                                            GError      **error);
+
+struct _BoltTimeTable
+{
+  GObject  object;
+
+  GFile   *root;
+  char    *name;
+  char    *path;
+
+  int      fd;
+  gboolean fresh;
+
+  /* protects everything below, the table is
+   * accessed from the store I/O thread as well */
+  GRecMutex lock;
+
+  /* in-memory copy of the records */
+  GArray     *records;
+  GHashTable *index;  /* uid -> record index */
+  GArray     *unused; /* indices of unused records */
+
+  /* write back */
+  GHashTable *dirty;  /* set of record indices */
+  guint       flush_id;
+};
+
+
+enum {
+  PROP_TABLE_0,
+
+  PROP_ROOT,
+  PROP_NAME,
+
+  PROP_TABLE_LAST
+};
+
+static GParamSpec *table_props[PROP_TABLE_LAST] = { NULL, };
+
+G_DEFINE_TYPE_WITH_CODE (BoltTimeTable,
+                         bolt_time_table,
+                         G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE,
+                                                bolt_time_table_initable_iface_init));
+
+static void
+bolt_time_table_finalize (GObject *object)
+{
+  g_autoptr(GError) err = NULL;
+  BoltTimeTable *table = BOLT_TIME_TABLE (object);
+  gboolean ok;
+
+  if (table->fd > -1)
+    {
+      ok = bolt_time_table_flush (table, &err);
+
+      if (!ok)
+        bolt_warn_err (err, LOG_TOPIC ("store"),
+                       "failed to write timestamps");
+
+      (void) close (table->fd);
+      table->fd = -1;
+    }
+
+  g_clear_object (&table->root);
+  g_clear_pointer (&table->name, g_free);
+  g_clear_pointer (&table->path, g_free);
+
+  g_clear_pointer (&table->records, g_array_unref);
+  g_clear_pointer (&table->index, g_hash_table_unref);
+  g_clear_pointer (&table->unused, g_array_unref);
+  g_clear_pointer (&table->dirty, g_hash_table_unref);
+
+  g_rec_mutex_clear (&table->lock);
+
+  G_OBJECT_CLASS (bolt_time_table_parent_class)->finalize (object);
+}
+
+static void
+bolt_time_table_init (BoltTimeTable *table)
+{
+  table->fd = -1;
+
+  g_rec_mutex_init (&table->lock);
+
+  table->records = g_array_new (FALSE, TRUE, sizeof (TimeRecord));
+  table->index = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        g_free, NULL);
+  table->unused = g_array_new (FALSE, FALSE, sizeof (guint));
+  table->dirty = g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+static void
+bolt_time_table_get_property (GObject    *object,
+                              guint       prop_id,
+                              GValue     *value,
+                              GParamSpec *pspec)
+{
+  BoltTimeTable *table = BOLT_TIME_TABLE (object);
+
+  switch (prop_id)
+    {
+    case PROP_ROOT:
+      g_value_set_object (value, table->root);
+      break;
+
+    case PROP_NAME:
+      g_value_set_string (value, table->name);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bolt_time_table_set_property (GObject      *object,
+                              guint         prop_id,
+                              const GValue *value,
+                              GParamSpec   *pspec)
+{
+  BoltTimeTable *table = BOLT_TIME_TABLE (object);
+
+  switch (prop_id)
+    {
+    case PROP_ROOT:
+      table->root = g_value_dup_object (value);
+      break;
+
+    case PROP_NAME:
+      table->name = g_value_dup_string (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+bolt_time_table_class_init (BoltTimeTableClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = bolt_time_table_finalize;
+
+  gobject_class->get_property = bolt_time_table_get_property;
+  gobject_class->set_property = bolt_time_table_set_property;
+
+  table_props[PROP_ROOT] =
+    g_param_spec_object ("root",
+                         NULL, NULL,
+                         G_TYPE_FILE,
+                         G_PARAM_READWRITE      |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_NAME);
+
+  table_props[PROP_NAME] =
+    g_param_spec_string ("name", NULL, NULL,
+                         NULL,
+                         G_PARAM_READWRITE      |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_NAME);
+
+  g_object_class_install_properties (gobject_class,
+                                     PROP_TABLE_LAST,
+                                     table_props);
+}
+
+static void
+bolt_time_table_initable_iface_init (GInitableIface *iface)
+{
+  iface->init = bolt_time_table_initialize;
+}
+
+/* internal methods */
+static int
+time_table_slot (const char *timesel)
+{
+  for (guint i = 0; i < TT_N_SLOTS; i++)
+    if (bolt_streq (timesels[i], timesel))
+      return (int) i;
+
+  return -1;
+}
+
+static gboolean
+time_table_load (BoltTimeTable *table,
+                 GError       **error)
+{
+  g_autofree char *data = NULL;
+  const TimeHeader *hdr;
+  struct stat st;
+  gboolean ok;
+  guint32 version;
+  guint32 recsize;
+  gsize size;
+  gsize n;
+
+  ok = bolt_fstat (table->fd, &st, error);
+
+  if (!ok)
+    return FALSE;
+
+  size = (gsize) st.st_size;
+
+  if (size == 0)
+    {
+      TimeHeader h;
+
+      memset (&h, 0, sizeof (h));
+      memcpy (h.magic, TT_MAGIC, sizeof (h.magic));
+      h.version = GUINT32_TO_LE (TT_VERSION);
+      h.recsize = GUINT32_TO_LE ((guint32) sizeof (TimeRecord));
+
+      table->fresh = TRUE;
+      return bolt_pwrite_all (table->fd, &h, sizeof (h), 0, error);
+    }
+
+  if (size < sizeof (TimeHeader))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "time table too small: %" G_GSIZE_FORMAT " bytes", size);
+      return FALSE;
+    }
+
+  data = g_malloc (size);
+  ok = bolt_read_all (table->fd, data, size, &n, error);
+
+  if (!ok)
+    return FALSE;
+
+  if (n != size)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "time table truncated while reading");
+      return FALSE;
+    }
+
+  hdr = (const TimeHeader *) data;
+  version = GUINT32_FROM_LE (hdr->version);
+  recsize = GUINT32_FROM_LE (hdr->recsize);
+
+  if (memcmp (hdr->magic, TT_MAGIC, sizeof (hdr->magic)) != 0)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                           "time table header is invalid");
+      return FALSE;
+    }
+
+  if (version != TT_VERSION || recsize != sizeof (TimeRecord))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "unsupported time table format: %u (%u)",
+                   version, recsize);
+      return FALSE;
+    }
+
+  n = (size - sizeof (TimeHeader)) / sizeof (TimeRecord);
+
+  /* a partially written record at the end is ignored
+   * and will be overwritten by the next new record */
+  if ((size - sizeof (TimeHeader)) % sizeof (TimeRecord) != 0)
+    bolt_warn (LOG_TOPIC ("store"), "time table has trailing data");
+
+  g_array_append_vals (table->records, data + sizeof (TimeHeader), n);
+
+  for (guint i = 0; i < n; i++)
+    {
+      TimeRecord *rec = &g_array_index (table->records, TimeRecord, i);
+
+      /* make sure the uid is always terminated */
+      rec->uid[TT_UID_LEN - 1] = '\0';
+
+      if (*rec->uid == '\0')
+        g_array_append_val (table->unused, i);
+      else
+        g_hash_table_insert (table->index,
+                             g_strdup (rec->uid),
+                             GUINT_TO_POINTER (i));
+    }
+
+  bolt_debug (LOG_TOPIC ("store"), "loaded %u timestamp records",
+              g_hash_table_size (table->index));
+
+  return TRUE;
+}
+
+static gboolean
+bolt_time_table_initialize (GInitable    *initable,
+                            GCancellable *cancellable,
+                            GError      **error)
+{
+  g_autoptr(GFile) file = NULL;
+  BoltTimeTable *table;
+
+  table = BOLT_TIME_TABLE (initable);
+
+  if (bolt_strzero (table->name) || table->root == NULL)
+    {
+      bolt_bug ("invalid arguments");
+      g_set_error (error, BOLT_ERROR, BOLT_ERROR_FAILED,
+                   "root and/or name NULL for time table");
+      return FALSE;
+    }
+
+  file = g_file_get_child (table->root, table->name);
+  table->path = g_file_get_path (file);
+
+  table->fd = bolt_open (table->path,
+                         O_RDWR | O_CREAT | O_CLOEXEC,
+                         0600,
+                         error);
+
+  if (table->fd < 0)
+    return FALSE;
+
+  return time_table_load (table, error);
+}
+
+static GRecMutex *
+time_table_lock (BoltTimeTable *table)
+{
+  g_rec_mutex_lock (&table->lock);
+  return &table->lock;
+}
+
+static void
+time_table_unlock (GRecMutex **lock)
+{
+  if (*lock != NULL)
+    g_rec_mutex_unlock (*lock);
+}
+
+#define time_table_autolock bolt_cleanup (time_table_unlock) G_GNUC_UNUSED
+
+static gboolean
+time_table_flush_timeout (gpointer user_data)
+{
+  g_autoptr(GError) err = NULL;
+  BoltTimeTable *table = user_data;
+  gboolean ok;
+
+  g_rec_mutex_lock (&table->lock);
+  table->flush_id = 0;
+  g_rec_mutex_unlock (&table->lock);
+
+  ok = bolt_time_table_flush (table, &err);
+
+  if (!ok)
+    bolt_warn_err (err, LOG_TOPIC ("store"),
+                   "failed to write timestamps");
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+time_table_mark_dirty (BoltTimeTable *table,
+                       guint          idx)
+{
+  g_hash_table_add (table->dirty, GUINT_TO_POINTER (idx));
+
+  if (table->flush_id != 0)
+    return;
+
+  table->flush_id = g_timeout_add_seconds (TT_FLUSH_DELAY,
+                                           time_table_flush_timeout,
+                                           table);
+}
+
+static int
+time_table_idxcmp (gconstpointer a,
+                   gconstpointer b)
+{
+  guint ia = *((const guint *) a);
+  guint ib = *((const guint *) b);
+
+  return (ia > ib) - (ia < ib);
+}
+
+/* public methods */
+
+BoltTimeTable *
+bolt_time_table_new (GFile      *root,
+                     const char *name,
+                     GError    **error)
+{
+  return g_initable_new (BOLT_TYPE_TIME_TABLE,
+                         NULL, error,
+                         "root", root,
+                         "name", name,
+                         NULL);
+}
+
+gboolean
+bolt_time_table_supports (const char *timesel)
+{
+  return time_table_slot (timesel) > -1;
+}
+
+gboolean
+bolt_time_table_is_fresh (BoltTimeTable *table)
+{
+  g_return_val_if_fail (BOLT_IS_TIME_TABLE (table), FALSE);
+
+  return table->fresh;
+}
+
+gboolean
+bolt_time_table_get (BoltTimeTable *table,
+                     const char    *uid,
+                     const char    *timesel,
+                     guint64       *outval,
+                     GError       **error)
+{
+  time_table_autolock GRecMutex *lock = NULL;
+  TimeRecord *rec;
+  gpointer idx;
+  guint64 val;
+  gboolean found;
+  int slot;
+
+  g_return_val_if_fail (BOLT_IS_TIME_TABLE (table), FALSE);
+  g_return_val_if_fail (uid != NULL, FALSE);
+  g_return_val_if_fail (timesel != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  slot = time_table_slot (timesel);
+
+  if (slot < 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "unknown timestamp '%s'", timesel);
+      return FALSE;
+    }
+
+  lock = time_table_lock (table);
+  found = g_hash_table_lookup_extended (table->index, uid, NULL, &idx);
+
+  if (!found)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                   "no timestamps for '%s'", uid);
+      return FALSE;
+    }
+
+  rec = &g_array_index (table->records, TimeRecord, GPOINTER_TO_UINT (idx));
+  val = GUINT64_FROM_LE (rec->stamps[slot]);
+
+  if (val == 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                   "timestamp '%s' not set for '%s'", timesel, uid);
+      return FALSE;
+    }
+
+  if (outval != NULL)
+    *outval = val;
+
+  return TRUE;
+}
+
+gboolean
+bolt_time_table_put (BoltTimeTable *table,
+                     const char    *uid,
+                     const char    *timesel,
+                     guint64        val,
+                     GError       **error)
+{
+  time_table_autolock GRecMutex *lock = NULL;
+  TimeRecord *rec;
+  gpointer idx;
+  gboolean found;
+  guint i;
+  int slot;
+
+  g_return_val_if_fail (BOLT_IS_TIME_TABLE (table), FALSE);
+  g_return_val_if_fail (uid != NULL, FALSE);
+  g_return_val_if_fail (timesel != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  slot = time_table_slot (timesel);
+
+  if (slot < 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "unknown timestamp '%s'", timesel);
+      return FALSE;
+    }
+
+  lock = time_table_lock (table);
+  found = g_hash_table_lookup_extended (table->index, uid, NULL, &idx);
+
+  if (found)
+    {
+      i = GPOINTER_TO_UINT (idx);
+    }
+  else if (strlen (uid) >= TT_UID_LEN || *uid == '\0')
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "invalid uid for time table: '%s'", uid);
+      return FALSE;
+    }
+  else if (table->unused->len > 0)
+    {
+      i = g_array_index (table->unused, guint, table->unused->len - 1);
+      g_array_set_size (table->unused, table->unused->len - 1);
+    }
+  else
+    {
+      i = table->records->len;
+      g_array_set_size (table->records, i + 1);
+    }
+
+  rec = &g_array_index (table->records, TimeRecord, i);
+
+  if (!found)
+    {
+      memset (rec, 0, sizeof (TimeRecord));
+      g_strlcpy (rec->uid, uid, sizeof (rec->uid));
+      g_hash_table_insert (table->index, g_strdup (uid), GUINT_TO_POINTER (i));
+    }
+
+  if (GUINT64_FROM_LE (rec->stamps[slot]) == val)
+    return TRUE;
+
+  rec->stamps[slot] = GUINT64_TO_LE (val);
+  time_table_mark_dirty (table, i);
+
+  return TRUE;
+}
+
+gboolean
+bolt_time_table_del (BoltTimeTable *table,
+                     const char    *uid,
+                     const char    *timesel,
+                     GError       **error)
+{
+  time_table_autolock GRecMutex *lock = NULL;
+  TimeRecord *rec;
+  gpointer idx;
+  gboolean ok;
+  guint i;
+  int slot;
+
+  g_return_val_if_fail (BOLT_IS_TIME_TABLE (table), FALSE);
+  g_return_val_if_fail (uid != NULL, FALSE);
+  g_return_val_if_fail (timesel != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  lock = time_table_lock (table);
+  ok = bolt_time_table_get (table, uid, timesel, NULL, error);
+
+  if (!ok)
+    return FALSE;
+
+  slot = time_table_slot (timesel);
+  idx = g_hash_table_lookup (table->index, uid);
+  i = GPOINTER_TO_UINT (idx);
+
+  rec = &g_array_index (table->records, TimeRecord, i);
+  rec->stamps[slot] = 0;
+
+  time_table_mark_dirty (table, i);
+
+  /* all timestamps are gone, recycle the record */
+  for (guint k = 0; k < TT_N_SLOTS; k++)
+    if (rec->stamps[k] != 0)
+      return TRUE;
+
+  g_hash_table_remove (table->index, uid);
+  memset (rec, 0, sizeof (TimeRecord));
+  g_array_append_val (table->unused, i);
+
+  return TRUE;
+}
+
+gboolean
+bolt_time_table_flush (BoltTimeTable *table,
+                       GError       **error)
+{
+  time_table_autolock GRecMutex *lock = NULL;
+  g_autoptr(GArray) dirty = NULL;
+  GHashTableIter iter;
+  gpointer key;
+  guint *idx;
+  guint n;
+
+  g_return_val_if_fail (BOLT_IS_TIME_TABLE (table), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  lock = time_table_lock (table);
+
+  if (table->flush_id != 0)
+    {
+      g_source_remove (table->flush_id);
+      table->flush_id = 0;
+    }
+
+  if (g_hash_table_size (table->dirty) == 0)
+    return TRUE;
+
+  n = g_hash_table_size (table->dirty);
+  dirty = g_array_sized_new (FALSE, FALSE, sizeof (guint), n);
+
+  g_hash_table_iter_init (&iter, table->dirty);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      guint i = GPOINTER_TO_UINT (key);
+      g_array_append_val (dirty, i);
+    }
+
+  g_hash_table_remove_all (table->dirty);
+
+  g_array_sort (dirty, time_table_idxcmp);
+  idx = (guint *) dirty->data;
+
+  /* write each run of adjacent records at once */
+  for (guint start = 0, end; start < n; start = end)
+    {
+      const TimeRecord *rec;
+      gboolean ok;
+      off_t offset;
+
+      for (end = start + 1; end < n; end++)
+        if (idx[end] != idx[end - 1] + 1)
+          break;
+
+      rec = &g_array_index (table->records, TimeRecord, idx[start]);
+      offset = sizeof (TimeHeader) + (off_t) idx[start] * sizeof (TimeRecord);
+
+      ok = bolt_pwrite_all (table->fd,
+                            rec, (end - start) * sizeof (TimeRecord),
+                            offset,
+                            error);
+
+      if (!ok)
+        {
+          /* keep the rest around for the next try */
+          for (guint k = start; k < n; k++)
+            g_hash_table_add (table->dirty, GUINT_TO_POINTER (idx[k]));
+
+          return FALSE;
+        }
+    }
+
+  bolt_debug (LOG_TOPIC ("store"), "wrote %u timestamp records", n);
+
+  return TRUE;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* BoltTimeTable - fixed size timestamp records, one per uid */
+#define BOLT_TYPE_TIME_TABLE bolt_time_table_get_type ()
+G_DECLARE_FINAL_TYPE (BoltTimeTable, bolt_time_table, BOLT, TIME_TABLE, GObject);
+
+BoltTimeTable *   bolt_time_table_new (GFile      *root,
+                                       const char *name,
+                                       GError    **error);
+
+gboolean          bolt_time_table_supports (const char *timesel);
+
+gboolean          bolt_time_table_is_fresh (BoltTimeTable *table);
+
+gboolean          bolt_time_table_get (BoltTimeTable *table,
+                                       const char    *uid,
+                                       const char    *timesel,
+                                       guint64       *outval,
+                                       GError       **error);
+
+gboolean          bolt_time_table_put (BoltTimeTable *table,
+                                       const char    *uid,
+                                       const char    *timesel,
+                                       guint64        val,
+                                       GError       **error);
+
+gboolean          bolt_time_table_del (BoltTimeTable *table,
+                                       const char    *uid,
+                                       const char    *timesel,
+                                       GError       **error);
+
+gboolean          bolt_time_table_flush (BoltTimeTable *table,
+                                         GError       **error);
+
+G_END_DECLS
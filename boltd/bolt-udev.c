@@ -23,6 +23,8 @@
 #include "bolt-udev.h"
 
 #include "bolt-error.h"
+#include "bolt-log.h"
+#include "bolt-str.h"
 #include "bolt-sysfs.h"
 
 #include <libudev.h>
@@ -41,6 +43,26 @@ static void     udev_initable_iface_init (GInitableIface *iface);
 static gboolean bolt_udev_initialize (GInitable    *initable,
                                       GCancellable *cancellable,
                                       GError      **error);
+
+/* queued uevent, see uevent_queue_push */
+typedef struct UEventEntry
+{
+  char        *action;
+  udev_device *device;
+  guint64      seq;
+  guint        depth;
+} UEventEntry;
+
+static void
+uevent_entry_free (gpointer data)
+{
+  UEventEntry *entry = data;
+
+  g_clear_pointer (&entry->device, udev_device_unref);
+  g_free (entry->action);
+  g_slice_free (UEventEntry, entry);
+}
+
 /*  */
 struct _BoltUdev
 {
@@ -51,6 +73,14 @@ struct _BoltUdev
   struct udev_monitor *monitor;
   GSource             *source;
 
+  /* event queue */
+  guint         window;   /* msec, 0: dispatch directly */
+  guint         flush_id;
+  GPtrArray    *queue;    /* UEventEntry */
+  GHashTable   *pending;  /* syspath -> UEventEntry in queue */
+  guint64       seq;
+  BoltUdevStats stats;
+
   /* properties */
   char *name;
   GStrv filter;
@@ -60,6 +90,7 @@ enum {
   PROP_0,
   PROP_NAME,
   PROP_FILTER,
+  PROP_WINDOW,
 
   PROP_LAST
 };
@@ -95,6 +126,15 @@ bolt_udev_finalize (GObject *object)
       udev->source = NULL;
     }
 
+  if (udev->flush_id)
+    {
+      g_source_remove (udev->flush_id);
+      udev->flush_id = 0;
+    }
+
+  g_clear_pointer (&udev->pending, g_hash_table_unref);
+  g_clear_pointer (&udev->queue, g_ptr_array_unref);
+
   g_clear_pointer (&udev->udev, udev_unref);
 
   g_clear_pointer (&udev->name, g_free);
@@ -122,6 +162,10 @@ bolt_udev_get_property (GObject    *object,
       g_value_set_boxed (value, udev->filter);
       break;
 
+    case PROP_WINDOW:
+      g_value_set_uint (value, udev->window);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -145,6 +189,10 @@ bolt_udev_set_property (GObject      *object,
       udev->filter = g_value_dup_boxed (value);
       break;
 
+    case PROP_WINDOW:
+      bolt_udev_set_window (udev, g_value_get_uint (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -153,6 +201,8 @@ bolt_udev_set_property (GObject      *object,
 static void
 bolt_udev_init (BoltUdev *udev)
 {
+  udev->queue = g_ptr_array_new_with_free_func (uevent_entry_free);
+  udev->pending = g_hash_table_new (g_str_hash, g_str_equal);
 }
 
 static void
@@ -180,6 +230,14 @@ bolt_udev_class_init (BoltUdevClass *klass)
                         G_PARAM_CONSTRUCT_ONLY |
                         G_PARAM_STATIC_STRINGS);
 
+  props[PROP_WINDOW] =
+    g_param_spec_uint ("window",
+                       NULL, NULL,
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READWRITE |
+                       G_PARAM_EXPLICIT_NOTIFY |
+                       G_PARAM_STATIC_STRINGS);
+
   g_object_class_install_properties (gobject_class,
                                      PROP_LAST,
                                      props);
@@ -295,6 +353,134 @@ setup_monitor (BoltUdev      *udev,
   return TRUE;
 }
 
+static gint
+uevent_entry_cmp (gconstpointer pa, gconstpointer pb)
+{
+  const UEventEntry *a = *((UEventEntry **) pa);
+  const UEventEntry *b = *((UEventEntry **) pb);
+  gboolean ar = g_str_equal (a->action, "remove");
+  gboolean br = g_str_equal (b->action, "remove");
+
+  /* removals first, children before their parents,
+   * everything else parents before their children */
+  if (ar != br)
+    return ar ? -1 : 1;
+
+  if (a->depth != b->depth)
+    {
+      if (ar)
+        return a->depth > b->depth ? -1 : 1;
+      else
+        return a->depth < b->depth ? -1 : 1;
+    }
+
+  return a->seq < b->seq ? -1 : (a->seq > b->seq ? 1 : 0);
+}
+
+static gboolean
+uevent_queue_flush (gpointer user_data)
+{
+  g_autoptr(GPtrArray) batch = NULL;
+  BoltUdev *udev = BOLT_UDEV (user_data);
+  guint n = 0;
+
+  udev->flush_id = 0;
+
+  batch = udev->queue;
+  udev->queue = g_ptr_array_new_with_free_func (uevent_entry_free);
+  g_hash_table_remove_all (udev->pending);
+
+  g_ptr_array_sort (batch, uevent_entry_cmp);
+
+  g_object_ref (udev);
+  for (guint i = 0; i < batch->len; i++)
+    {
+      UEventEntry *entry = g_ptr_array_index (batch, i);
+
+      g_signal_emit (udev, signals[SIGNAL_UEVENT], 0,
+                     entry->action, entry->device);
+      n++;
+    }
+
+  udev->stats.dispatched += n;
+
+  bolt_debug (LOG_TOPIC ("udev"), "dispatched %u events "
+              "[received: %" G_GUINT64_FORMAT ", merged: %" G_GUINT64_FORMAT
+              ", dropped: %" G_GUINT64_FORMAT "]",
+              n, udev->stats.received, udev->stats.merged,
+              udev->stats.dropped);
+
+  g_object_unref (udev);
+  return G_SOURCE_REMOVE;
+}
+
+/* Only the latest queued event for a syspath is considered
+ * for merging, which keeps the queue in causal order:
+ *   add    + change -> add
+ *   change + change -> change
+ *   change + remove -> remove
+ *   add    + remove -> (nothing)
+ * everything else, e.g. remove + add, is queued as is.
+ */
+static void
+uevent_queue_push (BoltUdev    *udev,
+                   const char  *action,
+                   udev_device *device)
+{
+  UEventEntry *entry;
+  const char *syspath;
+  gboolean merge = FALSE;
+
+  syspath = udev_device_get_syspath (device);
+  entry = g_hash_table_lookup (udev->pending, syspath);
+
+  if (entry != NULL)
+    {
+      const char *last = entry->action;
+
+      if (g_str_equal (last, "add") && g_str_equal (action, "remove"))
+        {
+          g_hash_table_remove (udev->pending, syspath);
+          g_ptr_array_remove (udev->queue, entry);
+          udev->stats.dropped += 2;
+          return;
+        }
+
+      merge = g_str_equal (action, "change") &&
+              (g_str_equal (last, "add") || g_str_equal (last, "change"));
+
+      merge = merge ||
+              (g_str_equal (last, "change") && g_str_equal (action, "remove"));
+    }
+
+  if (merge)
+    {
+      if (!g_str_equal (action, "change"))
+        bolt_set_strdup (&entry->action, action);
+
+      g_hash_table_remove (udev->pending, syspath);
+      udev_device_unref (entry->device);
+      entry->device = udev_device_ref (device);
+      udev->stats.merged++;
+    }
+  else
+    {
+      entry = g_slice_new0 (UEventEntry);
+      entry->action = g_strdup (action);
+      entry->device = udev_device_ref (device);
+      entry->depth = bolt_str_count_char (syspath, '/');
+      g_ptr_array_add (udev->queue, entry);
+    }
+
+  entry->seq = udev->seq++;
+  g_hash_table_replace (udev->pending,
+                        (gpointer) udev_device_get_syspath (entry->device),
+                        entry);
+
+  if (udev->flush_id == 0)
+    udev->flush_id = g_timeout_add (udev->window, uevent_queue_flush, udev);
+}
+
 static gboolean
 handle_uevent_udev (GIOChannel  *source,
                     GIOCondition condition,
@@ -319,6 +505,15 @@ handle_uevent_udev (GIOChannel  *source,
   if (syspath == NULL)
     return G_SOURCE_CONTINUE;
 
+  udev->stats.received++;
+
+  if (udev->window > 0)
+    {
+      uevent_queue_push (udev, action, device);
+      return G_SOURCE_CONTINUE;
+    }
+
+  udev->stats.dispatched++;
   g_signal_emit (udev, signals[SIGNAL_UEVENT], 0,
                  action, device);
 
@@ -367,6 +562,37 @@ bolt_udev_new (const char         *name,
 }
 
 
+void
+bolt_udev_set_window (BoltUdev *udev,
+                      guint     msec)
+{
+  g_return_if_fail (BOLT_IS_UDEV (udev));
+
+  if (udev->window == msec)
+    return;
+
+  udev->window = msec;
+
+  /* switching to direct dispatch, drain the queue */
+  if (msec == 0 && udev->flush_id > 0)
+    {
+      g_source_remove (udev->flush_id);
+      uevent_queue_flush (udev);
+    }
+
+  g_object_notify_by_pspec (G_OBJECT (udev), props[PROP_WINDOW]);
+}
+
+void
+bolt_udev_get_stats (BoltUdev      *udev,
+                     BoltUdevStats *stats)
+{
+  g_return_if_fail (BOLT_IS_UDEV (udev));
+  g_return_if_fail (stats != NULL);
+
+  *stats = udev->stats;
+}
+
 struct udev_enumerate *
 bolt_udev_new_enumerate (BoltUdev *udev,
                          GError  **error)
@@ -37,6 +37,22 @@ BoltUdev  *             bolt_udev_new (const char         *name,
                                        const char * const *filter,
                                        GError            **error);
 
+/* uevents are queued for 'msec', coalesced per syspath and
+ * then emitted as one batch; 0 disables the queue */
+void                    bolt_udev_set_window (BoltUdev *udev,
+                                              guint     msec);
+
+typedef struct BoltUdevStats
+{
+  guint64 received;   /* events read from the monitor */
+  guint64 merged;     /* folded into a queued event */
+  guint64 dropped;    /* cancelled out, i.e. add + remove */
+  guint64 dispatched; /* emitted via the "uevent" signal */
+} BoltUdevStats;
+
+void                    bolt_udev_get_stats (BoltUdev      *udev,
+                                             BoltUdevStats *stats);
+
 struct udev_enumerate * bolt_udev_new_enumerate (BoltUdev *udev,
                                                  GError  **error);
 
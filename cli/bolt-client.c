@@ -431,6 +431,52 @@ bolt_client_find_domain (BoltClient *client,
   return NULL;
 }
 
+static GPtrArray *
+client_list_devices_with_properties (BoltClient   *client,
+                                     GCancellable *cancel,
+                                     GError      **error)
+{
+  g_autoptr(GVariant) val = NULL;
+  g_autoptr(GPtrArray) devices = NULL;
+  g_autoptr(GVariantIter) iter = NULL;
+  GDBusConnection *bus = NULL;
+
+  val = g_dbus_proxy_call_sync (G_DBUS_PROXY (client),
+                                "ListDevicesWithProperties",
+                                NULL,
+                                G_DBUS_CALL_FLAGS_NONE,
+                                -1,
+                                cancel,
+                                error);
+  if (val == NULL)
+    return NULL;
+
+  bus = g_dbus_proxy_get_connection (G_DBUS_PROXY (client));
+
+  devices = g_ptr_array_new_with_free_func (g_object_unref);
+
+  g_variant_get (val, "(a{oa{sv}})", &iter);
+  while (TRUE)
+    {
+      g_autoptr(GVariant) props = NULL;
+      BoltDevice *dev;
+      const char *d;
+
+      /* unlike g_variant_iter_loop, props is ours and freed
+       * on every path out of the loop, including errors */
+      if (!g_variant_iter_next (iter, "{&o@a{sv}}", &d, &props))
+        break;
+
+      dev = bolt_device_new_with_properties (bus, d, props, cancel, error);
+      if (dev == NULL)
+        return NULL;
+
+      g_ptr_array_add (devices, dev);
+    }
+
+  return g_steal_pointer (&devices);
+}
+
 GPtrArray *
 bolt_client_list_devices (BoltClient   *client,
                           GCancellable *cancel,
@@ -439,6 +485,7 @@ bolt_client_list_devices (BoltClient   *client,
   g_autoptr(GVariant) val = NULL;
   g_autoptr(GPtrArray) devices = NULL;
   g_autoptr(GVariantIter) iter = NULL;
+  g_autoptr(GError) err = NULL;
   GDBusConnection *bus = NULL;
   const char *d;
 
@@ -446,6 +493,19 @@ bolt_client_list_devices (BoltClient   *client,
   g_return_val_if_fail (!cancel || G_IS_CANCELLABLE (cancel), NULL);
   g_return_val_if_fail (error == NULL || *error == NULL, NULL);
 
+  /* all devices and their properties in one go */
+  devices = client_list_devices_with_properties (client, cancel, &err);
+
+  if (devices != NULL)
+    return g_steal_pointer (&devices);
+
+  if (!g_error_matches (err, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+    {
+      bolt_error_propagate (error, &err);
+      return NULL;
+    }
+
+  /* older daemon, one call per device */
   val = g_dbus_proxy_call_sync (G_DBUS_PROXY (client),
                                 "ListDevices",
                                 NULL,
@@ -31,6 +31,10 @@
 struct _BoltDevice
 {
   BoltProxy parent;
+
+  /* PropertiesChanged, for proxies that do not load properties */
+  GDBusConnection *props_bus;
+  guint            props_id;
 };
 
 enum {
@@ -65,11 +69,25 @@ G_DEFINE_TYPE (BoltDevice,
                BOLT_TYPE_PROXY);
 
 
+static void
+bolt_device_finalize (GObject *object)
+{
+  BoltDevice *dev = BOLT_DEVICE (object);
+
+  if (dev->props_id > 0)
+    g_dbus_connection_signal_unsubscribe (dev->props_bus, dev->props_id);
+
+  g_clear_object (&dev->props_bus);
+
+  G_OBJECT_CLASS (bolt_device_parent_class)->finalize (object);
+}
+
 static void
 bolt_device_class_init (BoltDeviceClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 
+  gobject_class->finalize = bolt_device_finalize;
   gobject_class->get_property = bolt_proxy_property_getter;
   gobject_class->set_property = bolt_proxy_property_setter;
 
@@ -229,6 +247,115 @@ bolt_device_new_for_object_path (GDBusConnection *bus,
   return dev;
 }
 
+static void
+bolt_device_props_changed (GDBusConnection *bus,
+                           const char      *sender,
+                           const char      *path,
+                           const char      *interface,
+                           const char      *signal,
+                           GVariant        *params,
+                           gpointer         user_data)
+{
+  g_autoptr(BoltDevice) dev = NULL;
+  g_autoptr(GVariant) changed = NULL;
+  g_autofree const char **invalidated = NULL;
+  GVariantIter iter;
+  const char *name;
+  GVariant *value;
+
+  if (!g_variant_is_of_type (params, G_VARIANT_TYPE ("(sa{sv}as)")))
+    return;
+
+  dev = g_weak_ref_get (user_data);
+  if (dev == NULL)
+    return;
+
+  g_variant_get (params, "(&s@a{sv}^a&s)", NULL, &changed, &invalidated);
+
+  g_variant_iter_init (&iter, changed);
+  while (g_variant_iter_next (&iter, "{&sv}", &name, &value))
+    {
+      g_dbus_proxy_set_cached_property (G_DBUS_PROXY (dev), name, value);
+      g_variant_unref (value);
+    }
+
+  for (guint i = 0; invalidated[i] != NULL; i++)
+    g_dbus_proxy_set_cached_property (G_DBUS_PROXY (dev), invalidated[i], NULL);
+
+  g_signal_emit_by_name (dev, "g-properties-changed",
+                         changed, invalidated);
+}
+
+static void
+bolt_device_weak_ref_free (gpointer data)
+{
+  GWeakRef *ref = data;
+
+  g_weak_ref_clear (ref);
+  g_free (ref);
+}
+
+/* NB: the properties are taken from 'properties' (a{sv}),
+ * they are not loaded from the bus; since GDBusProxy does
+ * then not listen to PropertiesChanged, we subscribe to it
+ * ourselves and keep the cache up to date */
+BoltDevice *
+bolt_device_new_with_properties (GDBusConnection *bus,
+                                 const char      *path,
+                                 GVariant        *properties,
+                                 GCancellable    *cancel,
+                                 GError         **error)
+{
+  BoltDevice *dev;
+  GVariantIter iter;
+  const char *name;
+  GVariant *value;
+  GWeakRef *ref;
+
+  g_return_val_if_fail (G_IS_DBUS_CONNECTION (bus), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail (properties != NULL, NULL);
+  g_return_val_if_fail (!cancel || G_IS_CANCELLABLE (cancel), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  dev = g_initable_new (BOLT_TYPE_DEVICE,
+                        cancel, error,
+                        "g-flags", G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                        "g-connection", bus,
+                        "g-name", BOLT_DBUS_NAME,
+                        "g-object-path", path,
+                        "g-interface-name", BOLT_DBUS_DEVICE_INTERFACE,
+                        NULL);
+
+  if (dev == NULL)
+    return NULL;
+
+  g_variant_iter_init (&iter, properties);
+  while (g_variant_iter_next (&iter, "{&sv}", &name, &value))
+    {
+      g_dbus_proxy_set_cached_property (G_DBUS_PROXY (dev), name, value);
+      g_variant_unref (value);
+    }
+
+  ref = g_new0 (GWeakRef, 1);
+  g_weak_ref_init (ref, dev);
+
+  dev->props_bus = g_object_ref (bus);
+  dev->props_id =
+    g_dbus_connection_signal_subscribe (bus,
+                                        BOLT_DBUS_NAME,
+                                        "org.freedesktop.DBus.Properties",
+                                        "PropertiesChanged",
+                                        path,
+                                        BOLT_DBUS_DEVICE_INTERFACE,
+                                        G_DBUS_SIGNAL_FLAGS_NONE,
+                                        bolt_device_props_changed,
+                                        ref,
+                                        bolt_device_weak_ref_free);
+
+  return dev;
+}
+
 gboolean
 bolt_device_authorize (BoltDevice   *dev,
                        BoltAuthCtrl  flags,
@@ -33,6 +33,12 @@ BoltDevice *  bolt_device_new_for_object_path (GDBusConnection *bus,
                                                GCancellable    *cancellable,
                                                GError         **error);
 
+BoltDevice *  bolt_device_new_with_properties (GDBusConnection *bus,
+                                               const char      *path,
+                                               GVariant        *properties,
+                                               GCancellable    *cancellable,
+                                               GError         **error);
+
 gboolean      bolt_device_authorize (BoltDevice   *dev,
                                      BoltAuthCtrl  flags,
                                      GCancellable *cancellable,
@@ -215,6 +215,51 @@ bolt_write_all (int         fd,
   return ok;
 }
 
+gboolean
+bolt_pwrite_all (int         fd,
+                 const void *buf,
+                 gsize       nbytes,
+                 off_t       offset,
+                 GError    **error)
+{
+  const char *data = buf;
+
+  g_return_val_if_fail (buf != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  while (nbytes > 0)
+    {
+      ssize_t n;
+
+      n = pwrite (fd, data, nbytes, offset);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+
+      if (n < 0)
+        {
+          g_set_error (error, G_IO_ERROR,
+                       g_io_error_from_errno (errno),
+                       "write error: %s",
+                       g_strerror (errno));
+          return FALSE;
+        }
+      else if (n == 0)
+        {
+          g_set_error (error, G_IO_ERROR,
+                       g_io_error_from_errno (EIO),
+                       "write error (zero write)");
+          return FALSE;
+        }
+
+      data += n;
+      offset += n;
+      nbytes -= n;
+    }
+
+  return TRUE;
+}
+
 DIR *
 bolt_opendir (const char *path,
               GError    **error)
@@ -736,6 +781,29 @@ bolt_fdatasync (int      fd,
   return FALSE;
 }
 
+gboolean
+bolt_fsync (int      fd,
+            GError **error)
+{
+  int code;
+  int r;
+
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  r = fsync (fd);
+
+  if (r == 0)
+    return TRUE;
+
+  code = errno;
+  g_set_error (error, G_IO_ERROR,
+               g_io_error_from_errno (code),
+               "could not sync file: %s",
+               g_strerror (code));
+
+  return FALSE;
+}
+
 gboolean
 bolt_lseek (int      fd,
             off_t    offset,
@@ -789,6 +857,32 @@ bolt_rename (const char *from,
   return FALSE;
 }
 
+gboolean
+bolt_link (const char *from,
+           const char *to,
+           GError    **error)
+{
+  int code;
+  int r;
+
+  g_return_val_if_fail (from != NULL, FALSE);
+  g_return_val_if_fail (to != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  r = link (from, to);
+
+  if (r == 0)
+    return TRUE;
+
+  code = errno;
+  g_set_error (error, G_IO_ERROR,
+               g_io_error_from_errno (code),
+               "could not link '%s' to '%s': %s",
+               from, to, g_strerror (code));
+
+  return FALSE;
+}
+
 #if !HAVE_FN_COPY_FILE_RANGE
 static loff_t
 copy_file_range (int          fd_in,
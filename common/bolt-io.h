@@ -55,6 +55,12 @@ gboolean   bolt_write_all (int         fd,
                            gssize      nbytes,
                            GError    **error);
 
+gboolean   bolt_pwrite_all (int         fd,
+                            const void *buf,
+                            gsize       nbytes,
+                            off_t       offset,
+                            GError    **error);
+
 gboolean   bolt_ftruncate (int      fd,
                            off_t    size,
                            GError **error);
@@ -131,6 +137,9 @@ gboolean   bolt_fstatat (int          dirfd,
 gboolean   bolt_fdatasync (int      fd,
                            GError **error);
 
+gboolean   bolt_fsync (int      fd,
+                       GError **error);
+
 gboolean   bolt_lseek (int      fd,
                        off_t    offset,
                        int      whence,
@@ -141,6 +150,10 @@ gboolean   bolt_rename (const char *from,
                         const char *to,
                         GError    **error);
 
+gboolean   bolt_link (const char *from,
+                      const char *to,
+                      GError    **error);
+
 gboolean   bolt_copy_bytes (int      fd_from,
                             int      fd_to,
                             size_t   len,
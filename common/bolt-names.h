@@ -70,6 +70,7 @@ G_BEGIN_DECLS
 #define BOLT_ENV_DBPATH "BOLT_DBPATH"
 #define BOLT_ENV_RUNTIME_DIRECTORY "RUNTIME_DIRECTORY"
 #define BOLT_ENV_STATE_DIRECTORY "STATE_DIRECTORY"
+#define BOLT_ENV_STORE_BACKEND "BOLT_STORE_BACKEND"
 
 /* other well known names */
 #define INTEL_WMI_THUNDERBOLT_GUID "86CCFD48-205E-4A77-9C48-2021CBEDE341"
@@ -397,3 +397,16 @@ bolt_comparefn_strcmp (gconstpointer a,
 
   return g_strcmp0 (*astrv, *bstrv);
 }
+
+guint
+bolt_str_count_char (const char *str,
+                     char        c)
+{
+  guint count = 0;
+
+  for (const char *p = str; p && *p; p++)
+    if (*p == c)
+      count++;
+
+  return count;
+}
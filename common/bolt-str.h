@@ -98,4 +98,7 @@ gboolean bolt_set_strdup_printf (char      **target,
 gint     bolt_comparefn_strcmp (gconstpointer a,
                                 gconstpointer b);
 
+guint    bolt_str_count_char (const char *str,
+                              char        c);
+
 G_END_DECLS
@@ -870,6 +870,12 @@ test_io_errors (TestIO *tt, gconstpointer user_data)
   g_assert_false (ok);
   g_clear_pointer (&err, g_error_free);
 
+  /* link */
+  ok = bolt_link (noexist, subdir, &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_assert_false (ok);
+  g_clear_pointer (&err, g_error_free);
+
   /* copy_bytes */
   ok = bolt_copy_bytes (to, from, 1, &err);
   g_assert_nonnull (err);
@@ -1274,6 +1280,11 @@ test_str (TestRng *tt, gconstpointer user_data)
   g_assert_cmpuint (1U, ==, g_strv_length (r));
   g_assert_true (g_strv_contains ((char const * const * ) r, "test"));
   g_strfreev (r);
+
+  g_assert_cmpuint (bolt_str_count_char (NULL, '/'), ==, 0);
+  g_assert_cmpuint (bolt_str_count_char ("", '/'), ==, 0);
+  g_assert_cmpuint (bolt_str_count_char ("0-0", '/'), ==, 0);
+  g_assert_cmpuint (bolt_str_count_char ("/sys/devices/0-0", '/'), ==, 3);
 }
 
 
@@ -22,11 +22,13 @@
 
 #include "bolt-device.h"
 
+#include "bolt-auth.h"
 #include "bolt-dbus.h"
 #include "bolt-domain.h"
 #include "bolt-store.h"
 
 #include "bolt-error.h"
+#include "bolt-str.h"
 
 #include <locale.h>
 
@@ -76,6 +78,130 @@ test_device_basic (TestDevice *tt, gconstpointer user_data)
   g_assert_false (ok);
 }
 
+typedef struct
+{
+  GPtrArray *order; /* uids, in the order they finished */
+  guint      pending;
+} AuthOrder;
+
+static void
+auth_order_done (GObject      *object,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+  BoltDevice *dev = BOLT_DEVICE (object);
+  AuthOrder *ao = user_data;
+
+  g_ptr_array_add (ao->order, g_strdup (bolt_device_get_uid (dev)));
+  ao->pending--;
+}
+
+static BoltDevice *
+auth_device_new (BoltDomain *domain,
+                 const char *uid,
+                 const char *syspath)
+{
+  return g_object_new (BOLT_TYPE_DEVICE,
+                       "uid", uid,
+                       "name", "Device",
+                       "vendor", "GNOME.org",
+                       "status", BOLT_STATUS_CONNECTED,
+                       "domain", domain,
+                       "sysfs-path", syspath,
+                       NULL);
+}
+
+static void
+test_device_auth_queue (TestDevice *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltDomain) d1 = NULL;
+  g_autoptr(BoltDomain) d2 = NULL;
+  g_autoptr(BoltDevice) host = NULL;
+  g_autoptr(BoltDevice) child = NULL;
+  g_autoptr(BoltDevice) parent = NULL;
+  g_autoptr(BoltDevice) other = NULL;
+  g_autoptr(GPtrArray) order = NULL;
+  BoltDevice *devs[4];
+  BoltDevice *expected[3];
+  AuthOrder ao;
+  guint queued;
+  guint inflight;
+
+  d1 = g_object_new (BOLT_TYPE_DOMAIN,
+                     "uid", "884c6edd-7118-4b21-b186-b02d396ecca0",
+                     "bootacl", NULL,
+                     NULL);
+
+  d2 = g_object_new (BOLT_TYPE_DOMAIN,
+                     "uid", "884c6edd-7118-4b21-b186-b02d396ecca1",
+                     "bootacl", NULL,
+                     NULL);
+
+  /* the sysfs paths do not exist, the authorizations will
+   * fail right away, which is fine for checking the order */
+  host = auth_device_new (d1, "fbc83890-e9bf-45e5-a777-b3728490989a",
+                          "/nonexistent/domain0/0-0");
+  child = auth_device_new (d1, "fbc83890-e9bf-45e5-a777-b3728490989b",
+                           "/nonexistent/domain0/0-0/0-1/0-301");
+  parent = auth_device_new (d1, "fbc83890-e9bf-45e5-a777-b3728490989c",
+                            "/nonexistent/domain0/0-0/0-1");
+  other = auth_device_new (d2, "fbc83890-e9bf-45e5-a777-b3728490989d",
+                           "/nonexistent/domain1/1-0/1-1");
+
+  devs[0] = host;
+  devs[1] = child;
+  devs[2] = parent;
+  devs[3] = other;
+
+  expected[0] = host;
+  expected[1] = parent;
+  expected[2] = child;
+
+  order = g_ptr_array_new_with_free_func (g_free);
+  ao.order = order;
+  ao.pending = G_N_ELEMENTS (devs);
+
+  bolt_device_get_auth_queue (&queued, &inflight);
+  g_assert_cmpuint (queued, ==, 0);
+  g_assert_cmpuint (inflight, ==, 0);
+
+  /* the child is queued before its parent */
+  for (guint i = 0; i < G_N_ELEMENTS (devs); i++)
+    {
+      g_autoptr(BoltAuth) auth = NULL;
+
+      auth = bolt_auth_new (devs[i], BOLT_SECURITY_USER, NULL);
+      bolt_device_authorize (devs[i], auth, auth_order_done, &ao);
+    }
+
+  /* one authorization per domain in flight, i.e. both
+   * domains in parallel, the rest of the first waits */
+  bolt_device_get_auth_queue (&queued, &inflight);
+  g_assert_cmpuint (queued, ==, 2);
+  g_assert_cmpuint (inflight, ==, 2);
+
+  while (ao.pending > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  bolt_device_get_auth_queue (&queued, &inflight);
+  g_assert_cmpuint (queued, ==, 0);
+  g_assert_cmpuint (inflight, ==, 0);
+
+  g_assert_cmpuint (order->len, ==, G_N_ELEMENTS (devs));
+
+  /* within the first domain: parents before children */
+  for (guint i = 0, k = 0; i < order->len; i++)
+    {
+      const char *uid = g_ptr_array_index (order, i);
+
+      if (bolt_streq (uid, bolt_device_get_uid (other)))
+        continue;
+
+      g_assert_cmpuint (k, <, G_N_ELEMENTS (expected));
+      g_assert_cmpstr (uid, ==, bolt_device_get_uid (expected[k++]));
+    }
+}
+
 int
 main (int argc, char **argv)
 {
@@ -92,5 +218,12 @@ main (int argc, char **argv)
               test_device_basic,
               NULL);
 
+  g_test_add ("/device/auth_queue",
+              TestDevice,
+              NULL,
+              NULL,
+              test_device_auth_queue,
+              NULL);
+
   return g_test_run ();
 }
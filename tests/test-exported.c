@@ -123,6 +123,11 @@ static GVariant *  handle_peng (BoltExported          *obj,
                                 GDBusMethodInvocation *inv,
                                 GError               **error);
 
+static void        handle_pang (BoltExported          *obj,
+                                GVariant              *params,
+                                GDBusMethodInvocation *inv,
+                                GTask                 *task);
+
 static gboolean handle_authorize_method (BoltExported          *exported,
                                          GDBusMethodInvocation *inv,
                                          GError               **error,
@@ -168,6 +173,10 @@ struct _BtExported
 
   BoltSecurity  security;
   BoltKittFlags kitt;
+
+  /* async method calls */
+  GTask        *pang;
+  guint         pang_cancelled;
 };
 
 G_DEFINE_TYPE (BtExported, bt_exported, BOLT_TYPE_EXPORTED);
@@ -198,6 +207,7 @@ bt_exported_finalize (GObject *object)
   BtExported *be = BT_EXPORTED (object);
 
   g_clear_object (&be->prop_obj);
+  g_clear_object (&be->pang);
 
   g_free (be->str);
   g_free (be->object_id);
@@ -365,6 +375,7 @@ bt_exported_class_init (BtExportedClass *klass)
   bolt_exported_class_export_properties (exported_class, PROP_STR, PROP_LAST, props);
   bolt_exported_class_export_method (exported_class, "Ping", handle_ping);
   bolt_exported_class_export_method (exported_class, "Peng", handle_peng);
+  bolt_exported_class_export_async_method (exported_class, "Pang", handle_pang);
 
   bolt_exported_class_property_setter (exported_class,
                                        props[PROP_STR_RW],
@@ -463,6 +474,46 @@ handle_peng (BoltExported          *obj,
   return NULL;
 }
 
+static void
+pang_cancelled (GCancellable *cancel,
+                gpointer      user_data)
+{
+  BtExported *be = BT_EXPORTED (user_data);
+  g_autoptr(GTask) task = g_steal_pointer (&be->pang);
+
+  be->pang_cancelled++;
+
+  if (task != NULL)
+    g_task_return_error_if_cancelled (task);
+}
+
+static void
+handle_pang (BoltExported          *obj,
+             GVariant              *params,
+             GDBusMethodInvocation *inv,
+             GTask                 *task)
+{
+  BtExported *be = BT_EXPORTED (obj);
+  gboolean wait;
+
+  g_variant_get (params, "(b)", &wait);
+
+  if (!wait)
+    {
+      g_task_return_pointer (task,
+                             g_variant_new ("(s)", "PANG"),
+                             (GDestroyNotify) g_variant_unref);
+      return;
+    }
+
+  /* only ever completed by the caller going away */
+  g_assert_null (be->pang);
+  be->pang = g_object_ref (task);
+
+  g_cancellable_connect (g_task_get_cancellable (task),
+                         G_CALLBACK (pang_cancelled),
+                         be, NULL);
+}
 
 static gboolean
 handle_set_str_rw (BoltExported *obj,
@@ -799,6 +850,241 @@ test_exported_basic (TestExported *tt, gconstpointer data)
   g_assert_error (ctx->error, BOLT_ERROR, BOLT_ERROR_FAILED);
 }
 
+static void
+test_exported_async (TestExported *tt, gconstpointer data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(CallCtx) ctx = NULL;
+  g_autoptr(CallCtx) pending = NULL;
+  g_autoptr(GDBusConnection) client = NULL;
+  g_autofree char *address = NULL;
+  const char *str = NULL;
+  gboolean ok;
+
+  ctx = call_ctx_new ();
+  pending = call_ctx_new ();
+
+  bt_exported_install_method_authorizer (tt->obj);
+  tt->obj->authorize_methods = TRUE;
+
+  /* completed right away */
+  g_dbus_connection_call (tt->bus,
+                          tt->bus_name,
+                          tt->obj_path,
+                          DBUS_IFACE,
+                          "Pang",
+                          g_variant_new ("(b)", FALSE),
+                          G_VARIANT_TYPE ("(s)"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          2000,
+                          NULL,
+                          dbus_call_done,
+                          ctx);
+  call_ctx_run (ctx);
+  g_assert_no_error (ctx->error);
+  g_assert_nonnull (ctx->data);
+  g_variant_get (ctx->data, "(&s)", &str);
+  g_assert_cmpstr (str, ==, "PANG");
+
+  /* a call that is pending until the caller disconnects */
+  address = g_dbus_address_get_for_bus_sync (G_BUS_TYPE_SESSION, NULL, &err);
+  g_assert_no_error (err);
+
+  client = g_dbus_connection_new_for_address_sync (address,
+                                                   G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                   G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                   NULL,
+                                                   NULL,
+                                                   &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (client);
+
+  g_dbus_connection_call (client,
+                          tt->bus_name,
+                          tt->obj_path,
+                          DBUS_IFACE,
+                          "Pang",
+                          g_variant_new ("(b)", TRUE),
+                          G_VARIANT_TYPE ("(s)"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          NULL,
+                          dbus_call_done,
+                          pending);
+
+  while (tt->obj->pang == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* other calls are not blocked by the pending one */
+  g_dbus_connection_call (tt->bus,
+                          tt->bus_name,
+                          tt->obj_path,
+                          DBUS_IFACE,
+                          "Ping",
+                          NULL,
+                          G_VARIANT_TYPE ("(s)"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          2000,
+                          NULL,
+                          dbus_call_done,
+                          ctx);
+  call_ctx_run (ctx);
+  g_assert_no_error (ctx->error);
+  g_assert_nonnull (ctx->data);
+  g_variant_get (ctx->data, "(&s)", &str);
+  g_assert_cmpstr (str, ==, "PONG");
+
+  g_assert_cmpuint (tt->obj->pang_cancelled, ==, 0);
+
+  /* caller goes away, the call gets cancelled */
+  ok = g_dbus_connection_close_sync (client, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  while (tt->obj->pang_cancelled == 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (tt->obj->pang_cancelled, ==, 1);
+  g_assert_null (tt->obj->pang);
+}
+
+typedef struct
+{
+  GMainLoop *loop;
+  guint      pending;
+  guint      done;
+  guint      limited;
+} LimitCtx;
+
+static void
+limit_call_done (GObject      *source_object,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GVariant) v = NULL;
+  LimitCtx *ctx = user_data;
+
+  v = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object),
+                                     res, &err);
+
+  if (g_error_matches (err, G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED))
+    ctx->limited++;
+  else
+    g_assert_no_error (err);
+
+  ctx->done++;
+
+  if (--ctx->pending == 0)
+    g_main_loop_quit (ctx->loop);
+}
+
+static void
+limit_ctx_call (TestExported *tt,
+                LimitCtx     *ctx,
+                const char   *iface,
+                const char   *method,
+                const char   *reply,
+                guint         n)
+{
+  for (guint i = 0; i < n; i++)
+    {
+      g_dbus_connection_call (tt->bus,
+                              tt->bus_name,
+                              tt->obj_path,
+                              iface,
+                              method,
+                              NULL,
+                              G_VARIANT_TYPE (reply),
+                              G_DBUS_CALL_FLAGS_NONE,
+                              -1,
+                              NULL,
+                              limit_call_done,
+                              ctx);
+      ctx->pending++;
+    }
+}
+
+static void
+limit_ctx_ping (TestExported *tt, LimitCtx *ctx, guint n)
+{
+  limit_ctx_call (tt, ctx, DBUS_IFACE, "Ping", "(s)", n);
+}
+
+static void
+test_exported_ratelimit (TestExported *tt, gconstpointer data)
+{
+  g_autoptr(GError) err = NULL;
+  BoltExportedStats before;
+  BoltExportedStats after;
+  LimitCtx ctx = {NULL, };
+  gboolean ok;
+
+  ctx.loop = g_main_loop_new (NULL, FALSE);
+
+  bt_exported_install_method_authorizer (tt->obj);
+  tt->obj->authorize_methods = TRUE;
+
+  /* all calls succeed, the ones above the burst are delayed */
+  bolt_exported_set_rate_limit (50, 2);
+  bolt_exported_get_stats (&before);
+
+  limit_ctx_ping (tt, &ctx, 5);
+  g_main_loop_run (ctx.loop);
+
+  bolt_exported_get_stats (&after);
+  g_assert_cmpuint (ctx.done, ==, 5);
+  g_assert_cmpuint (ctx.limited, ==, 0);
+  g_assert_cmpuint (after.throttled - before.throttled, >=, 3);
+  g_assert_cmpuint (after.rejected, ==, before.rejected);
+
+  /* too many waiting calls get rejected; lifting the limit
+   * dispatches all the calls that are still waiting */
+  bolt_exported_set_rate_limit (1, 1);
+  before = after;
+  ctx.done = 0;
+
+  limit_ctx_ping (tt, &ctx, 40);
+
+  while (ctx.limited == 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  bolt_exported_set_rate_limit (0, 0);
+
+  if (ctx.pending > 0)
+    g_main_loop_run (ctx.loop);
+
+  bolt_exported_get_stats (&after);
+  g_assert_cmpuint (ctx.done, ==, 40);
+  g_assert_cmpuint (ctx.limited, >, 0);
+  g_assert_cmpuint (after.rejected - before.rejected, ==, ctx.limited);
+
+  /* the object manager is admitted like all other calls */
+  ok = bolt_exported_export_object_manager (BOLT_EXPORTED (tt->obj), &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  bolt_exported_set_rate_limit (50, 1);
+  before = after;
+  ctx.done = 0;
+  ctx.limited = 0;
+
+  limit_ctx_call (tt, &ctx,
+                  "org.freedesktop.DBus.ObjectManager",
+                  "GetManagedObjects",
+                  "(a{oa{sa{sv}}})",
+                  3);
+  g_main_loop_run (ctx.loop);
+
+  bolt_exported_get_stats (&after);
+  g_assert_cmpuint (ctx.done, ==, 3);
+  g_assert_cmpuint (ctx.limited, ==, 0);
+  g_assert_cmpuint (after.throttled - before.throttled, >=, 2);
+
+  bolt_exported_set_rate_limit (0, 0);
+  g_main_loop_unref (ctx.loop);
+}
+
 static void
 test_exported_props (TestExported *tt, gconstpointer data)
 {
@@ -1081,6 +1367,153 @@ test_exported_props_changed (TestExported *tt, gconstpointer data)
   g_assert_true (have_str);
 }
 
+typedef struct
+{
+  GMainLoop *loop;
+  guint      signals;
+  guint      changes;
+} ChangesCtx;
+
+static void
+props_changed_count (GDBusConnection *connection,
+                     const gchar     *sender_name,
+                     const gchar     *object_path,
+                     const gchar     *interface_name,
+                     const gchar     *signal_name,
+                     GVariant        *parameters,
+                     gpointer         user_data)
+{
+  g_autoptr(GVariant) changed = NULL;
+  ChangesCtx *ctx = user_data;
+
+  changed = g_variant_get_child_value (parameters, 1);
+
+  ctx->signals++;
+  ctx->changes += g_variant_n_children (changed);
+}
+
+static gboolean
+change_properties_separately (gpointer user_data)
+{
+  TestExported *tt = user_data;
+
+  /* separate notify batches */
+  g_object_set (tt->obj, "str-rw", "huhu", NULL);
+  g_object_set (tt->obj, "bool", TRUE, NULL);
+  g_object_set (tt->obj, "str-rw", "hallo", NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+changes_timeout (gpointer user_data)
+{
+  ChangesCtx *ctx = user_data;
+
+  g_main_loop_quit (ctx->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+test_exported_props_coalesced (TestExported *tt, gconstpointer data)
+{
+  BoltExportedStats before;
+  BoltExportedStats after;
+  ChangesCtx ctx = {NULL, 0, 0};
+  guint sid;
+
+  ctx.loop = g_main_loop_new (NULL, FALSE);
+
+  sid = g_dbus_connection_signal_subscribe (tt->bus,
+                                            tt->bus_name,
+                                            "org.freedesktop.DBus.Properties",
+                                            "PropertiesChanged",
+                                            tt->obj_path,
+                                            DBUS_IFACE,
+                                            G_DBUS_SIGNAL_FLAGS_NONE,
+                                            props_changed_count,
+                                            &ctx,
+                                            NULL);
+
+  g_assert_cmpuint (sid, >, 0);
+
+  bolt_exported_get_stats (&before);
+
+  g_idle_add (change_properties_separately, tt);
+  g_timeout_add (500, changes_timeout, &ctx);
+  g_main_loop_run (ctx.loop);
+
+  g_dbus_connection_signal_unsubscribe (tt->bus, sid);
+
+  /* one signal with the two distinct properties */
+  g_assert_cmpuint (ctx.signals, ==, 1);
+  g_assert_cmpuint (ctx.changes, ==, 2);
+  g_assert_cmpstr (tt->obj->str, ==, "hallo");
+
+  bolt_exported_get_stats (&after);
+  g_assert_cmpuint (after.signals - before.signals, ==, 1);
+  g_assert_cmpuint (after.saved - before.saved, ==, 2);
+  g_assert_cmpuint (after.changes - before.changes, ==, 3);
+
+  g_main_loop_unref (ctx.loop);
+}
+
+static const char *
+get_all_lookup_str (TestExported *tt,
+                    CallCtx      *ctx,
+                    const char   *name)
+{
+  g_autoptr(GVariant) props = NULL;
+  const char *str = NULL;
+
+  g_dbus_connection_call (tt->bus,
+                          tt->bus_name,
+                          tt->obj_path,
+                          "org.freedesktop.DBus.Properties",
+                          "GetAll",
+                          g_variant_new ("(s)", DBUS_IFACE),
+                          G_VARIANT_TYPE ("(a{sv})"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          2000,
+                          NULL,
+                          dbus_call_done,
+                          ctx);
+
+  call_ctx_run (ctx);
+  g_assert_no_error (ctx->error);
+  g_assert_nonnull (ctx->data);
+
+  props = g_variant_get_child_value (ctx->data, 0);
+  g_variant_lookup (props, name, "&s", &str);
+
+  return str;
+}
+
+static void
+test_exported_props_getall (TestExported *tt, gconstpointer data)
+{
+  g_autoptr(CallCtx) ctx = NULL;
+  const char *str;
+
+  ctx = call_ctx_new ();
+
+  g_object_set (tt->obj, "str-rw", "huhu", NULL);
+
+  str = get_all_lookup_str (tt, ctx, "StrRW");
+  g_assert_cmpstr (str, ==, "huhu");
+
+  /* served from the cache */
+  str = get_all_lookup_str (tt, ctx, "StrRW");
+  g_assert_cmpstr (str, ==, "huhu");
+
+  /* the change invalidates the cache */
+  g_object_set (tt->obj, "str-rw", "hallo", NULL);
+
+  str = get_all_lookup_str (tt, ctx, "StrRW");
+  g_assert_cmpstr (str, ==, "hallo");
+}
+
 static void
 test_exported_props_enums (TestExported *tt, gconstpointer data)
 {
@@ -1318,6 +1751,20 @@ main (int argc, char **argv)
               test_exported_basic,
               test_exported_teardown);
 
+  g_test_add ("/exported/async",
+              TestExported,
+              NULL,
+              test_exported_setup,
+              test_exported_async,
+              test_exported_teardown);
+
+  g_test_add ("/exported/ratelimit",
+              TestExported,
+              NULL,
+              test_exported_setup,
+              test_exported_ratelimit,
+              test_exported_teardown);
+
   g_test_add ("/exported/props",
               TestExported,
               NULL,
@@ -1332,6 +1779,20 @@ main (int argc, char **argv)
               test_exported_props_changed,
               test_exported_teardown);
 
+  g_test_add ("/exported/props/coalesced",
+              TestExported,
+              NULL,
+              test_exported_setup,
+              test_exported_props_coalesced,
+              test_exported_teardown);
+
+  g_test_add ("/exported/props/getall",
+              TestExported,
+              NULL,
+              test_exported_setup,
+              test_exported_props_getall,
+              test_exported_teardown);
+
   g_test_add ("/exported/props/enums",
               TestExported,
               NULL,
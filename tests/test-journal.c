@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 
 typedef struct
@@ -352,6 +353,545 @@ test_journal_diff (TestJournal *tt, gconstpointer user_data)
     }
 }
 
+typedef struct
+{
+  GMainLoop *loop;
+  guint      pending;
+  guint      done;
+  guint      failed;
+} GroupCtx;
+
+static void
+group_put_done (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  GroupCtx *ctx = user_data;
+  gboolean ok;
+
+  ok = bolt_journal_put_finish (BOLT_JOURNAL (source), res, &err);
+
+  if (ok)
+    ctx->done++;
+  else
+    ctx->failed++;
+
+  if (--ctx->pending == 0)
+    g_main_loop_quit (ctx->loop);
+}
+
+static void
+test_journal_group (TestJournal *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltJournal) j = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GPtrArray) arr = NULL;
+  GroupCtx ctx = {NULL, };
+  gboolean ok;
+  int window;
+  guint n = 10;
+
+  j = bolt_journal_new (tt->root, "group", &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (j);
+
+  g_object_get (j, "commit-window", &window, NULL);
+  g_assert_cmpint (window, ==, -1);
+
+  bolt_journal_set_commit_window (j, 0);
+  g_object_get (j, "commit-window", &window, NULL);
+  g_assert_cmpint (window, ==, 0);
+
+  ctx.loop = g_main_loop_new (NULL, FALSE);
+
+  for (guint i = 0; i < n; i++)
+    {
+      g_autofree char *uid = NULL;
+
+      uid = g_strdup_printf ("%08x-0000-4000-8000-%012x", i, i);
+      bolt_journal_put_async (j, uid,
+                              i % 2 ? BOLT_JOURNAL_REMOVED : BOLT_JOURNAL_ADDED,
+                              NULL, group_put_done, &ctx);
+      ctx.pending++;
+    }
+
+  /* an id that can not be stored */
+  bolt_journal_put_async (j, "this-id-is-much-too-long-for-the-journal",
+                          BOLT_JOURNAL_ADDED,
+                          NULL, group_put_done, &ctx);
+  ctx.pending++;
+
+  /* written, but not yet committed */
+  g_assert_false (bolt_journal_is_fresh (j));
+  g_assert_cmpuint (ctx.done, ==, 0);
+
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (arr);
+  g_assert_cmpuint (arr->len, ==, n);
+  g_clear_pointer (&arr, g_ptr_array_unref);
+
+  g_main_loop_run (ctx.loop);
+
+  g_assert_cmpuint (ctx.pending, ==, 0);
+  g_assert_cmpuint (ctx.done, ==, n);
+  g_assert_cmpuint (ctx.failed, ==, 1);
+
+  /* synchronous puts are also grouped */
+  ok = bolt_journal_put (j, "aaaa", BOLT_JOURNAL_ADDED, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = bolt_journal_flush (j, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  /* pending entries are committed before a reset */
+  bolt_journal_put_async (j, "bbbb", BOLT_JOURNAL_ADDED,
+                          NULL, group_put_done, &ctx);
+  ctx.pending++;
+
+  ok = bolt_journal_reset (j, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_assert_true (bolt_journal_is_fresh (j));
+
+  g_main_loop_run (ctx.loop);
+  g_assert_cmpuint (ctx.done, ==, n + 1);
+
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, 0);
+
+  g_main_loop_unref (ctx.loop);
+}
+
+static gsize
+journal_file_size (TestJournal *tt, const char *name)
+{
+  g_autofree char *path = NULL;
+  GStatBuf st;
+  int r;
+
+  path = g_build_filename (tt->path, name, NULL);
+  r = g_stat (path, &st);
+  g_assert_cmpint (r, ==, 0);
+
+  return (gsize) st.st_size;
+}
+
+static void
+test_journal_compact (TestJournal *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltJournal) j = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GPtrArray) arr = NULL;
+  g_autoptr(GHashTable) diff = NULL;
+  const char *a = "884c6edd-7118-4b21-b186-b02d396ecca0";
+  const char *b = "0123456789abcdef";
+  g_autofree char *path = NULL;
+  gboolean ok;
+  gsize size;
+  int r;
+
+  j = bolt_journal_new (tt->root, "compact", &err);
+  g_assert_no_error (err);
+
+  ok = bolt_journal_put (j, a, BOLT_JOURNAL_ADDED, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  /* diffs are appended */
+  diff = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (diff, (gpointer) a, GINT_TO_POINTER ('-'));
+  g_hash_table_insert (diff, (gpointer) b, GINT_TO_POINTER ('+'));
+  g_hash_table_insert (diff, (gpointer) "cccc", GINT_TO_POINTER ('+'));
+
+  size = journal_file_size (tt, "compact");
+  ok = bolt_journal_put_diff (j, diff, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_assert_cmpuint (journal_file_size (tt, "compact"), ==, size + 3 * 32);
+
+  /* an incompletely written diff is dropped */
+  ok = bolt_journal_put_diff (j, diff, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_clear_object (&j);
+
+  /* cut the last record of the diff in half */
+  size = journal_file_size (tt, "compact");
+  path = g_build_filename (tt->path, "compact", NULL);
+  r = truncate (path, size - 32 - 5);
+  g_assert_cmpint (r, ==, 0);
+
+  j = bolt_journal_new (tt->root, "compact", &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (journal_file_size (tt, "compact"), ==, size - 3 * 32);
+
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, 4);
+  g_clear_pointer (&arr, g_ptr_array_unref);
+
+  /* compaction keeps the last op of every id */
+  ok = bolt_journal_compact (j, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  /* header, checkpoint and one entry per id */
+  g_assert_cmpuint (journal_file_size (tt, "compact"), ==, 16 + 4 * 32);
+
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, 3);
+
+  for (guint i = 0; i < arr->len; i++)
+    {
+      BoltJournalItem *item = g_ptr_array_index (arr, i);
+
+      if (g_str_equal (item->id, a))
+        g_assert_cmpint (item->op, ==, BOLT_JOURNAL_REMOVED);
+      else
+        g_assert_cmpint (item->op, ==, BOLT_JOURNAL_ADDED);
+    }
+
+  g_clear_pointer (&arr, g_ptr_array_unref);
+
+  /* the checkpoint survives re-opening, and compaction
+   * happens automatically once the tail grows too long */
+  g_clear_object (&j);
+  j = bolt_journal_new (tt->root, "compact", &err);
+  g_assert_no_error (err);
+  g_assert_false (bolt_journal_is_fresh (j));
+
+  for (guint i = 0; i < 200; i++)
+    {
+      ok = bolt_journal_put (j, i % 3 ? a : b,
+                             i % 2 ? BOLT_JOURNAL_ADDED : BOLT_JOURNAL_REMOVED,
+                             &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+    }
+
+  /* compacted after 128 entries: 3 in the snapshot, 72 in the tail */
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, 3 + 72);
+  g_assert_cmpuint (journal_file_size (tt, "compact"), ==, 16 + (1 + 3 + 72) * 32);
+}
+
+static void
+test_journal_iter (TestJournal *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltJournal) j = NULL;
+  g_autoptr(BoltJournalIter) iter = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *path = NULL;
+  const char *id;
+  BoltJournalOp op;
+  gboolean ok;
+  guint64 ts;
+  guint k;
+  static BoltJournalItem items[] = {
+    {(char *) "884c6edd-7118-4b21-b186-b02d396ecca0", BOLT_JOURNAL_ADDED,   0},
+    {(char *) "aaaa",                                 BOLT_JOURNAL_ADDED,   0},
+    {(char *) "0123456789abcdef",                     BOLT_JOURNAL_ADDED,   0},
+    {(char *) "aaaa",                                 BOLT_JOURNAL_REMOVED, 0},
+  };
+  /* newest first */
+  static const char *compacted[] = {
+    "aaaa",
+    "0123456789abcdef",
+    "884c6edd-7118-4b21-b186-b02d396ecca0",
+  };
+  const char *text =
+    "aaaa + 0000000000000001\n"
+    "bbbb - 0000000000000002\n";
+
+  j = bolt_journal_new (tt->root, "iter", &err);
+  g_assert_no_error (err);
+
+  /* empty journal */
+  iter = bolt_journal_iter_new (j, BOLT_JOURNAL_ITER_FORWARD, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (iter);
+  g_assert_false (bolt_journal_iter_next (iter, &id, &op, &ts));
+  g_clear_pointer (&iter, bolt_journal_iter_free);
+
+  for (guint i = 0; i < G_N_ELEMENTS (items); i++)
+    {
+      ok = bolt_journal_put (j, items[i].id, items[i].op, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+    }
+
+  iter = bolt_journal_iter_new (j, BOLT_JOURNAL_ITER_FORWARD, &err);
+  g_assert_no_error (err);
+
+  for (k = 0; bolt_journal_iter_next (iter, &id, &op, &ts); k++)
+    {
+      g_assert_cmpuint (k, <, G_N_ELEMENTS (items));
+      g_assert_cmpstr (id, ==, items[k].id);
+      g_assert_cmpint (op, ==, items[k].op);
+      g_assert_cmpuint (ts, >, 0);
+    }
+
+  g_assert_cmpuint (k, ==, G_N_ELEMENTS (items));
+  g_clear_pointer (&iter, bolt_journal_iter_free);
+
+  iter = bolt_journal_iter_new (j, BOLT_JOURNAL_ITER_REVERSE, &err);
+  g_assert_no_error (err);
+
+  for (k = G_N_ELEMENTS (items); bolt_journal_iter_next (iter, &id, &op, NULL); k--)
+    {
+      g_assert_cmpuint (k, >, 0);
+      g_assert_cmpstr (id, ==, items[k - 1].id);
+      g_assert_cmpint (op, ==, items[k - 1].op);
+    }
+
+  g_assert_cmpuint (k, ==, 0);
+  g_clear_pointer (&iter, bolt_journal_iter_free);
+
+  /* the checkpoint is not visible */
+  ok = bolt_journal_compact (j, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  iter = bolt_journal_iter_new (j, BOLT_JOURNAL_ITER_REVERSE, &err);
+  g_assert_no_error (err);
+
+  for (k = 0; bolt_journal_iter_next (iter, &id, NULL, NULL); k++)
+    {
+      g_assert_cmpuint (k, <, G_N_ELEMENTS (compacted));
+      g_assert_cmpstr (id, ==, compacted[k]);
+    }
+
+  g_assert_cmpuint (k, ==, G_N_ELEMENTS (compacted));
+  g_clear_pointer (&iter, bolt_journal_iter_free);
+  g_clear_object (&j);
+
+  /* text journals */
+  path = g_build_filename (tt->path, "text", NULL);
+  ok = g_file_set_contents (path, text, -1, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  j = bolt_journal_new (tt->root, "text", &err);
+  g_assert_no_error (err);
+
+  iter = bolt_journal_iter_new (j, BOLT_JOURNAL_ITER_REVERSE, &err);
+  g_assert_no_error (err);
+
+  g_assert_true (bolt_journal_iter_next (iter, &id, &op, &ts));
+  g_assert_cmpstr (id, ==, "bbbb");
+  g_assert_cmpint (op, ==, BOLT_JOURNAL_REMOVED);
+  g_assert_cmpuint (ts, ==, 2);
+
+  g_assert_true (bolt_journal_iter_next (iter, &id, &op, &ts));
+  g_assert_cmpstr (id, ==, "aaaa");
+  g_assert_cmpint (op, ==, BOLT_JOURNAL_ADDED);
+  g_assert_cmpuint (ts, ==, 1);
+
+  g_assert_false (bolt_journal_iter_next (iter, &id, &op, &ts));
+}
+
+static void
+test_journal_index (TestJournal *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltJournal) j = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GPtrArray) arr = NULL;
+  g_autoptr(GHashTable) diff = NULL;
+  const char *a = "884c6edd-7118-4b21-b186-b02d396ecca0";
+  BoltJournalOp op;
+  gboolean ok;
+  guint64 ts, last;
+
+  j = bolt_journal_new (tt->root, "index", &err);
+  g_assert_no_error (err);
+
+  g_assert_false (bolt_journal_lookup (j, a, &op, &ts));
+
+  ok = bolt_journal_put (j, a, BOLT_JOURNAL_ADDED, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = bolt_journal_put (j, "bbbb", BOLT_JOURNAL_ADDED, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = bolt_journal_lookup (j, a, &op, &ts);
+  g_assert_true (ok);
+  g_assert_cmpint (op, ==, BOLT_JOURNAL_ADDED);
+  g_assert_cmpuint (ts, >, 0);
+
+  ok = bolt_journal_put (j, a, BOLT_JOURNAL_REMOVED, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = bolt_journal_lookup (j, a, &op, &last);
+  g_assert_true (ok);
+  g_assert_cmpint (op, ==, BOLT_JOURNAL_REMOVED);
+  g_assert_cmpuint (last, >=, ts);
+
+  diff = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_insert (diff, (gpointer) "bbbb", GINT_TO_POINTER ('-'));
+  g_hash_table_insert (diff, (gpointer) "cccc", GINT_TO_POINTER ('+'));
+
+  ok = bolt_journal_put_diff (j, diff, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = bolt_journal_lookup (j, "bbbb", &op, NULL);
+  g_assert_true (ok);
+  g_assert_cmpint (op, ==, BOLT_JOURNAL_REMOVED);
+
+  /* the index is rebuilt when the journal is opened */
+  g_clear_object (&j);
+  j = bolt_journal_new (tt->root, "index", &err);
+  g_assert_no_error (err);
+
+  ok = bolt_journal_lookup (j, "cccc", &op, NULL);
+  g_assert_true (ok);
+  g_assert_cmpint (op, ==, BOLT_JOURNAL_ADDED);
+
+  /* one entry per id, in the order of their last op */
+  arr = bolt_journal_list_latest (j);
+  g_assert_nonnull (arr);
+  g_assert_cmpuint (arr->len, ==, 3);
+
+  g_assert_cmpstr (((BoltJournalItem *) arr->pdata[0])->id, ==, a);
+  g_assert_cmpint (((BoltJournalItem *) arr->pdata[0])->op, ==, BOLT_JOURNAL_REMOVED);
+  g_assert_true (g_str_equal (((BoltJournalItem *) arr->pdata[1])->id, "bbbb") ||
+                 g_str_equal (((BoltJournalItem *) arr->pdata[1])->id, "cccc"));
+  g_clear_pointer (&arr, g_ptr_array_unref);
+
+  ok = bolt_journal_reset (j, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_assert_false (bolt_journal_lookup (j, a, NULL, NULL));
+
+  arr = bolt_journal_list_latest (j);
+  g_assert_cmpuint (arr->len, ==, 0);
+}
+
+static gboolean
+journal_file_exists (TestJournal *tt, const char *name)
+{
+  g_autofree char *path = NULL;
+
+  path = g_build_filename (tt->path, name, NULL);
+
+  return g_file_test (path, G_FILE_TEST_EXISTS);
+}
+
+static void
+test_journal_rotate (TestJournal *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltJournal) j = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GPtrArray) arr = NULL;
+  BoltJournalOp op;
+  gboolean ok;
+  guint64 size;
+
+  j = bolt_journal_new (tt->root, "rotate", &err);
+  g_assert_no_error (err);
+
+  /* four entries per segment */
+  bolt_journal_set_limits (j, 4 * 32, 0);
+  g_object_get (j, "max-size", &size, NULL);
+  g_assert_cmpuint (size, ==, 4 * 32);
+
+  for (guint i = 0; i < 8; i++)
+    {
+      g_autofree char *id = g_strdup_printf ("id%02u", i);
+
+      ok = bolt_journal_put (j, id, BOLT_JOURNAL_ADDED, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+    }
+
+  g_assert_true (journal_file_exists (tt, "rotate.0"));
+  g_assert_true (journal_file_exists (tt, "rotate.1"));
+  g_assert_false (journal_file_exists (tt, "rotate.2"));
+  g_assert_cmpuint (journal_file_size (tt, "rotate"), ==, 16);
+
+  /* the segments are replayed in order after re-opening */
+  g_clear_object (&j);
+  j = bolt_journal_new (tt->root, "rotate", &err);
+  g_assert_no_error (err);
+  g_assert_false (bolt_journal_is_fresh (j));
+  bolt_journal_set_limits (j, 4 * 32, 0);
+
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, 8);
+
+  for (guint i = 0; i < arr->len; i++)
+    {
+      g_autofree char *id = g_strdup_printf ("id%02u", i);
+      BoltJournalItem *item = g_ptr_array_index (arr, i);
+
+      g_assert_cmpstr (item->id, ==, id);
+    }
+
+  g_clear_pointer (&arr, g_ptr_array_unref);
+
+  ok = bolt_journal_lookup (j, "id03", &op, NULL);
+  g_assert_true (ok);
+  g_assert_cmpint (op, ==, BOLT_JOURNAL_ADDED);
+
+  /* more sealed segments than allowed: checkpoint and drop */
+  for (guint i = 8; i < 20; i++)
+    {
+      g_autofree char *id = g_strdup_printf ("id%02u", i);
+
+      ok = bolt_journal_put (j, id, BOLT_JOURNAL_ADDED, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+    }
+
+  for (guint i = 0; i < 5; i++)
+    {
+      g_autofree char *name = g_strdup_printf ("rotate.%u", i);
+      g_assert_false (journal_file_exists (tt, name));
+    }
+
+  /* header, checkpoint and the snapshot */
+  g_assert_cmpuint (journal_file_size (tt, "rotate"), ==, 16 + 21 * 32);
+
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, 20);
+  g_assert_cmpstr (((BoltJournalItem *) arr->pdata[19])->id, ==, "id19");
+  g_clear_pointer (&arr, g_ptr_array_unref);
+
+  /* a reset also removes sealed segments */
+  for (guint i = 0; i < 4; i++)
+    {
+      ok = bolt_journal_put (j, "aaaa", BOLT_JOURNAL_REMOVED, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+    }
+
+  g_assert_true (journal_file_exists (tt, "rotate.0"));
+
+  ok = bolt_journal_reset (j, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_assert_false (journal_file_exists (tt, "rotate.0"));
+
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, 0);
+}
+
 static void
 test_journal_invalid_file (TestJournal *tt, gconstpointer user_data)
 {
@@ -398,6 +938,314 @@ test_journal_invalid_file (TestJournal *tt, gconstpointer user_data)
   g_test_trap_assert_passed ();
   g_test_trap_assert_stderr ("*invalid entry*");
 }
+
+static void
+test_journal_binary (TestJournal *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltJournal) j = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GPtrArray) arr = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *data = NULL;
+  gboolean ok;
+  gsize len;
+  static BoltJournalItem items[] = {
+    {(char *) "884c6edd-7118-4b21-b186-b02d396ecca0", BOLT_JOURNAL_ADDED,   0},
+    {(char *) "aaaa",                                 BOLT_JOURNAL_REMOVED, 0},
+    {(char *) "0123456789abcdef",                     BOLT_JOURNAL_ADDED,   0},
+  };
+
+  if (g_test_subprocess ())
+    {
+      int fd;
+
+      g_log_set_writer_func (nonfatal_logger, NULL, NULL);
+
+      j = bolt_journal_new (tt->root, "binary", &err);
+      g_assert_no_error (err);
+
+      for (guint i = 0; i < G_N_ELEMENTS (items); i++)
+        {
+          ok = bolt_journal_put (j, items[i].id, items[i].op, &err);
+          g_assert_no_error (err);
+          g_assert_true (ok);
+        }
+
+      g_clear_object (&j);
+
+      /* corrupt the id of the second record */
+      path = g_build_filename (tt->path, "binary", NULL);
+      fd = g_open (path, O_RDWR, 0);
+      g_assert_cmpint (fd, >, -1);
+      g_assert_cmpint (pwrite (fd, "x", 1, 16 + 32 + 2), ==, 1);
+      close (fd);
+
+      j = bolt_journal_new (tt->root, "binary", &err);
+      g_assert_no_error (err);
+
+      arr = bolt_journal_list (j, &err);
+      g_assert_no_error (err);
+      g_assert_cmpuint (arr->len, ==, G_N_ELEMENTS (items) - 1);
+
+      exit (0);
+    }
+
+  j = bolt_journal_new (tt->root, "binary", &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (j);
+
+  for (guint i = 0; i < G_N_ELEMENTS (items); i++)
+    {
+      ok = bolt_journal_put (j, items[i].id, items[i].op, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+    }
+
+  /* ids that are neither uuids nor short enough */
+  ok = bolt_journal_put (j, "0123456789abcdef0", BOLT_JOURNAL_ADDED, &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+  g_assert_false (ok);
+  g_clear_error (&err);
+
+  /* header and one fixed size record per entry */
+  path = g_build_filename (tt->path, "binary", NULL);
+  ok = g_file_get_contents (path, &data, &len, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_assert_cmpuint (len, ==, 16 + G_N_ELEMENTS (items) * 32);
+  g_assert_true (g_str_has_prefix (data, "BOLTJRNL"));
+
+  g_clear_object (&j);
+  j = bolt_journal_new (tt->root, "binary", &err);
+  g_assert_no_error (err);
+  g_assert_false (bolt_journal_is_fresh (j));
+
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, G_N_ELEMENTS (items));
+
+  for (guint i = 0; i < arr->len; i++)
+    {
+      BoltJournalItem *ours = items + i;
+      BoltJournalItem *theirs = arr->pdata[i];
+
+      g_assert_cmpstr (theirs->id, ==, ours->id);
+      g_assert_cmpint (theirs->op, ==, ours->op);
+      g_assert_cmpuint (theirs->ts, >, 0);
+    }
+
+  /* corrupted records are skipped */
+  g_test_trap_subprocess (NULL, 0, 0);
+  g_test_trap_assert_passed ();
+  g_test_trap_assert_stderr ("*invalid entry*");
+}
+
+static void
+test_journal_text (TestJournal *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltJournal) j = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GPtrArray) arr = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *data = NULL;
+  gboolean ok;
+  const char *text =
+    "884c6edd-7118-4b21-b186-b02d396ecca0 + 0000000000000017\n"
+    "fbc83890-e9bf-45e5-a777-b3728490989c - 000000000000002A\n";
+
+  path = g_build_filename (tt->path, "text", NULL);
+  ok = g_file_set_contents (path, text, -1, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  j = bolt_journal_new (tt->root, "text", &err);
+  g_assert_no_error (err);
+  g_assert_false (bolt_journal_is_fresh (j));
+
+  /* reading does not change the file */
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, 2);
+  g_clear_pointer (&arr, g_ptr_array_unref);
+
+  ok = g_file_get_contents (path, &data, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_cmpstr (data, ==, text);
+  g_clear_pointer (&data, g_free);
+
+  /* the first write converts it */
+  ok = bolt_journal_put (j, "aaaa", BOLT_JOURNAL_ADDED, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = g_file_get_contents (path, &data, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (g_str_has_prefix (data, "BOLTJRNL"));
+
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, 3);
+
+  g_assert_cmpstr (((BoltJournalItem *) arr->pdata[0])->id, ==,
+                   "884c6edd-7118-4b21-b186-b02d396ecca0");
+  g_assert_cmpint (((BoltJournalItem *) arr->pdata[0])->op, ==, BOLT_JOURNAL_ADDED);
+  g_assert_cmpuint (((BoltJournalItem *) arr->pdata[0])->ts, ==, 0x17);
+
+  g_assert_cmpstr (((BoltJournalItem *) arr->pdata[1])->id, ==,
+                   "fbc83890-e9bf-45e5-a777-b3728490989c");
+  g_assert_cmpint (((BoltJournalItem *) arr->pdata[1])->op, ==, BOLT_JOURNAL_REMOVED);
+  g_assert_cmpuint (((BoltJournalItem *) arr->pdata[1])->ts, ==, 0x2A);
+
+  g_assert_cmpstr (((BoltJournalItem *) arr->pdata[2])->id, ==, "aaaa");
+  g_clear_pointer (&arr, g_ptr_array_unref);
+
+  /* journals with ids that can not be converted stay text */
+  g_clear_object (&j);
+  g_clear_pointer (&data, g_free);
+
+  text = "this-id-is-way-too-long-for-binary + 0000000000000017\n";
+  ok = g_file_set_contents (path, text, -1, &err);
+  g_assert_no_error (err);
+
+  j = bolt_journal_new (tt->root, "text", &err);
+  g_assert_no_error (err);
+
+  ok = bolt_journal_put (j, "aaaa", BOLT_JOURNAL_ADDED, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = g_file_get_contents (path, &data, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (g_str_has_prefix (data, "this-id-is"));
+
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, 2);
+  g_clear_pointer (&arr, g_ptr_array_unref);
+
+  /* as do journals that are about to get such an id */
+  g_clear_object (&j);
+  g_clear_pointer (&data, g_free);
+
+  text = "884c6edd-7118-4b21-b186-b02d396ecca0 + 0000000000000017\n";
+  ok = g_file_set_contents (path, text, -1, &err);
+  g_assert_no_error (err);
+
+  j = bolt_journal_new (tt->root, "text", &err);
+  g_assert_no_error (err);
+
+  ok = bolt_journal_put (j, "this-id-is-way-too-long-for-binary",
+                         BOLT_JOURNAL_ADDED, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = g_file_get_contents (path, &data, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (g_str_has_prefix (data, "884c6edd"));
+
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, 2);
+  g_clear_pointer (&arr, g_ptr_array_unref);
+
+  /* and new journals whose first id is one */
+  g_clear_object (&j);
+  g_clear_pointer (&data, g_free);
+
+  j = bolt_journal_new (tt->root, "fresh", &err);
+  g_assert_no_error (err);
+  g_assert_true (bolt_journal_is_fresh (j));
+
+  ok = bolt_journal_put (j, "this-id-is-way-too-long-for-binary",
+                         BOLT_JOURNAL_ADDED, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_clear_pointer (&path, g_free);
+  path = g_build_filename (tt->path, "fresh", NULL);
+  ok = g_file_get_contents (path, &data, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (g_str_has_prefix (data, "this-id-is"));
+
+  arr = bolt_journal_list (j, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, 1);
+}
+
+static gdouble
+replay_journal (GFile *root, const char *name, guint n)
+{
+  g_autoptr(BoltJournal) j = NULL;
+  g_autoptr(GPtrArray) arr = NULL;
+  g_autoptr(GError) err = NULL;
+  gdouble secs;
+  GTimer *timer;
+
+  j = bolt_journal_new (root, name, &err);
+  g_assert_no_error (err);
+
+  timer = g_timer_new ();
+  arr = bolt_journal_list (j, &err);
+  secs = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  g_assert_no_error (err);
+  g_assert_cmpuint (arr->len, ==, n);
+
+  return secs;
+}
+
+static void
+test_journal_replay (TestJournal *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltJournal) j = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GString) text = NULL;
+  g_autofree char *path = NULL;
+  gdouble t_text, t_bin;
+  gboolean ok;
+  guint n = 1000;
+
+  if (g_test_perf ())
+    n = 100000;
+
+  text = g_string_sized_new (n * 56);
+  for (guint i = 0; i < n; i++)
+    g_string_append_printf (text,
+                            "%08x-0000-4000-8000-%012x %c %016X\n",
+                            i, i, i % 2 ? '+' : '-', i + 1);
+
+  path = g_build_filename (tt->path, "text", NULL);
+  ok = g_file_set_contents (path, text->str, text->len, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_clear_pointer (&path, g_free);
+
+  path = g_build_filename (tt->path, "binary", NULL);
+  ok = g_file_set_contents (path, text->str, text->len, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  /* converts the second one to the binary format */
+  j = bolt_journal_new (tt->root, "binary", &err);
+  g_assert_no_error (err);
+
+  ok = bolt_journal_put (j, "aaaa", BOLT_JOURNAL_ADDED, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_clear_object (&j);
+
+  t_text = replay_journal (tt->root, "text", n);
+  t_bin = replay_journal (tt->root, "binary", n + 1);
+
+  g_test_message ("replaying %u entries: text %.3f s, binary %.3f s",
+                  n, t_text, t_bin);
+
+  g_test_minimized_result (t_bin, "binary replay of %u entries: %.3f s",
+                           n, t_bin);
+}
+
 static void
 test_journal_op_stringops (TestJournal *tt, gconstpointer user_data)
 {
@@ -468,6 +1316,41 @@ main (int argc, char **argv)
               test_journal_diff,
               test_journal_tear_down);
 
+  g_test_add ("/journal/group",
+              TestJournal,
+              NULL,
+              test_journal_setup,
+              test_journal_group,
+              test_journal_tear_down);
+
+  g_test_add ("/journal/compact",
+              TestJournal,
+              NULL,
+              test_journal_setup,
+              test_journal_compact,
+              test_journal_tear_down);
+
+  g_test_add ("/journal/iter",
+              TestJournal,
+              NULL,
+              test_journal_setup,
+              test_journal_iter,
+              test_journal_tear_down);
+
+  g_test_add ("/journal/index",
+              TestJournal,
+              NULL,
+              test_journal_setup,
+              test_journal_index,
+              test_journal_tear_down);
+
+  g_test_add ("/journal/rotate",
+              TestJournal,
+              NULL,
+              test_journal_setup,
+              test_journal_rotate,
+              test_journal_tear_down);
+
   g_test_add ("/journal/invalid_file",
               TestJournal,
               NULL,
@@ -475,6 +1358,27 @@ main (int argc, char **argv)
               test_journal_invalid_file,
               test_journal_tear_down);
 
+  g_test_add ("/journal/binary",
+              TestJournal,
+              NULL,
+              test_journal_setup,
+              test_journal_binary,
+              test_journal_tear_down);
+
+  g_test_add ("/journal/text",
+              TestJournal,
+              NULL,
+              test_journal_setup,
+              test_journal_text,
+              test_journal_tear_down);
+
+  g_test_add ("/journal/replay",
+              TestJournal,
+              NULL,
+              test_journal_setup,
+              test_journal_replay,
+              test_journal_tear_down);
+
   g_test_add ("/journal/op/string",
               TestJournal,
               NULL,
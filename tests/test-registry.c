@@ -0,0 +1,379 @@
+/*
+ * Copyright © 2018 Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *       Christian J. Kellner <christian@kellner.me>
+ */
+
+#include "config.h"
+
+#include "bolt-registry.h"
+
+#include "bolt-dbus.h"
+#include "bolt-device.h"
+
+#include <locale.h>
+
+typedef struct
+{
+  BoltRegistry *reg;
+} TestRegistry;
+
+static void
+test_registry_setup (TestRegistry *tt, gconstpointer user_data)
+{
+  tt->reg = bolt_registry_new ();
+}
+
+static void
+test_registry_tear_down (TestRegistry *tt, gconstpointer user_data)
+{
+  g_clear_object (&tt->reg);
+}
+
+static BoltDevice *
+make_device (guint       n,
+             const char *name)
+{
+  g_autofree char *uid = NULL;
+  g_autofree char *path = NULL;
+  BoltDevice *dev;
+
+  uid = g_strdup_printf ("fbc83890-e9bf-45e5-a777-%012x", n);
+  path = g_strdup_printf ("/sys/devices/pci0000:00/0000:00:1d.4/"
+                          "0000:05:00.0/0000:06:00.0/0000:07:00.0/"
+                          "domain0/0-0/0-%x", n);
+
+  dev = g_object_new (BOLT_TYPE_DEVICE,
+                      "uid", uid,
+                      "name", name,
+                      "vendor", "GNOME.org",
+                      "status", BOLT_STATUS_DISCONNECTED,
+                      "sysfs-path", path,
+                      NULL);
+
+  return dev;
+}
+
+static void
+test_registry_basic (TestRegistry *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltDevice) a = NULL;
+  g_autoptr(BoltDevice) b = NULL;
+  g_autoptr(BoltDevice) c = NULL;
+  BoltDevice *d;
+  gboolean ok;
+  guint n;
+
+  a = make_device (1, "Laptop");
+  b = make_device (2, "Laptop");
+  c = make_device (3, "Dock");
+
+  bolt_registry_add (tt->reg, a);
+  bolt_registry_add (tt->reg, b);
+  bolt_registry_add (tt->reg, c);
+
+  n = bolt_registry_get_count (tt->reg);
+  g_assert_cmpuint (n, ==, 3);
+
+  d = bolt_registry_lookup_uid (tt->reg, bolt_device_get_uid (b));
+  g_assert_true (d == b);
+
+  d = bolt_registry_lookup_syspath (tt->reg, bolt_device_get_syspath (c));
+  g_assert_true (d == c);
+
+  d = bolt_registry_lookup_uid (tt->reg, "nonexistent");
+  g_assert_null (d);
+
+  d = bolt_registry_lookup_object_path (tt->reg, "/org/freedesktop/bolt");
+  g_assert_null (d);
+
+  n = bolt_registry_count_name (tt->reg, "GNOME.org", "Laptop");
+  g_assert_cmpuint (n, ==, 2);
+
+  n = bolt_registry_count_name (tt->reg, "GNOME.org", "Dock");
+  g_assert_cmpuint (n, ==, 1);
+
+  n = bolt_registry_count_name_unstored (tt->reg, "GNOME.org", "Laptop");
+  g_assert_cmpuint (n, ==, 2);
+
+  /* removal */
+  ok = bolt_registry_remove (tt->reg, a);
+  g_assert_true (ok);
+
+  ok = bolt_registry_remove (tt->reg, a);
+  g_assert_false (ok);
+
+  n = bolt_registry_get_count (tt->reg);
+  g_assert_cmpuint (n, ==, 2);
+
+  d = bolt_registry_lookup_uid (tt->reg, bolt_device_get_uid (a));
+  g_assert_null (d);
+
+  d = bolt_registry_lookup_syspath (tt->reg, bolt_device_get_syspath (a));
+  g_assert_null (d);
+
+  n = bolt_registry_count_name (tt->reg, "GNOME.org", "Laptop");
+  g_assert_cmpuint (n, ==, 1);
+
+  /* the remaining devices must still be reachable by index */
+  for (guint i = 0; i < bolt_registry_get_count (tt->reg); i++)
+    {
+      BoltDevice *dev = bolt_registry_get_nth (tt->reg, i);
+      g_assert_true (dev == b || dev == c);
+    }
+
+  ok = bolt_registry_remove (tt->reg, c);
+  g_assert_true (ok);
+
+  d = bolt_registry_get_nth (tt->reg, 0);
+  g_assert_true (d == b);
+}
+
+static void
+test_registry_reindex (TestRegistry *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltDevice) a = NULL;
+  g_autoptr(BoltDevice) b = NULL;
+  g_autofree char *path = NULL;
+  BoltDevice *d;
+
+  a = make_device (1, "Laptop");
+  b = make_device (2, "Dock");
+
+  bolt_registry_add (tt->reg, a);
+  bolt_registry_add (tt->reg, b);
+
+  path = g_strdup (bolt_device_get_syspath (a));
+
+  /* device got disconnected */
+  g_object_set (a, "sysfs-path", NULL, NULL);
+
+  d = bolt_registry_lookup_syspath (tt->reg, path);
+  g_assert_null (d);
+
+  /* a different device shows up at the same place */
+  g_object_set (b, "sysfs-path", path, NULL);
+
+  d = bolt_registry_lookup_syspath (tt->reg, path);
+  g_assert_true (d == b);
+
+  /* the old device re-appears at the same place, before
+   * 'b' has been updated, i.e. the newer entry wins */
+  g_object_set (a, "sysfs-path", path, NULL);
+
+  d = bolt_registry_lookup_syspath (tt->reg, path);
+  g_assert_true (d == a);
+
+  /* the update of the stale entry must not remove 'a' */
+  g_object_set (b, "sysfs-path", NULL, NULL);
+
+  d = bolt_registry_lookup_syspath (tt->reg, path);
+  g_assert_true (d == a);
+}
+
+static void
+test_registry_topology (TestRegistry *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltDevice) host = NULL;
+  g_autoptr(BoltDevice) dock = NULL;
+  g_autoptr(BoltDevice) disk = NULL;
+  g_autoptr(BoltDevice) cable = NULL;
+  g_autoptr(GPtrArray) children = NULL;
+  g_autoptr(GPtrArray) tree = NULL;
+  BoltDevice *d;
+
+  host = make_device (0, "Laptop");
+  dock = make_device (1, "Dock");
+  disk = make_device (2, "Disk");
+  cable = make_device (3, "Cable");
+
+  /* host -> dock -> { disk, cable } */
+  g_object_set (dock, "parent", bolt_device_get_uid (host), NULL);
+  g_object_set (disk, "parent", bolt_device_get_uid (dock), NULL);
+
+  bolt_registry_add (tt->reg, host);
+  bolt_registry_add (tt->reg, dock);
+  bolt_registry_add (tt->reg, disk);
+  bolt_registry_add (tt->reg, cable);
+
+  /* update after the device got registered */
+  g_object_set (cable, "parent", bolt_device_get_uid (dock), NULL);
+
+  d = bolt_registry_get_parent (tt->reg, host);
+  g_assert_null (d);
+
+  d = bolt_registry_get_parent (tt->reg, dock);
+  g_assert_true (d == host);
+
+  d = bolt_registry_get_parent (tt->reg, cable);
+  g_assert_true (d == dock);
+
+  children = bolt_registry_get_children (tt->reg, dock);
+  g_assert_cmpuint (children->len, ==, 2);
+  g_clear_pointer (&children, g_ptr_array_unref);
+
+  children = bolt_registry_get_children (tt->reg, disk);
+  g_assert_cmpuint (children->len, ==, 0);
+  g_clear_pointer (&children, g_ptr_array_unref);
+
+  tree = bolt_registry_get_subtree (tt->reg, host);
+  g_assert_cmpuint (tree->len, ==, 4);
+  g_assert_true (g_ptr_array_index (tree, 0) == host);
+  g_assert_true (g_ptr_array_index (tree, 1) == dock);
+  g_clear_pointer (&tree, g_ptr_array_unref);
+
+  /* the dock gets disconnected */
+  g_object_set (dock, "parent", NULL, NULL);
+
+  d = bolt_registry_get_parent (tt->reg, dock);
+  g_assert_null (d);
+
+  children = bolt_registry_get_children (tt->reg, host);
+  g_assert_cmpuint (children->len, ==, 0);
+  g_clear_pointer (&children, g_ptr_array_unref);
+
+  /* removing the disk updates the children of the dock */
+  bolt_registry_remove (tt->reg, disk);
+
+  children = bolt_registry_get_children (tt->reg, dock);
+  g_assert_cmpuint (children->len, ==, 1);
+  g_assert_true (g_ptr_array_index (children, 0) == cable);
+
+  tree = bolt_registry_get_subtree (tt->reg, dock);
+  g_assert_cmpuint (tree->len, ==, 2);
+}
+
+static gint64
+bench_lookups (BoltRegistry *reg,
+               GStrv         uids,
+               GStrv         paths,
+               guint         rounds)
+{
+  guint n = g_strv_length (uids);
+  gint64 start, end;
+
+  start = g_get_monotonic_time ();
+
+  for (guint r = 0; r < rounds; r++)
+    {
+      BoltDevice *dev;
+      guint k = (r * 7919) % n;
+
+      dev = bolt_registry_lookup_uid (reg, uids[k]);
+      g_assert_nonnull (dev);
+
+      dev = bolt_registry_lookup_syspath (reg, paths[k]);
+      g_assert_nonnull (dev);
+    }
+
+  end = g_get_monotonic_time ();
+
+  /* nano-seconds per lookup */
+  return ((end - start) * 1000) / (rounds * 2);
+}
+
+static void
+test_registry_bench (TestRegistry *tt, gconstpointer user_data)
+{
+  static const guint sizes[] = {16, 128, 1024, 4096};
+  guint rounds = g_test_perf () ? 1000000 : 20000;
+  gint64 first = 0;
+  gint64 last = 0;
+
+  for (guint s = 0; s < G_N_ELEMENTS (sizes); s++)
+    {
+      g_autoptr(BoltRegistry) reg = NULL;
+      g_autoptr(GPtrArray) uids = NULL;
+      g_autoptr(GPtrArray) paths = NULL;
+      gint64 ns;
+
+      reg = bolt_registry_new ();
+      uids = g_ptr_array_new_with_free_func (g_free);
+      paths = g_ptr_array_new_with_free_func (g_free);
+
+      for (guint i = 0; i < sizes[s]; i++)
+        {
+          g_autoptr(BoltDevice) dev = make_device (i, "Device");
+
+          bolt_registry_add (reg, dev);
+          g_ptr_array_add (uids, g_strdup (bolt_device_get_uid (dev)));
+          g_ptr_array_add (paths, g_strdup (bolt_device_get_syspath (dev)));
+        }
+
+      g_ptr_array_add (uids, NULL);
+      g_ptr_array_add (paths, NULL);
+
+      ns = bench_lookups (reg,
+                          (GStrv) uids->pdata,
+                          (GStrv) paths->pdata,
+                          rounds);
+
+      g_test_message ("%5u devices: %" G_GINT64_FORMAT " ns / lookup",
+                      sizes[s], ns);
+
+      if (s == 0)
+        first = MAX (ns, 1);
+      last = ns;
+    }
+
+  /* lookups must not scale with the number of devices, a
+   * linear scan would be ~256 times slower for the largest
+   * set; allow for a generous factor to cover cache effects
+   * and noisy test machines. */
+  if (g_test_perf ())
+    g_assert_cmpint (last, <, first * 16);
+}
+
+int
+main (int argc, char **argv)
+{
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  bolt_dbus_ensure_resources ();
+
+  g_test_add ("/registry/basic",
+              TestRegistry,
+              NULL,
+              test_registry_setup,
+              test_registry_basic,
+              test_registry_tear_down);
+
+  g_test_add ("/registry/reindex",
+              TestRegistry,
+              NULL,
+              test_registry_setup,
+              test_registry_reindex,
+              test_registry_tear_down);
+
+  g_test_add ("/registry/topology",
+              TestRegistry,
+              NULL,
+              test_registry_setup,
+              test_registry_topology,
+              test_registry_tear_down);
+
+  g_test_add ("/registry/bench",
+              TestRegistry,
+              NULL,
+              test_registry_setup,
+              test_registry_bench,
+              test_registry_tear_down);
+
+  return g_test_run ();
+}
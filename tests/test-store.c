@@ -39,6 +39,7 @@
 
 #include <fcntl.h>
 #include <locale.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h> /* unlinkat, truncate */
@@ -246,6 +247,8 @@ test_store_config (TestStore *tt, gconstpointer user_data)
   g_autoptr(GError) err = NULL;
   BoltAuthMode authmode;
   BoltPolicy policy;
+  guint rate, burst;
+  guint latency;
   gboolean ok;
   BoltTri tri;
 
@@ -300,6 +303,48 @@ test_store_config (TestStore *tt, gconstpointer user_data)
   g_assert_no_error (err);
   g_assert (tri == TRI_YES);
   g_assert_cmpuint (authmode, ==, BOLT_AUTH_ENABLED);
+
+  /* rate limit */
+  tri = bolt_config_load_rate_limit (loaded, &rate, &burst, &err);
+  g_assert_no_error (err);
+  g_assert (tri == TRI_NO);
+
+  g_key_file_set_string (loaded, "config", "RateLimit", "WRONG");
+  tri = bolt_config_load_rate_limit (loaded, &rate, &burst, &err);
+  g_assert_error (err, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE);
+  g_assert (tri == TRI_ERROR);
+  g_clear_pointer (&err, g_error_free);
+
+  g_key_file_set_uint64 (loaded, "config", "RateLimit", 10);
+  tri = bolt_config_load_rate_limit (loaded, &rate, &burst, &err);
+  g_assert_no_error (err);
+  g_assert (tri == TRI_YES);
+  g_assert_cmpuint (rate, ==, 10);
+  g_assert_cmpuint (burst, ==, 10);
+
+  g_key_file_set_uint64 (loaded, "config", "RateLimitBurst", 20);
+  tri = bolt_config_load_rate_limit (loaded, &rate, &burst, &err);
+  g_assert_no_error (err);
+  g_assert (tri == TRI_YES);
+  g_assert_cmpuint (rate, ==, 10);
+  g_assert_cmpuint (burst, ==, 20);
+
+  /* changes latency */
+  tri = bolt_config_load_changes_latency (loaded, &latency, &err);
+  g_assert_no_error (err);
+  g_assert (tri == TRI_NO);
+
+  g_key_file_set_string (loaded, "config", "ChangesLatency", "WRONG");
+  tri = bolt_config_load_changes_latency (loaded, &latency, &err);
+  g_assert_error (err, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE);
+  g_assert (tri == TRI_ERROR);
+  g_clear_pointer (&err, g_error_free);
+
+  g_key_file_set_uint64 (loaded, "config", "ChangesLatency", 50);
+  tri = bolt_config_load_changes_latency (loaded, &latency, &err);
+  g_assert_no_error (err);
+  g_assert (tri == TRI_YES);
+  g_assert_cmpuint (latency, ==, 50);
 }
 
 static void
@@ -674,56 +719,1134 @@ test_store_domain (TestStore *tt, gconstpointer user_data)
   g_assert_false (bolt_domain_is_stored (s1));
 }
 
-int
-main (int argc, char **argv)
+static void
+test_store_database (TestStore *tt, gconstpointer user_data)
 {
+  g_autoptr(BoltStore) store = NULL;
+  g_autoptr(BoltDevice) dev = NULL;
+  g_autoptr(BoltDevice) stored = NULL;
+  g_autoptr(BoltKey) key = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *dbpath = NULL;
+  g_autofree char *devpath = NULL;
+  g_autofree char *corrupt = NULL;
+  g_autofree char *prev = NULL;
+  g_auto(GStrv) ids = NULL;
+  const char *uids[] = {
+    "884c6edd-7118-4b21-b186-b02d396ecca0",
+    "fbc83890-e9bf-45e5-a777-b3728490989c",
+  };
+  gboolean ok;
 
-  setlocale (LC_ALL, "");
+  /* populate the directory layout first */
+  for (guint i = 0; i < G_N_ELEMENTS (uids); i++)
+    {
+      g_autoptr(BoltDevice) d = NULL;
 
-  g_test_init (&argc, &argv, NULL);
+      d = g_object_new (BOLT_TYPE_DEVICE,
+                        "uid", uids[i],
+                        "name", "Laptop",
+                        "vendor", "GNOME.org",
+                        "status", BOLT_STATUS_DISCONNECTED,
+                        NULL);
 
-  bolt_dbus_ensure_resources ();
+      ok = bolt_store_put_device (tt->store, d, BOLT_POLICY_AUTO, NULL, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+    }
 
-  g_test_add ("/daemon/key",
-              TestStore,
-              NULL,
-              test_store_setup,
-              test_key,
-              test_store_tear_down);
+  dbpath = g_build_filename (tt->path, "devices.db", NULL);
+  devpath = g_build_filename (tt->path, "devices", NULL);
+  g_assert_false (g_file_test (dbpath, G_FILE_TEST_EXISTS));
 
-  g_test_add ("/daemon/store/basic",
-              TestStore,
-              NULL,
-              test_store_setup,
-              test_store_basic,
-              test_store_tear_down);
+  /* open the store with the database, which migrates */
+  g_setenv ("BOLT_STORE_BACKEND", "database", TRUE);
+  store = bolt_store_new (tt->path);
+  g_unsetenv ("BOLT_STORE_BACKEND");
 
-  g_test_add ("/daemon/store/config",
-              TestStore,
-              NULL,
-              test_store_setup,
-              test_store_config,
-              test_store_tear_down);
+  g_assert_true (g_file_test (dbpath, G_FILE_TEST_IS_REGULAR));
+  g_assert_false (g_file_test (devpath, G_FILE_TEST_EXISTS));
 
-  g_test_add ("/daemon/store/invalid_data",
-              TestStore,
-              NULL,
-              test_store_setup,
-              test_store_invalid_data,
-              test_store_tear_down);
+  ids = bolt_store_list_uids (store, "devices", &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (ids);
+  g_assert_cmpuint (g_strv_length (ids), ==, G_N_ELEMENTS (uids));
 
-  g_test_add ("/daemon/store/times",
-              TestStore,
-              NULL,
-              test_store_setup,
-              test_store_times,
-              test_store_tear_down);
+  for (guint i = 0; i < G_N_ELEMENTS (uids); i++)
+    g_assert_true (g_strv_contains ((const char * const *) ids, uids[i]));
 
-  g_test_add ("/daemon/store/domain",
-              TestStore,
-              NULL,
-              test_store_setup,
-              test_store_domain,
+  stored = bolt_store_get_device (store, uids[0], &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (stored);
+  g_assert_cmpstr (bolt_device_get_name (stored), ==, "Laptop");
+  g_assert_cmpstr (bolt_device_get_vendor (stored), ==, "GNOME.org");
+  g_assert_cmpuint (bolt_device_get_policy (stored), ==, BOLT_POLICY_AUTO);
+  g_assert_cmpuint (bolt_device_get_keystate (stored), ==, BOLT_KEY_MISSING);
+  g_clear_object (&stored);
+
+  /* update a device, with a key */
+  dev = bolt_store_get_device (store, uids[1], &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (dev);
+
+  key = bolt_key_new (NULL);
+  g_assert_nonnull (key);
+
+  g_object_set (dev, "label", "Work", NULL);
+  ok = bolt_store_put_device (store, dev, BOLT_POLICY_MANUAL, key, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  /* clearing the label removes it from the record */
+  g_object_set (dev, "label", NULL, NULL);
+  ok = bolt_store_put_device (store, dev, BOLT_POLICY_MANUAL, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  /* delete the other one */
+  stored = bolt_store_get_device (store, uids[0], &err);
+  g_assert_no_error (err);
+  ok = bolt_store_del (store, stored, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_clear_object (&stored);
+
+  /* re-open, the existing database file is picked up
+   * automatically, and the changes are persistent */
+  g_clear_object (&store);
+  store = bolt_store_new (tt->path);
+
+  stored = bolt_store_get_device (store, uids[0], &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_assert_null (stored);
+  g_clear_error (&err);
+
+  stored = bolt_store_get_device (store, uids[1], &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (stored);
+  g_assert_cmpuint (bolt_device_get_policy (stored), ==, BOLT_POLICY_MANUAL);
+  g_assert_cmpuint (bolt_device_get_keystate (stored), ==, BOLT_KEY_NEW);
+  g_assert_null (bolt_device_get_label (stored));
+  g_clear_object (&stored);
+
+  g_clear_pointer (&ids, g_strfreev);
+  ids = bolt_store_list_uids (store, "devices", &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (g_strv_length (ids), ==, 1);
+  g_assert_cmpstr (ids[0], ==, uids[1]);
+
+  /* switching back to directories is refused */
+  g_clear_object (&store);
+  g_setenv ("BOLT_STORE_BACKEND", "directory", TRUE);
+  g_log_set_writer_func (null_logger, NULL, NULL);
+  store = bolt_store_new (tt->path);
+  g_log_set_writer_func (g_log_writer_default, NULL, NULL);
+  g_unsetenv ("BOLT_STORE_BACKEND");
+
+  g_clear_pointer (&ids, g_strfreev);
+  ids = bolt_store_list_uids (store, "devices", &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (g_strv_length (ids), ==, 1);
+  g_assert_cmpstr (ids[0], ==, uids[1]);
+
+  /* a corrupted database is set aside and the previous
+   * generation is restored, only the deletion is lost */
+  g_clear_object (&store);
+  prev = g_build_filename (tt->path, "devices.db.prev", NULL);
+  g_assert_true (g_file_test (prev, G_FILE_TEST_IS_REGULAR));
+
+  ok = g_file_set_contents (dbpath, "BOLTDB", -1, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_log_set_writer_func (null_logger, NULL, NULL);
+  store = bolt_store_new (tt->path);
+  g_log_set_writer_func (g_log_writer_default, NULL, NULL);
+
+  corrupt = g_build_filename (tt->path, "devices.db.corrupt", NULL);
+  g_assert_true (g_file_test (corrupt, G_FILE_TEST_IS_REGULAR));
+  g_assert_true (g_file_test (dbpath, G_FILE_TEST_IS_REGULAR));
+  g_assert_false (g_file_test (prev, G_FILE_TEST_EXISTS));
+
+  g_clear_pointer (&ids, g_strfreev);
+  ids = bolt_store_list_uids (store, "devices", &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (g_strv_length (ids), ==, G_N_ELEMENTS (uids));
+
+  stored = bolt_store_get_device (store, uids[1], &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (stored);
+  g_assert_cmpuint (bolt_device_get_policy (stored), ==, BOLT_POLICY_MANUAL);
+  g_assert_cmpuint (bolt_device_get_keystate (stored), ==, BOLT_KEY_NEW);
+  g_clear_object (&stored);
+
+  /* without a previous generation, the devices are
+   * recovered from the layout kept around by the migration */
+  g_clear_object (&store);
+  ok = g_file_set_contents (dbpath, "BOLTDB", -1, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_log_set_writer_func (null_logger, NULL, NULL);
+  store = bolt_store_new (tt->path);
+  g_log_set_writer_func (g_log_writer_default, NULL, NULL);
+
+  g_assert_true (g_file_test (dbpath, G_FILE_TEST_IS_REGULAR));
+
+  g_clear_pointer (&ids, g_strfreev);
+  ids = bolt_store_list_uids (store, "devices", &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (g_strv_length (ids), ==, G_N_ELEMENTS (uids));
+
+  /* in the state of the migration */
+  stored = bolt_store_get_device (store, uids[1], &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (stored);
+  g_assert_cmpuint (bolt_device_get_policy (stored), ==, BOLT_POLICY_AUTO);
+  g_clear_object (&stored);
+}
+
+static void
+test_store_timetable (TestStore *tt, gconstpointer user_data)
+{
+  g_autoptr(BoltStore) store = NULL;
+  g_autoptr(GFile) root = NULL;
+  g_autoptr(GFile) legacy = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *path = NULL;
+  g_autofree char *times = NULL;
+  g_autofree char *dbpath = NULL;
+  const char *uid = "884c6edd-7118-4b21-b186-b02d396ecca0";
+  guint64 connin = 574416000;
+  guint64 authin = 574423871;
+  guint64 connout = 0;
+  guint64 authout = 0;
+  gboolean ok;
+
+  /* timestamps in the old, one file per timestamp, layout */
+  path = g_build_filename (tt->path, "legacy", NULL);
+  root = g_file_new_for_path (path);
+  legacy = g_file_resolve_relative_path (root, "times/884c6edd-7118-4b21-b186-b02d396ecca0.conntime");
+
+  ok = bolt_fs_make_parent_dirs (legacy, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = bolt_fs_touch (legacy, connin, connin, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  /* migrated when the store is created */
+  store = bolt_store_new (path);
+
+  times = g_build_filename (path, "times", NULL);
+  dbpath = g_build_filename (path, "times.db", NULL);
+  g_assert_false (g_file_test (times, G_FILE_TEST_EXISTS));
+  g_assert_true (g_file_test (dbpath, G_FILE_TEST_IS_REGULAR));
+
+  ok = bolt_store_get_times (store, uid, &err,
+                             "conntime", &connout,
+                             "authtime", &authout,
+                             NULL);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_assert_cmpuint (connout, ==, connin);
+  g_assert_cmpuint (authout, ==, 0);
+
+  ok = bolt_store_put_times (store, uid, &err,
+                             "authtime", authin,
+                             NULL);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  /* unknown timestamps are still stored as files */
+  ok = bolt_store_put_time (store, uid, "othertime", authin, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_assert_true (g_file_test (times, G_FILE_TEST_IS_DIR));
+
+  /* changes are written back when the store goes away */
+  g_clear_object (&store);
+  store = bolt_store_new (path);
+
+  connout = authout = 0;
+  ok = bolt_store_get_times (store, uid, &err,
+                             "conntime", &connout,
+                             "authtime", &authout,
+                             NULL);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_assert_cmpuint (connout, ==, connin);
+  g_assert_cmpuint (authout, ==, authin);
+
+  authout = 0;
+  ok = bolt_store_get_time (store, uid, "othertime", &authout, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_assert_cmpuint (authout, ==, authin);
+
+  /* removing all timestamps frees the record,
+   * which then gets used for the next uid */
+  ok = bolt_store_del_times (store, uid, &err,
+                             "conntime", "authtime",
+                             NULL);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = bolt_store_get_time (store, uid, "conntime", &connout, &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_assert_false (ok);
+  g_clear_error (&err);
+
+  ok = bolt_store_put_time (store, "fbc83890-e9bf-45e5-a777-b3728490989c",
+                            "conntime", connin, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_clear_object (&store);
+  store = bolt_store_new (path);
+
+  ok = bolt_store_get_time (store, uid, "conntime", &connout, &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_assert_false (ok);
+  g_clear_error (&err);
+
+  connout = 0;
+  ok = bolt_store_get_time (store, "fbc83890-e9bf-45e5-a777-b3728490989c",
+                            "conntime", &connout, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  g_assert_cmpuint (connout, ==, connin);
+}
+
+static void
+test_store_transaction (TestStore *tt, gconstpointer user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(BoltKey) loaded = NULL;
+  g_autofree char *keypath = NULL;
+  g_auto(GStrv) ids = NULL;
+  const char *uids[] = {
+    "884c6edd-7118-4b21-b186-b02d396ecca0",
+    "fbc83890-e9bf-45e5-a777-b3728490989c",
+  };
+  gboolean ok;
+
+  bolt_store_begin (tt->store);
+
+  for (guint i = 0; i < G_N_ELEMENTS (uids); i++)
+    {
+      g_autoptr(BoltDevice) dev = NULL;
+      g_autoptr(BoltDevice) stored = NULL;
+      g_autoptr(BoltKey) key = NULL;
+      g_autofree char *path = NULL;
+
+      dev = g_object_new (BOLT_TYPE_DEVICE,
+                          "uid", uids[i],
+                          "name", "Laptop",
+                          "vendor", "GNOME.org",
+                          "status", BOLT_STATUS_DISCONNECTED,
+                          NULL);
+
+      key = bolt_key_new (NULL);
+      g_assert_nonnull (key);
+
+      ok = bolt_store_put_device (tt->store, dev, BOLT_POLICY_AUTO, key, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+
+      /* not there yet, but visible via the store */
+      path = g_build_filename (tt->path, "devices", uids[i], NULL);
+      g_assert_false (g_file_test (path, G_FILE_TEST_EXISTS));
+
+      stored = bolt_store_get_device (tt->store, uids[i], &err);
+      g_assert_no_error (err);
+      g_assert_nonnull (stored);
+      g_assert_cmpuint (bolt_device_get_keystate (stored), ==, BOLT_KEY_HAVE);
+    }
+
+  /* staged files do not show up in listings */
+  ids = bolt_store_list_uids (tt->store, "devices", &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (g_strv_length (ids), ==, 0);
+  g_clear_pointer (&ids, g_strfreev);
+
+  ok = bolt_store_commit (tt->store, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ids = bolt_store_list_uids (tt->store, "devices", &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (g_strv_length (ids), ==, G_N_ELEMENTS (uids));
+  g_clear_pointer (&ids, g_strfreev);
+
+  for (guint i = 0; i < G_N_ELEMENTS (uids); i++)
+    {
+      g_autoptr(BoltKey) key = NULL;
+
+      key = bolt_store_get_key (tt->store, uids[i], &err);
+      g_assert_no_error (err);
+      g_assert_nonnull (key);
+    }
+
+  /* changes can be discarded */
+  bolt_store_begin (tt->store);
+
+  for (guint i = 0; i < G_N_ELEMENTS (uids); i++)
+    {
+      g_autoptr(BoltDevice) dev = NULL;
+
+      dev = bolt_store_get_device (tt->store, uids[i], &err);
+      g_assert_no_error (err);
+
+      g_object_set (dev, "label", "Changed", NULL);
+      ok = bolt_store_put_device (tt->store, dev, BOLT_POLICY_MANUAL, NULL, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+    }
+
+  bolt_store_rollback (tt->store);
+
+  for (guint i = 0; i < G_N_ELEMENTS (uids); i++)
+    {
+      g_autoptr(BoltDevice) dev = NULL;
+
+      dev = bolt_store_get_device (tt->store, uids[i], &err);
+      g_assert_no_error (err);
+      g_assert_nonnull (dev);
+
+      g_assert_null (bolt_device_get_label (dev));
+      g_assert_cmpuint (bolt_device_get_policy (dev), ==, BOLT_POLICY_AUTO);
+    }
+
+  /* deletions are staged as well */
+  keypath = g_build_filename (tt->path, "keys", uids[0], NULL);
+  bolt_store_begin (tt->store);
+
+  ok = bolt_store_del_key (tt->store, uids[0], &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_assert_true (g_file_test (keypath, G_FILE_TEST_EXISTS));
+
+  loaded = bolt_store_get_key (tt->store, uids[0], &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_assert_null (loaded);
+  g_clear_error (&err);
+
+  ok = bolt_store_del_key (tt->store, uids[0], &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+  g_assert_false (ok);
+  g_clear_error (&err);
+
+  bolt_store_rollback (tt->store);
+
+  loaded = bolt_store_get_key (tt->store, uids[0], &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (loaded);
+  g_clear_object (&loaded);
+
+  bolt_store_begin (tt->store);
+
+  ok = bolt_store_del_key (tt->store, uids[0], &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = bolt_store_commit (tt->store, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_assert_false (g_file_test (keypath, G_FILE_TEST_EXISTS));
+}
+
+typedef struct
+{
+  GMainLoop *loop;
+  GThread   *main;
+  GPtrArray *order;   /* completion order */
+  guint      added;
+  guint      removed;
+  guint      pending;
+} AsyncCtx;
+
+static void
+async_ctx_op_done (AsyncCtx *ctx, const char *uid)
+{
+  g_assert_true (g_thread_self () == ctx->main);
+  g_ptr_array_add (ctx->order, g_strdup (uid));
+
+  if (--ctx->pending == 0)
+    g_main_loop_quit (ctx->loop);
+}
+
+static void
+async_put_done (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  AsyncCtx *ctx = user_data;
+  gboolean ok;
+
+  ok = bolt_store_put_device_finish (BOLT_STORE (source), res, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  async_ctx_op_done (ctx, "put");
+}
+
+static void
+async_key_done (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(BoltKey) key = NULL;
+  AsyncCtx *ctx = user_data;
+
+  key = bolt_store_get_key_finish (BOLT_STORE (source), res, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (key);
+
+  async_ctx_op_done (ctx, "key");
+}
+
+static void
+async_del_done (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  AsyncCtx *ctx = user_data;
+  gboolean ok;
+
+  ok = bolt_store_del_finish (BOLT_STORE (source), res, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  async_ctx_op_done (ctx, "del");
+}
+
+static void
+async_on_added (BoltStore  *store,
+                const char *uid,
+                AsyncCtx   *ctx)
+{
+  g_assert_true (g_thread_self () == ctx->main);
+  ctx->added++;
+}
+
+static void
+async_on_removed (BoltStore  *store,
+                  const char *uid,
+                  AsyncCtx   *ctx)
+{
+  g_assert_true (g_thread_self () == ctx->main);
+  ctx->removed++;
+}
+
+static void
+test_store_async (TestStore *tt, gconstpointer user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GPtrArray) devices = NULL;
+  g_autoptr(GPtrArray) order = NULL;
+  g_auto(GStrv) ids = NULL;
+  const char *expected[] = {"put", "put", "put", "key", "del"};
+  AsyncCtx ctx = { NULL, };
+
+  devices = g_ptr_array_new_with_free_func (g_object_unref);
+  order = g_ptr_array_new_with_free_func (g_free);
+
+  ctx.loop = g_main_loop_new (NULL, FALSE);
+  ctx.main = g_thread_self ();
+  ctx.order = order;
+
+  g_signal_connect (tt->store, "device-added",
+                    G_CALLBACK (async_on_added), &ctx);
+  g_signal_connect (tt->store, "device-removed",
+                    G_CALLBACK (async_on_removed), &ctx);
+
+  for (guint i = 0; i < 3; i++)
+    {
+      g_autoptr(BoltKey) key = NULL;
+      g_autofree char *uid = NULL;
+      BoltDevice *dev;
+
+      uid = g_strdup_printf ("fbc83890-e9bf-45e5-a777-b3728490989%u", i);
+      dev = g_object_new (BOLT_TYPE_DEVICE,
+                          "uid", uid,
+                          "name", "Laptop",
+                          "vendor", "GNOME.org",
+                          "status", BOLT_STATUS_DISCONNECTED,
+                          NULL);
+
+      key = bolt_key_new (NULL);
+      g_assert_nonnull (key);
+
+      g_ptr_array_add (devices, dev);
+      bolt_store_put_device_async (tt->store, dev, BOLT_POLICY_AUTO, key,
+                                   NULL, async_put_done, &ctx);
+
+      /* the device object is only updated on completion */
+      g_assert_false (bolt_device_get_stored (dev));
+      ctx.pending++;
+    }
+
+  /* operations are executed in order: the key and the
+   * deletion must see the result of the put operations */
+  bolt_store_get_key_async (tt->store,
+                            bolt_device_get_uid (devices->pdata[0]),
+                            NULL, async_key_done, &ctx);
+  ctx.pending++;
+
+  bolt_store_del_async (tt->store, devices->pdata[1],
+                        NULL, async_del_done, &ctx);
+  ctx.pending++;
+
+  g_main_loop_run (ctx.loop);
+
+  g_assert_cmpuint (order->len, ==, G_N_ELEMENTS (expected));
+  for (guint i = 0; i < order->len; i++)
+    g_assert_cmpstr (order->pdata[i], ==, expected[i]);
+
+  g_assert_cmpuint (ctx.added, ==, 3);
+  g_assert_cmpuint (ctx.removed, ==, 1);
+
+  g_assert_true (bolt_device_get_stored (devices->pdata[0]));
+  g_assert_false (bolt_device_get_stored (devices->pdata[1]));
+  g_assert_true (bolt_device_get_stored (devices->pdata[2]));
+
+  ids = bolt_store_list_uids (tt->store, "devices", &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (g_strv_length (ids), ==, 2);
+
+  g_signal_handlers_disconnect_by_data (tt->store, &ctx);
+  g_main_loop_unref (ctx.loop);
+}
+
+/* a transaction that is held open by another thread, standing
+ * in for a disk that takes very long to sync the data */
+#define SLOW_TXN_LATENCY (5 * G_TIME_SPAN_SECOND)
+
+typedef struct
+{
+  BoltStore  *store;
+  BoltDevice *dev;
+
+  GMutex      lock;
+  GCond       cond;
+  gboolean    begun;
+  gboolean    done;
+  guint       writes;  /* completed async writes */
+} SlowTxn;
+
+static gpointer
+slow_txn_thread (gpointer data)
+{
+  g_autoptr(GError) err = NULL;
+  SlowTxn *st = data;
+  gint64 deadline;
+  gboolean ok;
+
+  bolt_store_begin (st->store);
+
+  ok = bolt_store_put_device (st->store, st->dev,
+                              BOLT_POLICY_MANUAL, NULL,
+                              &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_mutex_lock (&st->lock);
+  st->begun = TRUE;
+  g_cond_signal (&st->cond);
+
+  /* the injected latency: the lock of the store is held
+   * until the readers are done, or the deadline passed */
+  deadline = g_get_monotonic_time () + SLOW_TXN_LATENCY;
+  while (!st->done)
+    if (!g_cond_wait_until (&st->cond, &st->lock, deadline))
+      break;
+
+  g_mutex_unlock (&st->lock);
+
+  ok = bolt_store_commit (st->store, &err);
+  g_assert_no_error (err);
+
+  return GINT_TO_POINTER (ok);
+}
+
+static void
+slow_txn_put_done (GObject      *source,
+                   GAsyncResult *res,
+                   gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  SlowTxn *st = user_data;
+  gboolean ok;
+
+  ok = bolt_store_put_device_finish (BOLT_STORE (source), res, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  st->writes++;
+}
+
+static void
+slow_txn_key_done (GObject      *source,
+                   GAsyncResult *res,
+                   gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  SlowTxn *st = user_data;
+  gboolean ok;
+
+  ok = bolt_store_put_key_finish (BOLT_STORE (source), res, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  st->writes++;
+}
+
+static void
+slow_txn_domain_done (GObject      *source,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  SlowTxn *st = user_data;
+  gboolean ok;
+
+  ok = bolt_store_put_domain_finish (BOLT_STORE (source), res, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  st->writes++;
+}
+
+static void
+test_store_latency (TestStore *tt, gconstpointer user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(BoltDevice) dev = NULL;
+  g_autoptr(BoltDevice) other = NULL;
+  g_autoptr(BoltDevice) stored = NULL;
+  g_autoptr(BoltDomain) domain = NULL;
+  g_autoptr(BoltKey) key = NULL;
+  g_autoptr(BoltKey) okey = NULL;
+  g_auto(GStrv) ids = NULL;
+  const char *uid = "884c6edd-7118-4b21-b186-b02d396ecca0";
+  const char *ouid = "884c6edd-7118-4b21-b186-b02d396ecca1";
+  SlowTxn st = { NULL, };
+  GThread *thread;
+  gint64 start;
+  gint64 elapsed;
+  gboolean ok;
+
+  dev = g_object_new (BOLT_TYPE_DEVICE,
+                      "uid", uid,
+                      "name", "Laptop",
+                      "vendor", "GNOME.org",
+                      "status", BOLT_STATUS_DISCONNECTED,
+                      NULL);
+
+  key = bolt_key_new (NULL);
+  ok = bolt_store_put_device (tt->store, dev, BOLT_POLICY_AUTO, key, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = bolt_store_load_index (tt->store, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  st.store = tt->store;
+  st.dev = dev;
+  g_mutex_init (&st.lock);
+  g_cond_init (&st.cond);
+
+  thread = g_thread_new ("slow-txn", slow_txn_thread, &st);
+
+  g_mutex_lock (&st.lock);
+  while (!st.begun)
+    g_cond_wait (&st.cond, &st.lock);
+  g_mutex_unlock (&st.lock);
+
+  start = g_get_monotonic_time ();
+
+  /* reads do not wait for the transaction and see
+   * the committed data, not the staged one */
+  stored = bolt_store_get_device (tt->store, uid, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (stored);
+  g_assert_cmpuint (bolt_device_get_policy (stored), ==, BOLT_POLICY_AUTO);
+  g_assert_cmpuint (bolt_store_have_key (tt->store, uid), ==, BOLT_KEY_HAVE);
+  g_clear_object (&stored);
+
+  ids = bolt_store_list_uids (tt->store, "devices", &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (g_strv_length (ids), ==, 1);
+
+  g_assert_cmpuint (bolt_store_count_devices (tt->store), ==, 1);
+  g_assert_cmpuint (bolt_store_count_name (tt->store, "GNOME.org", "Laptop"), ==, 1);
+
+  /* writes are queued, and the main thread stays responsive:
+   * devices (e.g. a new label), keys (authorization with a new
+   * key) and domains (boot ACL changes, newly connected ones) */
+  other = g_object_new (BOLT_TYPE_DEVICE,
+                        "uid", ouid,
+                        "name", "Laptop",
+                        "vendor", "GNOME.org",
+                        "status", BOLT_STATUS_DISCONNECTED,
+                        NULL);
+
+  bolt_store_put_device_async (tt->store, other, BOLT_POLICY_AUTO, NULL,
+                               NULL, slow_txn_put_done, &st);
+
+  okey = bolt_key_new (NULL);
+  bolt_store_put_key_async (tt->store, ouid, okey,
+                            NULL, slow_txn_key_done, &st);
+
+  domain = g_object_new (BOLT_TYPE_DOMAIN,
+                         "uid", "884c6edd-7118-4b21-b186-b02d396ecca2",
+                         "bootacl", NULL,
+                         NULL);
+
+  bolt_store_put_domain_async (tt->store, domain,
+                               NULL, slow_txn_domain_done, &st);
+
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  g_assert_cmpuint (st.writes, ==, 0);
+  g_assert_false (bolt_domain_is_stored (domain));
+
+  elapsed = g_get_monotonic_time () - start;
+  g_assert_cmpint (elapsed, <, SLOW_TXN_LATENCY / 2);
+
+  g_mutex_lock (&st.lock);
+  st.done = TRUE;
+  g_cond_signal (&st.cond);
+  g_mutex_unlock (&st.lock);
+
+  ok = GPOINTER_TO_INT (g_thread_join (thread));
+  g_assert_true (ok);
+
+  while (st.writes < 3)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (bolt_store_have_key (tt->store, ouid), ==, BOLT_KEY_HAVE);
+  g_assert_true (bolt_domain_is_stored (domain));
+
+  /* now the changes are visible */
+  stored = bolt_store_get_device (tt->store, uid, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (stored);
+  g_assert_cmpuint (bolt_device_get_policy (stored), ==, BOLT_POLICY_MANUAL);
+
+  g_assert_cmpuint (bolt_store_count_devices (tt->store), ==, 2);
+  g_assert_cmpuint (bolt_store_count_name (tt->store, "GNOME.org", "Laptop"), ==, 2);
+
+  g_cond_clear (&st.cond);
+  g_mutex_clear (&st.lock);
+}
+
+static void
+test_store_load (TestStore *tt, gconstpointer user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GPtrArray) devs = NULL;
+  g_autoptr(BoltStore) store = NULL;
+  g_auto(GStrv) ids = NULL;
+  gboolean ok;
+  gdouble secs;
+  GTimer *timer;
+  guint n = 100;
+
+  if (g_test_perf ())
+    n = 1000;
+
+  bolt_store_begin (tt->store);
+
+  for (guint i = 0; i < n; i++)
+    {
+      g_autoptr(BoltDevice) dev = NULL;
+      g_autoptr(BoltKey) key = NULL;
+      g_autofree char *uid = NULL;
+
+      uid = g_strdup_printf ("884c6edd-7118-4b21-b186-%012u", i);
+      dev = g_object_new (BOLT_TYPE_DEVICE,
+                          "uid", uid,
+                          "name", "Laptop",
+                          "vendor", "GNOME.org",
+                          "status", BOLT_STATUS_DISCONNECTED,
+                          NULL);
+
+      if (i % 2 == 0)
+        key = bolt_key_new (NULL);
+
+      ok = bolt_store_put_device (tt->store, dev, BOLT_POLICY_AUTO, key, &err);
+      g_assert_no_error (err);
+      g_assert_true (ok);
+    }
+
+  ok = bolt_store_commit (tt->store, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  /* load everything from a fresh store, like the daemon does */
+  store = bolt_store_new (tt->path);
+  g_assert_nonnull (store);
+
+  ids = bolt_store_list_uids (store, "devices", &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (g_strv_length (ids), ==, n);
+
+  timer = g_timer_new ();
+  devs = bolt_store_get_devices (store, (const char **) ids);
+  secs = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  g_assert_cmpuint (devs->len, ==, n);
+
+  for (guint i = 0; i < n; i++)
+    {
+      BoltDevice *dev = g_ptr_array_index (devs, i);
+      const char *uid = bolt_device_get_uid (dev);
+      BoltKeyState keystate;
+      guint k;
+
+      /* the order of the uids is preserved */
+      g_assert_cmpstr (uid, ==, ids[i]);
+      g_assert_cmpstr (bolt_device_get_name (dev), ==, "Laptop");
+      g_assert_true (bolt_device_get_stored (dev));
+
+      k = (guint) g_ascii_strtoull (uid + strlen ("884c6edd-7118-4b21-b186-"),
+                                    NULL, 10);
+      keystate = bolt_device_get_keystate (dev);
+      g_assert_cmpuint (keystate, ==, k % 2 == 0 ? BOLT_KEY_HAVE : BOLT_KEY_MISSING);
+    }
+
+  g_test_minimized_result (secs * 1000.0 / n,
+                           "loading %u devices took %.3f s, %.3f s per 1k",
+                           n, secs, secs * 1000.0 / n);
+}
+
+static void
+test_store_index (TestStore *tt, gconstpointer user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(BoltStoreEntry) entry = NULL;
+  g_autoptr(GPtrArray) entries = NULL;
+  g_autoptr(BoltDevice) dev = NULL;
+  g_autoptr(BoltKey) key = NULL;
+  const char *uid = "884c6edd-7118-4b21-b186-b02d396ecca0";
+  gboolean ok;
+
+  ok = bolt_store_load_index (tt->store, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_assert_cmpuint (bolt_store_count_devices (tt->store), ==, 0);
+  g_assert_null (bolt_store_lookup_entry (tt->store, uid));
+
+  dev = g_object_new (BOLT_TYPE_DEVICE,
+                      "uid", uid,
+                      "name", "Laptop",
+                      "vendor", "GNOME.org",
+                      "status", BOLT_STATUS_DISCONNECTED,
+                      "conntime", (guint64) 23,
+                      NULL);
+
+  ok = bolt_store_put_device (tt->store, dev, BOLT_POLICY_AUTO, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  /* the index is kept up to date */
+  g_assert_cmpuint (bolt_store_count_devices (tt->store), ==, 1);
+  g_assert_cmpuint (bolt_store_count_name (tt->store, "GNOME.org", "Laptop"), ==, 1);
+  g_assert_cmpuint (bolt_store_count_name (tt->store, "GNOME.org", "Desktop"), ==, 0);
+
+  entry = bolt_store_lookup_entry (tt->store, uid);
+  g_assert_nonnull (entry);
+  g_assert_cmpstr (entry->uid, ==, uid);
+  g_assert_cmpstr (entry->name, ==, "Laptop");
+  g_assert_cmpstr (entry->vendor, ==, "GNOME.org");
+  g_assert_cmpuint (entry->policy, ==, BOLT_POLICY_AUTO);
+  g_assert_cmpuint (entry->key, ==, BOLT_KEY_MISSING);
+  g_assert_cmpuint (entry->conntime, ==, 23);
+  g_assert_cmpuint (entry->authtime, ==, 0);
+  g_clear_pointer (&entry, bolt_store_entry_free);
+
+  key = bolt_key_new (NULL);
+  ok = bolt_store_put_key (tt->store, uid, key, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  ok = bolt_store_put_time (tt->store, uid, "authtime", 42, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  entry = bolt_store_lookup_entry (tt->store, uid);
+  g_assert_nonnull (entry);
+  g_assert_cmpuint (entry->key, ==, BOLT_KEY_NEW);
+  g_assert_cmpuint (entry->authtime, ==, 42);
+  g_clear_pointer (&entry, bolt_store_entry_free);
+
+  /* a fresh index has the same information */
+  g_clear_object (&tt->store);
+  tt->store = bolt_store_new (tt->path);
+  g_assert_nonnull (tt->store);
+
+  ok = bolt_store_load_index (tt->store, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  entries = bolt_store_list_entries (tt->store);
+  g_assert_cmpuint (entries->len, ==, 1);
+  g_assert_cmpuint (bolt_store_count_name (tt->store, "GNOME.org", "Laptop"), ==, 1);
+
+  entry = bolt_store_lookup_entry (tt->store, uid);
+  g_assert_nonnull (entry);
+  g_assert_cmpstr (entry->name, ==, "Laptop");
+  g_assert_cmpuint (entry->policy, ==, BOLT_POLICY_AUTO);
+  g_assert_cmpuint (entry->key, !=, BOLT_KEY_MISSING);
+  g_assert_cmpuint (entry->conntime, ==, 23);
+  g_assert_cmpuint (entry->authtime, ==, 42);
+  g_clear_pointer (&entry, bolt_store_entry_free);
+
+  /* rolled back changes do not show up */
+  bolt_store_begin (tt->store);
+  ok = bolt_store_del_key (tt->store, uid, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+  bolt_store_rollback (tt->store);
+
+  entry = bolt_store_lookup_entry (tt->store, uid);
+  g_assert_nonnull (entry);
+  g_assert_cmpuint (entry->key, !=, BOLT_KEY_MISSING);
+  g_clear_pointer (&entry, bolt_store_entry_free);
+
+  /* storing a device again does not count it twice */
+  ok = bolt_store_put_device (tt->store, dev, BOLT_POLICY_AUTO, NULL, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_assert_cmpuint (bolt_store_count_name (tt->store, "GNOME.org", "Laptop"), ==, 1);
+
+  /* and deleted devices are gone */
+  g_clear_object (&dev);
+  dev = bolt_store_get_device (tt->store, uid, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (dev);
+
+  ok = bolt_store_del (tt->store, dev, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  g_assert_null (bolt_store_lookup_entry (tt->store, uid));
+  g_assert_cmpuint (bolt_store_count_devices (tt->store), ==, 0);
+  g_assert_cmpuint (bolt_store_count_name (tt->store, "GNOME.org", "Laptop"), ==, 0);
+}
+
+int
+main (int argc, char **argv)
+{
+
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  bolt_dbus_ensure_resources ();
+
+  g_test_add ("/daemon/key",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_key,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/basic",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_basic,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/config",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_config,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/invalid_data",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_invalid_data,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/times",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_times,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/timetable",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_timetable,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/transaction",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_transaction,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/async",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_async,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/latency",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_latency,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/load",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_load,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/index",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_index,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/domain",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_domain,
+              test_store_tear_down);
+
+  g_test_add ("/daemon/store/database",
+              TestStore,
+              NULL,
+              test_store_setup,
+              test_store_database,
               test_store_tear_down);
 
   return g_test_run ();
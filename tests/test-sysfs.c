@@ -963,14 +963,32 @@ test_bootacl_update_online (TestBootacl *tt, gconstpointer user)
   g_assert_false (changeset.fired);
 }
 
+static void
+bootacl_stored_done (GObject      *store,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  gboolean *done = user_data;
+  gboolean ok;
+
+  ok = bolt_store_put_domain_finish (BOLT_STORE (store), res, &err);
+  g_assert_no_error (err);
+  g_assert_true (ok);
+
+  *done = TRUE;
+}
+
 static void
 test_bootacl_update_offline (TestBootacl *tt, gconstpointer user)
 {
   g_autoptr(GError) err = NULL;
   g_autoptr(BoltStore) store = NULL;
+  g_autoptr(BoltDomain) stored = NULL;
   g_auto(GStrv) sysacl = NULL;
   g_auto(BoltTmpDir) dir = NULL;
   BoltDomain *dom = tt->dom;
+  gboolean done = FALSE;
   gboolean ok;
   GStrv have;
   GStrv acl = tt->acl;
@@ -1057,6 +1075,22 @@ test_bootacl_update_offline (TestBootacl *tt, gconstpointer user)
   g_debug ("4. no change reconnect");
   bolt_domain_disconnected (dom);
   test_bootacl_read_acl (tt, &sysacl);
+
+  /* 5. updates are written on the I/O thread, in order; once
+   *    another write is done, all of them have been written */
+  g_debug ("5. stored bootacl");
+  bolt_store_put_domain_async (store, dom, NULL, bootacl_stored_done, &done);
+
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+
+  stored = bolt_store_get_domain (store, bolt_domain_get_uid (dom), &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (stored);
+
+  bolt_assert_strv_equal (bolt_domain_get_bootacl (stored),
+                          bolt_domain_get_bootacl (dom),
+                          -1);
 }
 
 static gboolean
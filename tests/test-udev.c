@@ -207,6 +207,93 @@ test_udev_basic (TestUdev *tt, gconstpointer user)
   uevent_clear (&ev);
 }
 
+static void
+got_uevent_record (BoltUdev           *udev,
+                   const char         *action,
+                   struct udev_device *device,
+                   gpointer            user_data)
+{
+  GPtrArray *events = user_data;
+  const char *name = udev_device_get_sysname (device);
+
+  g_ptr_array_add (events, g_strdup_printf ("%s %s", action, name));
+}
+
+static void
+test_udev_queue (TestUdev *tt, gconstpointer user)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(BoltUdev) udev = NULL;
+  g_autoptr(GPtrArray) events = NULL;
+  g_autofree char *ev_domain = NULL;
+  g_autofree char *ev_host = NULL;
+  UEvent ev = { NULL, };
+  BoltUdevStats stats;
+  const char *filter[] = {"thunderbolt", NULL};
+  const char *domain;
+  const char *host;
+  const char *dock;
+  guint window;
+  MockDevId hostid = {
+    .vendor_id = 0x42,
+    .vendor_name = "GNOME.org",
+    .device_id = 0x42,
+    .device_name = "Laptop",
+    .unique_id = "884c6edd-7118-4b21-b186-b02d396ecca0",
+  };
+  MockDevId dockid = {
+    .vendor_id = 0x42,
+    .vendor_name = "GNOME.org",
+    .device_id = 0x42,
+    .device_name = "Thunderbolt Dock",
+    .unique_id = "884c6edd-7118-4b21-b186-b02d396ecca1",
+  };
+
+  udev = bolt_udev_new ("udev", filter, &err);
+
+  g_assert_nonnull (udev);
+  g_assert_no_error (err);
+
+  bolt_udev_set_window (udev, 500);
+  g_object_get (udev, "window", &window, NULL);
+  g_assert_cmpuint (window, ==, 500);
+
+  events = g_ptr_array_new_with_free_func (g_free);
+  g_signal_connect (udev, "uevent", (GCallback) got_uevent_record, events);
+  g_signal_connect (udev, "uevent", (GCallback) got_uevent, &ev);
+
+  /* a dock that vanishes again within the window */
+  domain = mock_sysfs_domain_add (tt->sysfs, BOLT_SECURITY_NONE, NULL);
+  g_assert_nonnull (domain);
+
+  host = mock_sysfs_host_add (tt->sysfs, domain, &hostid);
+  g_assert_nonnull (host);
+
+  dock = mock_sysfs_device_add (tt->sysfs, host, &dockid, 0, NULL, 0);
+  g_assert_nonnull (dock);
+
+  mock_sysfs_device_remove (tt->sysfs, dock);
+
+  /* the whole batch is dispatched at once */
+  wait_for_event (&ev, 2);
+  g_assert_false (ev.timedout);
+
+  ev_domain = g_strdup_printf ("add %s", domain);
+  ev_host = g_strdup_printf ("add %s", host);
+
+  g_assert_cmpuint (events->len, ==, 2);
+  g_assert_cmpstr (g_ptr_array_index (events, 0), ==, ev_domain);
+  g_assert_cmpstr (g_ptr_array_index (events, 1), ==, ev_host);
+
+  bolt_udev_get_stats (udev, &stats);
+  g_assert_cmpuint (stats.received, ==, stats.merged + stats.dropped + 2);
+  g_assert_cmpuint (stats.dropped, >=, 2);
+  g_assert_cmpuint (stats.dispatched, ==, 2);
+
+  /* cleanup */
+  uevent_clear (&ev);
+}
+
 static void
 test_udev_detect_force_power (TestUdev *tt, gconstpointer user)
 {
@@ -280,6 +367,13 @@ main (int argc, char **argv)
               test_udev_basic,
               test_udev_tear_down);
 
+  g_test_add ("/udev/queue",
+              TestUdev,
+              NULL,
+              test_udev_setup,
+              test_udev_queue,
+              test_udev_tear_down);
+
   g_test_add ("/udev/detect_force_power",
               TestUdev,
               NULL,